@@ -0,0 +1,1706 @@
+// Run with --benchmark_out=results.json --benchmark_out_format=json to save the results for
+// comparison between builds. Every benchmark reports heap allocations per iteration as "allocs".
+// Throughput is reported as FLOPS, floating point operations per second, and bytes_per_second
+// for the data each iteration reads and writes.
+
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <vector>
+#include "../MathsLib_Start1/Vector.h"
+#include "../MathsLib_Start1/Matrix.h"
+#include "../MathsLib_Start1/MatrixBatch.h"
+#include "../MathsLib_Start1/Decomposition.h"
+#include "../MathsLib_Start1/SparseMatrix.h"
+#include "../MathsLib_Start1/DataFile.h"
+#include "../MathsLib_Start1/MatrixStream.h"
+#include "../MathsLib_Start1/TextIO.h"
+#include "../MathsLib_Start1/ReducedPrecision.h"
+#include "../MathsLib_Start1/NearestNeighbours.h"
+#include "../MathsLib_Start1/MemoryResource.h"
+#include "../MathsLib_Start1/Stats.h"
+#include "../MathsLib_Start1/Ray.h"
+#include "../MathsLib_Start1/RayBatch.h"
+#include "../MathsLib_Start1/Bvh.h"
+#include "../MathsLib_Start1/Simd.h"
+#include "../MathsLib_Start1/ThreadPool.h"
+
+// --------- Allocation counting. ---------
+
+// Replacing the global allocation functions counts every heap allocation made by the library,
+// including from pool threads. The array and nothrow forms forward to these by default. The
+// aligned forms are what std::pmr::new_delete_resource() allocates through.
+static std::atomic<size_t> allocations{ 0 };
+
+void* operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (void* memory = std::malloc(size > 0 ? size : 1)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	const size_t align = static_cast<size_t>(alignment);
+#ifdef _MSC_VER
+	void* memory = _aligned_malloc(size > 0 ? size : 1, align);
+#else
+	void* memory = std::aligned_alloc(align, (size + align - 1) / align * align + (size == 0 ? align : 0));
+#endif
+	if (memory) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+#ifdef _MSC_VER
+	_aligned_free(memory);
+#else
+	std::free(memory);
+#endif
+}
+
+void operator delete(void* memory, size_t, std::align_val_t alignment) noexcept {
+	operator delete(memory, alignment);
+}
+
+static size_t allocation_count() {
+	return allocations.load(std::memory_order_relaxed);
+}
+
+// Read before touching state.counters, which allocates itself.
+static void set_allocation_counter(benchmark::State& state, size_t allocations_before) {
+	const double count = static_cast<double>(allocation_count() - allocations_before);
+	state.counters["allocs"] = benchmark::Counter(count, benchmark::Counter::kAvgIterations);
+}
+
+// --------- Helpers shared by the benchmarks. ---------
+
+// Deterministic, non-trivial contents so nothing can be constant folded.
+static Matrix make_matrix(size_t rows, size_t cols) {
+	Matrix M(cols, rows);
+
+	for (size_t r = 0; r < rows; r++) {
+		for (size_t c = 0; c < cols; c++) {
+			M[r][c] = static_cast<double>((r * 31 + c * 17) % 97) / 97.0;
+		}
+	}
+
+	return M;
+}
+
+// The original Matrix * Matrix: transpose M1, build a Vector per output element, transpose back.
+static Matrix reference_multiply(const Matrix& M0, const Matrix& M1) {
+	Matrix M(M0.get_row_count(), M1.get_col_count());
+
+	size_t x = 0;
+	size_t y = 0;
+	for (const auto& V1 : M1.transpose()) {
+		for (const auto& V0 : M0) {
+			M[y][x] = Vector(std::vector<double>(V1.begin(), V1.end())).dot_product(std::vector<double>(V0.begin(), V0.end()));
+			x++;
+		}
+		x = 0;
+		y++;
+	}
+
+	return M.transpose();
+}
+
+static Vector make_vector(size_t n, size_t seed = 0) {
+	Vector V(n);
+
+	for (size_t i = 0; i < n; i++) {
+		V[i] = static_cast<double>((i * 31 + seed * 17) % 97) / 97.0 + 1.0;
+	}
+
+	return V;
+}
+
+static void set_flop_counter(benchmark::State& state, double flops) {
+	state.counters["FLOPS"] = benchmark::Counter(flops, benchmark::Counter::kIsIterationInvariantRate, benchmark::Counter::kIs1000);
+}
+
+static void set_flop_counter(benchmark::State& state, size_t m, size_t n, size_t k) {
+	set_flop_counter(state, 2.0 * m * n * k);
+}
+
+static void set_byte_counter(benchmark::State& state, size_t doubles) {
+	state.SetBytesProcessed(state.iterations() * doubles * sizeof(double));
+}
+
+// --------- Matrix multiplication: blocked GEMM against the original implementation. ---------
+
+// Arguments are m, n, k for an (m x k) * (k x n) product.
+static void gemm_shapes(benchmark::internal::Benchmark* b) {
+	for (const int64_t size : { 64, 128, 256, 512, 1024 }) {
+		b->Args({ size, size, size });
+	}
+
+	// Skinny shapes: tall by narrow, wide inner dimension, and matrix times a few columns.
+	b->Args({ 4096, 16, 16 });
+	b->Args({ 16, 16, 4096 });
+	b->Args({ 1024, 4, 1024 });
+	b->Args({ 4096, 64, 64 });
+}
+
+static void BM_matrix_multiply(benchmark::State& state) {
+	const size_t m = state.range(0), n = state.range(1), k = state.range(2);
+	const Matrix A = make_matrix(m, k);
+	const Matrix B = make_matrix(k, n);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Matrix C = A * B;
+		benchmark::DoNotOptimize(C);
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, m, n, k);
+}
+BENCHMARK(BM_matrix_multiply)->Apply(gemm_shapes);
+
+static void BM_matrix_multiply_reference(benchmark::State& state) {
+	const size_t m = state.range(0), n = state.range(1), k = state.range(2);
+	const Matrix A = make_matrix(m, k);
+	const Matrix B = make_matrix(k, n);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Matrix C = reference_multiply(A, B);
+		benchmark::DoNotOptimize(C);
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, m, n, k);
+}
+BENCHMARK(BM_matrix_multiply_reference)->Apply(gemm_shapes);
+
+// Accumulating form, C = alpha * A * B + beta * C, which reuses the destination storage.
+static void BM_gemm_accumulate(benchmark::State& state) {
+	const size_t m = state.range(0), n = state.range(1), k = state.range(2);
+	const Matrix A = make_matrix(m, k);
+	const Matrix B = make_matrix(k, n);
+	Matrix C = make_matrix(m, n);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		gemm(1.0, A, B, 0.5, C);
+		benchmark::ClobberMemory();
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, m, n, k);
+}
+BENCHMARK(BM_gemm_accumulate)->Apply(gemm_shapes);
+
+// A^T B through a transposed view, against materialising the transpose first.
+static void BM_transposed_view_multiply(benchmark::State& state) {
+	const size_t m = state.range(0), n = state.range(1), k = state.range(2);
+	const Matrix A = make_matrix(k, m);
+	const Matrix B = make_matrix(k, n);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Matrix C = A.T() * B;
+		benchmark::DoNotOptimize(C);
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, m, n, k);
+}
+BENCHMARK(BM_transposed_view_multiply)->Apply(gemm_shapes);
+
+static void BM_transposed_copy_multiply(benchmark::State& state) {
+	const size_t m = state.range(0), n = state.range(1), k = state.range(2);
+	const Matrix A = make_matrix(k, m);
+	const Matrix B = make_matrix(k, n);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Matrix C = A.transpose() * B;
+		benchmark::DoNotOptimize(C);
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, m, n, k);
+}
+BENCHMARK(BM_transposed_copy_multiply)->Apply(gemm_shapes);
+
+// Blocked update of the lower right quarter of a matrix from two of its other quarters.
+static void BM_block_gemm(benchmark::State& state) {
+	const size_t half = state.range(0);
+	Matrix M = make_matrix(2 * half, 2 * half);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		gemm(-1.0, M.block(half, 0, half, half), M.block(0, half, half, half), 1.0, M.block(half, half, half, half));
+		benchmark::ClobberMemory();
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, half, half, half);
+}
+BENCHMARK(BM_block_gemm)->RangeMultiplier(4)->Range(64, 1024);
+
+// --------- Vector kernels for each instruction set, level given by the second argument. ---------
+
+static void BM_simd_dot(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const SimdKernels& kernels = simd_kernels(static_cast<SimdLevel>(state.range(1)));
+	std::vector<double> a(n, 1.5), b(n, 0.5);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(kernels.dot(a.data(), b.data(), n));
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetLabel(kernels.name);
+	set_flop_counter(state, 2.0 * n);
+}
+BENCHMARK(BM_simd_dot)->ArgsProduct({ { 64, 256, 1024, 4096 }, { 0, 1, 2, 3 } });
+
+static void BM_simd_add(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const SimdKernels& kernels = simd_kernels(static_cast<SimdLevel>(state.range(1)));
+	std::vector<double> a(n, 1.5), b(n, 0.5), out(n);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		kernels.add(a.data(), b.data(), out.data(), n);
+		benchmark::ClobberMemory();
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetLabel(kernels.name);
+	set_byte_counter(state, 3 * n);
+}
+BENCHMARK(BM_simd_add)->ArgsProduct({ { 64, 256, 1024, 4096 }, { 0, 1, 2, 3 } });
+
+// --------- Lazy expressions, one fused pass regardless of the number of operators. ---------
+
+static void BM_vector_expression(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const Vector a(std::vector<double>(n, 1.0)), b(std::vector<double>(n, 2.0)), c(std::vector<double>(n, 3.0));
+	Vector result(n);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		result = a + b * 2.0 - c;
+		benchmark::ClobberMemory();
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_byte_counter(state, 4 * n);
+}
+BENCHMARK(BM_vector_expression)->RangeMultiplier(8)->Range(64, 1 << 18);
+
+// --------- Vector operations, swept over the vector length. ---------
+
+// Short vectors such as 3D points fit in the inline storage, the rest allocate.
+static void vector_sizes(benchmark::internal::Benchmark* b) {
+	b->Arg(3)->Arg(8);
+	b->RangeMultiplier(8)->Range(64, 1 << 20);
+}
+
+static void BM_vector_dot_product(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const Vector a = make_vector(n, 1), b = make_vector(n, 2);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(a.dot_product(b));
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 2.0 * n);
+	set_byte_counter(state, 2 * n);
+}
+BENCHMARK(BM_vector_dot_product)->Apply(vector_sizes);
+
+static void BM_vector_euclidean_length(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const Vector a = make_vector(n, 1);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(a.euclidean_length());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 2.0 * n);
+	set_byte_counter(state, n);
+}
+BENCHMARK(BM_vector_euclidean_length)->Apply(vector_sizes);
+
+static void BM_vector_normalise(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const Vector a = make_vector(n, 1);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Vector result = a.normalise();
+		benchmark::DoNotOptimize(result.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 3.0 * n);
+	set_byte_counter(state, 3 * n);
+}
+BENCHMARK(BM_vector_normalise)->Apply(vector_sizes);
+
+static void BM_vector_distance(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const Vector a = make_vector(n, 1), b = make_vector(n, 2);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(a.distance(b));
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 3.0 * n);
+	set_byte_counter(state, 2 * n);
+}
+BENCHMARK(BM_vector_distance)->Apply(vector_sizes);
+
+// Only defined for three dimensional vectors, so there is nothing to sweep.
+static void BM_vector_cross_product(benchmark::State& state) {
+	const Vector a = make_vector(3, 1), b = make_vector(3, 2);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Vector result = a.cross_product(b);
+		benchmark::DoNotOptimize(result.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 9.0);
+}
+BENCHMARK(BM_vector_cross_product);
+
+// Operators producing a new Vector. doubles is how many vector lengths each call reads and writes.
+template <typename Op>
+static void BM_vector_operator(benchmark::State& state, Op op, size_t doubles) {
+	const size_t n = state.range(0);
+	const Vector a = make_vector(n, 1), b = make_vector(n, 2);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Vector result = op(a, b);
+		benchmark::DoNotOptimize(result.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, static_cast<double>(n));
+	set_byte_counter(state, doubles * n);
+}
+BENCHMARK_CAPTURE(BM_vector_operator, add, [](const Vector& a, const Vector& b) { return Vector(a + b); }, 3)->Apply(vector_sizes);
+BENCHMARK_CAPTURE(BM_vector_operator, subtract, [](const Vector& a, const Vector& b) { return Vector(a - b); }, 3)->Apply(vector_sizes);
+BENCHMARK_CAPTURE(BM_vector_operator, multiply, [](const Vector& a, const Vector&) { return Vector(a * 1.5); }, 2)->Apply(vector_sizes);
+BENCHMARK_CAPTURE(BM_vector_operator, divide, [](const Vector& a, const Vector&) { return Vector(a / 1.5); }, 2)->Apply(vector_sizes);
+BENCHMARK_CAPTURE(BM_vector_operator, negate, [](const Vector& a, const Vector&) { return Vector(-a); }, 2)->Apply(vector_sizes);
+
+// Compound assignment, updating a in place.
+template <typename Op>
+static void BM_vector_compound_operator(benchmark::State& state, Op op, size_t doubles) {
+	const size_t n = state.range(0);
+	Vector a = make_vector(n, 1);
+	const Vector b = make_vector(n, 2);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		op(a, b);
+		benchmark::ClobberMemory();
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, static_cast<double>(n));
+	set_byte_counter(state, doubles * n);
+}
+BENCHMARK_CAPTURE(BM_vector_compound_operator, add, [](Vector& a, const Vector& b) { a += b; }, 3)->Apply(vector_sizes);
+BENCHMARK_CAPTURE(BM_vector_compound_operator, subtract, [](Vector& a, const Vector& b) { a -= b; }, 3)->Apply(vector_sizes);
+BENCHMARK_CAPTURE(BM_vector_compound_operator, multiply, [](Vector& a, const Vector&) { a *= 1.0000001; }, 2)->Apply(vector_sizes);
+BENCHMARK_CAPTURE(BM_vector_compound_operator, divide, [](Vector& a, const Vector&) { a /= 1.0000001; }, 2)->Apply(vector_sizes);
+
+// Equal vectors, so every element is compared.
+static void BM_vector_equality(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const Vector a = make_vector(n, 1), b = make_vector(n, 1);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(a == b);
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_byte_counter(state, 2 * n);
+}
+BENCHMARK(BM_vector_equality)->Apply(vector_sizes);
+
+// --------- Factorizations: factor once, then solve many right hand sides. ---------
+
+// Diagonally dominant, so it is also symmetric positive definite once symmetrised.
+static Matrix make_spd_matrix(size_t size) {
+	Matrix M = make_matrix(size, size);
+	Matrix S = M + M.transpose();
+	for (size_t i = 0; i < size; i++) {
+		S(i, i) += static_cast<double>(2 * size);
+	}
+	return S;
+}
+
+static void BM_lu_factor(benchmark::State& state) {
+	const size_t size = state.range(0);
+	const Matrix A = make_spd_matrix(size);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		LUDecomposition lu(A);
+		benchmark::DoNotOptimize(lu.determinant());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 2.0 / 3.0 * size * size * size);
+}
+BENCHMARK(BM_lu_factor)->RangeMultiplier(4)->Range(64, 2048)->UseRealTime();
+
+static void BM_cholesky_factor(benchmark::State& state) {
+	const size_t size = state.range(0);
+	const Matrix A = make_spd_matrix(size);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		CholeskyDecomposition cholesky(A);
+		benchmark::DoNotOptimize(cholesky.determinant());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 1.0 / 3.0 * size * size * size);
+}
+BENCHMARK(BM_cholesky_factor)->RangeMultiplier(4)->Range(64, 2048)->UseRealTime();
+
+// Arguments are the row and column counts, least squares problems are tall.
+static void BM_qr_factor(benchmark::State& state) {
+	const size_t m = state.range(0), n = state.range(1);
+	const Matrix A = make_matrix(m, n);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		QRDecomposition qr(A);
+		benchmark::DoNotOptimize(qr.is_full_rank());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 2.0 * m * n * n - 2.0 / 3.0 * n * n * n);
+}
+BENCHMARK(BM_qr_factor)->Args({ 256, 256 })->Args({ 1024, 1024 })->Args({ 4096, 256 })->Args({ 2048, 1024 })->UseRealTime();
+
+// Arguments are the matrix size and the number of right hand sides.
+static void BM_lu_solve(benchmark::State& state) {
+	const size_t size = state.range(0), rhs = state.range(1);
+	const LUDecomposition lu(make_spd_matrix(size));
+	const Matrix B = make_matrix(size, rhs);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Matrix X = lu.solve(B);
+		benchmark::DoNotOptimize(X.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 2.0 * size * size * rhs);
+}
+BENCHMARK(BM_lu_solve)->Args({ 1024, 1 })->Args({ 1024, 64 })->Args({ 1024, 1024 })->UseRealTime();
+
+// --------- Sparse matrices: CSR and CSC products with dense operands. ---------
+
+// n x n with per_row pseudo random columns in each row.
+static SparseMatrix make_sparse_matrix(size_t n, size_t per_row, SparseLayout layout) {
+	SparseBuilder builder(n, n);
+	builder.reserve(n * per_row);
+	uint64_t seed = 1;
+	for (size_t r = 0; r < n; r++) {
+		for (size_t i = 0; i < per_row; i++) {
+			seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+			builder.add(r, (seed >> 33) % n, static_cast<double>(i + 1));
+		}
+	}
+	return builder.build(layout);
+}
+
+// Arguments are the size, the non-zeros per row and the layout, 0 for CSR and 1 for CSC.
+static void BM_sparse_matrix_vector(benchmark::State& state) {
+	const size_t n = state.range(0), per_row = state.range(1);
+	const SparseMatrix A = make_sparse_matrix(n, per_row, state.range(2) == 0 ? SparseLayout::CSR : SparseLayout::CSC);
+	const Vector x = make_vector(n);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Vector y = A * x;
+		benchmark::DoNotOptimize(y.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 2.0 * A.non_zero_count());
+	// A value and an index per non-zero, plus x and y.
+	set_byte_counter(state, 2 * A.non_zero_count() + 2 * n);
+}
+BENCHMARK(BM_sparse_matrix_vector)->ArgsProduct({ { 1 << 12, 1 << 16, 1 << 20 }, { 8 }, { 0, 1 } })->UseRealTime();
+
+// Arguments are the size, the non-zeros per row and the dense column count.
+static void BM_sparse_matrix_dense(benchmark::State& state) {
+	const size_t n = state.range(0), per_row = state.range(1), cols = state.range(2);
+	const SparseMatrix A = make_sparse_matrix(n, per_row, SparseLayout::CSR);
+	const Matrix B = make_matrix(n, cols);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Matrix C = A * B;
+		benchmark::DoNotOptimize(C.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 2.0 * A.non_zero_count() * cols);
+}
+BENCHMARK(BM_sparse_matrix_dense)->ArgsProduct({ { 1 << 12, 1 << 16 }, { 8 }, { 4, 64 } })->UseRealTime();
+
+// Builder throughput, the cost of getting unordered triplets into compressed form.
+static void BM_sparse_build(benchmark::State& state) {
+	const size_t n = state.range(0);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		SparseMatrix A = make_sparse_matrix(n, 8, SparseLayout::CSR);
+		benchmark::DoNotOptimize(A.get_values().data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * n * 8);
+}
+BENCHMARK(BM_sparse_build)->Range(1 << 12, 1 << 18)->UseRealTime();
+
+// --------- Data files: loading, mapping and streaming saved matrices. ---------
+
+// Argument is the matrix size. Mapping only touches the header, the elements are paged in on use.
+static void BM_load_matrix(benchmark::State& state) {
+	const size_t size = state.range(0);
+	const std::string path = (std::filesystem::temp_directory_path() / "mathslib_benchmark.bin").string();
+	save(make_matrix(size, size), path);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Matrix M = load_matrix(path);
+		benchmark::DoNotOptimize(M.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_byte_counter(state, size * size);
+	std::filesystem::remove(path);
+}
+BENCHMARK(BM_load_matrix)->RangeMultiplier(4)->Range(256, 4096)->UseRealTime();
+
+static void BM_map_matrix(benchmark::State& state) {
+	const size_t size = state.range(0);
+	const std::string path = (std::filesystem::temp_directory_path() / "mathslib_benchmark.bin").string();
+	save(make_matrix(size, size), path);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		MappedFile file(path);
+		benchmark::DoNotOptimize(file.matrix()(size - 1, size - 1));
+	}
+
+	set_allocation_counter(state, allocations_before);
+	std::filesystem::remove(path);
+}
+BENCHMARK(BM_map_matrix)->RangeMultiplier(4)->Range(256, 4096)->UseRealTime();
+
+// Out of core operations on a 2048 x 2048 file. Argument is the memory budget in MiB.
+static void BM_out_of_core_transpose(benchmark::State& state) {
+	const size_t size = 2048, budget = static_cast<size_t>(state.range(0)) << 20;
+	const std::string input = (std::filesystem::temp_directory_path() / "mathslib_benchmark.bin").string();
+	const std::string output = (std::filesystem::temp_directory_path() / "mathslib_benchmark_out.bin").string();
+	save(make_matrix(size, size), input);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		out_of_core_transpose(input, output, budget);
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_byte_counter(state, 2 * size * size);
+	std::filesystem::remove(input);
+	std::filesystem::remove(output);
+}
+BENCHMARK(BM_out_of_core_transpose)->Arg(4)->Arg(256)->UseRealTime();
+
+static void BM_out_of_core_matrix_vector(benchmark::State& state) {
+	const size_t size = 2048, budget = static_cast<size_t>(state.range(0)) << 20;
+	const std::string path = (std::filesystem::temp_directory_path() / "mathslib_benchmark.bin").string();
+	save(make_matrix(size, size), path);
+	const Vector x = make_vector(size);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Vector y = out_of_core_multiply(path, x, budget);
+		benchmark::DoNotOptimize(y.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_byte_counter(state, size * size);
+	std::filesystem::remove(path);
+}
+BENCHMARK(BM_out_of_core_matrix_vector)->Arg(4)->Arg(256)->UseRealTime();
+
+// Argument is the memory budget in MiB, 4 streams B once per block of A and 256 keeps it resident.
+static void BM_out_of_core_matrix_multiply(benchmark::State& state) {
+	const size_t size = 1024, budget = static_cast<size_t>(state.range(0)) << 20;
+	const std::string a = (std::filesystem::temp_directory_path() / "mathslib_benchmark_a.bin").string();
+	const std::string b = (std::filesystem::temp_directory_path() / "mathslib_benchmark_b.bin").string();
+	const std::string c = (std::filesystem::temp_directory_path() / "mathslib_benchmark_c.bin").string();
+	save(make_matrix(size, size), a);
+	save(make_matrix(size, size), b);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		out_of_core_multiply(a, b, c, budget);
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, size, size, size);
+	std::filesystem::remove(a);
+	std::filesystem::remove(b);
+	std::filesystem::remove(c);
+}
+BENCHMARK(BM_out_of_core_matrix_multiply)->Arg(4)->Arg(256)->UseRealTime();
+
+// --------- Text: CSV parsing and formatting, against iostreams. ---------
+
+// Argument is the row count of a 16 column matrix. Throughput is in bytes of text.
+static void BM_parse_matrix(benchmark::State& state) {
+	const size_t rows = state.range(0);
+	const std::string text = format_matrix(make_matrix(rows, 16).view());
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Matrix M = parse_matrix(text);
+		benchmark::DoNotOptimize(M.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_parse_matrix)->RangeMultiplier(16)->Range(256, 1 << 16)->UseRealTime();
+
+static void BM_parse_matrix_stream(benchmark::State& state) {
+	const size_t rows = state.range(0);
+	const std::string text = format_matrix(make_matrix(rows, 16).view(), ' ');
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Matrix M(16, rows);
+		std::istringstream stream(text);
+		for (size_t i = 0; i < rows * 16; i++) {
+			stream >> M.data()[i];
+		}
+		benchmark::DoNotOptimize(M.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_parse_matrix_stream)->RangeMultiplier(16)->Range(256, 1 << 16)->UseRealTime();
+
+static void BM_format_matrix(benchmark::State& state) {
+	const size_t rows = state.range(0);
+	const Matrix M = make_matrix(rows, 16);
+	const size_t bytes = format_matrix(M.view()).size();
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		std::string text = format_matrix(M.view());
+		benchmark::DoNotOptimize(text.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_format_matrix)->RangeMultiplier(16)->Range(256, 1 << 16)->UseRealTime();
+
+static void BM_format_matrix_stream(benchmark::State& state) {
+	const size_t rows = state.range(0);
+	const Matrix M = make_matrix(rows, 16);
+	const size_t bytes = format_matrix(M.view()).size();
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		std::ostringstream stream;
+		stream.precision(17);
+		for (const auto& row : M) {
+			for (const double value : row) {
+				stream << value << ',';
+			}
+			stream << '\n';
+		}
+		benchmark::DoNotOptimize(stream.str().data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_format_matrix_stream)->RangeMultiplier(16)->Range(256, 1 << 16)->UseRealTime();
+
+// --------- Reduced precision: the same work over double, float and bfloat16 storage. ---------
+
+static double squared_distance_of(const double* a, const double* b, size_t n) {
+	return simd_kernels().squared_distance(a, b, n);
+}
+
+static float squared_distance_of(const float* a, const float* b, size_t n) {
+	return simd_kernels().squared_distance_float(a, b, n);
+}
+
+static float squared_distance_of(const bfloat16* a, const bfloat16* b, size_t n) {
+	return simd_kernels().squared_distance_bf16(a, b, n);
+}
+
+// Stored as double in Matrix and Vector, otherwise in the reduced types.
+template <typename T>
+using BenchMatrix = std::conditional_t<std::is_same_v<T, double>, Matrix, ReducedMatrix<T>>;
+template <typename T>
+using BenchVector = std::conditional_t<std::is_same_v<T, double>, Vector, ReducedVector<T>>;
+
+template <typename T>
+static BenchMatrix<T> make_bench_matrix(size_t rows, size_t cols) {
+	if constexpr (std::is_same_v<T, double>) {
+		return make_matrix(rows, cols);
+	}
+	else {
+		return ReducedMatrix<T>(make_matrix(rows, cols));
+	}
+}
+
+// Squared distances from one 256 dimensional query to every row, the inner loop of a brute
+// force similarity search. Argument is the row count, throughput is bytes of stored elements.
+template <typename T>
+static void BM_reduced_distance(benchmark::State& state) {
+	constexpr size_t dims = 256;
+	const size_t rows = state.range(0);
+	const BenchMatrix<T> data = make_bench_matrix<T>(rows, dims);
+	const BenchMatrix<T> query = make_bench_matrix<T>(1, dims);
+	std::vector<float> distances(rows);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		for (size_t r = 0; r < rows; r++) {
+			distances[r] = static_cast<float>(squared_distance_of(data.data() + r * dims, query.data(), dims));
+		}
+		benchmark::DoNotOptimize(distances.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 3.0 * rows * dims);
+	state.SetBytesProcessed(state.iterations() * rows * dims * sizeof(T));
+}
+BENCHMARK_TEMPLATE(BM_reduced_distance, double)->RangeMultiplier(16)->Range(256, 1 << 16);
+BENCHMARK_TEMPLATE(BM_reduced_distance, float)->RangeMultiplier(16)->Range(256, 1 << 16);
+BENCHMARK_TEMPLATE(BM_reduced_distance, bfloat16)->RangeMultiplier(16)->Range(256, 1 << 16);
+
+template <typename T>
+static void BM_reduced_matrix_vector(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const BenchMatrix<T> A = make_bench_matrix<T>(n, n);
+	const BenchVector<T> x = BenchVector<T>(make_vector(n));
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		auto y = A * x;
+		benchmark::DoNotOptimize(y.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 2.0 * n * n);
+	state.SetBytesProcessed(state.iterations() * n * n * sizeof(T));
+}
+BENCHMARK_TEMPLATE(BM_reduced_matrix_vector, double)->RangeMultiplier(4)->Range(256, 4096)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_reduced_matrix_vector, float)->RangeMultiplier(4)->Range(256, 4096)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_reduced_matrix_vector, bfloat16)->RangeMultiplier(4)->Range(256, 4096)->UseRealTime();
+
+template <typename T>
+static void BM_reduced_gemm(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const BenchMatrix<T> A = make_bench_matrix<T>(n, n), B = make_bench_matrix<T>(n, n);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		auto C = A * B;
+		benchmark::DoNotOptimize(C.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, n, n, n);
+}
+BENCHMARK_TEMPLATE(BM_reduced_gemm, double)->RangeMultiplier(4)->Range(64, 1024)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_reduced_gemm, float)->RangeMultiplier(4)->Range(64, 1024)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_reduced_gemm, bfloat16)->RangeMultiplier(4)->Range(64, 1024)->UseRealTime();
+
+// Narrowing a double array, the cost of converting data before a reduced precision search.
+template <typename T>
+static void BM_convert_from_double(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const Vector in = make_vector(n);
+	std::vector<T> out(n);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		convert(in.data(), out.data(), n);
+		benchmark::ClobberMemory();
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetBytesProcessed(state.iterations() * n * (sizeof(double) + sizeof(T)));
+}
+BENCHMARK_TEMPLATE(BM_convert_from_double, float)->RangeMultiplier(16)->Range(1 << 10, 1 << 22)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_convert_from_double, bfloat16)->RangeMultiplier(16)->Range(1 << 10, 1 << 22)->UseRealTime();
+
+// --------- Nearest neighbours: 256 queries, k = 10. ---------
+
+// Pseudo random points in [0, 1), make_matrix repeats its rows every 97 and is full of ties.
+static Matrix make_points(size_t rows, size_t cols, uint64_t seed) {
+	Matrix M(cols, rows);
+	double* out = M.data();
+	for (size_t i = 0; i < rows * cols; i++) {
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		out[i] = static_cast<double>(seed >> 11) / 9007199254740992.0;
+	}
+	return M;
+}
+
+// Argument is the number of 64 dimensional points.
+static void BM_knn_brute_force(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const Matrix points = make_points(n, 64, 1), queries = make_points(256, 64, 2);
+	const BruteForceIndex index(points.view());
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		KnnResult result = index.search(queries.view(), 10);
+		benchmark::DoNotOptimize(result.indices.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 256, n, 64);
+}
+BENCHMARK(BM_knn_brute_force)->RangeMultiplier(8)->Range(1 << 10, 1 << 16)->UseRealTime();
+
+// One Vector::distance per pair and a partial sort per query, the loop the index replaces.
+static void BM_knn_pairwise_distance(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const Matrix points = make_points(n, 64, 1), queries = make_points(256, 64, 2);
+	std::vector<Vector> point_vectors, query_vectors;
+	for (size_t i = 0; i < n; i++) {
+		point_vectors.emplace_back(points.view().row(i));
+	}
+	for (size_t i = 0; i < 256; i++) {
+		query_vectors.emplace_back(queries.view().row(i));
+	}
+	std::vector<std::pair<double, size_t>> distances(n);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		for (const Vector& query : query_vectors) {
+			for (size_t i = 0; i < n; i++) {
+				distances[i] = { query.distance(point_vectors[i]), i };
+			}
+			std::partial_sort(distances.begin(), distances.begin() + 10, distances.end());
+			benchmark::DoNotOptimize(distances.data());
+		}
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 256, n, 64);
+}
+BENCHMARK(BM_knn_pairwise_distance)->RangeMultiplier(8)->Range(1 << 10, 1 << 16)->UseRealTime();
+
+// Three dimensional points, where the tree visits a handful of leaves per query.
+static void BM_knn_kd_tree(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const Matrix points = make_points(n, 3, 1), queries = make_points(256, 3, 2);
+	const KdTree tree(points.view());
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		KnnResult result = tree.search(queries.view(), 10);
+		benchmark::DoNotOptimize(result.indices.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+}
+BENCHMARK(BM_knn_kd_tree)->RangeMultiplier(8)->Range(1 << 10, 1 << 20)->UseRealTime();
+
+static void BM_knn_kd_tree_brute_force(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const Matrix points = make_points(n, 3, 1), queries = make_points(256, 3, 2);
+	const BruteForceIndex index(points.view());
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		KnnResult result = index.search(queries.view(), 10);
+		benchmark::DoNotOptimize(result.indices.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+}
+BENCHMARK(BM_knn_kd_tree_brute_force)->RangeMultiplier(8)->Range(1 << 10, 1 << 20)->UseRealTime();
+
+static void BM_kd_tree_build(benchmark::State& state) {
+	const size_t n = state.range(0);
+	const Matrix points = make_points(n, 3, 1);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		KdTree tree(points.view());
+		benchmark::DoNotOptimize(&tree);
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_kd_tree_build)->RangeMultiplier(8)->Range(1 << 10, 1 << 20)->UseRealTime();
+
+// --------- Bounding volume hierarchy: a camera's 64 x 64 rays against random geometry. ---------
+
+// Small triangles, or segments, scattered through the cube [0, 100)^3.
+static std::vector<Primitive> make_scene(size_t n, bool segments, uint64_t seed) {
+	const Matrix values = make_points(n, 9, seed);
+	std::vector<Primitive> scene;
+	scene.reserve(n);
+	for (size_t i = 0; i < n; i++) {
+		const Vec3d a{ values(i, 0) * 100, values(i, 1) * 100, values(i, 2) * 100 };
+		const Vec3d b = a + Vec3d{ values(i, 3), values(i, 4), values(i, 5) };
+		const Vec3d c = a + Vec3d{ values(i, 6), values(i, 7), values(i, 8) };
+		scene.push_back(segments ? Primitive::segment(a, b) : Primitive::triangle(a, b, c));
+	}
+	return scene;
+}
+
+// Neighbouring rays in the batch are neighbouring pixels, so packets stay coherent.
+static RayBatch make_camera_rays() {
+	RayBatch rays;
+	for (size_t y = 0; y < 64; y++) {
+		for (size_t x = 0; x < 64; x++) {
+			rays.push_back(Ray3d{ { 50, 50, -50 }, { (x / 63.0 - 0.5) * 0.8, (y / 63.0 - 0.5) * 0.8, 1 } });
+		}
+	}
+	return rays;
+}
+
+// Argument is the number of primitives.
+static void BM_bvh_build(benchmark::State& state) {
+	const std::vector<Primitive> scene = make_scene(state.range(0), false, 1);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Bvh bvh(scene);
+		benchmark::DoNotOptimize(&bvh);
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * scene.size());
+}
+BENCHMARK(BM_bvh_build)->RangeMultiplier(16)->Range(1 << 12, 1 << 20)->UseRealTime();
+
+static void BM_bvh_intersect(benchmark::State& state) {
+	const Bvh bvh(make_scene(state.range(0), false, 1));
+	const RayBatch rays = make_camera_rays();
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		std::vector<RayHit> hits = bvh.intersect(rays);
+		benchmark::DoNotOptimize(hits.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * rays.size());
+}
+BENCHMARK(BM_bvh_intersect)->RangeMultiplier(16)->Range(1 << 12, 1 << 20)->UseRealTime();
+
+static void BM_bvh_nearest_approach(benchmark::State& state) {
+	const Bvh bvh(make_scene(state.range(0), true, 1));
+	const RayBatch rays = make_camera_rays();
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		std::vector<RayApproach> approaches = bvh.nearest_approach(rays);
+		benchmark::DoNotOptimize(approaches.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * rays.size());
+}
+BENCHMARK(BM_bvh_nearest_approach)->RangeMultiplier(16)->Range(1 << 12, 1 << 20)->UseRealTime();
+
+// Every ray against every segment, the loop the hierarchy replaces.
+static void BM_bvh_brute_force_approach(benchmark::State& state) {
+	const std::vector<Primitive> scene = make_scene(state.range(0), true, 1);
+	const RayBatch rays = make_camera_rays();
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		double total = 0;
+		for (size_t i = 0; i < rays.size(); i++) {
+			const Ray3d ray = rays[i];
+			double nearest = std::numeric_limits<double>::infinity();
+			for (const Primitive& segment : scene) {
+				nearest = std::min(nearest, segment.distance(ray));
+			}
+			total += nearest;
+		}
+		benchmark::DoNotOptimize(total);
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * rays.size());
+}
+BENCHMARK(BM_bvh_brute_force_approach)->RangeMultiplier(16)->Range(1 << 8, 1 << 12)->UseRealTime();
+
+// Moves one primitive in a hundred and refits.
+static void BM_bvh_refit(benchmark::State& state) {
+	const std::vector<Primitive> scene = make_scene(state.range(0), false, 1);
+	Bvh bvh(scene);
+
+	const size_t allocations_before = allocation_count();
+	double shift = 0;
+	for (auto _ : state) {
+		shift = shift == 0 ? 0.01 : 0;
+		for (size_t i = 0; i < scene.size(); i += 100) {
+			Primitive moved = scene[i];
+			moved.a = moved.a + Vec3d{ shift, shift, shift };
+			bvh.update(i, moved);
+		}
+		bvh.refit();
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * (scene.size() / 100));
+}
+BENCHMARK(BM_bvh_refit)->RangeMultiplier(16)->Range(1 << 12, 1 << 20)->UseRealTime();
+
+// --------- Instrumentation: the cost of counting one operation when MATHSLIB_STATS is on. ---------
+
+static void BM_stats_operation_scope(benchmark::State& state) {
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		const OperationScope scope(StatsOperation::VectorDot);
+		count_flops(2);
+		benchmark::ClobberMemory();
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_stats_operation_scope);
+
+static void BM_stats_snapshot(benchmark::State& state) {
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(stats_snapshot(StatsScope::Process).to_prometheus());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_stats_snapshot);
+
+// --------- Memory resources: many short lived temporaries per request. ---------
+
+// Argument selects the resource, 0 the default heap, 1 a MemoryArena reset per request and
+// 2 a SizeClassPool. Each request builds a few hundred small temporaries.
+static void BM_request_temporaries(benchmark::State& state) {
+	const Vector a = make_vector(3, 1), b = make_vector(3, 2);
+	MemoryArena arena;
+	SizeClassPool pool;
+	std::pmr::memory_resource* resources[] = { std::pmr::get_default_resource(), &arena, &pool };
+	const char* labels[] = { "default", "arena", "pool" };
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		{
+			ScopedMemoryResource scope(resources[state.range(0)]);
+			double total = 0.0;
+
+			for (int i = 0; i < 64; i++) {
+				Vector direction = Vector(a - b * static_cast<double>(i)).normalise();
+				Vector normal = direction.cross_product(a);
+				Matrix outer = Matrix(normal) * Matrix(Vector(normal * 2.0 + direction)).transpose();
+				total += outer.trace() + normal.distance(b);
+			}
+			benchmark::DoNotOptimize(total);
+		}
+		arena.reset();
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetLabel(labels[state.range(0)]);
+	state.SetItemsProcessed(state.iterations() * 64);
+}
+BENCHMARK(BM_request_temporaries)->DenseRange(0, 2);
+
+// --------- Transpose: tiled and in place against the original row by row copy. ---------
+
+static Matrix reference_transpose(const Matrix& M) {
+	Matrix T(M.get_row_count(), M.get_col_count());
+
+	for (size_t x = 0; x < M.get_row_count(); x++) {
+		for (size_t y = 0; y < M.get_col_count(); y++) {
+			T[y][x] = M[x][y];
+		}
+	}
+
+	return T;
+}
+
+// 16384 x 16384 is 2GB per matrix, so the out of place runs need 4GB free.
+static void BM_transpose(benchmark::State& state) {
+	const size_t size = state.range(0);
+	const Matrix M = make_matrix(size, size);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Matrix T = M.transpose();
+		benchmark::DoNotOptimize(T.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_byte_counter(state, 2 * size * size);
+}
+BENCHMARK(BM_transpose)->RangeMultiplier(4)->Range(64, 16384)->UseRealTime();
+
+static void BM_transpose_reference(benchmark::State& state) {
+	const size_t size = state.range(0);
+	const Matrix M = make_matrix(size, size);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Matrix T = reference_transpose(M);
+		benchmark::DoNotOptimize(T.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_byte_counter(state, 2 * size * size);
+}
+BENCHMARK(BM_transpose_reference)->RangeMultiplier(4)->Range(64, 4096);
+
+static void BM_transpose_in_place(benchmark::State& state) {
+	const size_t size = state.range(0);
+	Matrix M = make_matrix(size, size);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		M.transpose_in_place();
+		benchmark::DoNotOptimize(M.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_byte_counter(state, 2 * size * size);
+}
+BENCHMARK(BM_transpose_in_place)->RangeMultiplier(4)->Range(64, 16384)->UseRealTime();
+
+// --------- Matrix operations, swept over square matrix sizes. ---------
+
+static void matrix_sizes(benchmark::internal::Benchmark* b) {
+	b->RangeMultiplier(4)->Range(16, 2048);
+}
+
+// Operators producing a new Matrix. doubles is how many matrices each call reads and writes.
+template <typename Op>
+static void BM_matrix_operator(benchmark::State& state, Op op, size_t doubles) {
+	const size_t size = state.range(0);
+	const Matrix A = make_matrix(size, size), B = make_matrix(size, size);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Matrix C = op(A, B);
+		benchmark::DoNotOptimize(C.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, static_cast<double>(size * size));
+	set_byte_counter(state, doubles * size * size);
+}
+BENCHMARK_CAPTURE(BM_matrix_operator, add, [](const Matrix& A, const Matrix& B) { return Matrix(A + B); }, 3)->Apply(matrix_sizes);
+BENCHMARK_CAPTURE(BM_matrix_operator, subtract, [](const Matrix& A, const Matrix& B) { return Matrix(A - B); }, 3)->Apply(matrix_sizes);
+BENCHMARK_CAPTURE(BM_matrix_operator, multiply_scalar, [](const Matrix& A, const Matrix&) { return Matrix(A * 1.5); }, 2)->Apply(matrix_sizes);
+BENCHMARK_CAPTURE(BM_matrix_operator, divide_scalar, [](const Matrix& A, const Matrix&) { return Matrix(A / 1.5); }, 2)->Apply(matrix_sizes);
+BENCHMARK_CAPTURE(BM_matrix_operator, negate, [](const Matrix& A, const Matrix&) { return Matrix(-A); }, 2)->Apply(matrix_sizes);
+
+template <typename Op>
+static void BM_matrix_compound_operator(benchmark::State& state, Op op, size_t doubles) {
+	const size_t size = state.range(0);
+	Matrix A = make_matrix(size, size);
+	const Matrix B = make_matrix(size, size);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		op(A, B);
+		benchmark::ClobberMemory();
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, static_cast<double>(size * size));
+	set_byte_counter(state, doubles * size * size);
+}
+BENCHMARK_CAPTURE(BM_matrix_compound_operator, add, [](Matrix& A, const Matrix& B) { A += B; }, 3)->Apply(matrix_sizes);
+BENCHMARK_CAPTURE(BM_matrix_compound_operator, subtract, [](Matrix& A, const Matrix& B) { A -= B; }, 3)->Apply(matrix_sizes);
+BENCHMARK_CAPTURE(BM_matrix_compound_operator, multiply_scalar, [](Matrix& A, const Matrix&) { A *= 1.0000001; }, 2)->Apply(matrix_sizes);
+BENCHMARK_CAPTURE(BM_matrix_compound_operator, divide_scalar, [](Matrix& A, const Matrix&) { A /= 1.0000001; }, 2)->Apply(matrix_sizes);
+
+static void BM_matrix_vector_multiply(benchmark::State& state) {
+	const size_t size = state.range(0);
+	const Matrix A = make_matrix(size, size);
+	const Vector V = make_vector(size, 1);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Matrix C = A * V;
+		benchmark::DoNotOptimize(C.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, 2.0 * size * size);
+	set_byte_counter(state, size * size + 2 * size);
+}
+BENCHMARK(BM_matrix_vector_multiply)->Apply(matrix_sizes);
+
+static void BM_matrix_equality(benchmark::State& state) {
+	const size_t size = state.range(0);
+	const Matrix A = make_matrix(size, size), B = make_matrix(size, size);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(A == B);
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_byte_counter(state, 2 * size * size);
+}
+BENCHMARK(BM_matrix_equality)->Apply(matrix_sizes);
+
+static void BM_matrix_trace(benchmark::State& state) {
+	const size_t size = state.range(0);
+	const Matrix A = make_matrix(size, size);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(A.trace());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, static_cast<double>(size));
+	set_byte_counter(state, size);
+}
+BENCHMARK(BM_matrix_trace)->Apply(matrix_sizes);
+
+// Zero fills size * size elements, then sets the diagonal.
+static void BM_matrix_identity(benchmark::State& state) {
+	const size_t size = state.range(0);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Matrix I = Matrix::identity(size);
+		benchmark::DoNotOptimize(I.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_byte_counter(state, size * size);
+}
+BENCHMARK(BM_matrix_identity)->Apply(matrix_sizes);
+
+// --------- Ray queries: batched structure of arrays against one Ray at a time. ---------
+
+static Ray make_ray(size_t i) {
+	const double t = static_cast<double>(i);
+	return Ray(Vector({ t, 1.0 - t, 0.5 * t }), Vector({ 1.0 + (i % 3), 0.5 * (i % 5), 2.0 - (i % 7) }));
+}
+
+static Vector make_point(size_t j) {
+	const double t = static_cast<double>(j);
+	return Vector({ (j % 11) - 5.0, 0.25 * t, (j % 13) * 0.5 });
+}
+
+// The same rays and points in both representations, for single queries.
+struct RayQueryData {
+	static constexpr size_t count = 64;
+	std::vector<Ray> rays;
+	std::vector<Vector> points;
+	std::vector<Ray3d> fixed_rays;
+	std::vector<Vec3d> fixed_points;
+
+	RayQueryData() {
+		for (size_t i = 0; i < count; i++) {
+			rays.push_back(make_ray(i));
+			points.push_back(make_point(i));
+			fixed_rays.push_back(Ray3d{ Vec3d::from_vector(rays[i].position), Vec3d::from_vector(rays[i].direction) });
+			fixed_points.push_back(Vec3d::from_vector(points[i]));
+		}
+	}
+};
+
+// One query per ray, against the next ray or a point. Ray forwards to the allocation free Ray3d.
+template <typename Query>
+static void BM_ray_query(benchmark::State& state, Query query) {
+	const RayQueryData data;
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		for (size_t i = 0; i < RayQueryData::count; i++) {
+			benchmark::DoNotOptimize(query(data, i));
+		}
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * RayQueryData::count);
+}
+BENCHMARK_CAPTURE(BM_ray_query, point_distance, [](const RayQueryData& d, size_t i) { return d.rays[i].point_distance(d.points[i]); });
+BENCHMARK_CAPTURE(BM_ray_query, line_distance, [](const RayQueryData& d, size_t i) { return d.rays[i].line_distance(d.rays[(i + 1) % RayQueryData::count]); });
+BENCHMARK_CAPTURE(BM_ray_query, intersect, [](const RayQueryData& d, size_t i) { return d.rays[i].intersect(d.rays[(i + 1) % RayQueryData::count]); });
+BENCHMARK_CAPTURE(BM_ray_query, point_distance_fixed, [](const RayQueryData& d, size_t i) { return d.fixed_rays[i].point_distance(d.fixed_points[i]); });
+BENCHMARK_CAPTURE(BM_ray_query, line_distance_fixed, [](const RayQueryData& d, size_t i) { return d.fixed_rays[i].line_distance(d.fixed_rays[(i + 1) % RayQueryData::count]); });
+BENCHMARK_CAPTURE(BM_ray_query, intersect_fixed, [](const RayQueryData& d, size_t i) { return d.fixed_rays[i].intersect(d.fixed_rays[(i + 1) % RayQueryData::count]); });
+
+// Arguments are the number of rays and the number of points they are each tested against.
+static void BM_ray_point_distance_per_call(benchmark::State& state) {
+	std::vector<Ray> rays;
+	std::vector<Vector> points;
+	for (int64_t i = 0; i < state.range(0); i++) {
+		rays.push_back(make_ray(i));
+	}
+	for (int64_t j = 0; j < state.range(1); j++) {
+		points.push_back(make_point(j));
+	}
+	std::vector<double> out(rays.size() * points.size());
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		double* result = out.data();
+		for (const Ray& ray : rays) {
+			for (const Vector& point : points) {
+				*result++ = ray.point_distance(point);
+			}
+		}
+		benchmark::DoNotOptimize(out.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * out.size());
+}
+BENCHMARK(BM_ray_point_distance_per_call)->Args({ 256, 4096 });
+
+static void BM_ray_point_distance_batch(benchmark::State& state) {
+	RayBatch rays;
+	PointBatch points;
+	for (int64_t i = 0; i < state.range(0); i++) {
+		rays.push_back(make_ray(i));
+	}
+	for (int64_t j = 0; j < state.range(1); j++) {
+		points.push_back(make_point(j));
+	}
+	std::vector<double> out(rays.size() * points.size());
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		point_distance(rays, points, out);
+		benchmark::DoNotOptimize(out.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * out.size());
+}
+BENCHMARK(BM_ray_point_distance_batch)->Args({ 256, 4096 })->UseRealTime();
+
+static void BM_ray_line_distance_per_call(benchmark::State& state) {
+	std::vector<Ray> rays;
+	for (int64_t i = 0; i < state.range(0); i++) {
+		rays.push_back(make_ray(i));
+	}
+	std::vector<double> out(rays.size() * rays.size());
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		double* result = out.data();
+		for (const Ray& ray : rays) {
+			for (const Ray& other : rays) {
+				*result++ = ray.line_distance(other);
+			}
+		}
+		benchmark::DoNotOptimize(out.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * out.size());
+}
+BENCHMARK(BM_ray_line_distance_per_call)->Arg(1024);
+
+static void BM_ray_line_distance_batch(benchmark::State& state) {
+	RayBatch rays;
+	for (int64_t i = 0; i < state.range(0); i++) {
+		rays.push_back(make_ray(i));
+	}
+	std::vector<double> out(rays.size() * rays.size());
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		line_distance(rays, rays, out);
+		benchmark::DoNotOptimize(out.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * out.size());
+}
+BENCHMARK(BM_ray_line_distance_batch)->Arg(1024)->UseRealTime();
+
+static void BM_ray_intersect_batch(benchmark::State& state) {
+	RayBatch rays;
+	for (int64_t i = 0; i < state.range(0); i++) {
+		rays.push_back(make_ray(i));
+	}
+	std::unique_ptr<bool[]> out(new bool[rays.size() * rays.size()]);
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		intersect(rays, rays, std::span<bool>(out.get(), rays.size() * rays.size()));
+		benchmark::DoNotOptimize(out.get());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * rays.size() * rays.size());
+}
+BENCHMARK(BM_ray_intersect_batch)->Arg(1024)->UseRealTime();
+
+// --------- Batched small matrices: structure of arrays against a loop over Mat. ---------
+
+static Mat4d make_mat4(size_t i) {
+	Mat4d M{};
+	for (size_t r = 0; r < 4; r++) {
+		for (size_t c = 0; c < 4; c++) {
+			M[r][c] = r == c ? 4.0 + (i % 5) : double((i + 3 * r + 7 * c) % 9) * 0.25 - 1.0;
+		}
+	}
+	return M;
+}
+
+// Closed form inverse of one matrix, the obvious per item alternative to the batch.
+static Mat4d inverse_per_item(const Mat4d& a) {
+	const double s0 = a[0][0] * a[1][1] - a[1][0] * a[0][1];
+	const double s1 = a[0][0] * a[1][2] - a[1][0] * a[0][2];
+	const double s2 = a[0][0] * a[1][3] - a[1][0] * a[0][3];
+	const double s3 = a[0][1] * a[1][2] - a[1][1] * a[0][2];
+	const double s4 = a[0][1] * a[1][3] - a[1][1] * a[0][3];
+	const double s5 = a[0][2] * a[1][3] - a[1][2] * a[0][3];
+	const double c5 = a[2][2] * a[3][3] - a[3][2] * a[2][3];
+	const double c4 = a[2][1] * a[3][3] - a[3][1] * a[2][3];
+	const double c3 = a[2][1] * a[3][2] - a[3][1] * a[2][2];
+	const double c2 = a[2][0] * a[3][3] - a[3][0] * a[2][3];
+	const double c1 = a[2][0] * a[3][2] - a[3][0] * a[2][2];
+	const double c0 = a[2][0] * a[3][1] - a[3][0] * a[2][1];
+	const double inv = 1.0 / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+	return Mat4d{ { { (a[1][1] * c5 - a[1][2] * c4 + a[1][3] * c3) * inv, (-a[0][1] * c5 + a[0][2] * c4 - a[0][3] * c3) * inv,
+					  (a[3][1] * s5 - a[3][2] * s4 + a[3][3] * s3) * inv, (-a[2][1] * s5 + a[2][2] * s4 - a[2][3] * s3) * inv },
+					{ (-a[1][0] * c5 + a[1][2] * c2 - a[1][3] * c1) * inv, (a[0][0] * c5 - a[0][2] * c2 + a[0][3] * c1) * inv,
+					  (-a[3][0] * s5 + a[3][2] * s2 - a[3][3] * s1) * inv, (a[2][0] * s5 - a[2][2] * s2 + a[2][3] * s1) * inv },
+					{ (a[1][0] * c4 - a[1][1] * c2 + a[1][3] * c0) * inv, (-a[0][0] * c4 + a[0][1] * c2 - a[0][3] * c0) * inv,
+					  (a[3][0] * s4 - a[3][1] * s2 + a[3][3] * s0) * inv, (-a[2][0] * s4 + a[2][1] * s2 - a[2][3] * s0) * inv },
+					{ (-a[1][0] * c3 + a[1][1] * c1 - a[1][2] * c0) * inv, (a[0][0] * c3 - a[0][1] * c1 + a[0][2] * c0) * inv,
+					  (-a[3][0] * s3 + a[3][1] * s1 - a[3][2] * s0) * inv, (a[2][0] * s3 - a[2][1] * s1 + a[2][2] * s0) * inv } } };
+}
+
+// Argument is the number of matrices.
+static void BM_mat4_multiply_per_item(benchmark::State& state) {
+	std::vector<Mat4d> A, B, out(state.range(0));
+	for (int64_t i = 0; i < state.range(0); i++) {
+		A.push_back(make_mat4(i));
+		B.push_back(make_mat4(i + 11));
+	}
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		for (size_t i = 0; i < out.size(); i++) {
+			out[i] = A[i] * B[i];
+		}
+		benchmark::DoNotOptimize(out.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_mat4_multiply_per_item)->Arg(1 << 8)->Arg(1 << 12);
+
+static void BM_mat4_multiply_batch(benchmark::State& state) {
+	Mat4Batch A, B, out(state.range(0));
+	for (int64_t i = 0; i < state.range(0); i++) {
+		A.push_back(make_mat4(i));
+		B.push_back(make_mat4(i + 11));
+	}
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		multiply(A, B, out);
+		benchmark::DoNotOptimize(out.element(0, 0));
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_mat4_multiply_batch)->Arg(1 << 8)->Arg(1 << 12)->UseRealTime();
+
+static void BM_mat4_inverse_per_item(benchmark::State& state) {
+	std::vector<Mat4d> A, out(state.range(0));
+	for (int64_t i = 0; i < state.range(0); i++) {
+		A.push_back(make_mat4(i));
+	}
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		for (size_t i = 0; i < out.size(); i++) {
+			out[i] = inverse_per_item(A[i]);
+		}
+		benchmark::DoNotOptimize(out.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_mat4_inverse_per_item)->Arg(1 << 12);
+
+// The general Matrix inverse, for scale.
+static void BM_mat4_inverse_matrix(benchmark::State& state) {
+	std::vector<Matrix> A;
+	for (int64_t i = 0; i < state.range(0); i++) {
+		A.push_back(make_mat4(i).to_matrix());
+	}
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		for (const Matrix& M : A) {
+			benchmark::DoNotOptimize(M.inverse());
+		}
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_mat4_inverse_matrix)->Arg(1 << 12);
+
+static void BM_mat4_inverse_batch(benchmark::State& state) {
+	Mat4Batch A, out(state.range(0));
+	for (int64_t i = 0; i < state.range(0); i++) {
+		A.push_back(make_mat4(i));
+	}
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		inverse(A, out);
+		benchmark::DoNotOptimize(out.element(0, 0));
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_mat4_inverse_batch)->Arg(1 << 12)->UseRealTime();
+
+// One transform applied to many points.
+static void BM_vec3_transform_per_item(benchmark::State& state) {
+	const Mat3d M{ { { 0.8, -0.6, 0 }, { 0.6, 0.8, 0 }, { 0, 0, 1 } } };
+	std::vector<Vec3d> v, out(state.range(0));
+	for (int64_t i = 0; i < state.range(0); i++) {
+		v.push_back(Vec3d{ double(i), 1.0 - i, 0.5 * i });
+	}
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		for (size_t i = 0; i < out.size(); i++) {
+			out[i] = M * v[i];
+		}
+		benchmark::DoNotOptimize(out.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_vec3_transform_per_item)->Arg(1 << 14);
+
+static void BM_vec3_transform_batch(benchmark::State& state) {
+	const Mat3d M{ { { 0.8, -0.6, 0 }, { 0.6, 0.8, 0 }, { 0, 0, 1 } } };
+	Vec3Batch v, out(state.range(0));
+	for (int64_t i = 0; i < state.range(0); i++) {
+		v.push_back(Vec3d{ double(i), 1.0 - i, 0.5 * i });
+	}
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		transform(M, v, out);
+		benchmark::DoNotOptimize(out.component(0));
+	}
+
+	set_allocation_counter(state, allocations_before);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_vec3_transform_batch)->Arg(1 << 14)->UseRealTime();
+
+// --------- Thread scaling: the same work on 1, 2, 4, ... library threads. ---------
+
+// Arguments are the matrix size and the thread count.
+static void BM_matrix_multiply_threads(benchmark::State& state) {
+	const size_t size = state.range(0);
+	const Matrix A = make_matrix(size, size);
+	const Matrix B = make_matrix(size, size);
+	set_thread_count(state.range(1));
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		Matrix C = A * B;
+		benchmark::DoNotOptimize(C);
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_flop_counter(state, size, size, size);
+}
+BENCHMARK(BM_matrix_multiply_threads)->ArgsProduct({ { 512, 2048 }, benchmark::CreateRange(1, 64, 2) })->UseRealTime();
+
+static void BM_matrix_elementwise_threads(benchmark::State& state) {
+	const size_t size = state.range(0);
+	const Matrix A = make_matrix(size, size);
+	const Matrix B = make_matrix(size, size);
+	Matrix C(size, size);
+	set_thread_count(state.range(1));
+
+	const size_t allocations_before = allocation_count();
+	for (auto _ : state) {
+		C = A * 2.0 - B;
+		benchmark::DoNotOptimize(C.data());
+	}
+
+	set_allocation_counter(state, allocations_before);
+	set_byte_counter(state, 3 * size * size);
+}
+BENCHMARK(BM_matrix_elementwise_threads)->ArgsProduct({ { 2048 }, benchmark::CreateRange(1, 64, 2) })->UseRealTime();
+
+BENCHMARK_MAIN();
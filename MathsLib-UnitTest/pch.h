@@ -7,5 +7,26 @@
 #include "gtest/gtest.h"
 #include "../MathsLib_Start1/Vector.h"
 #include "../MathsLib_Start1/Ray.h"
+#include "../MathsLib_Start1/RayBatch.h"
+#include "../MathsLib_Start1/Bvh.h"
 #include "../MathsLib_Start1/Matrix.h"
-#include <ranges>
\ No newline at end of file
+#include "../MathsLib_Start1/Decomposition.h"
+#include "../MathsLib_Start1/SparseMatrix.h"
+#include "../MathsLib_Start1/DataFile.h"
+#include "../MathsLib_Start1/MatrixStream.h"
+#include "../MathsLib_Start1/TextIO.h"
+#include "../MathsLib_Start1/ReducedPrecision.h"
+#include "../MathsLib_Start1/NearestNeighbours.h"
+#include "../MathsLib_Start1/Simd.h"
+#include "../MathsLib_Start1/ThreadPool.h"
+#include "../MathsLib_Start1/MemoryResource.h"
+#include "../MathsLib_Start1/Stats.h"
+#include "../MathsLib_Start1/FixedVector.h"
+#include "../MathsLib_Start1/FixedMatrix.h"
+#include "../MathsLib_Start1/MatrixBatch.h"
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <ranges>
+#include <thread>
\ No newline at end of file
@@ -320,13 +320,706 @@ TEST(Ray, intersect) {
 	EXPECT_TRUE(ray_1.intersect(ray_2));
 }
 
+TEST(Ray, line_distance) {
+	// Skew lines, one along x at the origin and one along y raised by 2 in z.
+	Ray ray_1(Vector({ 0,0,0 }), Vector({ 1,0,0 }));
+	Ray ray_2(Vector({ 0,0,2 }), Vector({ 0,1,0 }));
+	EXPECT_NEAR(ray_1.line_distance(ray_2), 2, 10e-9);
+
+	// Parallel lines fall back to the point distance.
+	Ray ray_3(Vector({ 0,3,4 }), Vector({ 2,0,0 }));
+	EXPECT_NEAR(ray_1.line_distance(ray_3), 5, 10e-9);
+
+	EXPECT_THROW(Ray(Vector({ 1,2 }), Vector({ 1,2,3 })), std::invalid_argument);
+}
+
+TEST(Ray, batched_queries_match_per_call) {
+	// Sizes that are not multiples of the SIMD width exercise the scalar tails.
+	RayBatch rays;
+	PointBatch points;
+	for (int i = 0; i < 5; i++) {
+		rays.push_back(Ray(Vector({ double(i), 2.0 - i, 3 }), Vector({ 1.0 + i, double(i % 2), -2 })));
+	}
+	for (int j = 0; j < 19; j++) {
+		points.push_back(Vec3d{ double(j % 4), double(j % 7) - 3, double(j) });
+	}
+
+	// Parallel, intersecting and skew partners for every ray.
+	RayBatch others(11);
+	for (size_t j = 0; j < others.size(); j++) {
+		others.set(j, j % 3 == 0 ? Ray3d{ { 0, 3, 4 }, { 2, 0, -4 } } : Ray3d{ { double(j), 1, 0 }, { 0, 1, double(j % 2) } });
+	}
+	others.push_back(Ray(Vector({ 1, 2, 3 }), Vector({ 9, 1, -5 })));
+
+	std::vector<double> point_distances(rays.size() * points.size());
+	std::vector<double> line_distances(rays.size() * others.size());
+	std::unique_ptr<bool[]> intersections(new bool[rays.size() * others.size()]);
+
+	point_distance(rays, points, point_distances);
+	line_distance(rays, others, line_distances);
+	intersect(rays, others, std::span<bool>(intersections.get(), rays.size() * others.size()));
+
+	for (size_t i = 0; i < rays.size(); i++) {
+		for (size_t j = 0; j < points.size(); j++) {
+			EXPECT_NEAR(point_distances[i * points.size() + j], rays[i].point_distance(points[j]), 10e-9);
+		}
+		for (size_t j = 0; j < others.size(); j++) {
+			EXPECT_NEAR(line_distances[i * others.size() + j], rays[i].line_distance(others[j]), 10e-9);
+			EXPECT_EQ(intersections[i * others.size() + j], rays[i].intersect(others[j]));
+		}
+	}
+	EXPECT_TRUE(std::ranges::any_of(intersections.get(), intersections.get() + rays.size() * others.size(), [](bool b) { return b; }));
+
+	std::vector<double> too_small(3);
+	EXPECT_THROW(point_distance(rays, points, too_small), std::invalid_argument);
+	EXPECT_THROW(points.push_back(Vector({ 1, 2 })), std::invalid_argument);
+}
+
+TEST(Ray, compound_assignment) {
+	Ray ray(Vector({ 1, 2, 3 }), Vector({ 9, 1, -5 }));
+
+	ray += Ray(Vector({ 1, 1, 1 }), Vector({ 1, 1, 1 }));
+	ray -= Ray(Vector({ 0, 0, 1 }), Vector({ 0, 0, 1 }));
+	ray *= 2;
+	ray /= 4;
+
+	EXPECT_EQ(ray.position, Vector({ 1, 1.5, 1.5 }));
+	EXPECT_EQ(ray.direction, Vector({ 5, 1, -2.5 }));
+
+	// Operators on a temporary ray reuse its vectors.
+	Ray ray_2 = Ray(Vector({ 1, 2, 3 }), Vector({ 1, 0, 0 })) + ray;
+	EXPECT_EQ(ray_2.position, Vector({ 2, 3.5, 4.5 }));
+}
+
+// -------- Fixed size Vec, Mat and FixedRay testing below -------------
+TEST(Fixed, vec_operations) {
+	constexpr Vec3d v1{ -1, 2, 7 };
+	constexpr Vec3d v2{ 3, 2, 9 };
+
+	// Everything except the square roots is usable at compile time.
+	static_assert(v1.dot_product(v2) == 64);
+	static_assert(v1.cross_product(v2) == Vec3d{ 4, 30, -8 });
+	static_assert((v1 + v2) == Vec3d{ 2, 4, 16 });
+	static_assert((2.0 * v1 - v2) == Vec3d{ -5, 2, 5 });
+	static_assert(Vec3d{}.is_zero());
+	static_assert(sizeof(Vec4f) == 4 * sizeof(float));
+
+	EXPECT_NEAR(Vec3d({ 1, 2, 3 }).euclidean_length(), 3.74165738, 10e-5);
+	EXPECT_NEAR(Vec3d({ 1, 2, 3 }).normalise()[2], 0.80178372, 10e-5);
+	EXPECT_NEAR(Vec3d({ -1, 3, 2 }).distance(Vec3d{ 3, 10, -3 }), 9.4868329, 10e-5);
+
+	// Conversions to and from the runtime sized Vector and between precisions.
+	EXPECT_EQ(Vec3d::from_vector(Vector({ 1, 2, 3 })), (Vec3d{ 1, 2, 3 }));
+	EXPECT_EQ(Vec3d({ 1, 2, 3 }).to_vector(), Vector({ 1, 2, 3 }));
+	EXPECT_THROW(Vec3d::from_vector(Vector({ 1, 2 })), std::invalid_argument);
+	EXPECT_EQ(static_cast<Vec3f>(v1), (Vec3f{ -1, 2, 7 }));
+}
+
+TEST(Fixed, mat_operations) {
+	constexpr Mat<3, 4> M0{ { { 1, 3, 4, 5 }, { 6, 5, 3, 1 }, { 9, 7, 7, 4 } } };
+	constexpr Mat<4, 3> M1{ { { 0, 2, 3 }, { 2, 6, 2 }, { 1, 3, 4 }, { 0, 9, 4 } } };
+	constexpr Mat3d solution{ { { 10, 77, 45 }, { 13, 60, 44 }, { 21, 117, 85 } } };
+
+	static_assert(M0 * M1 == solution);
+	static_assert(solution.trace() == 155);
+	static_assert(Mat3d::identity() * solution == solution);
+	static_assert(M0 * Vec4d{ 1, 2, 3, 4 } == Vec3d{ 39, 29, 60 });
+	static_assert((-Mat4d::identity()).trace() == -4);
+
+	EXPECT_EQ(M0.transpose().transpose(), M0);
+	EXPECT_EQ(Mat3d::from_matrix(Matrix({ { 10, 77, 45 }, { 13, 60, 44 }, { 21, 117, 85 } })), solution);
+	EXPECT_EQ(solution.to_matrix(), Matrix({ { 10, 77, 45 }, { 13, 60, 44 }, { 21, 117, 85 } }));
+	EXPECT_THROW(Mat3d::from_matrix(Matrix(4)), std::invalid_argument);
+}
+
+TEST(Fixed, ray_queries) {
+	constexpr Ray3d ray_1{ { 1, 2, 3 }, { 9, 1, -5 } };
+	constexpr Ray3d ray_2{ { 1, 2, 3 }, { 6, 1, -3 } };
+
+	static_assert(ray_1.intersect(ray_2));
+	static_assert((ray_1 + ray_2).position == Vec3d{ 2, 4, 6 });
+
+	const Ray3d ray_3{ { 1, 2, 5 }, { 4, 8, -4 } };
+	EXPECT_NEAR(ray_3.point_distance(Vec3d{ 4, 5, 1 }), 2.41522945, 10e-5);
+	EXPECT_NEAR(ray_3.point_distance(Vec3d{ 4, 5, 1 }), Ray(Vector({ 1, 2, 5 }), Vector({ 4, 8, -4 })).point_distance(Vector({ 4, 5, 1 })), 10e-12);
+}
+
+// Diagonally dominant, so every matrix is comfortably invertible.
+template <size_t N>
+static Mat<N, N, double> batch_test_matrix(size_t i) {
+	Mat<N, N, double> M{};
+	for (size_t r = 0; r < N; r++) {
+		for (size_t c = 0; c < N; c++) {
+			M[r][c] = r == c ? 4.0 + (i % 5) : double((i + 3 * r + 7 * c) % 9) * 0.25 - 1.0;
+		}
+	}
+	return M;
+}
+
+template <size_t N>
+static void check_batch_operations(size_t count) {
+	MatrixBatch<N> A, B;
+	VectorBatch<N> v;
+	for (size_t i = 0; i < count; i++) {
+		A.push_back(batch_test_matrix<N>(i));
+		B.push_back(batch_test_matrix<N>(i + 11).transpose());
+		Vec<N, double> x{};
+		for (size_t k = 0; k < N; k++) {
+			x[k] = double(i % 7) - double(k);
+		}
+		v.push_back(x);
+	}
+
+	MatrixBatch<N> product(count), transposed(count), inverted(count);
+	VectorBatch<N> transformed(count), broadcast(count);
+	std::vector<double> determinants(count);
+	multiply(A, B, product);
+	transform(A, v, transformed);
+	transform(A[0], v, broadcast);
+	transpose(A, transposed);
+	inverse(A, inverted);
+	determinant(A, determinants);
+
+	for (size_t i = 0; i < count; i++) {
+		// Every product and sum here is exact, so contracting them into fused multiply adds cannot
+		// change the results.
+		EXPECT_EQ(product[i], A[i] * B[i]);
+		EXPECT_EQ(transformed[i], A[i] * v[i]);
+		EXPECT_EQ(broadcast[i], A[0] * v[i]);
+		EXPECT_EQ(transposed[i], A[i].transpose());
+
+		const Matrix reference = A[i].to_matrix();
+		EXPECT_NEAR(determinants[i], reference.determinant(), 10e-9);
+		const Matrix expected_inverse = reference.inverse();
+		for (size_t r = 0; r < N; r++) {
+			for (size_t c = 0; c < N; c++) {
+				EXPECT_NEAR(inverted[i][r][c], expected_inverse(r, c), 10e-12);
+			}
+		}
+	}
+}
+
+TEST(MatrixBatch, operations_match_fixed) {
+	// Counts that are not multiples of the block size exercise the padded final block.
+	check_batch_operations<2>(19);
+	check_batch_operations<3>(8);
+	check_batch_operations<4>(13);
+	check_batch_operations<3>(1);
+}
+
+TEST(MatrixBatch, aliasing_large_batches_and_sizes) {
+	// Large enough to be split over the thread pool, with the result written over the input.
+	Mat4Batch A;
+	for (size_t i = 0; i < 5003; i++) {
+		A.push_back(batch_test_matrix<4>(i));
+	}
+	const Mat4Batch original = A;
+	inverse(A, A);
+	inverse(A, A);
+	for (size_t i = 0; i < A.size(); i += 97) {
+		for (size_t r = 0; r < 4; r++) {
+			for (size_t c = 0; c < 4; c++) {
+				EXPECT_NEAR(A[i][r][c], original[i][r][c], 10e-12);
+			}
+		}
+	}
+	const Mat4Batch round_trip = A;
+	multiply(original, A, A);
+	const Mat4d expected = original[4321] * round_trip[4321];
+	for (size_t r = 0; r < 4; r++) {
+		for (size_t c = 0; c < 4; c++) {
+			EXPECT_NEAR(A[4321][r][c], expected[r][c], 10e-12);
+		}
+	}
+
+	// Singular matrices give non finite elements rather than throwing.
+	Mat2Batch singular;
+	singular.push_back(Mat2d{ { { 1, 2 }, { 2, 4 } } });
+	std::vector<double> det(1);
+	determinant(singular, det);
+	EXPECT_EQ(det[0], 0.0);
+	inverse(singular, singular);
+	EXPECT_FALSE(std::isfinite(singular[0][0][0]));
+
+	Mat3Batch small(3), large(4);
+	Vec3Batch vectors(4);
+	std::vector<double> too_small(2);
+	EXPECT_THROW(multiply(small, large, large), std::invalid_argument);
+	EXPECT_THROW(transform(small, vectors, vectors), std::invalid_argument);
+	EXPECT_THROW(transpose(small, large), std::invalid_argument);
+	EXPECT_THROW(determinant(small, too_small), std::invalid_argument);
+}
+
 TEST(Vector, vector_equals_vector_operator) {
 	EXPECT_EQ(Vector({ 1,2,3 }), Vector({ 1,2,3 }));
 	EXPECT_THROW(Vector({ 1,2,3 }) == Vector({ 1,2,3,4 }), std::invalid_argument);
 }
 
+TEST(Vector, lazy_expressions) {
+	Vector a({ 1, 2, 3 });
+	Vector b({ 4, 5, 6 });
+	Vector c({ 1, 1, 1 });
+
+	// Operators build an expression, nothing is evaluated until it becomes a Vector.
+	static_assert(!std::is_same_v<decltype(a + b * 2.0 - c), Vector>);
+
+	Vector result = a + b * 2.0 - c;
+	EXPECT_EQ(result, Vector({ 8, 11, 14 }));
+	EXPECT_EQ(Vector(-(a - c) / 2), Vector({ 0, -0.5, -1 }));
+
+	// The target may appear on the right hand side.
+	a = a + a * 2.0;
+	EXPECT_EQ(a, Vector({ 3, 6, 9 }));
+
+	// Expressions convert wherever a Vector is expected.
+	EXPECT_EQ(c.dot_product(a - b), 3);
+
+	// Mismatched sizes are still reported when the expression is built.
+	Vector d({ 1, 2 });
+	EXPECT_THROW(a + d * 2.0, std::invalid_argument);
+}
+
+TEST(Vector, compound_assignment_and_moves) {
+	Vector a({ 1, 2, 3 });
+	const double* storage = a.data();
+
+	a += Vector({ 1, 1, 1 });
+	a -= Vector({ 0, 1, 2 }) * 2.0;
+	a *= 3;
+	a /= 2;
+	EXPECT_EQ(a, Vector({ 3, 1.5, 0 }));
+	EXPECT_EQ(a.data(), storage);
+	EXPECT_THROW(a += Vector({ 1, 2 }), std::invalid_argument);
+
+	// A temporary on the left donates its buffer to the result. Short vectors have none to give.
+	const size_t n = VectorStorage::inline_capacity + 4;
+	Vector long_b(n), donor(n);
+	for (size_t i = 0; i < n; i++) {
+		long_b[i] = static_cast<double>(i);
+		donor[i] = 2.0 * i;
+	}
+	const double* donor_storage = donor.data();
+	Vector result = std::move(donor) + long_b;
+	EXPECT_EQ(result[n - 1], 3.0 * (n - 1));
+	EXPECT_EQ(result.data(), donor_storage);
+
+	Vector b({ 1, 2, 3 });
+	EXPECT_EQ(Vector({ 4, 5, 6 }) + b, Vector({ 5, 7, 9 }));
+
+	// Subtraction with the temporary on the right keeps operand order.
+	EXPECT_EQ(b - Vector({ 1, 1, 1 }), Vector({ 0, 1, 2 }));
+	EXPECT_EQ(-Vector({ 1, -2 }) * 2.0, Vector({ -2, 4 }));
+
+	// normalise and distance no longer copy the vector first.
+	EXPECT_NEAR(Vector({ 3, 4 }).normalise()[0], 0.6, 10e-12);
+	EXPECT_NEAR(Vector({ 1, 1, 1, 1, 1 }).distance(Vector({ 2, 2, 2, 2, 2 })), sqrt(5.0), 10e-12);
+}
+
+TEST(Vector, small_vectors_stay_inline) {
+	if (VectorStorage::inline_capacity < 3) {
+		GTEST_SKIP() << "Built without inline storage for 3D vectors.";
+	}
+
+	// Anything allocated inside the scope would show up in the arena.
+	MemoryArena arena;
+	ScopedMemoryResource scope(&arena);
+
+	Vector a({ 1, 2, 3 });
+	Vector b({ 4, 5, 6 });
+	Vector c = a.cross_product(b) + a * 2.0;
+	Ray ray(a, b);
+	Ray moved = ray + Ray(b, c) * 2.0;
+	Vector copy = moved.direction;
+	copy = c;
+	Vector unit = copy.normalise();
+	EXPECT_NEAR(unit.euclidean_length(), 1.0, 10e-12);
+	EXPECT_EQ(c, Vector({ -1, 10, 3 }));
+	EXPECT_EQ(copy, c);
+	EXPECT_EQ(arena.bytes_used(), 0);
+
+	// Longer vectors spill to the resource, and can grow back from and shrink into the inline buffer.
+	Vector v(VectorStorage::inline_capacity);
+	v = Vector(VectorStorage::inline_capacity + 1) + Vector(VectorStorage::inline_capacity + 1);
+	EXPECT_GT(arena.bytes_used(), 0);
+	EXPECT_EQ(v.size(), VectorStorage::inline_capacity + 1);
+	v = a;
+	EXPECT_EQ(v, a);
+
+	// Moves of inline vectors copy the elements, the source is left empty.
+	Vector source({ 7, 8 });
+	Vector target(std::move(source));
+	EXPECT_EQ(target, Vector({ 7, 8 }));
+	EXPECT_EQ(source.size(), 0);
+}
+
+TEST(Vector, zero_copy_views) {
+	double buffer[] = { 1, 2, 3, 4, 5, 6 };
+	ConstVectorView evens(buffer, 3, 2);
+	VectorView odds(buffer + 1, 3, 2);
+
+	EXPECT_EQ(evens.size(), 3);
+	EXPECT_EQ(evens[2], 5);
+	EXPECT_EQ(evens.dot_product(odds), 2 + 12 + 30);
+	EXPECT_EQ(Vector({ 1, 1, 1 }).dot_product(evens), 9);
+
+	// Assignment writes through the view, never rebinding it.
+	odds = evens * 10;
+	EXPECT_EQ(buffer[1], 10);
+	EXPECT_EQ(buffer[5], 50);
+	EXPECT_EQ(Vector(odds - evens), Vector({ 9, 27, 45 }));
+
+	Vector v = { 3, 4 };
+	v.view() /= 5;
+	EXPECT_EQ(v.view().euclidean_length(), 1);
+	EXPECT_THROW(odds = v, std::invalid_argument);
+}
+
+TEST(Vector, expressions_of_own_views) {
+	// Operands that read the target through other strides are evaluated before it is written.
+	Vector v = { 1, 2, 3, 4 };
+	v = ConstVectorView(v.data() + 3, 4, -1) * 1.0;
+	EXPECT_EQ(v, Vector({ 4, 3, 2, 1 }));
+	Vector w = { 1, 2, 3, 4 };
+	w += ConstVectorView(w.data() + 3, 4, -1);
+	EXPECT_EQ(w, Vector({ 5, 5, 5, 5 }));
+	Vector x = { 1, 2, 3, 4 };
+	x -= ConstVectorView(x.data() + 3, 4, -1) * 2.0;
+	EXPECT_EQ(x, Vector({ -7, -4, -1, 2 }));
+	EXPECT_THROW(x -= ConstVectorView(x.data(), 2), std::invalid_argument);
+
+	// Writing through a view, and growing past storage the operand still reads.
+	Vector u = { 1, 2, 3, 4 };
+	u.view() = ConstVectorView(u.data() + 3, 4, -1);
+	EXPECT_EQ(u, Vector({ 4, 3, 2, 1 }));
+	u.view() -= ConstVectorView(u.data() + 3, 4, -1) * 2.0;
+	EXPECT_EQ(u, Vector({ 2, -1, -4, -7 }));
+	Vector grow = { 7 };
+	grow = ConstVectorView(grow.data(), 100, 0) * 1.0;
+	EXPECT_EQ(grow, Vector(std::vector<double>(100, 7)));
+
+	// The same above the length elements are split across threads at.
+	const size_t n = 100000;
+	Vector big(n);
+	for (size_t i = 0; i < n; i++) {
+		big[i] = static_cast<double>(i);
+	}
+	big += ConstVectorView(big.data() + n - 1, n, -1);
+	EXPECT_EQ(big, Vector(std::vector<double>(n, static_cast<double>(n - 1))));
+
+	// Operands laid out like the target are still evaluated in place.
+	Vector r = { 1, 2 };
+	r = r * 2.0 + r;
+	EXPECT_EQ(r, Vector({ 3, 6 }));
+}
+
+// Every instruction set must agree with the scalar reference kernels, including on the tails.
+TEST(Simd, kernels_match_scalar_reference) {
+	const SimdKernels& reference = simd_kernels(SimdLevel::Scalar);
+
+	for (const SimdLevel level : { SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512 }) {
+		const SimdKernels& kernels = simd_kernels(level);
+
+		for (size_t n = 0; n < 70; n++) {
+			std::vector<double> a(n), b(n), expected(n), actual(n);
+			for (size_t i = 0; i < n; i++) {
+				a[i] = static_cast<double>((i * 7) % 13) - 6.5;
+				b[i] = static_cast<double>((i * 5) % 11) * 0.25;
+			}
+
+			reference.add(a.data(), b.data(), expected.data(), n);
+			kernels.add(a.data(), b.data(), actual.data(), n);
+			EXPECT_EQ(actual, expected) << kernels.name;
+
+			reference.subtract(a.data(), b.data(), expected.data(), n);
+			kernels.subtract(a.data(), b.data(), actual.data(), n);
+			EXPECT_EQ(actual, expected) << kernels.name;
+
+			reference.scale(a.data(), -3.0, expected.data(), n);
+			kernels.scale(a.data(), -3.0, actual.data(), n);
+			EXPECT_EQ(actual, expected) << kernels.name;
+
+			EXPECT_NEAR(kernels.dot(a.data(), b.data(), n), reference.dot(a.data(), b.data(), n), 10e-9) << kernels.name;
+			EXPECT_NEAR(kernels.squared_distance(a.data(), b.data(), n), reference.squared_distance(a.data(), b.data(), n), 10e-9) << kernels.name;
+
+			// A single large element at the very end must be found by the tail handling.
+			std::vector<double> zeros(n, 0.0);
+			EXPECT_FALSE(kernels.any_abs_greater(zeros.data(), 0.0, n)) << kernels.name;
+			if (n > 0) {
+				zeros[n - 1] = -1.0;
+				EXPECT_TRUE(kernels.any_abs_greater(zeros.data(), 0.5, n)) << kernels.name;
+				EXPECT_FALSE(kernels.any_abs_greater(zeros.data(), 1.0, n)) << kernels.name;
+			}
+		}
+	}
+}
+
 // ------------------------ Matrix tests ----------------------------
 
+TEST(ThreadPool, parallel_for) {
+	ThreadPool pool(4);
+	EXPECT_EQ(pool.thread_count(), 4);
+
+	// Every index is visited exactly once, including from nested loops.
+	std::vector<int> visits(1000, 0);
+	pool.parallel_for(0, 10, 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			pool.parallel_for(i * 100, i * 100 + 100, 7, [&](size_t b, size_t e) {
+				for (size_t j = b; j < e; j++) {
+					visits[j]++;
+				}
+			});
+		}
+	});
+	EXPECT_TRUE(std::ranges::all_of(visits, [](int v) { return v == 1; }));
+
+	EXPECT_THROW(pool.parallel_for(0, 100, 1, [](size_t begin, size_t) {
+		if (begin == 42) {
+			throw std::invalid_argument("chunk failed");
+		}
+	}), std::invalid_argument);
+}
+
+TEST(ThreadPool, results_independent_of_thread_count) {
+	const size_t saved = get_thread_count();
+
+	Matrix A(300, 250);
+	Matrix B(270, 300);
+	Vector v(parallel_threshold * 2);
+	for (size_t r = 0; r < 250; r++) {
+		for (size_t c = 0; c < 300; c++) {
+			A(r, c) = std::sin(static_cast<double>(r * 300 + c));
+			B(c, r) = std::cos(static_cast<double>(r + c * 7));
+		}
+	}
+	for (size_t i = 0; i < v.size(); i++) {
+		v[i] = static_cast<double>(i % 101) / 7.0;
+	}
+
+	set_thread_count(1);
+	const Matrix product = A * B;
+	const Matrix transposed = A.transpose();
+	const Vector scaled = v * 3.0 + v / 5.0;
+
+	set_thread_count(5);
+	EXPECT_EQ(A * B, product);
+	EXPECT_EQ(A.transpose(), transposed);
+	EXPECT_EQ(Vector(v * 3.0 + v / 5.0), scaled);
+	EXPECT_EQ(transposed(7, 3), A(3, 7));
+
+	set_thread_count(saved);
+}
+
+TEST(Stats, counts_operations_on_this_thread) {
+	reset_stats();
+	const std::vector<double> values(100, 1.0);
+	const Vector v(values);
+	const Vector copy = v;
+	const Matrix A(40, 30), B(20, 40);
+	const Matrix C = A * B;
+	const StatsSnapshot stats = stats_snapshot();
+
+	// Compiled out by default, every counter then stays at zero.
+	if constexpr (stats_enabled) {
+		EXPECT_EQ(stats[StatsOperation::VectorConstruct].calls, 1);
+		EXPECT_EQ(stats[StatsOperation::VectorConstruct].allocations, 1);
+		EXPECT_EQ(stats[StatsOperation::VectorConstruct].bytes_copied, 800);
+		EXPECT_EQ(stats[StatsOperation::VectorCopy].calls, 1);
+		EXPECT_EQ(stats[StatsOperation::VectorCopy].bytes_copied, 800);
+
+		// The product counts its result and the gemm scratch, which gemm also counts.
+		EXPECT_EQ(stats[StatsOperation::MatrixConstruct].calls, 3);
+		EXPECT_EQ(stats[StatsOperation::MatrixMultiply].calls, 1);
+		EXPECT_EQ(stats[StatsOperation::MatrixMultiply].allocations, 2);
+		EXPECT_EQ(stats[StatsOperation::MatrixMultiply].flops, 2 * 30 * 20 * 40);
+		EXPECT_EQ(stats[StatsOperation::Gemm].calls, 1);
+		EXPECT_EQ(stats[StatsOperation::Gemm].allocations, 1);
+		EXPECT_EQ(stats[StatsOperation::Gemm].flops, 2 * 30 * 20 * 40);
+		EXPECT_EQ(stats[StatsOperation::MatrixCopy].calls, 0);
+	}
+	else {
+		for (const OperationStats& operation : stats.operations) {
+			EXPECT_EQ(operation.calls, 0);
+			EXPECT_EQ(operation.nanoseconds, 0);
+		}
+	}
+
+	reset_stats();
+	EXPECT_EQ(stats_snapshot()[StatsOperation::VectorConstruct].calls, 0);
+	EXPECT_EQ(stats_snapshot()[StatsOperation::Gemm].flops, 0);
+}
+
+TEST(Stats, copies_are_counted_with_their_storage) {
+	const Matrix M(1000, 1000);
+	const Vector v(1000000);
+	Matrix M_assigned(2);
+	Vector v_assigned(2);
+	reset_stats();
+	const Matrix M_copy = M;
+	const Vector v_copy = v;
+	const StatsSnapshot stats = stats_snapshot();
+
+	// Copying 8 MB cannot take less than 80 microseconds even at 100 GB/s, so the time must
+	// include making the storage and not just the constructor body.
+	if constexpr (stats_enabled) {
+		EXPECT_EQ(stats[StatsOperation::MatrixCopy].calls, 1);
+		EXPECT_EQ(stats[StatsOperation::MatrixCopy].bytes_copied, 8000000);
+		EXPECT_GT(stats[StatsOperation::MatrixCopy].nanoseconds, 80000);
+		EXPECT_EQ(stats[StatsOperation::VectorCopy].calls, 1);
+		EXPECT_EQ(stats[StatsOperation::VectorCopy].bytes_copied, 8000000);
+		EXPECT_GT(stats[StatsOperation::VectorCopy].nanoseconds, 80000);
+	}
+	EXPECT_EQ(M_copy, M);
+	EXPECT_EQ(v_copy, v);
+
+	// Copy assignment counts as a copy too, allocating only when the target is too small.
+	reset_stats();
+	M_assigned = M;
+	M_assigned = M;
+	v_assigned = v;
+	v_assigned = v;
+	const StatsSnapshot assigned = stats_snapshot();
+	if constexpr (stats_enabled) {
+		EXPECT_EQ(assigned[StatsOperation::MatrixCopy].calls, 2);
+		EXPECT_EQ(assigned[StatsOperation::MatrixCopy].allocations, 1);
+		EXPECT_EQ(assigned[StatsOperation::MatrixCopy].bytes_copied, 16000000);
+		EXPECT_EQ(assigned[StatsOperation::VectorCopy].calls, 2);
+		EXPECT_EQ(assigned[StatsOperation::VectorCopy].allocations, 1);
+		EXPECT_EQ(assigned[StatsOperation::VectorCopy].bytes_copied, 16000000);
+	}
+	EXPECT_EQ(M_assigned, M);
+	EXPECT_EQ(v_assigned, v);
+}
+
+TEST(Stats, process_scope_includes_exited_threads) {
+	reset_stats(StatsScope::Process);
+	std::thread([] {
+		const Vector v(std::vector<double>(50, 2.0));
+		EXPECT_EQ(v.dot_product(v), 200);
+	}).join();
+
+	// Nothing was counted on this thread.
+	EXPECT_EQ(stats_snapshot()[StatsOperation::VectorDot].calls, 0);
+	const StatsSnapshot process = stats_snapshot(StatsScope::Process);
+	EXPECT_EQ(process[StatsOperation::VectorDot].calls, stats_enabled ? 1 : 0);
+	EXPECT_EQ(process[StatsOperation::VectorDot].flops, stats_enabled ? 100 : 0);
+
+	reset_stats(StatsScope::Process);
+	EXPECT_EQ(stats_snapshot(StatsScope::Process)[StatsOperation::VectorDot].calls, 0);
+}
+
+TEST(Stats, pool_workers_retire_during_static_destruction) {
+	// Workers that counted something keep their counters until the library pool is destroyed at
+	// exit, after other statics, and must still be able to retire them then.
+	testing::GTEST_FLAG(death_test_style) = "threadsafe";
+	EXPECT_EXIT({
+		set_thread_count(4);
+		Matrix A(300, 300);
+		for (size_t r = 0; r < 300; r++) {
+			for (size_t c = 0; c < 300; c++) {
+				A(r, c) = static_cast<double>((r * 7 + c) % 13);
+			}
+		}
+		const Matrix product = A * A;
+
+		// Chunks that wait give the workers time to take some of them, even on one core.
+		default_thread_pool().parallel_for(0, 16, 1, [&product](size_t, size_t) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			const Matrix square = product * product;
+		});
+		std::exit(product(0, 0) > 0 ? 0 : 1);
+	}, testing::ExitedWithCode(0), "");
+}
+
+TEST(Stats, prometheus_and_json_dumps) {
+	StatsSnapshot stats;
+	stats.operations[static_cast<size_t>(StatsOperation::Gemm)] = { 2, 3, 64, 1000, 1500000000 };
+
+	const std::string text = stats.to_prometheus();
+	EXPECT_NE(text.find("# TYPE mathslib_calls_total counter\n"), std::string::npos);
+	EXPECT_NE(text.find("mathslib_calls_total{operation=\"gemm\"} 2\n"), std::string::npos);
+	EXPECT_NE(text.find("mathslib_allocations_total{operation=\"gemm\"} 3\n"), std::string::npos);
+	EXPECT_NE(text.find("mathslib_bytes_copied_total{operation=\"gemm\"} 64\n"), std::string::npos);
+	EXPECT_NE(text.find("mathslib_flops_total{operation=\"gemm\"} 1000\n"), std::string::npos);
+	EXPECT_NE(text.find("mathslib_seconds_total{operation=\"gemm\"} 1.5\n"), std::string::npos);
+	EXPECT_NE(text.find("mathslib_calls_total{operation=\"knn_search\"} 0\n"), std::string::npos);
+
+	const std::string json = stats.to_json();
+	EXPECT_EQ(json.find(stats_enabled ? "{\"enabled\":true," : "{\"enabled\":false,"), 0);
+	EXPECT_NE(json.find("\"gemm\":{\"calls\":2,\"allocations\":3,\"bytes_copied\":64,\"flops\":1000,\"nanoseconds\":1500000000}"), std::string::npos);
+	EXPECT_NE(json.find("\"vector_construct\":{\"calls\":0,"), std::string::npos);
+	EXPECT_EQ(json.substr(json.size() - 2), "}}");
+	EXPECT_STREQ(stats_operation_name(StatsOperation::MatrixMultiply), "matrix_multiply");
+}
+
+TEST(MemoryResource, arena_scopes_temporaries) {
+	MemoryArena arena(1024);
+	const Vector outside({ 1, 2, 3 });
+	const double* first = nullptr;
+
+	for (int request = 0; request < 3; request++) {
+		{
+			ScopedMemoryResource scope(&arena);
+			Vector a({ 1, 2, 3 });
+			Vector b = a * 2.0 + outside;
+			Matrix M(4, 4);
+
+			EXPECT_EQ(a.get_memory_resource(), &arena);
+			EXPECT_EQ(b.get_memory_resource(), &arena);
+			EXPECT_EQ(M.get_memory_resource(), &arena);
+			EXPECT_EQ(b, Vector({ 3, 6, 9 }));
+
+			// Spills into further chunks once the first one is full.
+			Vector large(1000);
+			EXPECT_EQ(large.get_memory_resource(), &arena);
+			EXPECT_GE(arena.bytes_used(), 1000 * sizeof(double));
+
+			// Every request starts again at the beginning of the same memory.
+			if (!first) {
+				first = large.data();
+			}
+			EXPECT_EQ(large.data(), first);
+		}
+		arena.reset();
+		EXPECT_EQ(arena.bytes_used(), 0);
+	}
+
+	// Outside a scope, and for copies made outside one, storage comes from the default resource.
+	EXPECT_EQ(outside.get_memory_resource(), std::pmr::get_default_resource());
+	const Vector in_arena(3, &arena);
+	EXPECT_EQ(in_arena.get_memory_resource(), &arena);
+	EXPECT_EQ(Vector(in_arena).get_memory_resource(), std::pmr::get_default_resource());
+	EXPECT_EQ(Matrix(2, 2, &arena).transpose().get_memory_resource(), &arena);
+}
+
+TEST(MemoryResource, size_class_pool_reuses_blocks) {
+	SizeClassPool pool;
+
+	// Two lengths past the inline storage in the same power of two size class.
+	const size_t n = std::bit_ceil(std::max<size_t>(VectorStorage::inline_capacity + 1, 4)) + 1;
+	const double* first = Vector(n, &pool).data();
+	const double* second = Vector(n + 1, &pool).data();
+	const size_t capacity = pool.capacity();
+
+	// The block freed last is reused first.
+	EXPECT_EQ(first, second);
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(first) % 64, 0);
+
+	{
+		ScopedMemoryResource scope(&pool);
+		for (int i = 0; i < 1000; i++) {
+			Vector v(n);
+			v[0] = 1.0;
+			Vector w = v.normalise() * 3.0;
+			EXPECT_EQ(w.get_memory_resource(), &pool);
+		}
+	}
+	EXPECT_EQ(pool.capacity(), capacity);
+
+	// Beyond the largest class allocations go to the upstream resource.
+	Vector large(SizeClassPool::max_block_size, &pool);
+	EXPECT_EQ(pool.capacity(), capacity);
+}
+
 TEST(Matrix, constructors) {
 	Matrix M0({ { 1, 3, 4, 5 }, { 6, 5, 3, 1 }, { 9, 7, 7, 4 } });
 	Matrix M1 = { { 1, 3, 4, 5 }, { 6, 5, 3, 1 }, { 9, 7, 7, 4 } };
@@ -372,6 +1065,56 @@ TEST(Matrix, constructors) {
 	}
 }
 
+TEST(Matrix, flat_storage_row_views) {
+	// Rows of differing length cannot be packed into contiguous storage.
+	EXPECT_THROW(Matrix({ { 1, 2, 3 }, { 4, 5 } }), std::invalid_argument);
+
+	Matrix M(3, 2);
+	M[1][2] = 7;
+	M[0][0] = -1;
+
+	EXPECT_EQ(M[1].size(), 3);
+	EXPECT_EQ(M[1].data(), M[0].data() + 3);
+	EXPECT_EQ(M, Matrix({ { -1, 0, 0 }, { 0, 0, 7 } }));
+	EXPECT_FALSE(M == Matrix({ { -1, 0, 0 }, { 0, 0, 8 } }));
+	EXPECT_FALSE(M == Matrix({ { -1, 0 }, { 0, 0 }, { 0, 7 } }));
+
+	// Writes through the iterator rows land in the matrix.
+	for (auto row : M) {
+		row[0] = 5;
+	}
+	EXPECT_EQ(M[0][0], 5);
+	EXPECT_EQ(M[1][0], 5);
+	EXPECT_EQ(M.end() - M.begin(), 2);
+}
+
+TEST(Matrix, zero_copy_views) {
+	Matrix M = { { 1, 2, 3 }, { 4, 5, 6 } };
+
+	// Columns are strided views, writes land in the matrix.
+	EXPECT_EQ(M.col(1), Vector({ 2, 5 }));
+	M.col(2) *= 10;
+	M.row(0) = Vector({ 7, 8, 9 });
+	EXPECT_EQ(M, Matrix({ { 7, 8, 9 }, { 4, 5, 60 } }));
+
+	// External column major memory, read without copying.
+	double buffer[] = { 1, 4, 2, 5, 3, 6 };
+	ConstMatrixView external(buffer, 2, 3, 1, 2);
+	EXPECT_EQ(external(1, 2), 6);
+	EXPECT_TRUE(external == Matrix({ { 1, 2, 3 }, { 4, 5, 6 } }));
+
+	Matrix scaled = external * 2;
+	EXPECT_EQ(scaled, Matrix({ { 2, 4, 6 }, { 8, 10, 12 } }));
+	EXPECT_EQ(Vector(external.col(1)), Vector({ 2, 5 }));
+
+	MatrixView writable(buffer, 2, 3, 1, 2);
+	writable = scaled - external;
+	EXPECT_EQ(buffer[5], 6);
+	EXPECT_EQ(buffer[2], 2);
+	EXPECT_THROW(writable = M.view() + Matrix(2, 2), std::invalid_argument);
+	EXPECT_THROW(writable = Matrix(2, 2), std::invalid_argument);
+}
+
 TEST(Matrix, transpose) {
 	Matrix M0 = { { 1, 3, 4, 5 }, { 6, 5, 3, 1 }, { 9, 7, 7, 4 } };
 	Matrix M1 = { {1, 6, 9}, {3, 5, 7}, {4, 3, 7}, {5, 1, 4} };
@@ -395,6 +1138,172 @@ TEST(Matrix, transpose) {
 
 }
 
+TEST(Matrix, blocked_transpose) {
+	// Sizes that leave partial tiles on both edges.
+	Matrix M(45, 70);
+	for (size_t r = 0; r < 70; r++) {
+		for (size_t c = 0; c < 45; c++) {
+			M(r, c) = static_cast<double>(r * 1000 + c);
+		}
+	}
+
+	const Matrix T = M.transpose();
+	EXPECT_EQ(T.get_row_count(), 45);
+	EXPECT_EQ(T.get_col_count(), 70);
+	for (size_t r = 0; r < 70; r++) {
+		for (size_t c = 0; c < 45; c++) {
+			EXPECT_EQ(T(c, r), M(r, c));
+		}
+	}
+
+	// Non-square falls back to a copy, square swaps in place without moving the storage.
+	Matrix copy = M;
+	EXPECT_EQ(copy.transpose_in_place(), T);
+
+	Matrix S(67);
+	for (size_t i = 0; i < 67 * 67; i++) {
+		S.data()[i] = static_cast<double>(i);
+	}
+	const Matrix expected = S.transpose();
+	const double* storage = S.data();
+	S.transpose_in_place();
+	EXPECT_EQ(S, expected);
+	EXPECT_EQ(S.data(), storage);
+	EXPECT_EQ(std::move(S).transpose().transpose(), expected);
+}
+
+TEST(Matrix, strided_views) {
+	Matrix M = { { 1, 2, 3, 4 }, { 5, 6, 7, 8 }, { 9, 10, 11, 12 } };
+
+	// Every view refers to the storage of M.
+	EXPECT_EQ(M.T().data(), M.data());
+	EXPECT_EQ(M.T(), M.transpose());
+	EXPECT_EQ(M.T().T(), M);
+	EXPECT_EQ(M.block(1, 1, 2, 2), Matrix({ { 6, 7 }, { 10, 11 } }));
+	EXPECT_EQ(M.row_range(1, 3), Matrix({ { 5, 6, 7, 8 }, { 9, 10, 11, 12 } }));
+	EXPECT_EQ(M.col_range(3, 4), Matrix({ { 4 }, { 8 }, { 12 } }));
+	EXPECT_EQ(M.T().block(2, 0, 2, 2), Matrix({ { 3, 7 }, { 4, 8 } }));
+	EXPECT_EQ(Vector(M.diagonal()), Vector({ 1, 6, 11 }));
+	EXPECT_EQ(Vector(M.T().diagonal()), Vector({ 1, 6, 11 }));
+	EXPECT_EQ(M.block(0, 1, 3, 3).trace(), 2 + 7 + 12);
+	EXPECT_EQ(M.block(0, 0, 0, 4).get_row_count(), 0);
+
+	EXPECT_THROW(M.block(2, 0, 2, 1), std::invalid_argument);
+	EXPECT_THROW(M.block(0, 1, 1, 4), std::invalid_argument);
+	EXPECT_THROW(M.row_range(2, 1), std::invalid_argument);
+	EXPECT_THROW(M.col_range(0, 5), std::invalid_argument);
+	EXPECT_THROW(M.T().block(0, 0, 5, 1), std::invalid_argument);
+
+	// Scalar and compound operations write only the elements in view.
+	M.block(0, 0, 2, 2) *= 10;
+	M.T().row(3) -= Vector({ 4, 8, 12 }).view();
+	M.block(1, 2, 2, 2) += M.block(0, 0, 2, 2);
+	M.diagonal() /= 2;
+	EXPECT_EQ(M, Matrix({ { 5, 20, 3, 0 }, { 50, 30, 17, 20 }, { 9, 10, 30.5, 60 } }));
+}
+
+TEST(Matrix, strided_view_products) {
+	const size_t m = 45, n = 23, k = 70;
+	Matrix A(m, k), B(n, k), big(k + 3, k + 5);
+	for (size_t p = 0; p < k; p++) {
+		for (size_t i = 0; i < m; i++) {
+			A(p, i) = static_cast<double>((p * 7 + i * 3) % 11) - 5;
+		}
+		for (size_t j = 0; j < n; j++) {
+			B(p, j) = static_cast<double>((p * 5 + j) % 13) - 6;
+		}
+	}
+	for (size_t i = 0; i < (k + 5) * (k + 3); i++) {
+		big.data()[i] = static_cast<double>(i % 17) - 8;
+	}
+
+	// A.T() * B reads A through swapped strides and matches the materialised transpose.
+	const Matrix expected = A.transpose() * B;
+	EXPECT_EQ(A.T() * B, expected);
+	EXPECT_EQ(std::as_const(A).T() * B.view(), expected);
+	EXPECT_EQ(B.T() * A, expected.transpose());
+	EXPECT_EQ(A.T() * B.T().T(), expected);
+
+	// Blocks of a larger matrix, both with a padded row stride.
+	const Matrix top = Matrix(big.block(0, 0, m, k));
+	const Matrix left = Matrix(big.block(2, 3, k, n));
+	EXPECT_EQ(big.block(0, 0, m, k) * big.block(2, 3, k, n), top * left);
+	EXPECT_THROW(A.T() * A.T(), std::invalid_argument);
+
+	// Accumulating into a block leaves the rest of C untouched.
+	Matrix C(n + 2, m + 1);
+	gemm(2.0, A.T(), B.view(), 0.0, C.block(1, 2, m, n));
+	EXPECT_EQ(Matrix(C.block(1, 2, m, n)), expected * 2);
+	EXPECT_EQ(C.row(0), Vector(n + 2));
+	EXPECT_EQ(C.col(0), Vector(m + 1));
+	EXPECT_THROW(gemm(1.0, A.T(), B.view(), 0.0, C.view()), std::invalid_argument);
+
+	const Vector x = Vector(A.col(0));
+	EXPECT_EQ(B.T() * x, B.transpose() * x);
+
+	// Assigning a matrix's own transposed view to it reads the view before the storage changes.
+	Matrix self = A;
+	self = self.T();
+	EXPECT_EQ(self, A.transpose());
+	self = self.block(1, 1, 3, 2);
+	EXPECT_EQ(self, Matrix(A.transpose().block(1, 1, 3, 2)));
+}
+
+TEST(Matrix, expressions_of_own_views) {
+	// Operands that read the target through other strides are evaluated before it is written.
+	Matrix M = { { 1, 2 }, { 3, 4 } };
+	M = M.T() * 2.0;
+	EXPECT_EQ(M, Matrix({ { 2, 6 }, { 4, 8 } }));
+	Matrix N = { { 1, 2 }, { 3, 4 } };
+	N += N.T();
+	EXPECT_EQ(N, Matrix({ { 2, 5 }, { 5, 8 } }));
+	N -= N.T() * 0.5;
+	EXPECT_EQ(N, Matrix({ { 1, 2.5 }, { 2.5, 4 } }));
+
+	// Blocks shifted either way from where the smaller result is written.
+	Matrix P = { { 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 } };
+	P = P.block(1, 1, 2, 2) - P.block(0, 0, 2, 2);
+	EXPECT_EQ(P, Matrix({ { 4, 4 }, { 4, 4 } }));
+	Matrix Q = { { 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 } };
+	Q = Q.block(0, 1, 3, 2) * 1.0;
+	EXPECT_EQ(Q, Matrix({ { 2, 3 }, { 5, 6 }, { 8, 9 } }));
+
+	// The same above the size rows are split across threads at.
+	const size_t n = 300;
+	Matrix big(n, n);
+	for (size_t i = 0; i < n * n; i++) {
+		big.data()[i] = static_cast<double>(i % 23);
+	}
+	const Matrix expected = big.transpose() * 3.0;
+	big = big.T() * 3.0;
+	EXPECT_EQ(big, expected);
+	big += big.T();
+	EXPECT_EQ(big, expected + expected.transpose());
+
+	// Operands laid out like the target are still evaluated in place.
+	Matrix R = { { 1, 2 }, { 3, 4 } };
+	R = R * 2.0 + R;
+	EXPECT_EQ(R, Matrix({ { 3, 6 }, { 9, 12 } }));
+}
+
+TEST(Matrix, view_assignment_of_own_views) {
+	Matrix A = { { 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 } };
+	const Matrix transposed = A.transpose();
+	A.view() = A.T();
+	EXPECT_EQ(A, transposed);
+	A.view() += A.T() * 1.0;
+	EXPECT_EQ(A, transposed + transposed.transpose());
+
+	// Blocks shifted forwards and backwards over each other.
+	Matrix P = { { 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 } };
+	P.block(1, 1, 2, 2) = P.block(0, 0, 2, 2);
+	EXPECT_EQ(P, Matrix({ { 1, 2, 3 }, { 4, 1, 2 }, { 7, 4, 5 } }));
+	P.block(0, 0, 2, 2) = P.block(1, 1, 2, 2);
+	EXPECT_EQ(P, Matrix({ { 1, 2, 3 }, { 4, 5, 2 }, { 7, 4, 5 } }));
+	P.block(1, 0, 2, 2) -= P.block(0, 1, 2, 2);
+	EXPECT_EQ(P, Matrix({ { 1, 2, 3 }, { 2, 2, 2 }, { 2, 2, 5 } }));
+}
+
 TEST(Matrix, matrix_equals_matrix_operator) {
 	Matrix M0 = { { 1, 3, 4, 5 }, { 6, 5, 3, 1 }, { 9, 7, 7, 4 } };
 	Matrix M1 = { { 1, 3, 4, 5 }, { 6, 5, 3, 1 }, { 9, 7, 7, 4 } };
@@ -480,6 +1389,45 @@ TEST(Matrix, matrix_multiply_matrix_operator) {
 	EXPECT_EQ(Matrix({ {1} }) * Matrix({ {1} }), Matrix({ {1} }));
 }
 
+TEST(Matrix, gemm_accumulate) {
+	// Sizes that are not multiples of the register or cache blocks exercise every edge path.
+	const size_t m = 103, n = 37, k = 300;
+	Matrix A(k, m), B(n, k), C(n, m);
+
+	for (size_t i = 0; i < m; i++) {
+		for (size_t p = 0; p < k; p++) {
+			A[i][p] = static_cast<double>((i * 7 + p * 3) % 11) - 5;
+		}
+	}
+	for (size_t p = 0; p < k; p++) {
+		for (size_t j = 0; j < n; j++) {
+			B[p][j] = static_cast<double>((p * 5 + j) % 13) - 6;
+		}
+	}
+	for (size_t i = 0; i < m; i++) {
+		for (size_t j = 0; j < n; j++) {
+			C[i][j] = static_cast<double>(i + j);
+		}
+	}
+
+	Matrix expected(C);
+	for (size_t i = 0; i < m; i++) {
+		for (size_t j = 0; j < n; j++) {
+			double sum = 0;
+			for (size_t p = 0; p < k; p++) {
+				sum += A[i][p] * B[p][j];
+			}
+			expected[i][j] = 2 * sum + 0.5 * expected[i][j];
+		}
+	}
+
+	gemm(2.0, A, B, 0.5, C);
+	EXPECT_EQ(C, expected);
+
+	Matrix wrong_shape(n, n);
+	EXPECT_THROW(gemm(1.0, A, B, 0.0, wrong_shape), std::invalid_argument);
+}
+
 TEST(Matrix, trace) {
 	Matrix M0({
 		{ 1, 3, 4, 5 },
@@ -534,6 +1482,37 @@ TEST(Matrix, unary_negation_operator) {
 	EXPECT_EQ((-M).trace(), -15);
 }
 
+TEST(Matrix, lazy_scalar_expressions) {
+	Matrix M({ { 1, 2 }, { 3, 4 } });
+
+	static_assert(!std::is_same_v<decltype(-M * 2.0), Matrix>);
+
+	Matrix result = -(M * 2.0) / 4;
+	EXPECT_EQ(result, Matrix({ { -0.5, -1 }, { -1.5, -2 } }));
+	EXPECT_EQ((M * 3).trace(), 15);
+
+	M = M * 2;
+	EXPECT_EQ(M, Matrix({ { 2, 4 }, { 6, 8 } }));
+	EXPECT_EQ(M(1, 0), 6);
+
+	// Expressions can be multiplied like any other matrix.
+	EXPECT_EQ((M / 2) * Matrix::identity(2), Matrix({ { 1, 2 }, { 3, 4 } }));
+}
+
+TEST(Matrix, compound_assignment) {
+	Matrix M({ { 1, 2 }, { 3, 4 } });
+
+	M += Matrix::identity(2);
+	M -= Matrix({ { 1, 1 }, { 1, 1 } }) * 2;
+	M *= 2;
+	M /= 4;
+	EXPECT_EQ(M, Matrix({ { 0, 0 }, { 0.5, 1.5 } }));
+	EXPECT_THROW(M += Matrix(3), std::invalid_argument);
+
+	EXPECT_EQ(M + M - M, M);
+	EXPECT_EQ(-Matrix::identity(2) * 3, Matrix({ { -3, 0 }, { 0, -3 } }));
+}
+
 TEST(Matrix, matrix_divided_constant_operator) {
 	Matrix M0({
 	{ 1, 2, 4, 4 },
@@ -565,6 +1544,827 @@ TEST(Matrix, matrix_divided_constant_operator) {
 
 }
 
+// Largest absolute element of A X - B.
+static double residual(const Matrix& A, const Matrix& X, const Matrix& B) {
+	const Matrix R = A * X - B;
+	double worst = 0.0;
+	for (size_t i = 0; i < R.get_row_count(); i++) {
+		for (size_t j = 0; j < R.get_col_count(); j++) {
+			worst = std::max(worst, std::abs(R(i, j)));
+		}
+	}
+	return worst;
+}
+
+// Pseudo random elements in [-0.5, 0.5). Sizes past the 64 column panel exercise the blocked GEMM updates.
+static Matrix test_matrix(size_t rows, size_t cols, uint64_t seed) {
+	Matrix M(cols, rows);
+	for (size_t i = 0; i < rows; i++) {
+		for (size_t j = 0; j < cols; j++) {
+			seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+			M(i, j) = static_cast<double>(seed >> 11) / 9007199254740992.0 - 0.5;
+		}
+	}
+	return M;
+}
+
+TEST(Decomposition, lu) {
+	Matrix A({
+		{ 0, 2, 1 },
+		{ 1, 1, 1 },
+		{ 2, 1, 3 }
+		});
+
+	const LUDecomposition lu(A);
+	EXPECT_FALSE(lu.is_singular());
+	EXPECT_NEAR(lu.determinant(), -3.0, 10e-12);
+	EXPECT_NEAR(A.determinant(), -3.0, 10e-12);
+
+	// P A = L U.
+	Matrix PA(3);
+	for (size_t i = 0; i < 3; i++) {
+		for (size_t j = 0; j < 3; j++) {
+			PA(i, j) = A(lu.get_permutation()[i], j);
+		}
+	}
+	EXPECT_LT(residual(lu.lower(), lu.upper(), PA), 10e-12);
+
+	const Vector x = A.solve(Vector({ 3, 3, 6 }));
+	EXPECT_NEAR(x[0], 1.0, 10e-12);
+	EXPECT_NEAR(x[1], 1.0, 10e-12);
+	EXPECT_NEAR(x[2], 1.0, 10e-12);
+	EXPECT_LT(residual(A, A.inverse(), Matrix::identity(3)), 10e-12);
+
+	const Matrix big = test_matrix(200, 200, 7);
+	const Matrix B = test_matrix(200, 37, 13);
+	const LUDecomposition big_lu(big);
+	EXPECT_LT(residual(big, big_lu.solve(B), B), 10e-9);
+	EXPECT_LT(residual(big, big_lu.inverse(), Matrix::identity(200)), 10e-9);
+
+	Matrix singular({
+		{ 1, 2 },
+		{ 2, 4 }
+		});
+	EXPECT_TRUE(LUDecomposition(singular).is_singular());
+	EXPECT_EQ(singular.determinant(), 0.0);
+	EXPECT_THROW(singular.inverse(), std::invalid_argument);
+	EXPECT_THROW(Matrix(2, 3).determinant(), std::invalid_argument);
+	EXPECT_THROW(A.solve(Vector({ 1, 2 })), std::invalid_argument);
+}
+
+TEST(Decomposition, cholesky) {
+	Matrix A({
+		{ 4, 12, -16 },
+		{ 12, 37, -43 },
+		{ -16, -43, 98 }
+		});
+
+	const CholeskyDecomposition cholesky(A);
+	Matrix L({
+		{ 2, 0, 0 },
+		{ 6, 1, 0 },
+		{ -8, 5, 3 }
+		});
+	EXPECT_EQ(cholesky.lower(), L);
+	EXPECT_NEAR(cholesky.determinant(), 36.0, 10e-9);
+	EXPECT_LT(residual(A, cholesky.inverse(), Matrix::identity(3)), 10e-9);
+
+	// G G^T + n I is symmetric positive definite.
+	const Matrix G = test_matrix(150, 150, 3);
+	Matrix spd = G * G.transpose() + Matrix::identity(150) * 150.0;
+	const Matrix B = test_matrix(150, 5, 21);
+	const CholeskyDecomposition big(spd);
+	EXPECT_LT(residual(spd, big.solve(B), B), 10e-9);
+
+	const Matrix small = test_matrix(10, 10, 5);
+	const Matrix small_spd = small * small.transpose() + Matrix::identity(10);
+	EXPECT_NEAR(CholeskyDecomposition(small_spd).determinant() / small_spd.determinant(), 1.0, 10e-9);
+
+	EXPECT_THROW(CholeskyDecomposition(Matrix({ { 1, 2 }, { 2, 1 } })), std::invalid_argument);
+}
+
+TEST(Decomposition, qr_least_squares) {
+	// Fits y = 1 + 2x exactly, then a line through noisy points.
+	Matrix A({
+		{ 1, 0 },
+		{ 1, 1 },
+		{ 1, 2 },
+		{ 1, 3 }
+		});
+	const Vector exact = A.least_squares(Vector({ 1, 3, 5, 7 }));
+	EXPECT_NEAR(exact[0], 1.0, 10e-12);
+	EXPECT_NEAR(exact[1], 2.0, 10e-12);
+
+	const Vector fit = A.least_squares(Vector({ 1, 2, 2, 4 }));
+	EXPECT_NEAR(fit[0], 0.9, 10e-12);
+	EXPECT_NEAR(fit[1], 0.9, 10e-12);
+
+	// Q has orthonormal columns, QR = A, and the residual is orthogonal to the columns of A.
+	const Matrix tall = test_matrix(300, 150, 9);
+	const Matrix B = test_matrix(300, 3, 17);
+	const QRDecomposition qr(tall);
+	const Matrix Q = qr.Q();
+	EXPECT_LT(residual(Q.transpose(), Q, Matrix::identity(150)), 10e-12);
+	EXPECT_LT(residual(Q, qr.R(), tall), 10e-12);
+	const Matrix X = qr.solve(B);
+	EXPECT_LT(residual(tall.transpose(), tall * X - B, Matrix(3, 150)), 10e-9);
+
+	// Square matrices get the exact solution and the same determinant as LU.
+	const Matrix square = test_matrix(100, 100, 4);
+	const QRDecomposition square_qr(square);
+	EXPECT_NEAR(square_qr.determinant() / square.determinant(), 1.0, 10e-9);
+	EXPECT_LT(residual(square, square_qr.inverse(), Matrix::identity(100)), 10e-9);
+
+	EXPECT_THROW(QRDecomposition(Matrix(3, 2)), std::invalid_argument);
+	EXPECT_THROW(A.least_squares(Vector({ 1, 2 })), std::invalid_argument);
+}
+
+TEST(SparseMatrix, builder_and_layouts) {
+	// Out of order triplets, a duplicate that is summed and one that cancels out.
+	SparseBuilder builder(3, 4);
+	builder.add(2, 3, 5.0);
+	builder.add(0, 1, 1.0);
+	builder.add(1, 0, 2.0);
+	builder.add(0, 1, 2.0);
+	builder.add(1, 2, 4.0);
+	builder.add(1, 2, -4.0);
+	EXPECT_EQ(builder.size(), 6);
+	EXPECT_THROW(builder.add(3, 0, 1.0), std::invalid_argument);
+
+	Matrix dense({
+		{ 0, 3, 0, 0 },
+		{ 2, 0, 0, 0 },
+		{ 0, 0, 0, 5 }
+		});
+
+	const SparseMatrix csr = builder.build();
+	const SparseMatrix csc = builder.build(SparseLayout::CSC);
+	EXPECT_EQ(csr.non_zero_count(), 3);
+	EXPECT_EQ(csr.get_offsets(), std::vector<size_t>({ 0, 1, 2, 3 }));
+	EXPECT_EQ(csr.get_indices(), std::vector<size_t>({ 1, 0, 3 }));
+	EXPECT_EQ(csc.get_offsets(), std::vector<size_t>({ 0, 1, 2, 2, 3 }));
+	EXPECT_EQ(csr(0, 1), 3.0);
+	EXPECT_EQ(csc(1, 1), 0.0);
+
+	EXPECT_EQ(csr, csc);
+	EXPECT_EQ(csr, dense);
+	EXPECT_EQ(csc.to_dense(), dense);
+	EXPECT_EQ(SparseMatrix(dense, SparseLayout::CSC), csc);
+	EXPECT_EQ(csr.to_layout(SparseLayout::CSC).get_indices(), csc.get_indices());
+	EXPECT_EQ(csr.transpose(), dense.transpose());
+	EXPECT_EQ(SparseMatrix(dense, SparseLayout::CSR, 2.5).non_zero_count(), 2);
+
+	EXPECT_EQ(csr * 0.0, SparseMatrix(3, 4));
+	EXPECT_EQ((csr - csc).non_zero_count(), 0);
+	EXPECT_EQ(csr + csc, Matrix(dense * 2.0));
+	EXPECT_EQ(dense - csc, Matrix(4, 3));
+	EXPECT_EQ(-csr, Matrix(-dense));
+
+	EXPECT_THROW(SparseMatrix(2, 2, SparseLayout::CSR, { 0, 1, 1 }, { 2 }, { 1.0 }), std::invalid_argument);
+	EXPECT_THROW(csr + SparseMatrix(4, 3), std::invalid_argument);
+}
+
+TEST(SparseMatrix, products_match_dense) {
+	const size_t saved = get_thread_count();
+
+	// Banded with some empty rows, large enough to be split across threads.
+	const size_t n = 20000;
+	SparseBuilder builder(n, n);
+	for (size_t r = 0; r < n; r++) {
+		if (r % 7 == 3) {
+			continue;
+		}
+		for (size_t c = r >= 2 ? r - 2 : 0; c < std::min(n, r + 3); c++) {
+			builder.add(r, c, std::sin(static_cast<double>(r * 5 + c)));
+		}
+	}
+	const SparseMatrix csr = builder.build();
+	const SparseMatrix csc = builder.build(SparseLayout::CSC);
+
+	Vector x(n);
+	for (size_t i = 0; i < n; i++) {
+		x[i] = std::cos(static_cast<double>(i));
+	}
+
+	set_thread_count(1);
+	const Vector y = csr * x;
+	const Vector y_csc = csc * x;
+	set_thread_count(5);
+	EXPECT_EQ(csr * x, y);
+	EXPECT_EQ(csc * x, y_csc);
+	set_thread_count(saved);
+
+	double worst = 0.0;
+	for (size_t r = 0; r < n; r++) {
+		double expected = 0.0;
+		for (size_t c = r >= 2 ? r - 2 : 0; c < std::min(n, r + 3); c++) {
+			expected += csr(r, c) * x[c];
+		}
+		EXPECT_EQ(y[r], expected);
+		worst = std::max(worst, std::abs(y_csc[r] - expected));
+	}
+	EXPECT_LT(worst, 10e-12);
+
+	// Sparse times dense both ways, against the dense product.
+	const Matrix A = test_matrix(40, 30, 3);
+	const Matrix B = test_matrix(30, 20, 8);
+	const SparseMatrix sparse_A(A, SparseLayout::CSR, 0.3);
+	const SparseMatrix sparse_B(B, SparseLayout::CSC, 0.3);
+	const Matrix dense_A = sparse_A.to_dense();
+	const Matrix dense_B = sparse_B.to_dense();
+	EXPECT_LT(residual(dense_A, B, sparse_A * B), 10e-12);
+	EXPECT_LT(residual(dense_A, B, sparse_A.to_layout(SparseLayout::CSC) * B), 10e-12);
+	EXPECT_LT(residual(A, dense_B, A * sparse_B), 10e-12);
+	EXPECT_LT(residual(A, dense_B, A * sparse_B.to_layout(SparseLayout::CSR)), 10e-12);
+
+	EXPECT_THROW(sparse_A * Vector(3), std::invalid_argument);
+	EXPECT_THROW(sparse_A * A, std::invalid_argument);
+}
+
+static std::string temp_file(const char* name) {
+	return (std::filesystem::temp_directory_path() / name).string();
+}
+
+TEST(DataFile, save_and_load) {
+	// Reference XXH64 values.
+	EXPECT_EQ(checksum("", 0), 0xEF46DB3751D8E999ULL);
+	EXPECT_EQ(checksum("abc", 3), 0x44BC2CF5AD770999ULL);
+
+	const std::string matrix_path = temp_file("mathslib_matrix.bin");
+	const std::string vector_path = temp_file("mathslib_vector.bin");
+	const Matrix M = test_matrix(37, 11, 5);
+	const Vector V = { 1.5, -2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+	save(M, matrix_path);
+	save(V, vector_path);
+
+	EXPECT_EQ(load_matrix(matrix_path), M);
+	EXPECT_EQ(load_vector(vector_path), V);
+	EXPECT_EQ(std::filesystem::file_size(matrix_path), 64 + 37 * 11 * sizeof(double));
+	EXPECT_THROW(load_vector(matrix_path), std::invalid_argument);
+	EXPECT_THROW(load_matrix(temp_file("mathslib_missing.bin")), std::runtime_error);
+
+	// Flipping one bit of one element fails the checksum, cutting the file short fails the size check.
+	{
+		std::fstream file(matrix_path, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(64 + 100);
+		file.put(static_cast<char>(1));
+	}
+	EXPECT_THROW(load_matrix(matrix_path), std::runtime_error);
+	EXPECT_NO_THROW(MappedFile{ matrix_path });
+	EXPECT_THROW(MappedFile(matrix_path, true), std::runtime_error);
+	std::filesystem::resize_file(matrix_path, 1000);
+	EXPECT_THROW(load_matrix(matrix_path), std::runtime_error);
+
+	std::filesystem::remove(matrix_path);
+	std::filesystem::remove(vector_path);
+}
+
+TEST(DataFile, mapped_views) {
+	const std::string path = temp_file("mathslib_mapped.bin");
+	const Matrix M = test_matrix(20, 30, 6);
+	save(M, path);
+
+	MappedFile file(path, true);
+	const ConstMatrixView view = file.matrix();
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(view.data()) % DataFileHeader::default_alignment, 0);
+	EXPECT_EQ(view.get_row_count(), 20);
+	EXPECT_EQ(Matrix(view), M);
+	EXPECT_EQ(Matrix(view * 2.0), Matrix(M * 2.0));
+	EXPECT_THROW(file.vector(), std::invalid_argument);
+
+	// Views stay valid when the mapping moves.
+	MappedFile moved = std::move(file);
+	EXPECT_EQ(moved.matrix()(3, 4), M(3, 4));
+
+	// A file written on a machine of the other byte order is swapped by load and rejected by a mapping.
+	{
+		std::fstream stream(path, std::ios::binary | std::ios::in | std::ios::out);
+		std::vector<char> bytes((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+		auto reverse = [&bytes](size_t offset, size_t size) {
+			std::reverse(bytes.begin() + offset, bytes.begin() + offset + size);
+		};
+		reverse(4, 2);
+		for (size_t offset = 8; offset < 16; offset += 4) {
+			reverse(offset, 4);
+		}
+		for (size_t offset = 16; offset < bytes.size(); offset += 8) {
+			reverse(offset, 8);
+		}
+		// The checksum covers the elements as stored, so it is recomputed over the swapped bytes.
+		const uint64_t swapped_checksum = checksum(bytes.data() + 64, 20 * 30 * sizeof(double));
+		std::memcpy(bytes.data() + 48, &swapped_checksum, sizeof(swapped_checksum));
+		reverse(48, 8);
+		stream.seekp(0);
+		stream.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+	}
+	EXPECT_EQ(load_matrix(path), M);
+	EXPECT_THROW(MappedFile{ path }, std::runtime_error);
+
+	std::filesystem::remove(path);
+}
+
+TEST(MatrixStream, reader_and_writer) {
+	const std::string path = temp_file("mathslib_stream.bin");
+	const Matrix M = test_matrix(50, 7, 11);
+
+	// Written in uneven blocks, including a strided view, and read back whole and in blocks.
+	{
+		MatrixWriter writer(path, 7);
+		writer.write_rows(M.data(), 20);
+		writer.write_rows(ConstMatrixView(M.data() + 20 * 7, 30, 7, 7));
+		EXPECT_EQ(writer.get_row_count(), 50);
+		EXPECT_THROW(writer.write_rows(Matrix(3, 2).view()), std::invalid_argument);
+		writer.finish();
+	}
+	EXPECT_EQ(load_matrix(path), M);
+
+	// A writer destroyed before finish() leaves no file behind.
+	{
+		MatrixWriter writer(path + ".partial", 7);
+		writer.write_rows(M.data(), 20);
+	}
+	EXPECT_FALSE(std::filesystem::exists(path + ".partial"));
+
+	MatrixReader reader(path);
+	EXPECT_EQ(reader.get_row_count(), 50);
+	std::vector<double> rows(16 * 7);
+	size_t total = 0;
+	while (const size_t count = reader.read_rows(rows.data(), 16)) {
+		EXPECT_TRUE(std::equal(rows.begin(), rows.begin() + count * 7, M.data() + total * 7));
+		total += count;
+	}
+	EXPECT_EQ(total, 50);
+	EXPECT_THROW(reader.read_rows(1), std::invalid_argument);
+
+	std::vector<double> block(3 * 2);
+	reader.read_block(10, 4, 3, 2, block.data());
+	EXPECT_EQ(block[0], M(10, 4));
+	EXPECT_EQ(block[5], M(12, 5));
+	EXPECT_THROW(reader.read_block(49, 0, 2, 1, block.data()), std::invalid_argument);
+
+	reader.seek_row(45);
+	EXPECT_EQ(reader.read_rows(10), Matrix(ConstMatrixView(M.data() + 45 * 7, 5, 7, 7)));
+
+	// Sequential reads check the checksum when they reach the end.
+	{
+		std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(64 + 8 * 100);
+		file.put(static_cast<char>(1));
+	}
+	MatrixReader corrupted(path);
+	EXPECT_NO_THROW(corrupted.read_rows(25));
+	EXPECT_THROW(corrupted.read_rows(25), std::runtime_error);
+
+	std::filesystem::remove(path);
+}
+
+TEST(MatrixStream, out_of_core_operations) {
+	const std::string a_path = temp_file("mathslib_stream_a.bin");
+	const std::string b_path = temp_file("mathslib_stream_b.bin");
+	const std::string out_path = temp_file("mathslib_stream_out.bin");
+	const Matrix A = test_matrix(90, 70, 21);
+	const Matrix B = test_matrix(70, 40, 22);
+	Vector x(70);
+	for (size_t i = 0; i < 70; i++) {
+		x[i] = std::sin(static_cast<double>(i));
+	}
+	save(A, a_path);
+	save(B, b_path);
+
+	// Budgets small enough for many blocks, and the default one that holds everything.
+	for (const size_t budget : { size_t{ 4096 }, size_t{ 20000 }, default_stream_budget }) {
+		out_of_core_transpose(a_path, out_path, budget);
+		EXPECT_EQ(load_matrix(out_path), A.transpose());
+
+		EXPECT_EQ(A * x, out_of_core_multiply(a_path, x, budget));
+
+		out_of_core_multiply(a_path, b_path, out_path, budget);
+		EXPECT_LT(residual(A, B, load_matrix(out_path)), 10e-12);
+	}
+
+	EXPECT_THROW(out_of_core_multiply(a_path, Vector(3), 4096), std::invalid_argument);
+	EXPECT_THROW(out_of_core_multiply(a_path, a_path, out_path, 4096), std::invalid_argument);
+
+	// A checksum mismatch found with the last block of A aborts the product after earlier blocks
+	// were written, and the partial output is removed rather than left looking complete.
+	{
+		std::fstream file(a_path, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(64 + 8 * (90 * 70 - 1));
+		file.put(static_cast<char>(1));
+	}
+	EXPECT_THROW(out_of_core_multiply(a_path, b_path, out_path, 4096), std::runtime_error);
+	EXPECT_FALSE(std::filesystem::exists(out_path));
+	EXPECT_THROW(load_matrix(out_path), std::runtime_error);
+	EXPECT_THROW(out_of_core_transpose(a_path, out_path, 4096), std::runtime_error);
+	EXPECT_FALSE(std::filesystem::exists(out_path));
+	EXPECT_THROW(out_of_core_transpose(a_path, out_path), std::runtime_error);
+	EXPECT_FALSE(std::filesystem::exists(out_path));
+
+	std::filesystem::remove(a_path);
+	std::filesystem::remove(b_path);
+	std::filesystem::remove(out_path);
+}
+
+TEST(TextIO, parse_and_format) {
+	// Spaces around delimiters, a leading plus, CRLF line ends and a trailing blank line.
+	const Matrix M = parse_matrix("x,y,z\r\n1, 2.5 ,-3\r\n+4,5e-3,6\r\n\r\n", ',', 1);
+	EXPECT_EQ(M, Matrix({ { 1, 2.5, -3 }, { 4, 5e-3, 6 } }));
+	EXPECT_EQ(parse_matrix("1 \t 2\n3  4", ' '), parse_matrix("1,2\n3,4"));
+	EXPECT_EQ(parse_matrix("1\t2\n3\t4", '\t'), Matrix({ { 1, 2 }, { 3, 4 } }));
+	EXPECT_EQ(parse_vector("1,2\n3\n\n4,5\n"), Vector({ 1, 2, 3, 4, 5 }));
+
+	// Parsing into existing storage, here the transposed view of a matrix.
+	Matrix target(3, 2);
+	parse_matrix("1,2\n3,4\n5,6", MatrixView(target.data(), 3, 2, 1, 3));
+	EXPECT_EQ(target, Matrix({ { 1, 3, 5 }, { 2, 4, 6 } }));
+	EXPECT_THROW(parse_matrix("1,2\n3,4", target.view()), std::invalid_argument);
+
+	// Errors name the line, counting skipped ones.
+	try {
+		parse_matrix("a,b\n1,2\n3,x\n", ',', 1);
+		FAIL();
+	}
+	catch (const std::invalid_argument& error) {
+		EXPECT_EQ(std::string(error.what()).rfind("Line 3:", 0), 0);
+	}
+	EXPECT_THROW(parse_matrix("1,2\n3,4,5"), std::invalid_argument);
+	EXPECT_THROW(parse_matrix("1,2\n3"), std::invalid_argument);
+	EXPECT_THROW(parse_matrix("1,2,\n3,4"), std::invalid_argument);
+	EXPECT_THROW(parse_matrix("1 2\n3;4", ' '), std::invalid_argument);
+	EXPECT_THROW(parse_vector("1,,2"), std::invalid_argument);
+
+	// Shortest round trip formatting.
+	EXPECT_EQ(format_matrix(Matrix({ { 0.1, -2 }, { 1e300, 0.5 } }).view()), "0.1,-2\n1e+300,0.5\n");
+	EXPECT_EQ(format_vector(Vector({ 1, 2.25 }).view(), ' '), "1 2.25\n");
+	const Matrix random = test_matrix(40, 9, 31) * 1e-7;
+	EXPECT_EQ(parse_matrix(format_matrix(random.view())), random);
+	EXPECT_EQ(parse_matrix(format_matrix(random.view(), ' '), ' '), random);
+
+	testing::internal::CaptureStdout();
+	Matrix({ { 1, 2 }, { 3, 4 } }).print();
+	Vector({ 0.5, 1 }).print();
+	EXPECT_EQ(testing::internal::GetCapturedStdout(), "1 2\n3 4\n\n0.5 1\n\n");
+}
+
+TEST(TextIO, large_files_in_chunks) {
+	const size_t saved = get_thread_count();
+	const std::string path = temp_file("mathslib_text.csv");
+
+	// Several megabytes of text, so parsing and formatting split into many chunks.
+	const Matrix M = test_matrix(20000, 12, 41);
+	set_thread_count(1);
+	write_csv(path, M.view());
+	const std::string text = format_matrix(M.view());
+	EXPECT_GT(text.size(), size_t{ 4 } << 20);
+
+	set_thread_count(5);
+	EXPECT_EQ(format_matrix(M.view()), text);
+	EXPECT_EQ(read_csv(path), M);
+	const Vector all = parse_vector(text);
+	EXPECT_EQ(all.size(), 20000 * 12);
+	EXPECT_TRUE(std::equal(all.begin(), all.end(), M.data()));
+
+	// An error deep in the text reports its own line.
+	std::string broken = text;
+	broken[broken.find('\n', 3000000) + 1] = 'q';
+	try {
+		parse_matrix(broken);
+		FAIL();
+	}
+	catch (const std::invalid_argument& error) {
+		const size_t line = static_cast<size_t>(std::count(broken.begin(), broken.begin() + broken.find('q'), '\n')) + 1;
+		EXPECT_EQ(std::string(error.what()).rfind("Line " + std::to_string(line) + ":", 0), 0);
+	}
+
+	set_thread_count(saved);
+	std::filesystem::remove(path);
+}
+
+TEST(ReducedPrecision, conversions) {
+	// Ties round to the even mantissa, 7 bits below the leading one.
+	EXPECT_EQ(bfloat16(1.0f).bits, 0x3F80);
+	EXPECT_EQ(static_cast<float>(bfloat16(1.0f + 0x1p-8f)), 1.0f);
+	EXPECT_EQ(static_cast<float>(bfloat16(1.0f + 0x3p-8f)), 1.0f + 0x1p-6f);
+
+	// Through float the sticky bit would be lost and the tie rounded down.
+	EXPECT_EQ(static_cast<double>(bfloat16(1.0 + 0x1p-8 + 0x1p-40)), 1.0 + 0x1p-7);
+	EXPECT_EQ(static_cast<double>(bfloat16(-1.0 - 0x1p-8 - 0x1p-40)), -1.0 - 0x1p-7);
+	EXPECT_EQ(static_cast<double>(bfloat16(1e300)), std::numeric_limits<double>::infinity());
+	EXPECT_EQ(static_cast<float>(bfloat16(3.4e38f)), std::numeric_limits<float>::infinity());
+	EXPECT_TRUE(std::isnan(static_cast<float>(bfloat16(std::numeric_limits<float>::quiet_NaN()))));
+	EXPECT_EQ(bfloat16(0.0f), bfloat16(-0.0f));
+
+	const Vector v = { 0.1, -2.5, 1e-3 };
+	const Vector from_float = VectorF(v).to_vector();
+	EXPECT_EQ(from_float[0], static_cast<double>(0.1f));
+	EXPECT_EQ(from_float[1], -2.5);
+	EXPECT_EQ(VectorBF16(VectorF(v)), VectorBF16(v));
+	EXPECT_EQ(VectorF(VectorBF16{ 1.5f, -3.0f }), (VectorF{ 1.5f, -3.0f }));
+
+	// Values with few significant bits survive every round trip exactly.
+	const Matrix M = { { 1, -2, 0.5 }, { 3.25, 0, 96 } };
+	EXPECT_EQ(MatrixBF16(M).to_matrix(), M);
+	EXPECT_EQ(MatrixF(MatrixBF16(M)).to_matrix(), M);
+	EXPECT_EQ(MatrixBF16(M).get_row_count(), 2);
+	EXPECT_THROW(MatrixF(0, 3), std::invalid_argument);
+
+	// Sized from columns then rows, like Matrix.
+	EXPECT_EQ(MatrixF(3, 2).get_row_count(), Matrix(3, 2).get_row_count());
+	EXPECT_EQ(MatrixF(3, 2).get_col_count(), Matrix(3, 2).get_col_count());
+	EXPECT_EQ(MatrixF(3, 2).to_matrix(), Matrix(3, 2));
+}
+
+TEST(ReducedPrecision, kernels_and_products) {
+	// Small multiples of 0.25 are exact in bfloat16 and every partial sum is exact in float, so
+	// each instruction set must match the double result exactly.
+	for (const SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512 }) {
+		const SimdKernels& kernels = simd_kernels(level);
+
+		for (size_t n = 0; n < 140; n++) {
+			std::vector<double> a(n), b(n);
+			for (size_t i = 0; i < n; i++) {
+				a[i] = static_cast<double>((i * 7) % 13) - 6.5;
+				b[i] = static_cast<double>((i * 5) % 11) * 0.25;
+			}
+			std::vector<float> af(n), bf(n);
+			std::vector<bfloat16> ah(n), bh(n);
+			convert(a.data(), af.data(), n);
+			convert(b.data(), bf.data(), n);
+			convert(a.data(), ah.data(), n);
+			convert(b.data(), bh.data(), n);
+
+			const double dot = simd_kernels(SimdLevel::Scalar).dot(a.data(), b.data(), n);
+			const double distance = simd_kernels(SimdLevel::Scalar).squared_distance(a.data(), b.data(), n);
+			EXPECT_EQ(kernels.dot_float(af.data(), bf.data(), n), dot) << kernels.name << " " << n;
+			EXPECT_EQ(kernels.dot_bf16(ah.data(), bh.data(), n), dot) << kernels.name << " " << n;
+			EXPECT_EQ(kernels.squared_distance_float(af.data(), bf.data(), n), distance) << kernels.name << " " << n;
+			EXPECT_EQ(kernels.squared_distance_bf16(ah.data(), bh.data(), n), distance) << kernels.name << " " << n;
+		}
+	}
+
+	// Integer valued operands past one register tile and one cache block of k.
+	Matrix A(300, 37), B(29, 300);
+	for (size_t r = 0; r < A.get_row_count(); r++) {
+		for (size_t c = 0; c < A.get_col_count(); c++) {
+			A(r, c) = static_cast<double>((r * 3 + c * 7) % 9) - 4;
+		}
+	}
+	for (size_t r = 0; r < B.get_row_count(); r++) {
+		for (size_t c = 0; c < B.get_col_count(); c++) {
+			B(r, c) = static_cast<double>((r * 5 + c) % 7) - 3;
+		}
+	}
+	const Matrix expected = A * B;
+	EXPECT_EQ((MatrixF(A) * MatrixF(B)).to_matrix(), expected);
+	EXPECT_EQ((MatrixBF16(A) * MatrixBF16(B)).to_matrix(), expected);
+	EXPECT_THROW(MatrixF(A) * MatrixF(A), std::invalid_argument);
+
+	Vector x(300);
+	for (size_t i = 0; i < x.size(); i++) {
+		x[i] = static_cast<double>(i % 5) - 2;
+	}
+	EXPECT_EQ((MatrixBF16(A) * VectorBF16(x)).to_vector(), A * x);
+	EXPECT_FLOAT_EQ(VectorF(x).distance(VectorF(x.normalise())), static_cast<float>(x.distance(x.normalise())));
+}
+
+// Every distance computed directly, ordered by distance then index.
+static std::vector<std::pair<double, size_t>> naive_neighbours(const Matrix& points, ConstVectorView query, DistanceMetric metric) {
+	std::vector<std::pair<double, size_t>> all;
+	for (size_t p = 0; p < points.get_row_count(); p++) {
+		const ConstVectorView point = points.view().row(p);
+		double distance = 0.0;
+		if (metric == DistanceMetric::L2) {
+			distance = (Vector(point) - Vector(query)).euclidean_length();
+		}
+		else if (metric == DistanceMetric::Cosine) {
+			distance = 1.0 - point.dot_product(query) / (point.euclidean_length() * query.euclidean_length());
+		}
+		else {
+			distance = -point.dot_product(query);
+		}
+		all.emplace_back(distance, p);
+	}
+	std::sort(all.begin(), all.end());
+	return all;
+}
+
+TEST(NearestNeighbours, brute_force_metrics) {
+	// Three blocks of points, the last one partial, and two blocks of queries.
+	const Matrix points = test_matrix(2500, 7, 41);
+	const Matrix queries = test_matrix(70, 7, 43);
+
+	for (const DistanceMetric metric : { DistanceMetric::L2, DistanceMetric::Cosine, DistanceMetric::Dot }) {
+		const BruteForceIndex index(points.view(), metric);
+		const KnnResult result = index.search(queries.view(), 5);
+		ASSERT_EQ(result.query_count, 70);
+		ASSERT_EQ(result.k, 5);
+
+		for (size_t q = 0; q < queries.get_row_count(); q++) {
+			const auto expected = naive_neighbours(points, queries.view().row(q), metric);
+			for (size_t rank = 0; rank < 5; rank++) {
+				EXPECT_EQ(result.index(q, rank), expected[rank].second);
+				EXPECT_NEAR(result.distance(q, rank), expected[rank].first, 1e-9);
+			}
+		}
+
+		const KnnResult single = index.search(queries.view().row(3), 5);
+		EXPECT_EQ(single.indices, std::vector<size_t>(result.indices.begin() + 15, result.indices.begin() + 20));
+	}
+
+	// k is clamped, ties go to the lower index, zero vectors are at cosine distance 1.
+	const Matrix same = { { 1, 1 }, { 1, 1 }, { 1, 1 }, { 0, 0 } };
+	const KnnResult ties = BruteForceIndex(same.view()).search(Vector({ 1, 1 }).view(), 10);
+	EXPECT_EQ(ties.k, 4);
+	EXPECT_EQ(ties.indices, std::vector<size_t>({ 0, 1, 2, 3 }));
+	EXPECT_EQ(BruteForceIndex(same.view(), DistanceMetric::Cosine).search(Vector({ 1, 1 }).view(), 4).distance(0, 3), 1.0);
+	EXPECT_THROW(BruteForceIndex(same.view()).search(queries.view(), 1), std::invalid_argument);
+}
+
+TEST(NearestNeighbours, kd_tree_matches_brute_force) {
+	const Matrix points = test_matrix(3000, 3, 47);
+	const Matrix queries = test_matrix(100, 3, 53);
+
+	const KdTree tree(points.view());
+	const KnnResult expected = BruteForceIndex(points.view()).search(queries.view(), 8);
+	const KnnResult actual = tree.search(queries.view(), 8);
+	EXPECT_EQ(actual.indices, expected.indices);
+	for (size_t i = 0; i < actual.distances.size(); i++) {
+		EXPECT_NEAR(actual.distances[i], expected.distances[i], 1e-9);
+	}
+
+	// Points exactly on splitting planes, and every point a duplicate of another.
+	Matrix grid(2, 200);
+	for (size_t i = 0; i < 200; i++) {
+		grid(i, 0) = static_cast<double>(i % 10);
+		grid(i, 1) = static_cast<double>(i / 20);
+	}
+	const KnnResult on_grid = KdTree(grid.view(), 4).search(Vector({ 3, 4 }).view(), 3);
+	EXPECT_EQ(on_grid.indices, std::vector<size_t>({ 83, 93, 63 }));
+	EXPECT_EQ(on_grid.distance(0, 0), 0.0);
+	EXPECT_EQ(on_grid.distance(0, 2), 1.0);
+
+	EXPECT_EQ(KdTree(grid.view()).search(grid.view(), 1).indices[150], 150 - 10 * ((150 / 10) % 2));
+	EXPECT_THROW(tree.search(Vector({ 1, 2 }).view(), 1), std::invalid_argument);
+}
+
+TEST(Bvh, primitive_queries) {
+	const Ray3d ray{ { 0, 0, -5 }, { 0, 0, 2 } };
+
+	EXPECT_DOUBLE_EQ(Primitive::sphere(Vec3d{ 0, 0, 0 }, 1).hit(ray), 2);
+	EXPECT_DOUBLE_EQ(Primitive::sphere(Vec3d{ 0, 0, -5 }, 1).hit(ray), 0.5);
+	EXPECT_DOUBLE_EQ(Primitive::sphere(Vec3d{ 3, 0, 0 }, 1).distance(ray), 2);
+	EXPECT_DOUBLE_EQ(Primitive::sphere(Vec3d{ 0, 0, -9 }, 1).distance(ray), 3);
+
+	EXPECT_DOUBLE_EQ(Primitive::box(Vec3d{ 1, 1, 1 }, Vec3d{ -1, -1, -1 }).hit(ray), 2);
+	EXPECT_DOUBLE_EQ(Primitive::box(Vec3d{ 1, 1, -6 }, Vec3d{ -1, -1, -4 }).hit(ray), 0.5);
+	EXPECT_DOUBLE_EQ(Primitive::box(Vec3d{ 2, 3, 0 }, Vec3d{ 4, 7, 1 }).distance(ray), std::sqrt(13.0));
+	EXPECT_EQ(Primitive::box(Vec3d{ 2, 3, 0 }, Vec3d{ 4, 7, 1 }).hit(ray), std::numeric_limits<double>::infinity());
+
+	const Primitive triangle = Primitive::triangle(Vector({ -1, -1, 1 }), Vector({ 3, -1, 1 }), Vector({ -1, 3, 1 }));
+	EXPECT_DOUBLE_EQ(triangle.hit(ray), 3);
+	EXPECT_EQ(triangle.distance(ray), 0);
+	EXPECT_DOUBLE_EQ(triangle.distance(Ray3d{ { 4, 4, -5 }, { 0, 0, 1 } }), std::sqrt(18.0));
+	EXPECT_DOUBLE_EQ(triangle.distance(Ray3d{ { 0, 0, 3 }, { 0, 0, 1 } }), 2);
+
+	// Segments have no surface to hit, only a distance.
+	const Primitive segment = Primitive::segment(Vector({ 1, -4, 0 }), Vector({ 1, 4, 0 }));
+	EXPECT_EQ(segment.hit(ray), std::numeric_limits<double>::infinity());
+	EXPECT_DOUBLE_EQ(segment.distance(ray), 1);
+	EXPECT_DOUBLE_EQ(segment.distance(Ray3d{ { 0, 0, 2 }, { 0, 0, 1 } }), std::sqrt(5.0));
+	EXPECT_DOUBLE_EQ(segment.distance(Ray3d{ { 0, -9, 0 }, { 0, 1, 0 } }), 1);
+
+	EXPECT_THROW(Primitive::sphere(Vector({ 0, 0 }), 1), std::invalid_argument);
+	EXPECT_THROW(Primitive::sphere(Vec3d{ 0, 0, 0 }, -1), std::invalid_argument);
+	EXPECT_THROW(Bvh({}, 0), std::invalid_argument);
+}
+
+// A mix of every kind of primitive scattered through a cube of side 20.
+static std::vector<Primitive> test_scene(size_t n, uint64_t seed) {
+	const Matrix values = test_matrix(n, 9, seed);
+	std::vector<Primitive> scene;
+	for (size_t i = 0; i < n; i++) {
+		const Vec3d centre{ values(i, 0) * 20, values(i, 1) * 20, values(i, 2) * 20 };
+		const Vec3d offset{ values(i, 3), values(i, 4), values(i, 5) };
+		const Vec3d other{ values(i, 6), values(i, 7), values(i, 8) };
+		switch (i % 4) {
+		case 0:
+			scene.push_back(Primitive::segment(centre - offset, centre + offset));
+			break;
+		case 1:
+			scene.push_back(Primitive::sphere(centre, std::abs(values(i, 3)) * 0.5));
+			break;
+		case 2:
+			scene.push_back(Primitive::box(centre - offset * 0.5, centre + offset * 0.5));
+			break;
+		default:
+			scene.push_back(Primitive::triangle(centre, centre + offset, centre + other));
+		}
+	}
+	return scene;
+}
+
+static RayBatch test_rays(size_t n, uint64_t seed) {
+	const Matrix values = test_matrix(n, 6, seed);
+	RayBatch rays;
+	for (size_t i = 0; i < n; i++) {
+		Ray3d ray{ { values(i, 0) * 30, values(i, 1) * 30, values(i, 2) * 30 }, { values(i, 3), values(i, 4), values(i, 5) } };
+		// Rays along the axes exercise the zero direction components of the box test.
+		if (i % 5 == 0) {
+			ray.direction[1] = 0;
+		}
+		if (i % 7 == 0) {
+			ray.direction = Vec3d{ 0, 0, i % 2 == 0 ? 1.0 : -1.0 };
+		}
+		rays.push_back(ray);
+	}
+	return rays;
+}
+
+static void expect_matches_brute_force(const Bvh& bvh, const RayBatch& rays) {
+	const std::vector<RayHit> hits = bvh.intersect(rays);
+	const std::vector<RayApproach> approaches = bvh.nearest_approach(rays);
+	ASSERT_EQ(hits.size(), rays.size());
+	ASSERT_EQ(approaches.size(), rays.size());
+
+	for (size_t i = 0; i < rays.size(); i++) {
+		RayHit hit;
+		RayApproach approach;
+		for (size_t p = 0; p < bvh.size(); p++) {
+			const double t = bvh[p].hit(rays[i]);
+			if (t < hit.t) {
+				hit = { p, t };
+			}
+			const double distance = bvh[p].distance(rays[i]);
+			if (distance < approach.distance) {
+				approach = { p, distance };
+			}
+		}
+
+		EXPECT_EQ(hits[i].primitive, hit.primitive);
+		EXPECT_EQ(hits[i].t, hit.t);
+		EXPECT_EQ(approaches[i].primitive, approach.primitive);
+		EXPECT_EQ(approaches[i].distance, approach.distance);
+	}
+}
+
+TEST(Bvh, matches_brute_force) {
+	const std::vector<Primitive> scene = test_scene(3000, 51);
+	const Bvh bvh(scene);
+	const RayBatch rays = test_rays(203, 53);
+	ASSERT_EQ(bvh.size(), scene.size());
+	EXPECT_EQ(bvh[17].a, scene[17].a);
+	EXPECT_EQ(bvh.nodes()[0].count, 0u);
+
+	expect_matches_brute_force(bvh, rays);
+
+	size_t hit_count = 0;
+	for (size_t i = 0; i < rays.size(); i++) {
+		const RayHit hit = bvh.intersect(rays[i]);
+		EXPECT_EQ(hit.primitive, bvh.intersect(rays).at(i).primitive);
+		hit_count += hit.primitive != RayHit::npos;
+	}
+	EXPECT_GT(hit_count, 0u);
+	EXPECT_LT(hit_count, rays.size());
+
+	const Ray ray(Vector({ 0, 0, -30 }), Vector({ 0, 0, 1 }));
+	EXPECT_EQ(bvh.nearest_approach(ray).distance, bvh.nearest_approach(Ray3d{ { 0, 0, -30 }, { 0, 0, 1 } }).distance);
+
+	// A single leaf and an empty scene.
+	expect_matches_brute_force(Bvh(test_scene(3, 55)), rays);
+	const Bvh empty({});
+	EXPECT_EQ(empty.intersect(rays[0]).primitive, RayHit::npos);
+	EXPECT_EQ(empty.nearest_approach(rays).size(), rays.size());
+}
+
+TEST(Bvh, refit_after_updates) {
+	std::vector<Primitive> scene = test_scene(2000, 57);
+	Bvh bvh(scene);
+	const RayBatch rays = test_rays(64, 59);
+
+	// Moves a quarter of the scene well outside the bounds it was built with.
+	const std::vector<Primitive> moved = test_scene(500, 61);
+	for (size_t i = 0; i < moved.size(); i++) {
+		Primitive primitive = moved[i];
+		primitive.a = primitive.a * 2;
+		primitive.b = primitive.b * 2;
+		bvh.update(i * 4 + 1, primitive);
+	}
+	EXPECT_THROW(bvh.intersect(rays), std::logic_error);
+	EXPECT_THROW(bvh.update(2000, moved[0]), std::invalid_argument);
+
+	bvh.refit();
+	expect_matches_brute_force(bvh, rays);
+
+	const Aabb& root = bvh.nodes()[0].bounds;
+	for (size_t i = 0; i < bvh.size(); i++) {
+		const Aabb bounds = bvh[i].bounds();
+		for (size_t axis = 0; axis < 3; axis++) {
+			EXPECT_LE(root.min[axis], bounds.min[axis]);
+			EXPECT_GE(root.max[axis], bounds.max[axis]);
+		}
+	}
+}
+
 
 int main(int argc, char* argv[]) {
 	testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,69 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+
+// Brain floating point: the sign, the 8 bit exponent and the top 7 mantissa bits of a float.
+//
+// It covers the same range as float with about 3 significant digits, so storing data as
+// bfloat16 halves the memory traffic of float and quarters that of double. Arithmetic is done by
+// widening to float, which is exact.
+//
+// Narrowing rounds to nearest with ties to even, overflows to infinity and keeps NaN a NaN.
+// Both conversions are explicit so a loss of precision is always visible at the call site.
+struct bfloat16 {
+	uint16_t bits = 0;
+
+	constexpr bfloat16() noexcept = default;
+
+	constexpr explicit bfloat16(float value) noexcept : bits{ from_float(value) } {}
+
+	// Rounds once, straight from the double, so there is no double rounding through float.
+	constexpr explicit bfloat16(double value) noexcept : bits{ from_float(round_to_odd(value)) } {}
+
+	constexpr explicit operator float() const noexcept {
+		return std::bit_cast<float>(static_cast<uint32_t>(bits) << 16);
+	}
+
+	constexpr explicit operator double() const noexcept {
+		return static_cast<double>(static_cast<float>(*this));
+	}
+
+	static constexpr bfloat16 from_bits(uint16_t bits) noexcept {
+		bfloat16 result;
+		result.bits = bits;
+		return result;
+	}
+
+	// Compares the values like float does, so +0 equals -0 and NaN equals nothing.
+	friend constexpr bool operator==(bfloat16 a, bfloat16 b) noexcept {
+		return static_cast<float>(a) == static_cast<float>(b);
+	}
+
+	static constexpr uint16_t from_float(float value) noexcept {
+		const uint32_t x = std::bit_cast<uint32_t>(value);
+		if ((x & 0x7FFFFFFFu) > 0x7F800000u) {
+			// Quiet the NaN so truncating its payload cannot turn it into an infinity.
+			return static_cast<uint16_t>((x >> 16) | 0x0040u);
+		}
+		return static_cast<uint16_t>((x + 0x7FFFu + ((x >> 16) & 1u)) >> 16);
+	}
+
+	// The float nearest the double rounded toward zero, with its lowest bit set when that lost
+	// anything. Rounding this float to bfloat16 gives the correctly rounded double.
+	static constexpr float round_to_odd(double value) noexcept {
+		float f = static_cast<float>(value);
+		if (static_cast<double>(f) == value || value != value) {
+			return f;
+		}
+
+		uint32_t x = std::bit_cast<uint32_t>(f);
+		if ((x & 0x7FFFFFFFu) == 0x7F800000u) {
+			// Finite doubles past the float range, the largest float keeps them above bfloat16's.
+			x = (x & 0x80000000u) | 0x7F7FFFFFu;
+		}
+		else if ((f < 0 ? -static_cast<double>(f) : static_cast<double>(f)) > (value < 0 ? -value : value)) {
+			x--;
+		}
+		return std::bit_cast<float>(x | 1u);
+	}
+};
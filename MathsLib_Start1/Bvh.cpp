@@ -0,0 +1,1068 @@
+#include "Bvh.h"
+#include "Simd.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+
+#ifdef MATHSLIB_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+	constexpr double infinity = std::numeric_limits<double>::infinity();
+	constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+	// Centroids are binned along each axis to evaluate the surface area heuristic.
+	constexpr size_t bin_count = 16;
+
+	// Ranges of at least this many primitives are binned in parallel chunks of this size, and
+	// build their two subtrees as separate tasks.
+	constexpr size_t parallel_build_size = size_t{ 1 } << 12;
+
+	// Rays per packet, and packets per traversal task.
+	constexpr size_t packet_width = 8;
+	constexpr size_t packet_grain = 16;
+
+	// --------- Geometry. ---------
+
+	Vec3d component_min(const Vec3d& a, const Vec3d& b) noexcept {
+		return Vec3d{ std::min(a[0], b[0]), std::min(a[1], b[1]), std::min(a[2], b[2]) };
+	}
+
+	Vec3d component_max(const Vec3d& a, const Vec3d& b) noexcept {
+		return Vec3d{ std::max(a[0], b[0]), std::max(a[1], b[1]), std::max(a[2], b[2]) };
+	}
+
+	// Node bounds are widened by a few ulps so rounding in the traversal's box test, or a ray
+	// lying exactly in a face's plane, cannot cull a primitive touching the face.
+	Aabb padded(Aabb box) noexcept {
+		for (size_t axis = 0; axis < 3; axis++) {
+			const double margin = (std::abs(box.min[axis]) + std::abs(box.max[axis])) * 1e-12 + 1e-300;
+			box.min[axis] -= margin;
+			box.max[axis] += margin;
+		}
+		return box;
+	}
+
+	// Squared distance between the ray and the segment from a to b. The closest points of two
+	// segments, with the ray's parameter s unbounded above and the segment's t in [0, 1].
+	double ray_segment_squared_distance(const Ray3d& ray, const Vec3d& a, const Vec3d& b) noexcept {
+		const Vec3d& d1 = ray.direction;
+		const Vec3d d2 = b - a;
+		const Vec3d r = ray.position - a;
+		const double aa = d1.squared_length();
+		const double ee = d2.squared_length();
+		const double f = d2.dot_product(r);
+
+		double s = 0;
+		double t = 0;
+		if (aa == 0) {
+			t = ee > 0 ? std::clamp(f / ee, 0.0, 1.0) : 0.0;
+		}
+		else {
+			const double c = d1.dot_product(r);
+			if (ee == 0) {
+				s = std::max(-c / aa, 0.0);
+			}
+			else {
+				// Parallel lines start from the ray's position.
+				const double bb = d1.dot_product(d2);
+				const double denominator = aa * ee - bb * bb;
+				if (denominator > 0) {
+					s = std::max((bb * f - c * ee) / denominator, 0.0);
+				}
+
+				t = (bb * s + f) / ee;
+				if (t < 0) {
+					t = 0;
+					s = std::max(-c / aa, 0.0);
+				}
+				else if (t > 1) {
+					t = 1;
+					s = std::max((bb - c) / aa, 0.0);
+				}
+			}
+		}
+
+		return (ray.position + d1 * s - (a + d2 * t)).squared_length();
+	}
+
+	// The point of the triangle closest to p, by the Voronoi region of p.
+	Vec3d closest_on_triangle(const Vec3d& p, const Vec3d& a, const Vec3d& b, const Vec3d& c) noexcept {
+		const Vec3d ab = b - a;
+		const Vec3d ac = c - a;
+		const Vec3d ap = p - a;
+		const double d1 = ab.dot_product(ap);
+		const double d2 = ac.dot_product(ap);
+		if (d1 <= 0 && d2 <= 0) {
+			return a;
+		}
+
+		const Vec3d bp = p - b;
+		const double d3 = ab.dot_product(bp);
+		const double d4 = ac.dot_product(bp);
+		if (d3 >= 0 && d4 <= d3) {
+			return b;
+		}
+
+		const double vc = d1 * d4 - d3 * d2;
+		if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+			return a + ab * (d1 / (d1 - d3));
+		}
+
+		const Vec3d cp = p - c;
+		const double d5 = ab.dot_product(cp);
+		const double d6 = ac.dot_product(cp);
+		if (d6 >= 0 && d5 <= d6) {
+			return c;
+		}
+
+		const double vb = d5 * d2 - d1 * d6;
+		if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+			return a + ac * (d2 / (d2 - d6));
+		}
+
+		const double va = d3 * d6 - d5 * d4;
+		if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+			return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		}
+
+		// A degenerate triangle has no interior, its edges give the distance instead.
+		const double total = va + vb + vc;
+		if (total == 0) {
+			return a;
+		}
+		return a + ab * (vb / total) + ac * (vc / total);
+	}
+
+	// Parameters where the ray's line enters and leaves the box, false if it misses.
+	bool slab_interval(const Ray3d& ray, const Vec3d& min, const Vec3d& max, double& near, double& far) noexcept {
+		near = -infinity;
+		far = infinity;
+		for (size_t axis = 0; axis < 3; axis++) {
+			const double origin = ray.position[axis];
+			const double direction = ray.direction[axis];
+			if (direction == 0) {
+				if (!(origin >= min[axis] && origin <= max[axis])) {
+					return false;
+				}
+				continue;
+			}
+
+			const double t0 = (min[axis] - origin) / direction;
+			const double t1 = (max[axis] - origin) / direction;
+			near = std::max(near, std::min(t0, t1));
+			far = std::min(far, std::max(t0, t1));
+		}
+		return near <= far;
+	}
+
+	// Two sided, returns infinity for rays parallel to the triangle.
+	double triangle_hit(const Ray3d& ray, const Vec3d& a, const Vec3d& b, const Vec3d& c) noexcept {
+		const Vec3d e1 = b - a;
+		const Vec3d e2 = c - a;
+		const Vec3d p = ray.direction.cross_product(e2);
+		const double determinant = e1.dot_product(p);
+		if (determinant == 0) {
+			return infinity;
+		}
+
+		const double inverse = 1 / determinant;
+		const Vec3d s = ray.position - a;
+		const double u = s.dot_product(p) * inverse;
+		if (!(u >= 0 && u <= 1)) {
+			return infinity;
+		}
+
+		const Vec3d q = s.cross_product(e1);
+		const double v = ray.direction.dot_product(q) * inverse;
+		if (!(v >= 0 && u + v <= 1)) {
+			return infinity;
+		}
+
+		const double t = e2.dot_product(q) * inverse;
+		return t >= 0 ? t : infinity;
+	}
+
+	// --------- Build. ---------
+
+	struct BuildItem {
+		Aabb bounds;
+		size_t index;
+
+		// Twice the centroid, which bins the same as the centroid without the multiplication.
+		double centre(size_t axis) const noexcept {
+			return bounds.min[axis] + bounds.max[axis];
+		}
+	};
+
+	struct RangeBounds {
+		Aabb bounds;
+		Aabb centres;
+
+		void add(const BuildItem& item) noexcept {
+			bounds.grow(item.bounds);
+			centres.grow(Vec3d{ item.centre(0), item.centre(1), item.centre(2) });
+		}
+
+		void merge(const RangeBounds& other) noexcept {
+			bounds.grow(other.bounds);
+			centres.grow(other.centres);
+		}
+	};
+
+	struct Bins {
+		Aabb bounds[3][bin_count];
+		size_t counts[3][bin_count] = {};
+
+		void merge(const Bins& other) noexcept {
+			for (size_t axis = 0; axis < 3; axis++) {
+				for (size_t bin = 0; bin < bin_count; bin++) {
+					bounds[axis][bin].grow(other.bounds[axis][bin]);
+					counts[axis][bin] += other.counts[axis][bin];
+				}
+			}
+		}
+	};
+
+	// Folds add(result, i) over [begin, end), in parallel chunks for large ranges. Merging is
+	// order independent, so the result does not depend on the thread count.
+	template <typename T, typename Add>
+	T reduce_range(size_t begin, size_t end, Add add) {
+		if (end - begin < 2 * parallel_build_size) {
+			T result{};
+			for (size_t i = begin; i < end; i++) {
+				add(result, i);
+			}
+			return result;
+		}
+
+		const size_t chunks = (end - begin + parallel_build_size - 1) / parallel_build_size;
+		std::vector<T> parts(chunks);
+		default_thread_pool().parallel_for(0, chunks, 1, [&](size_t chunk_begin, size_t chunk_end) {
+			for (size_t c = chunk_begin; c < chunk_end; c++) {
+				const size_t last = std::min(end, begin + (c + 1) * parallel_build_size);
+				for (size_t i = begin + c * parallel_build_size; i < last; i++) {
+					add(parts[c], i);
+				}
+			}
+		});
+
+		for (size_t c = 1; c < chunks; c++) {
+			parts[0].merge(parts[c]);
+		}
+		return parts[0];
+	}
+
+	struct Split {
+		bool leaf;
+		size_t middle;
+		uint32_t axis;
+		RangeBounds left;
+		RangeBounds right;
+	};
+
+	// Builds in two phases. The levels holding at least parallel_build_size primitives are split
+	// first, leaving independent subtrees that are then built in parallel, each depth first into
+	// its own nodes. Finally everything is concatenated in depth first order, so the layout only
+	// depends on the scene.
+	class Builder {
+		struct Reference {
+			size_t index;
+			bool is_subtree;
+		};
+
+		struct TopNode {
+			Bvh::Node node;
+			Reference children[2];
+		};
+
+		struct Subtree {
+			size_t begin;
+			size_t end;
+			RangeBounds range;
+			std::vector<Bvh::Node> nodes;
+		};
+
+		std::vector<BuildItem>& items;
+		size_t max_leaf_size;
+		std::vector<TopNode> top;
+		std::vector<Subtree> subtrees;
+
+		// Decides whether items[begin, end) make a leaf and otherwise partitions them, by binned
+		// centroid along the axis whose split minimises area times count over both sides.
+		Split split(size_t begin, size_t end, const RangeBounds& range) const {
+			Split result{};
+			result.leaf = true;
+			const size_t count = end - begin;
+			if (count == 1) {
+				return result;
+			}
+
+			// Small ranges use a bin per primitive, which is as fine as they need and cheaper to sweep.
+			const size_t bins_used = std::min(bin_count, count);
+			double scale[3];
+			for (size_t axis = 0; axis < 3; axis++) {
+				const double extent = range.centres.max[axis] - range.centres.min[axis];
+				scale[axis] = extent > 0 && std::isfinite(extent) ? bins_used / extent : 0;
+			}
+			auto bin_of = [&](const BuildItem& item, size_t axis) {
+				return std::min(bins_used - 1, static_cast<size_t>((item.centre(axis) - range.centres.min[axis]) * scale[axis]));
+			};
+
+			const Bins bins = reduce_range<Bins>(begin, end, [&](Bins& b, size_t i) {
+				const BuildItem& item = items[i];
+				for (size_t axis = 0; axis < 3; axis++) {
+					if (scale[axis] > 0) {
+						const size_t bin = bin_of(item, axis);
+						b.counts[axis][bin]++;
+						b.bounds[axis][bin].grow(item.bounds);
+					}
+				}
+			});
+
+			double best_cost = infinity;
+			size_t best_axis = 0;
+			size_t best_bin = 0;
+			for (size_t axis = 0; axis < 3; axis++) {
+				if (scale[axis] == 0) {
+					continue;
+				}
+
+				double right_areas[bin_count];
+				size_t right_counts[bin_count];
+				Aabb right;
+				size_t right_count = 0;
+				for (size_t bin = bins_used; bin-- > 0;) {
+					right.grow(bins.bounds[axis][bin]);
+					right_count += bins.counts[axis][bin];
+					right_areas[bin] = right.surface_area();
+					right_counts[bin] = right_count;
+				}
+
+				Aabb left;
+				size_t left_count = 0;
+				for (size_t bin = 0; bin + 1 < bins_used; bin++) {
+					left.grow(bins.bounds[axis][bin]);
+					left_count += bins.counts[axis][bin];
+					if (left_count == 0 || right_counts[bin + 1] == 0) {
+						continue;
+					}
+
+					const double cost = left.surface_area() * left_count + right_areas[bin + 1] * right_counts[bin + 1];
+					if (cost < best_cost) {
+						best_cost = cost;
+						best_axis = axis;
+						best_bin = bin;
+					}
+				}
+			}
+
+			// Traversing a node costs about as much as testing one primitive.
+			const double area = range.bounds.surface_area();
+			if (count <= max_leaf_size && (best_cost == infinity || area == 0 || 1 + best_cost / area >= count)) {
+				return result;
+			}
+
+			result.leaf = false;
+			if (best_cost == infinity) {
+				// Every centroid coincides, so any split is as good as another.
+				result.middle = begin + count / 2;
+				auto add = [this](RangeBounds& r, size_t i) {
+					r.add(items[i]);
+				};
+				result.left = reduce_range<RangeBounds>(begin, result.middle, add);
+				result.right = reduce_range<RangeBounds>(result.middle, end, add);
+				return result;
+			}
+
+			// Partitions from both ends, gathering the bounds of each side on the way.
+			result.axis = static_cast<uint32_t>(best_axis);
+			size_t i = begin;
+			size_t j = end;
+			while (true) {
+				while (i < j && bin_of(items[i], best_axis) <= best_bin) {
+					result.left.add(items[i++]);
+				}
+				while (i < j && bin_of(items[j - 1], best_axis) > best_bin) {
+					result.right.add(items[--j]);
+				}
+				if (i == j) {
+					break;
+				}
+				std::swap(items[i], items[j - 1]);
+			}
+			result.middle = i;
+			return result;
+		}
+
+		// Appends the subtree depth first, interior nodes pointing at their right child in out.
+		void build_subtree(std::vector<Bvh::Node>& out, size_t begin, size_t end, const RangeBounds& range) const {
+			const size_t index = out.size();
+			out.push_back(Bvh::Node{ padded(range.bounds), begin, static_cast<uint32_t>(end - begin), 0 });
+
+			const Split next = split(begin, end, range);
+			if (next.leaf) {
+				return;
+			}
+
+			out[index].count = 0;
+			out[index].axis = next.axis;
+			build_subtree(out, begin, next.middle, next.left);
+			out[index].first = out.size();
+			build_subtree(out, next.middle, end, next.right);
+		}
+
+		Reference build_top(size_t begin, size_t end, const RangeBounds& range) {
+			if (end - begin >= parallel_build_size) {
+				const Split next = split(begin, end, range);
+				if (!next.leaf) {
+					const size_t index = top.size();
+					top.push_back(TopNode{ Bvh::Node{ padded(range.bounds), 0, 0, next.axis }, {} });
+					const Reference left = build_top(begin, next.middle, next.left);
+					const Reference right = build_top(next.middle, end, next.right);
+					top[index].children[0] = left;
+					top[index].children[1] = right;
+					return Reference{ index, false };
+				}
+			}
+
+			subtrees.push_back(Subtree{ begin, end, range, {} });
+			return Reference{ subtrees.size() - 1, true };
+		}
+
+		void assemble(const Reference& reference, std::vector<Bvh::Node>& tree) const {
+			if (reference.is_subtree) {
+				const size_t base = tree.size();
+				for (Bvh::Node node : subtrees[reference.index].nodes) {
+					if (node.count == 0) {
+						node.first += base;
+					}
+					tree.push_back(node);
+				}
+				return;
+			}
+
+			const TopNode& node = top[reference.index];
+			const size_t index = tree.size();
+			tree.push_back(node.node);
+			assemble(node.children[0], tree);
+			tree[index].first = tree.size();
+			assemble(node.children[1], tree);
+		}
+
+	public:
+		Builder(std::vector<BuildItem>& items, size_t max_leaf_size) noexcept : items{ items }, max_leaf_size{ max_leaf_size } {}
+
+		std::vector<Bvh::Node> build() {
+			const RangeBounds range = reduce_range<RangeBounds>(0, items.size(), [this](RangeBounds& r, size_t i) {
+				r.add(items[i]);
+			});
+			const Reference root = build_top(0, items.size(), range);
+
+			default_thread_pool().parallel_for(0, subtrees.size(), 1, [this](size_t begin, size_t end) {
+				for (size_t s = begin; s < end; s++) {
+					Subtree& subtree = subtrees[s];
+					build_subtree(subtree.nodes, subtree.begin, subtree.end, subtree.range);
+				}
+			});
+
+			size_t count = top.size();
+			for (const Subtree& subtree : subtrees) {
+				count += subtree.nodes.size();
+			}
+			std::vector<Bvh::Node> tree;
+			tree.reserve(count);
+			assemble(root, tree);
+			return tree;
+		}
+	};
+
+	// --------- Traversal. ---------
+
+	// Rays of a packet coordinate by coordinate. Lanes without a ray have an empty interval, so
+	// they fail every box test.
+	struct Packet {
+		alignas(64) double origin[3][packet_width];
+		alignas(64) double inverse[3][packet_width];
+		// Each lane only needs boxes within grow of the ray and nearer than t_max.
+		alignas(64) double t_max[packet_width];
+		alignas(64) double grow[packet_width];
+		Ray3d rays[packet_width];
+		uint32_t lanes;
+
+		void clear() noexcept {
+			for (size_t lane = 0; lane < packet_width; lane++) {
+				for (size_t axis = 0; axis < 3; axis++) {
+					origin[axis][lane] = 0;
+					inverse[axis][lane] = 1;
+				}
+				t_max[lane] = -infinity;
+				grow[lane] = 0;
+			}
+			lanes = 0;
+		}
+
+		// A zero direction gets the largest finite inverse rather than infinity, so the box
+		// test never multiplies zero by infinity.
+		void set(size_t lane, const Ray3d& ray, double t_limit, double grow_by) noexcept {
+			for (size_t axis = 0; axis < 3; axis++) {
+				origin[axis][lane] = ray.position[axis];
+				inverse[axis][lane] = ray.direction[axis] != 0 ? 1 / ray.direction[axis] : std::numeric_limits<double>::max();
+			}
+			t_max[lane] = t_limit;
+			grow[lane] = grow_by;
+			rays[lane] = ray;
+			lanes |= uint32_t{ 1 } << lane;
+		}
+	};
+
+	struct TreeRef {
+		const Bvh::Node* nodes;
+		const Primitive* primitives;
+		const size_t* original;
+	};
+
+	double ray_point_squared_distance(const Ray3d& ray, const Vec3d& point) noexcept {
+		const Vec3d offset = point - ray.position;
+		const double length = ray.direction.squared_length();
+		const double s = length > 0 ? std::max(offset.dot_product(ray.direction) / length, 0.0) : 0.0;
+		return (offset - ray.direction * s).squared_length();
+	}
+
+	// Nearest hit, each hit shrinks its lane's t_max.
+	struct NearestHit {
+		using Result = RayHit;
+
+		static void visit(const Primitive& primitive, size_t index, Packet& packet, size_t lane, RayHit& result) noexcept {
+			const double t = primitive.hit(packet.rays[lane]);
+			if (t != infinity && (t < result.t || (t == result.t && index < result.primitive))) {
+				result = { index, t };
+				packet.t_max[lane] = t;
+			}
+		}
+
+		// The child the ray enters first along the split axis.
+		static bool right_first(const Packet& packet, size_t lane, uint32_t axis, const Aabb&, const Aabb&) noexcept {
+			return packet.inverse[axis][lane] < 0;
+		}
+	};
+
+	// Nearest approach, each closer primitive shrinks how far its lane grows the boxes. A box
+	// grown by d on every side holds everything within d of it, so a ray missing it is further.
+	struct NearestApproach {
+		using Result = RayApproach;
+
+		static void visit(const Primitive& primitive, size_t index, Packet& packet, size_t lane, RayApproach& result) noexcept {
+			const double distance = primitive.distance(packet.rays[lane]);
+			if (distance < result.distance || (distance == result.distance && index < result.primitive)) {
+				result = { index, distance };
+				packet.grow[lane] = distance;
+			}
+		}
+
+		// The child whose centre is nearer the ray, which is the more likely to hold the nearest
+		// primitive and shrink the search early.
+		static bool right_first(const Packet& packet, size_t lane, uint32_t, const Aabb& left, const Aabb& right) noexcept {
+			const Ray3d& ray = packet.rays[lane];
+			return ray_point_squared_distance(ray, right.centre()) < ray_point_squared_distance(ray, left.centre());
+		}
+	};
+
+	// The box tests write a mask of the lanes whose ray meets each of two boxes. Lanes outside
+	// active may be set and are cleared by the caller.
+
+	void test_boxes_generic(const Packet& packet, uint32_t active, const Aabb& left, const Aabb& right, uint32_t* masks) noexcept {
+		const Aabb* boxes[2] = { &left, &right };
+		for (size_t box = 0; box < 2; box++) {
+			uint32_t mask = 0;
+			for (uint32_t lanes = active; lanes != 0; lanes &= lanes - 1) {
+				const size_t lane = static_cast<size_t>(std::countr_zero(lanes));
+				double near = 0;
+				double far = packet.t_max[lane];
+				for (size_t axis = 0; axis < 3; axis++) {
+					const double t0 = (boxes[box]->min[axis] - packet.grow[lane] - packet.origin[axis][lane]) * packet.inverse[axis][lane];
+					const double t1 = (boxes[box]->max[axis] + packet.grow[lane] - packet.origin[axis][lane]) * packet.inverse[axis][lane];
+					near = std::max(near, std::min(t0, t1));
+					far = std::min(far, std::max(t0, t1));
+				}
+				mask |= static_cast<uint32_t>(near <= far) << lane;
+			}
+			masks[box] = mask;
+		}
+	}
+
+#ifdef MATHSLIB_X86
+
+	// --------- AVX2, the packet as two halves of four. ---------
+
+	MATHSLIB_TARGET_AVX2 void test_boxes_avx2(const Packet& packet, uint32_t, const Aabb& left, const Aabb& right, uint32_t* masks) noexcept {
+		const Aabb* boxes[2] = { &left, &right };
+		for (size_t box = 0; box < 2; box++) {
+			uint32_t mask = 0;
+			for (size_t half = 0; half < packet_width; half += 4) {
+				const __m256d grow = _mm256_load_pd(packet.grow + half);
+				__m256d near = _mm256_setzero_pd();
+				__m256d far = _mm256_load_pd(packet.t_max + half);
+				for (size_t axis = 0; axis < 3; axis++) {
+					const __m256d origin = _mm256_load_pd(packet.origin[axis] + half);
+					const __m256d inverse = _mm256_load_pd(packet.inverse[axis] + half);
+					const __m256d t0 = _mm256_mul_pd(_mm256_sub_pd(_mm256_sub_pd(_mm256_set1_pd(boxes[box]->min[axis]), grow), origin), inverse);
+					const __m256d t1 = _mm256_mul_pd(_mm256_sub_pd(_mm256_add_pd(_mm256_set1_pd(boxes[box]->max[axis]), grow), origin), inverse);
+					near = _mm256_max_pd(near, _mm256_min_pd(t0, t1));
+					far = _mm256_min_pd(far, _mm256_max_pd(t0, t1));
+				}
+				mask |= static_cast<uint32_t>(_mm256_movemask_pd(_mm256_cmp_pd(near, far, _CMP_LE_OQ))) << half;
+			}
+			masks[box] = mask;
+		}
+	}
+
+	// --------- AVX-512, the whole packet in one register. ---------
+
+	// The masked forms with every lane set avoid GCC warning about the undefined pass through.
+	MATHSLIB_TARGET_AVX512 MATHSLIB_ALWAYS_INLINE __m512d min_avx512(__m512d a, __m512d b) {
+		return _mm512_mask_min_pd(a, 0xFF, a, b);
+	}
+
+	MATHSLIB_TARGET_AVX512 MATHSLIB_ALWAYS_INLINE __m512d max_avx512(__m512d a, __m512d b) {
+		return _mm512_mask_max_pd(a, 0xFF, a, b);
+	}
+
+	MATHSLIB_TARGET_AVX512 void test_boxes_avx512(const Packet& packet, uint32_t, const Aabb& left, const Aabb& right, uint32_t* masks) noexcept {
+		const __m512d grow = _mm512_load_pd(packet.grow);
+		const __m512d t_max = _mm512_load_pd(packet.t_max);
+		const Aabb* boxes[2] = { &left, &right };
+		for (size_t box = 0; box < 2; box++) {
+			__m512d near = _mm512_setzero_pd();
+			__m512d far = t_max;
+			for (size_t axis = 0; axis < 3; axis++) {
+				const __m512d origin = _mm512_load_pd(packet.origin[axis]);
+				const __m512d inverse = _mm512_load_pd(packet.inverse[axis]);
+				const __m512d t0 = _mm512_mul_pd(_mm512_sub_pd(_mm512_sub_pd(_mm512_set1_pd(boxes[box]->min[axis]), grow), origin), inverse);
+				const __m512d t1 = _mm512_mul_pd(_mm512_sub_pd(_mm512_add_pd(_mm512_set1_pd(boxes[box]->max[axis]), grow), origin), inverse);
+				near = max_avx512(near, min_avx512(t0, t1));
+				far = min_avx512(far, max_avx512(t0, t1));
+			}
+			masks[box] = _mm512_cmp_pd_mask(near, far, _CMP_LE_OQ);
+		}
+	}
+#endif
+
+	using BoxTest = void (*)(const Packet& packet, uint32_t active, const Aabb& left, const Aabb& right, uint32_t* masks) noexcept;
+
+	// Depth first through the tree with a mask of the lanes still interested in each node. Both
+	// children are tested together, and the nearer one for the first lane is visited first.
+	template <typename Query, BoxTest test_boxes>
+	void traverse(const TreeRef& tree, Packet& packet, typename Query::Result* results) {
+		struct Entry {
+			size_t node;
+			uint32_t mask;
+		};
+		thread_local std::vector<Entry> stack;
+		stack.clear();
+		stack.push_back({ 0, packet.lanes });
+
+		while (!stack.empty()) {
+			const Entry entry = stack.back();
+			stack.pop_back();
+			const Bvh::Node& node = tree.nodes[entry.node];
+
+			if (node.count > 0) {
+				// Lanes may have found something nearer since the leaf was queued.
+				uint32_t masks[2];
+				test_boxes(packet, entry.mask, node.bounds, node.bounds, masks);
+				for (uint32_t lanes = entry.mask & masks[0]; lanes != 0; lanes &= lanes - 1) {
+					const size_t lane = static_cast<size_t>(std::countr_zero(lanes));
+					for (size_t p = node.first; p < node.first + node.count; p++) {
+						Query::visit(tree.primitives[p], tree.original[p], packet, lane, results[lane]);
+					}
+				}
+				continue;
+			}
+
+			const size_t children[2] = { entry.node + 1, node.first };
+			uint32_t masks[2];
+			test_boxes(packet, entry.mask, tree.nodes[children[0]].bounds, tree.nodes[children[1]].bounds, masks);
+
+			const size_t lane = static_cast<size_t>(std::countr_zero(entry.mask));
+			const size_t near = Query::right_first(packet, lane, node.axis, tree.nodes[children[0]].bounds, tree.nodes[children[1]].bounds) ? 1 : 0;
+			if ((masks[1 - near] &= entry.mask) != 0) {
+				stack.push_back({ children[1 - near], masks[1 - near] });
+			}
+			if ((masks[near] &= entry.mask) != 0) {
+				stack.push_back({ children[near], masks[near] });
+			}
+		}
+	}
+
+	struct Traversal {
+		void (*intersect)(const TreeRef& tree, Packet& packet, RayHit* results);
+		void (*nearest_approach)(const TreeRef& tree, Packet& packet, RayApproach* results);
+	};
+
+	const Traversal& select_traversal() noexcept {
+		static const Traversal generic = { traverse<NearestHit, test_boxes_generic>, traverse<NearestApproach, test_boxes_generic> };
+#ifdef MATHSLIB_X86
+		static const Traversal avx2 = { traverse<NearestHit, test_boxes_avx2>, traverse<NearestApproach, test_boxes_avx2> };
+		static const Traversal avx512 = { traverse<NearestHit, test_boxes_avx512>, traverse<NearestApproach, test_boxes_avx512> };
+#endif
+
+		switch (simd_kernels().level) {
+#ifdef MATHSLIB_X86
+		case SimdLevel::AVX512:
+			return avx512;
+		case SimdLevel::AVX2:
+			return avx2;
+#endif
+		default:
+			return generic;
+		}
+	}
+
+	// Calls run(packet, first) for packets of consecutive rays of the batch, spread over the
+	// thread pool.
+	template <typename Run>
+	void for_each_packet(const RayBatch& rays, double t_limit, double grow_by, Run run) {
+		const size_t packets = (rays.size() + packet_width - 1) / packet_width;
+		default_thread_pool().parallel_for(0, packets, packet_grain, [&](size_t packet_begin, size_t packet_end) {
+			Packet packet;
+			for (size_t p = packet_begin; p < packet_end; p++) {
+				const size_t first = p * packet_width;
+				packet.clear();
+				for (size_t lane = 0; lane < packet_width && first + lane < rays.size(); lane++) {
+					packet.set(lane, rays[first + lane], t_limit, grow_by);
+				}
+				run(packet, first);
+			}
+		});
+	}
+
+	Ray3d as_fixed(const Ray& ray) {
+		return Ray3d{ Vec3d::from_vector(ray.position), Vec3d::from_vector(ray.direction) };
+	}
+}
+
+// --------- Aabb. ---------
+
+void Aabb::grow(const Vec3d& point) noexcept {
+	min = component_min(min, point);
+	max = component_max(max, point);
+}
+
+void Aabb::grow(const Aabb& box) noexcept {
+	min = component_min(min, box.min);
+	max = component_max(max, box.max);
+}
+
+Vec3d Aabb::centre() const noexcept {
+	return (min + max) * 0.5;
+}
+
+double Aabb::surface_area() const noexcept {
+	const Vec3d extent = max - min;
+	if (!(extent[0] >= 0 && extent[1] >= 0 && extent[2] >= 0)) {
+		return 0;
+	}
+	return 2 * (extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0]);
+}
+
+// --------- Primitive. ---------
+
+Primitive Primitive::segment(const Vec3d& a, const Vec3d& b) noexcept {
+	return Primitive{ PrimitiveKind::Segment, a, b, Vec3d{}, 0 };
+}
+
+Primitive Primitive::sphere(const Vec3d& centre, double radius) {
+	if (!(radius >= 0)) {
+		throw std::invalid_argument("Sphere radius must not be negative.");
+	}
+	return Primitive{ PrimitiveKind::Sphere, centre, Vec3d{}, Vec3d{}, radius };
+}
+
+Primitive Primitive::box(const Vec3d& corner, const Vec3d& opposite) noexcept {
+	return Primitive{ PrimitiveKind::Box, component_min(corner, opposite), component_max(corner, opposite), Vec3d{}, 0 };
+}
+
+Primitive Primitive::triangle(const Vec3d& a, const Vec3d& b, const Vec3d& c) noexcept {
+	return Primitive{ PrimitiveKind::Triangle, a, b, c, 0 };
+}
+
+Primitive Primitive::segment(const Vector& a, const Vector& b) {
+	return segment(Vec3d::from_vector(a), Vec3d::from_vector(b));
+}
+
+Primitive Primitive::sphere(const Vector& centre, double radius) {
+	return sphere(Vec3d::from_vector(centre), radius);
+}
+
+Primitive Primitive::box(const Vector& corner, const Vector& opposite) {
+	return box(Vec3d::from_vector(corner), Vec3d::from_vector(opposite));
+}
+
+Primitive Primitive::triangle(const Vector& a, const Vector& b, const Vector& c) {
+	return triangle(Vec3d::from_vector(a), Vec3d::from_vector(b), Vec3d::from_vector(c));
+}
+
+Aabb Primitive::bounds() const noexcept {
+	Aabb box;
+	switch (kind) {
+	case PrimitiveKind::Sphere:
+		box.min = a - Vec3d{ radius, radius, radius };
+		box.max = a + Vec3d{ radius, radius, radius };
+		break;
+	case PrimitiveKind::Triangle:
+		box.grow(c);
+		[[fallthrough]];
+	default:
+		box.grow(a);
+		box.grow(b);
+	}
+	return box;
+}
+
+double Primitive::hit(const Ray3d& ray) const noexcept {
+	switch (kind) {
+	case PrimitiveKind::Sphere: {
+		const Vec3d offset = ray.position - a;
+		const double qa = ray.direction.squared_length();
+		const double qb = ray.direction.dot_product(offset);
+		const double discriminant = qb * qb - qa * (offset.squared_length() - radius * radius);
+		if (qa == 0 || !(discriminant >= 0)) {
+			return infinity;
+		}
+
+		// A ray starting inside leaves through the far side.
+		const double root = std::sqrt(discriminant);
+		const double t0 = (-qb - root) / qa;
+		if (t0 >= 0) {
+			return t0;
+		}
+		const double t1 = (-qb + root) / qa;
+		return t1 >= 0 ? t1 : infinity;
+	}
+	case PrimitiveKind::Box: {
+		double near, far;
+		if (!slab_interval(ray, a, b, near, far) || !(far >= 0)) {
+			return infinity;
+		}
+		return near >= 0 ? near : far;
+	}
+	case PrimitiveKind::Triangle:
+		return triangle_hit(ray, a, b, c);
+	default:
+		return infinity;
+	}
+}
+
+// The minimum over the ray and a convex primitive is either a crossing, at the ray's position or
+// on the primitive's boundary, so surfaces reduce to the ray's position and their edges.
+double Primitive::distance(const Ray3d& ray) const noexcept {
+	switch (kind) {
+	case PrimitiveKind::Segment:
+		return std::sqrt(ray_segment_squared_distance(ray, a, b));
+	case PrimitiveKind::Sphere: {
+		return std::max(std::sqrt(ray_point_squared_distance(ray, a)) - radius, 0.0);
+	}
+	case PrimitiveKind::Box: {
+		double near, far;
+		if (slab_interval(ray, a, b, near, far) && far >= 0) {
+			return 0;
+		}
+
+		double squared = (component_min(component_max(ray.position, a), b) - ray.position).squared_length();
+		for (size_t axis = 0; axis < 3; axis++) {
+			const size_t u = (axis + 1) % 3;
+			const size_t v = (axis + 2) % 3;
+			for (size_t corner = 0; corner < 4; corner++) {
+				Vec3d from = a;
+				from[u] = corner & 1 ? b[u] : a[u];
+				from[v] = corner & 2 ? b[v] : a[v];
+				Vec3d to = from;
+				to[axis] = b[axis];
+				squared = std::min(squared, ray_segment_squared_distance(ray, from, to));
+			}
+		}
+		return std::sqrt(squared);
+	}
+	case PrimitiveKind::Triangle: {
+		if (triangle_hit(ray, a, b, c) != infinity) {
+			return 0;
+		}
+
+		double squared = (closest_on_triangle(ray.position, a, b, c) - ray.position).squared_length();
+		squared = std::min(squared, ray_segment_squared_distance(ray, a, b));
+		squared = std::min(squared, ray_segment_squared_distance(ray, b, c));
+		squared = std::min(squared, ray_segment_squared_distance(ray, c, a));
+		return std::sqrt(squared);
+	}
+	default:
+		return infinity;
+	}
+}
+
+// --------- Bvh. ---------
+
+Bvh::Bvh(std::vector<Primitive> scene, size_t max_leaf_size) {
+	if (max_leaf_size == 0) {
+		throw std::invalid_argument("Bvh leaves must hold at least one primitive.");
+	}
+	MATHSLIB_COUNT_OPERATION(BvhBuild);
+
+	const size_t n = scene.size();
+	if (n == 0) {
+		return;
+	}
+
+	std::vector<BuildItem> items(n);
+	default_thread_pool().parallel_for(0, n, parallel_grain, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			items[i] = BuildItem{ scene[i].bounds(), i };
+		}
+	});
+	tree = Builder(items, max_leaf_size).build();
+
+	parents.assign(tree.size(), npos);
+	leaves.resize(n);
+	for (size_t index = 0; index < tree.size(); index++) {
+		const Node& node = tree[index];
+		if (node.count > 0) {
+			std::fill(leaves.begin() + node.first, leaves.begin() + node.first + node.count, index);
+		}
+		else {
+			parents[index + 1] = index;
+			parents[node.first] = index;
+		}
+	}
+
+	primitives.resize(n);
+	original.resize(n);
+	positions.resize(n);
+	for (size_t position = 0; position < n; position++) {
+		original[position] = items[position].index;
+		primitives[position] = scene[original[position]];
+		positions[original[position]] = position;
+	}
+	is_stale.assign(tree.size(), 0);
+}
+
+size_t Bvh::size() const noexcept {
+	return primitives.size();
+}
+
+std::span<const Bvh::Node> Bvh::nodes() const noexcept {
+	return tree;
+}
+
+const Primitive& Bvh::operator[](size_t index) const {
+	return primitives[positions[index]];
+}
+
+void Bvh::update(size_t index, const Primitive& primitive) {
+	if (index >= primitives.size()) {
+		throw std::invalid_argument("Primitive index is out of range.");
+	}
+
+	const size_t position = positions[index];
+	primitives[position] = primitive;
+	for (size_t node = leaves[position]; node != npos && !is_stale[node]; node = parents[node]) {
+		is_stale[node] = 1;
+		stale.push_back(node);
+	}
+}
+
+// Children follow their parents, so refitting in decreasing order refits every child first.
+void Bvh::refit() {
+	std::sort(stale.begin(), stale.end(), std::greater<>());
+	for (const size_t index : stale) {
+		Node& node = tree[index];
+		if (node.count > 0) {
+			Aabb bounds;
+			for (size_t p = node.first; p < node.first + node.count; p++) {
+				bounds.grow(primitives[p].bounds());
+			}
+			node.bounds = padded(bounds);
+		}
+		else {
+			node.bounds = tree[index + 1].bounds;
+			node.bounds.grow(tree[node.first].bounds);
+		}
+		is_stale[index] = 0;
+	}
+	stale.clear();
+}
+
+void Bvh::check_refit() const {
+	if (!stale.empty()) {
+		throw std::logic_error("Bvh has updated primitives, refit() must be called before querying.");
+	}
+}
+
+RayHit Bvh::intersect(const Ray& ray) const {
+	return intersect(as_fixed(ray));
+}
+
+RayHit Bvh::intersect(const Ray3d& ray) const {
+	check_refit();
+	MATHSLIB_COUNT_OPERATION(BvhQuery);
+	static const Traversal& traversal = select_traversal();
+	RayHit result;
+	if (!tree.empty()) {
+		Packet packet;
+		packet.clear();
+		packet.set(0, ray, infinity, 0);
+		traversal.intersect(TreeRef{ tree.data(), primitives.data(), original.data() }, packet, &result);
+	}
+	return result;
+}
+
+std::vector<RayHit> Bvh::intersect(const RayBatch& rays) const {
+	check_refit();
+	MATHSLIB_COUNT_OPERATION(BvhQuery);
+	static const Traversal& traversal = select_traversal();
+	std::vector<RayHit> results(rays.size());
+	if (!tree.empty()) {
+		const TreeRef ref{ tree.data(), primitives.data(), original.data() };
+		for_each_packet(rays, infinity, 0, [&](Packet& packet, size_t first) {
+			traversal.intersect(ref, packet, results.data() + first);
+		});
+	}
+	return results;
+}
+
+RayApproach Bvh::nearest_approach(const Ray& ray) const {
+	return nearest_approach(as_fixed(ray));
+}
+
+RayApproach Bvh::nearest_approach(const Ray3d& ray) const {
+	check_refit();
+	MATHSLIB_COUNT_OPERATION(BvhQuery);
+	static const Traversal& traversal = select_traversal();
+	RayApproach result;
+	if (!tree.empty()) {
+		Packet packet;
+		packet.clear();
+		packet.set(0, ray, infinity, infinity);
+		traversal.nearest_approach(TreeRef{ tree.data(), primitives.data(), original.data() }, packet, &result);
+	}
+	return result;
+}
+
+std::vector<RayApproach> Bvh::nearest_approach(const RayBatch& rays) const {
+	check_refit();
+	MATHSLIB_COUNT_OPERATION(BvhQuery);
+	static const Traversal& traversal = select_traversal();
+	std::vector<RayApproach> results(rays.size());
+	if (!tree.empty()) {
+		const TreeRef ref{ tree.data(), primitives.data(), original.data() };
+		for_each_packet(rays, infinity, infinity, [&](Packet& packet, size_t first) {
+			traversal.nearest_approach(ref, packet, results.data() + first);
+		});
+	}
+	return results;
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+#include "FixedVector.h"
+#include "Ray.h"
+#include "RayBatch.h"
+#include "Vector.h"
+
+// Bounding volume hierarchy for ray queries against large scenes of segments, spheres, boxes and
+// triangles.
+//
+// Rays start at their position and extend along their direction, which need not be normalised,
+// so a hit at parameter t is at position + t * direction. Two queries are answered:
+// - intersect, the nearest surface crossing at t >= 0. Segments have no surface and are skipped.
+// - nearest_approach, the smallest Euclidean distance between the ray and any primitive, zero
+//   for a ray that crosses one.
+//
+// The tree is built top down with the binned surface area heuristic, subtrees in parallel on the
+// library thread pool. Batches of rays are traversed in packets of 8, testing every ray of a
+// packet against a node's bounds with SIMD, and packets are spread over the thread pool.
+// Rays that are close together in the batch share most of their traversal.
+//
+// Ties are broken by the lower primitive index, so results do not depend on the thread count or
+// the instruction set.
+
+// Axis aligned bounding box.
+struct Aabb {
+	Vec3d min{ std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity() };
+	Vec3d max{ -std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity() };
+
+	void grow(const Vec3d& point) noexcept;
+	void grow(const Aabb& box) noexcept;
+	Vec3d centre() const noexcept;
+	// Zero for an empty box.
+	double surface_area() const noexcept;
+};
+
+enum class PrimitiveKind { Segment, Sphere, Box, Triangle };
+
+// One piece of geometry. Made with the factories below, which take Vec3d or three dimensional
+// Vector corners.
+struct Primitive {
+	PrimitiveKind kind;
+	// Segment end points a and b, sphere centre a, box corners a (minimum) and b (maximum), or
+	// triangle corners a, b and c.
+	Vec3d a, b, c;
+	double radius;
+
+	static Primitive segment(const Vec3d& a, const Vec3d& b) noexcept;
+	static Primitive sphere(const Vec3d& centre, double radius);
+	// The corners may be given in any order.
+	static Primitive box(const Vec3d& corner, const Vec3d& opposite) noexcept;
+	static Primitive triangle(const Vec3d& a, const Vec3d& b, const Vec3d& c) noexcept;
+
+	// Throw std::invalid_argument for a negative radius or a Vector that is not three dimensional.
+	static Primitive segment(const Vector& a, const Vector& b);
+	static Primitive sphere(const Vector& centre, double radius);
+	static Primitive box(const Vector& corner, const Vector& opposite);
+	static Primitive triangle(const Vector& a, const Vector& b, const Vector& c);
+
+	Aabb bounds() const noexcept;
+
+	// The ray parameter of the nearest surface crossing at t >= 0, or infinity if there is none.
+	double hit(const Ray3d& ray) const noexcept;
+
+	// The distance between the ray and the primitive, zero when the ray crosses it.
+	double distance(const Ray3d& ray) const noexcept;
+};
+
+struct RayHit {
+	static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+	// Index of the primitive hit, npos for a miss.
+	size_t primitive = npos;
+	double t = std::numeric_limits<double>::infinity();
+};
+
+struct RayApproach {
+	static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+	// Index of the nearest primitive, npos for an empty hierarchy.
+	size_t primitive = npos;
+	double distance = std::numeric_limits<double>::infinity();
+};
+
+class Bvh {
+public:
+	// Leaves hold primitives [first, first + count) in leaf order. Interior nodes have a count of
+	// zero, their left child is the next node and their right child is first. Nodes are in depth
+	// first order, so children always follow their parent.
+	struct Node {
+		Aabb bounds;
+		size_t first;
+		uint32_t count;
+		// The split axis, which orders the children for traversal.
+		uint32_t axis;
+	};
+
+private:
+	std::vector<Node> tree;
+	std::vector<size_t> parents;
+	// Primitives in leaf order, the original index of each, the position of each original index
+	// and the leaf holding each position.
+	std::vector<Primitive> primitives;
+	std::vector<size_t> original;
+	std::vector<size_t> positions;
+	std::vector<size_t> leaves;
+	// Nodes whose bounds are out of date, and a flag per node for whether it is listed.
+	std::vector<size_t> stale;
+	std::vector<uint8_t> is_stale;
+
+	void check_refit() const;
+
+public:
+	// Leaves of more than max_leaf_size primitives are always split. An empty scene is allowed,
+	// queries then find nothing.
+	explicit Bvh(std::vector<Primitive> primitives, size_t max_leaf_size = 4);
+
+	size_t size() const noexcept;
+	std::span<const Node> nodes() const noexcept;
+
+	// The primitive with the given original index.
+	const Primitive& operator[](size_t index) const;
+
+	// Replaces a primitive, for animated scenes. The tree keeps its shape, so refit() must be called
+	// before the next query, and scenes that move a lot query faster after a rebuild.
+	void update(size_t index, const Primitive& primitive);
+
+	// Recomputes the bounds of the nodes above the primitives updated since the last refit only.
+	void refit();
+
+	RayHit intersect(const Ray& ray) const;
+	RayHit intersect(const Ray3d& ray) const;
+	// One result per ray of the batch.
+	std::vector<RayHit> intersect(const RayBatch& rays) const;
+
+	RayApproach nearest_approach(const Ray& ray) const;
+	RayApproach nearest_approach(const Ray3d& ray) const;
+	std::vector<RayApproach> nearest_approach(const RayBatch& rays) const;
+};
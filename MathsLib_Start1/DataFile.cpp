@@ -0,0 +1,412 @@
+#include "DataFile.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	uint16_t byte_swap(uint16_t x) noexcept {
+		return static_cast<uint16_t>((x >> 8) | (x << 8));
+	}
+
+	uint32_t byte_swap(uint32_t x) noexcept {
+		return (x >> 24) | ((x >> 8) & 0xFF00) | ((x << 8) & 0xFF0000) | (x << 24);
+	}
+
+	uint64_t byte_swap(uint64_t x) noexcept {
+		return (static_cast<uint64_t>(byte_swap(static_cast<uint32_t>(x))) << 32) | byte_swap(static_cast<uint32_t>(x >> 32));
+	}
+
+	// Little endian loads for the checksum, so it hashes the same bytes the same way everywhere.
+	uint64_t read64(const std::byte* p) noexcept {
+		uint64_t x;
+		std::memcpy(&x, p, sizeof(x));
+		return std::endian::native == std::endian::little ? x : byte_swap(x);
+	}
+
+	uint32_t read32(const std::byte* p) noexcept {
+		uint32_t x;
+		std::memcpy(&x, p, sizeof(x));
+		return std::endian::native == std::endian::little ? x : byte_swap(x);
+	}
+
+	constexpr uint64_t P1 = 11400714785074694791ULL;
+	constexpr uint64_t P2 = 14029467366897019727ULL;
+	constexpr uint64_t P3 = 1609587929392839161ULL;
+	constexpr uint64_t P4 = 9650029242287828579ULL;
+	constexpr uint64_t P5 = 2870177450012600261ULL;
+
+	uint64_t lane_round(uint64_t accumulator, uint64_t input) noexcept {
+		accumulator += input * P2;
+		return std::rotl(accumulator, 31) * P1;
+	}
+
+	uint64_t merge_round(uint64_t hash, uint64_t accumulator) noexcept {
+		hash ^= lane_round(0, accumulator);
+		return hash * P1 + P4;
+	}
+
+	// Swaps the multi byte fields of a header written on a machine of the other byte order.
+	void swap_header(DataFileHeader& header) noexcept {
+		header.version = byte_swap(header.version);
+		header.byte_order_mark = byte_swap(header.byte_order_mark);
+		header.alignment = byte_swap(header.alignment);
+		header.rows = byte_swap(header.rows);
+		header.cols = byte_swap(header.cols);
+		header.data_offset = byte_swap(header.data_offset);
+		header.data_size = byte_swap(header.data_size);
+		header.data_checksum = byte_swap(header.data_checksum);
+		header.reserved = byte_swap(header.reserved);
+	}
+
+	void write_file(const std::string& path, const DataFileHeader& header, const double* data) {
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			throw std::runtime_error("Could not open " + path + " for writing.");
+		}
+
+		const char padding[DataFileHeader::default_alignment] = {};
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(padding, static_cast<std::streamsize>(header.data_offset - sizeof(header)));
+		file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(header.data_size));
+
+		if (!file.flush()) {
+			throw std::runtime_error("Could not write " + path + ".");
+		}
+	}
+
+	// Reads a file of the given rank into the object make(rows, cols) returns.
+	template <typename T, typename Make>
+	T load(const std::string& path, uint8_t rank, Make make) {
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file) {
+			throw std::runtime_error("Could not open " + path + " for reading.");
+		}
+
+		const uint64_t file_size = static_cast<uint64_t>(file.tellg());
+		file.seekg(0);
+
+		DataFileHeader header{};
+		file.read(reinterpret_cast<char*>(&header), std::min<uint64_t>(sizeof(header), file_size));
+		const bool swapped = validate_header(header, file_size, path);
+		if (header.rank != rank) {
+			throw std::invalid_argument(path + (rank == 1 ? " holds a Matrix, not a Vector." : " holds a Vector, not a Matrix."));
+		}
+
+		T result = make(header.rows, header.cols);
+		double* out = result.data();
+		file.seekg(static_cast<std::streamoff>(header.data_offset));
+		file.read(reinterpret_cast<char*>(out), static_cast<std::streamsize>(header.data_size));
+		if (!file) {
+			throw std::runtime_error("Could not read " + path + ".");
+		}
+
+		if (checksum(out, header.data_size) != header.data_checksum) {
+			throw std::runtime_error(path + ": checksum mismatch.");
+		}
+
+		if (swapped) {
+			swap_byte_order(out, header.rows * header.cols);
+		}
+
+		return result;
+	}
+}
+
+DataFileHeader make_data_file_header(uint8_t rank, size_t rows, size_t cols, uint64_t data_checksum) noexcept {
+	DataFileHeader header{};
+	std::memcpy(header.magic, DataFileHeader::expected_magic, sizeof(header.magic));
+	header.version = DataFileHeader::current_version;
+	header.data_type = DataType::Float64;
+	header.rank = rank;
+	header.byte_order_mark = DataFileHeader::native_byte_order;
+	header.alignment = DataFileHeader::default_alignment;
+	header.rows = rows;
+	header.cols = cols;
+	header.data_offset = std::max<uint64_t>(sizeof(DataFileHeader), DataFileHeader::default_alignment);
+	header.data_size = rows * cols * sizeof(double);
+	header.data_checksum = data_checksum;
+	return header;
+}
+
+bool validate_header(DataFileHeader& header, uint64_t file_size, const std::string& path) {
+	auto fail = [&path](const char* reason) {
+		return std::runtime_error(path + ": " + reason);
+	};
+
+	if (file_size < sizeof(DataFileHeader) || std::memcmp(header.magic, DataFileHeader::expected_magic, sizeof(header.magic)) != 0) {
+		throw fail("not a MathsLib data file.");
+	}
+
+	const bool swapped = header.byte_order_mark != DataFileHeader::native_byte_order;
+	if (swapped) {
+		swap_header(header);
+		if (header.byte_order_mark != DataFileHeader::native_byte_order) {
+			throw fail("unrecognised byte order.");
+		}
+	}
+
+	if (header.version > DataFileHeader::current_version) {
+		throw fail("written by a newer version of the format.");
+	}
+	if (header.data_type != DataType::Float64) {
+		throw fail("unsupported element type.");
+	}
+	if (header.rank != 1 && header.rank != 2) {
+		throw fail("unsupported rank.");
+	}
+
+	const bool offset_valid = std::has_single_bit(header.alignment) && header.alignment >= alignof(double)
+		&& header.data_offset >= sizeof(DataFileHeader) && header.data_offset % header.alignment == 0;
+	const bool size_valid = (header.rank == 2 || header.cols == 1)
+		&& (header.cols == 0 || header.rows <= std::numeric_limits<uint64_t>::max() / sizeof(double) / header.cols)
+		&& header.data_size == header.rows * header.cols * sizeof(double);
+	if (!offset_valid || !size_valid) {
+		throw fail("inconsistent header.");
+	}
+
+	if (header.data_offset > file_size || header.data_size > file_size - header.data_offset) {
+		throw fail("file is shorter than its header says.");
+	}
+
+	return swapped;
+}
+
+void swap_byte_order(double* data, size_t n) noexcept {
+	for (size_t i = 0; i < n; i++) {
+		uint64_t word;
+		std::memcpy(&word, data + i, sizeof(word));
+		word = byte_swap(word);
+		std::memcpy(data + i, &word, sizeof(word));
+	}
+}
+
+Checksum::Checksum() noexcept : lanes{ P1 + P2, P2, 0, 0 - P1 } { }
+
+// XXH64, processing 32 byte stripes in four independent lanes. A stripe split across calls waits in pending.
+void Checksum::update(const void* data, size_t size) noexcept {
+	const std::byte* p = static_cast<const std::byte*>(data);
+	const std::byte* const end = p + size;
+	total_size += size;
+
+	auto stripe = [this](const std::byte* q) {
+		lanes[0] = lane_round(lanes[0], read64(q));
+		lanes[1] = lane_round(lanes[1], read64(q + 8));
+		lanes[2] = lane_round(lanes[2], read64(q + 16));
+		lanes[3] = lane_round(lanes[3], read64(q + 24));
+	};
+
+	if (pending_size > 0) {
+		const size_t fill = std::min<size_t>(sizeof(pending) - pending_size, size);
+		std::memcpy(pending + pending_size, p, fill);
+		pending_size += fill;
+		p += fill;
+		if (pending_size < sizeof(pending)) {
+			return;
+		}
+		stripe(pending);
+		pending_size = 0;
+	}
+
+	for (; end - p >= 32; p += 32) {
+		stripe(p);
+	}
+
+	pending_size = static_cast<size_t>(end - p);
+	std::memcpy(pending, p, pending_size);
+}
+
+uint64_t Checksum::value() const noexcept {
+	uint64_t hash;
+
+	if (total_size >= 32) {
+		hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+		for (const uint64_t lane : lanes) {
+			hash = merge_round(hash, lane);
+		}
+	}
+	else {
+		hash = P5;
+	}
+
+	hash += total_size;
+
+	const std::byte* p = pending;
+	const std::byte* const end = pending + pending_size;
+	for (; end - p >= 8; p += 8) {
+		hash ^= lane_round(0, read64(p));
+		hash = std::rotl(hash, 27) * P1 + P4;
+	}
+	if (end - p >= 4) {
+		hash ^= read32(p) * P1;
+		hash = std::rotl(hash, 23) * P2 + P3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		hash ^= static_cast<uint64_t>(*p) * P5;
+		hash = std::rotl(hash, 11) * P1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= P2;
+	hash ^= hash >> 29;
+	hash *= P3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+uint64_t checksum(const void* data, size_t size) noexcept {
+	Checksum hash;
+	hash.update(data, size);
+	return hash.value();
+}
+
+void save(const Vector& V, const std::string& path) {
+	write_file(path, make_data_file_header(1, V.size(), 1, checksum(V.data(), V.size() * sizeof(double))), V.data());
+}
+
+void save(const Matrix& M, const std::string& path) {
+	write_file(path, make_data_file_header(2, M.get_row_count(), M.get_col_count(), checksum(M.data(), M.get_row_count() * M.get_col_count() * sizeof(double))), M.data());
+}
+
+Vector load_vector(const std::string& path) {
+	return load<Vector>(path, 1, [](size_t rows, size_t) {
+		return Vector(rows);
+	});
+}
+
+Matrix load_matrix(const std::string& path) {
+	return load<Matrix>(path, 2, [](size_t rows, size_t cols) {
+		return Matrix(cols, rows);
+	});
+}
+
+MappedFile::MappedFile(const std::string& path, bool verify_checksum) {
+#ifdef _WIN32
+	// The view keeps the mapping alive, so both handles can be closed once it exists.
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Could not open " + path + " for reading.");
+	}
+
+	LARGE_INTEGER file_size{};
+	HANDLE file_mapping = nullptr;
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart >= static_cast<LONGLONG>(sizeof(DataFileHeader))) {
+		file_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	}
+	if (file_mapping != nullptr) {
+		mapping = static_cast<const std::byte*>(MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0));
+		CloseHandle(file_mapping);
+	}
+	CloseHandle(file);
+
+	if (mapping == nullptr) {
+		throw std::runtime_error("Could not map " + path + ".");
+	}
+	mapping_size = static_cast<size_t>(file_size.QuadPart);
+#else
+	const int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0) {
+		throw std::runtime_error("Could not open " + path + " for reading.");
+	}
+
+	// The mapping outlives the descriptor.
+	struct stat status{};
+	void* address = MAP_FAILED;
+	if (::fstat(file, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(DataFileHeader)) {
+		address = ::mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	}
+	::close(file);
+
+	if (address == MAP_FAILED) {
+		throw std::runtime_error("Could not map " + path + ".");
+	}
+	mapping = static_cast<const std::byte*>(address);
+	mapping_size = static_cast<size_t>(status.st_size);
+#endif
+
+	try {
+		std::memcpy(&file_header, mapping, sizeof(file_header));
+		if (validate_header(file_header, mapping_size, path)) {
+			throw std::runtime_error(path + ": saved with the other byte order, use load_vector or load_matrix.");
+		}
+		if (verify_checksum && checksum(data(), file_header.data_size) != file_header.data_checksum) {
+			throw std::runtime_error(path + ": checksum mismatch.");
+		}
+	}
+	catch (...) {
+		close();
+		throw;
+	}
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+	: file_header{ other.file_header }, mapping{ std::exchange(other.mapping, nullptr) }, mapping_size{ std::exchange(other.mapping_size, 0) } { }
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		close();
+		file_header = other.file_header;
+		mapping = std::exchange(other.mapping, nullptr);
+		mapping_size = std::exchange(other.mapping_size, 0);
+	}
+	return *this;
+}
+
+void MappedFile::close() noexcept {
+	if (mapping == nullptr) {
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(mapping);
+#else
+	::munmap(const_cast<std::byte*>(mapping), mapping_size);
+#endif
+	mapping = nullptr;
+	mapping_size = 0;
+}
+
+const DataFileHeader& MappedFile::header() const noexcept {
+	return file_header;
+}
+
+const double* MappedFile::data() const noexcept {
+	return mapping == nullptr ? nullptr : reinterpret_cast<const double*>(mapping + file_header.data_offset);
+}
+
+ConstVectorView MappedFile::vector() const {
+	if (file_header.rank != 1) {
+		throw std::invalid_argument("The mapped file holds a Matrix, not a Vector.");
+	}
+	return ConstVectorView(data(), file_header.rows);
+}
+
+ConstMatrixView MappedFile::matrix() const {
+	if (file_header.rank != 2) {
+		throw std::invalid_argument("The mapped file holds a Vector, not a Matrix.");
+	}
+	return ConstMatrixView(data(), file_header.rows, file_header.cols, static_cast<std::ptrdiff_t>(file_header.cols));
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "Matrix.h"
+#include "MatrixView.h"
+#include "Vector.h"
+#include "VectorView.h"
+
+// Binary files for Vector and Matrix data.
+//
+// A file is a 64 byte header followed by the elements, row major, starting at data_offset.
+// The offset is a multiple of the header's alignment, so a file mapped at a page boundary has
+// its elements aligned for SIMD loads and can be used in place. Elements and header fields are
+// written in the byte order of the machine that saved the file, recorded in byte_order_mark.
+// load() swaps a file from a machine of the other byte order, a mapping cannot and throws.
+//
+// Problems with the file, such as a bad magic number, a newer version, a short file or a
+// checksum mismatch, throw std::runtime_error.
+
+enum class DataType : uint8_t { Float64 = 1 };
+
+struct DataFileHeader {
+	static constexpr char expected_magic[4] = { 'M', 'L', 'I', 'B' };
+	static constexpr uint16_t current_version = 1;
+	static constexpr uint32_t native_byte_order = 0x01020304;
+	static constexpr uint32_t default_alignment = 64;
+
+	char magic[4];
+	uint16_t version;
+	DataType data_type;
+	// 1 for a Vector, 2 for a Matrix.
+	uint8_t rank;
+	uint32_t byte_order_mark;
+	uint32_t alignment;
+	// A Vector has one column.
+	uint64_t rows;
+	uint64_t cols;
+	uint64_t data_offset;
+	uint64_t data_size;
+	// checksum() of the data_size bytes of elements as stored.
+	uint64_t data_checksum;
+	uint64_t reserved;
+};
+
+static_assert(sizeof(DataFileHeader) == 64, "The header layout is part of the file format.");
+
+// 64 bit XXH64 hash with seed 0, reading the bytes in the same order on any machine.
+uint64_t checksum(const void* data, size_t size) noexcept;
+
+// Incremental form of checksum() for data that arrives in pieces, any split gives the same value.
+class Checksum {
+	uint64_t lanes[4];
+	std::byte pending[32];
+	size_t pending_size = 0;
+	uint64_t total_size = 0;
+
+public:
+	Checksum() noexcept;
+
+	void update(const void* data, size_t size) noexcept;
+	uint64_t value() const noexcept;
+};
+
+// Header for a native byte order file, elements start at the first aligned offset after it.
+DataFileHeader make_data_file_header(uint8_t rank, size_t rows, size_t cols, uint64_t data_checksum) noexcept;
+
+// Checks a header read from a file of file_size bytes, converting it to native byte order.
+// Returns true when the elements are in the other byte order.
+bool validate_header(DataFileHeader& header, uint64_t file_size, const std::string& path);
+
+// Reverses the bytes of each element, for elements read from a file of the other byte order.
+void swap_byte_order(double* data, size_t n) noexcept;
+
+void save(const Vector& V, const std::string& path);
+void save(const Matrix& M, const std::string& path);
+
+// Read the whole file, checking the checksum. A Vector file cannot be loaded as a Matrix or
+// the other way round.
+Vector load_vector(const std::string& path);
+Matrix load_matrix(const std::string& path);
+
+// Read only memory mapping of a file, exposing its elements as views with no copy. The operating
+// system pages elements in as they are first touched, so opening costs the same for any file
+// size unless verify_checksum reads everything up front. Views stay valid while the MappedFile
+// lives.
+class MappedFile {
+	DataFileHeader file_header{};
+	const std::byte* mapping = nullptr;
+	size_t mapping_size = 0;
+
+	void close() noexcept;
+
+public:
+	explicit MappedFile(const std::string& path, bool verify_checksum = false);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	const DataFileHeader& header() const noexcept;
+	const double* data() const noexcept;
+
+	// Throw std::invalid_argument when the file holds the other kind.
+	ConstVectorView vector() const;
+	ConstMatrixView matrix() const;
+};
@@ -0,0 +1,536 @@
+// Blocked LU, Cholesky and QR factorizations.
+//
+// All three follow the LAPACK structure. The matrix is processed in panels of NB columns. Each
+// panel is factored with simple loops, and its effect on the trailing matrix is applied as one
+// rank NB update through gemm. For large matrices the panels are a small fraction of the
+// floating point work.
+
+#include "Decomposition.h"
+#include "Gemm.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+
+	// Panel width. Wide enough for the GEMM updates to run near peak, narrow enough that the
+	// unblocked panel work stays small.
+	constexpr size_t NB = 64;
+
+	// Columns of the trailing matrix per GEMM in the Cholesky update, which only fills the lower triangle.
+	constexpr size_t SYRK_BLOCK = 256;
+
+	// Solves T X = B in place for an n x n lower triangular T, addressed through strides so a
+	// transposed factor needs no copy. B is n x r, row major with leading dimension ldb. Each
+	// block of NB rows first has the contribution of all earlier blocks removed by one GEMM.
+	void solve_lower(size_t n, size_t r, bool unit_diagonal, const double* T, std::ptrdiff_t rs_t, std::ptrdiff_t cs_t, double* B, size_t ldb) {
+		for (size_t i0 = 0; i0 < n; i0 += NB) {
+			const size_t ib = std::min(NB, n - i0);
+
+			if (i0 > 0) {
+				gemm(ib, r, i0, -1.0, T + i0 * rs_t, rs_t, cs_t, B, ldb, 1, 1.0, B + i0 * ldb, ldb, 1);
+			}
+
+			for (size_t i = i0; i < i0 + ib; i++) {
+				double* row = B + i * ldb;
+
+				for (size_t j = i0; j < i; j++) {
+					const double t = T[i * rs_t + j * cs_t];
+					const double* source = B + j * ldb;
+					for (size_t c = 0; c < r; c++) {
+						row[c] -= t * source[c];
+					}
+				}
+
+				if (!unit_diagonal) {
+					const double d = T[i * rs_t + i * cs_t];
+					for (size_t c = 0; c < r; c++) {
+						row[c] /= d;
+					}
+				}
+			}
+		}
+	}
+
+	// Upper triangular counterpart of solve_lower, working up from the last block.
+	void solve_upper(size_t n, size_t r, const double* T, std::ptrdiff_t rs_t, std::ptrdiff_t cs_t, double* B, size_t ldb) {
+		for (size_t end = n; end > 0;) {
+			const size_t ib = std::min(NB, end);
+			const size_t i0 = end - ib;
+
+			if (end < n) {
+				gemm(ib, r, n - end, -1.0, T + i0 * rs_t + end * cs_t, rs_t, cs_t, B + end * ldb, ldb, 1, 1.0, B + i0 * ldb, ldb, 1);
+			}
+
+			for (size_t i = end; i-- > i0;) {
+				double* row = B + i * ldb;
+
+				for (size_t j = i + 1; j < end; j++) {
+					const double t = T[i * rs_t + j * cs_t];
+					const double* source = B + j * ldb;
+					for (size_t c = 0; c < r; c++) {
+						row[c] -= t * source[c];
+					}
+				}
+
+				const double d = T[i * rs_t + i * cs_t];
+				for (size_t c = 0; c < r; c++) {
+					row[c] /= d;
+				}
+			}
+
+			end = i0;
+		}
+	}
+
+	void require_square(const Matrix& A, const char* message) {
+		if (A.get_row_count() != A.get_col_count()) {
+			throw std::invalid_argument(message);
+		}
+	}
+
+	void require_rows(const Matrix& B, size_t rows) {
+		if (B.get_row_count() != rows) {
+			throw std::invalid_argument("Right hand side must have as many rows as the matrix.");
+		}
+	}
+
+	Vector first_column(const Matrix& M) {
+		Vector v(M.get_row_count());
+		for (size_t i = 0; i < v.size(); i++) {
+			v[i] = M(i, 0);
+		}
+		return v;
+	}
+}
+
+// --------- LU. ---------
+
+LUDecomposition::LUDecomposition(const Matrix& A) : factors(A) {
+	factor();
+}
+
+LUDecomposition::LUDecomposition(Matrix&& A) : factors(std::move(A)) {
+	factor();
+}
+
+void LUDecomposition::factor() {
+	require_square(factors, "LU decomposition can only be obtained if the matrix is square.");
+
+	const size_t n = factors.get_row_count();
+	double* a = factors.data();
+
+	permutation.resize(n);
+	std::iota(permutation.begin(), permutation.end(), size_t{ 0 });
+
+	for (size_t k = 0; k < n; k += NB) {
+		const size_t e = std::min(k + NB, n);
+
+		// Panel, columns k to e of rows k onwards. Whole rows are swapped so each pivot also
+		// applies to the columns on both sides of the panel.
+		for (size_t j = k; j < e; j++) {
+			size_t p = j;
+			for (size_t i = j + 1; i < n; i++) {
+				if (std::abs(a[i * n + j]) > std::abs(a[p * n + j])) {
+					p = i;
+				}
+			}
+
+			if (p != j) {
+				std::swap_ranges(a + j * n, a + (j + 1) * n, a + p * n);
+				std::swap(permutation[j], permutation[p]);
+				permutation_sign = -permutation_sign;
+			}
+
+			const double pivot = a[j * n + j];
+			if (pivot == 0.0) {
+				singular = true;
+				continue;
+			}
+
+			const double* pivot_row = a + j * n;
+			parallel_rows(n - j - 1, e - j, [a, n, j, e, pivot, pivot_row](size_t row_begin, size_t row_end) {
+				for (size_t i = j + 1 + row_begin; i < j + 1 + row_end; i++) {
+					double* row = a + i * n;
+					const double l = row[j] /= pivot;
+					for (size_t c = j + 1; c < e; c++) {
+						row[c] -= l * pivot_row[c];
+					}
+				}
+			});
+		}
+
+		if (e < n) {
+			// U12 = L11^-1 A12, then A22 -= L21 U12.
+			solve_lower(e - k, n - e, true, a + k * n + k, n, 1, a + k * n + e, n);
+			gemm(n - e, n - e, e - k, -1.0, a + e * n + k, n, 1, a + k * n + e, n, 1, 1.0, a + e * n + e, n, 1);
+		}
+	}
+}
+
+bool LUDecomposition::is_singular() const noexcept {
+	return singular;
+}
+
+Matrix LUDecomposition::solve(const Matrix& B) const {
+	const size_t n = factors.get_row_count();
+	require_rows(B, n);
+	if (singular) {
+		throw std::invalid_argument("Matrix is singular.");
+	}
+
+	const size_t r = B.get_col_count();
+	Matrix X(r, n);
+	for (size_t i = 0; i < n; i++) {
+		std::copy_n(B.data() + permutation[i] * r, r, X.data() + i * r);
+	}
+
+	solve_lower(n, r, true, factors.data(), n, 1, X.data(), r);
+	solve_upper(n, r, factors.data(), n, 1, X.data(), r);
+	return X;
+}
+
+Vector LUDecomposition::solve(const Vector& b) const {
+	return first_column(solve(Matrix(b)));
+}
+
+Matrix LUDecomposition::inverse() const {
+	return solve(Matrix::identity(factors.get_row_count()));
+}
+
+double LUDecomposition::determinant() const noexcept {
+	double det = permutation_sign;
+	for (size_t i = 0; i < factors.get_row_count(); i++) {
+		det *= factors(i, i);
+	}
+	return det;
+}
+
+Matrix LUDecomposition::lower() const {
+	const size_t n = factors.get_row_count();
+	Matrix L(n);
+	for (size_t i = 0; i < n; i++) {
+		std::copy_n(factors.data() + i * n, i, L.data() + i * n);
+		L(i, i) = 1.0;
+	}
+	return L;
+}
+
+Matrix LUDecomposition::upper() const {
+	const size_t n = factors.get_row_count();
+	Matrix U(n);
+	for (size_t i = 0; i < n; i++) {
+		std::copy(factors.data() + i * n + i, factors.data() + (i + 1) * n, U.data() + i * n + i);
+	}
+	return U;
+}
+
+const std::vector<size_t>& LUDecomposition::get_permutation() const noexcept {
+	return permutation;
+}
+
+// --------- Cholesky. ---------
+
+CholeskyDecomposition::CholeskyDecomposition(const Matrix& A) : CholeskyDecomposition(Matrix(A)) { }
+
+CholeskyDecomposition::CholeskyDecomposition(Matrix&& A) : factor(std::move(A)) {
+	require_square(factor, "Cholesky decomposition can only be obtained if the matrix is square.");
+
+	const size_t n = factor.get_row_count();
+	double* a = factor.data();
+
+	// Solves row i of the panel against the rows of L11 above it, columns k to end.
+	auto solve_row = [a, n](size_t i, size_t k, size_t end) {
+		for (size_t j = k; j < end; j++) {
+			double sum = a[i * n + j];
+			for (size_t p = k; p < j; p++) {
+				sum -= a[i * n + p] * a[j * n + p];
+			}
+			a[i * n + j] = sum / a[j * n + j];
+		}
+	};
+
+	for (size_t k = 0; k < n; k += NB) {
+		const size_t e = std::min(k + NB, n);
+
+		// Diagonal block.
+		for (size_t j = k; j < e; j++) {
+			double d = a[j * n + j];
+			for (size_t p = k; p < j; p++) {
+				d -= a[j * n + p] * a[j * n + p];
+			}
+
+			// Also rejects NaN.
+			if (!(d > 0.0)) {
+				throw std::invalid_argument("Matrix is not positive definite.");
+			}
+			a[j * n + j] = std::sqrt(d);
+
+			for (size_t i = j + 1; i < e; i++) {
+				double sum = a[i * n + j];
+				for (size_t p = k; p < j; p++) {
+					sum -= a[i * n + p] * a[j * n + p];
+				}
+				a[i * n + j] = sum / a[j * n + j];
+			}
+		}
+
+		if (e == n) {
+			break;
+		}
+
+		// L21 = A21 L11^-T, every row independently.
+		parallel_rows(n - e, e - k, [&solve_row, e, k](size_t row_begin, size_t row_end) {
+			for (size_t i = e + row_begin; i < e + row_end; i++) {
+				solve_row(i, k, e);
+			}
+		});
+
+		// A22 -= L21 L21^T, lower triangle only, a block of columns per GEMM.
+		for (size_t j0 = e; j0 < n; j0 += SYRK_BLOCK) {
+			const size_t w = std::min(SYRK_BLOCK, n - j0);
+			gemm(n - j0, w, e - k, -1.0, a + j0 * n + k, n, 1, a + j0 * n + k, 1, n, 1.0, a + j0 * n + j0, n, 1);
+		}
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		std::fill(a + i * n + i + 1, a + (i + 1) * n, 0.0);
+	}
+}
+
+Matrix CholeskyDecomposition::solve(const Matrix& B) const {
+	const size_t n = factor.get_row_count();
+	require_rows(B, n);
+
+	// L Y = B, then L^T X = Y through the transposed strides of L.
+	Matrix X(B);
+	const size_t r = X.get_col_count();
+	solve_lower(n, r, false, factor.data(), n, 1, X.data(), r);
+	solve_upper(n, r, factor.data(), 1, n, X.data(), r);
+	return X;
+}
+
+Vector CholeskyDecomposition::solve(const Vector& b) const {
+	return first_column(solve(Matrix(b)));
+}
+
+Matrix CholeskyDecomposition::inverse() const {
+	return solve(Matrix::identity(factor.get_row_count()));
+}
+
+double CholeskyDecomposition::determinant() const noexcept {
+	double det = 1.0;
+	for (size_t i = 0; i < factor.get_row_count(); i++) {
+		det *= factor(i, i) * factor(i, i);
+	}
+	return det;
+}
+
+const Matrix& CholeskyDecomposition::lower() const noexcept {
+	return factor;
+}
+
+// --------- QR. ---------
+
+QRDecomposition::QRDecomposition(const Matrix& A) : factors(A) {
+	factor();
+}
+
+QRDecomposition::QRDecomposition(Matrix&& A) : factors(std::move(A)) {
+	factor();
+}
+
+void QRDecomposition::factor() {
+	const size_t m = factors.get_row_count();
+	const size_t n = factors.get_col_count();
+	if (m < n) {
+		throw std::invalid_argument("QR decomposition requires at least as many rows as columns.");
+	}
+
+	double* a = factors.data();
+	std::vector<double> w(NB);
+
+	for (size_t k = 0; k < n; k += NB) {
+		const size_t e = std::min(k + NB, n);
+		const size_t nb = e - k;
+		const size_t rows = m - k;
+		std::vector<double> taus(nb);
+
+		// Panel, one reflector per column. H = I - tau v v^T maps column j below the diagonal onto
+		// beta e_j, v has an implicit leading 1 and the rest is stored in place of the zeros.
+		for (size_t j = k; j < e; j++) {
+			const double alpha = a[j * n + j];
+			double sigma = 0.0;
+			for (size_t i = j + 1; i < m; i++) {
+				sigma += a[i * n + j] * a[i * n + j];
+			}
+
+			if (sigma == 0.0) {
+				continue;
+			}
+
+			const double norm = std::sqrt(alpha * alpha + sigma);
+			const double beta = alpha <= 0.0 ? norm : -norm;
+			const double tau = (beta - alpha) / beta;
+			const double scale = 1.0 / (alpha - beta);
+			for (size_t i = j + 1; i < m; i++) {
+				a[i * n + j] *= scale;
+			}
+			a[j * n + j] = beta;
+			taus[j - k] = tau;
+			reflection_count++;
+
+			// Rest of the panel, A -= tau v (v^T A).
+			const size_t cols = e - j - 1;
+			std::copy_n(a + j * n + j + 1, cols, w.data());
+			for (size_t i = j + 1; i < m; i++) {
+				const double v = a[i * n + j];
+				for (size_t c = 0; c < cols; c++) {
+					w[c] += v * a[i * n + j + 1 + c];
+				}
+			}
+			for (size_t c = 0; c < cols; c++) {
+				w[c] *= tau;
+				a[j * n + j + 1 + c] -= w[c];
+			}
+			for (size_t i = j + 1; i < m; i++) {
+				const double v = a[i * n + j];
+				for (size_t c = 0; c < cols; c++) {
+					a[i * n + j + 1 + c] -= v * w[c];
+				}
+			}
+		}
+
+		// Explicit V with its unit diagonal and zeros above, so the block can go through GEMM.
+		BlockReflector block{ k, nb, std::vector<double>(rows * nb, 0.0), std::vector<double>(nb * nb, 0.0) };
+		for (size_t i = 0; i < rows; i++) {
+			for (size_t c = 0; c < std::min(i, nb); c++) {
+				block.V[i * nb + c] = a[(k + i) * n + k + c];
+			}
+			if (i < nb) {
+				block.V[i * nb + i] = 1.0;
+			}
+		}
+
+		// T from T(0:j, j) = -tau_j T(0:j, 0:j) V(:, 0:j)^T v_j, with the Gram matrix V^T V from GEMM.
+		std::vector<double> gram(nb * nb);
+		gemm(nb, nb, rows, 1.0, block.V.data(), 1, nb, block.V.data(), nb, 1, 0.0, gram.data(), nb, 1);
+		for (size_t j = 0; j < nb; j++) {
+			for (size_t p = 0; p < j; p++) {
+				double sum = 0.0;
+				for (size_t q = p; q < j; q++) {
+					sum += block.T[p * nb + q] * gram[q * nb + j];
+				}
+				block.T[p * nb + j] = -taus[j] * sum;
+			}
+			block.T[j * nb + j] = taus[j];
+		}
+
+		// Trailing columns, A22 = (I - V T^T V^T) A22.
+		if (e < n) {
+			const size_t cols = n - e;
+			std::vector<double> W(nb * cols), TW(nb * cols);
+			double* C = a + k * n + e;
+
+			gemm(nb, cols, rows, 1.0, block.V.data(), 1, nb, C, n, 1, 0.0, W.data(), cols, 1);
+			gemm(nb, cols, nb, 1.0, block.T.data(), 1, nb, W.data(), cols, 1, 0.0, TW.data(), cols, 1);
+			gemm(rows, cols, nb, -1.0, block.V.data(), nb, 1, TW.data(), cols, 1, 1.0, C, n, 1);
+		}
+
+		reflectors.push_back(std::move(block));
+	}
+}
+
+// Q = H_0 H_1 ... so Q^T applies the blocks first to last with T^T, and Q last to first with T.
+void QRDecomposition::apply(bool transpose, double* C, size_t cols) const {
+	std::vector<double> W, TW;
+
+	for (size_t b = 0; b < reflectors.size(); b++) {
+		const BlockReflector& block = reflectors[transpose ? b : reflectors.size() - 1 - b];
+		const size_t rows = factors.get_row_count() - block.offset;
+		const size_t nb = block.width;
+		double* rows_c = C + block.offset * cols;
+
+		W.resize(nb * cols);
+		TW.resize(nb * cols);
+		gemm(nb, cols, rows, 1.0, block.V.data(), 1, nb, rows_c, cols, 1, 0.0, W.data(), cols, 1);
+		if (transpose) {
+			gemm(nb, cols, nb, 1.0, block.T.data(), 1, nb, W.data(), cols, 1, 0.0, TW.data(), cols, 1);
+		}
+		else {
+			gemm(nb, cols, nb, 1.0, block.T.data(), nb, 1, W.data(), cols, 1, 0.0, TW.data(), cols, 1);
+		}
+		gemm(rows, cols, nb, -1.0, block.V.data(), nb, 1, TW.data(), cols, 1, 1.0, rows_c, cols, 1);
+	}
+}
+
+bool QRDecomposition::is_full_rank() const noexcept {
+	for (size_t i = 0; i < factors.get_col_count(); i++) {
+		if (factors(i, i) == 0.0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+Matrix QRDecomposition::solve(const Matrix& B) const {
+	const size_t m = factors.get_row_count();
+	const size_t n = factors.get_col_count();
+	require_rows(B, m);
+	if (!is_full_rank()) {
+		throw std::invalid_argument("Matrix is rank deficient.");
+	}
+
+	// R X = (Q^T B)(0:n), the remaining rows of Q^T B are the residual.
+	const size_t r = B.get_col_count();
+	Matrix QtB(B);
+	apply(true, QtB.data(), r);
+
+	Matrix X(r, n);
+	std::copy_n(QtB.data(), n * r, X.data());
+	solve_upper(n, r, factors.data(), n, 1, X.data(), r);
+	return X;
+}
+
+Vector QRDecomposition::solve(const Vector& b) const {
+	return first_column(solve(Matrix(b)));
+}
+
+Matrix QRDecomposition::inverse() const {
+	require_square(factors, "Inverse of a matrix can only be obtained if the matrix is square.");
+	return solve(Matrix::identity(factors.get_row_count()));
+}
+
+// Every reflector with a non-zero tau is a reflection with determinant -1.
+double QRDecomposition::determinant() const {
+	require_square(factors, "Determinant of a matrix can only be obtained if the matrix is square.");
+
+	double det = (reflection_count % 2 == 0) ? 1.0 : -1.0;
+	for (size_t i = 0; i < factors.get_row_count(); i++) {
+		det *= factors(i, i);
+	}
+	return det;
+}
+
+Matrix QRDecomposition::Q() const {
+	const size_t m = factors.get_row_count();
+	const size_t n = factors.get_col_count();
+
+	Matrix Q(n, m);
+	for (size_t i = 0; i < n; i++) {
+		Q(i, i) = 1.0;
+	}
+	apply(false, Q.data(), n);
+	return Q;
+}
+
+Matrix QRDecomposition::R() const {
+	const size_t n = factors.get_col_count();
+	Matrix R(n);
+	for (size_t i = 0; i < n; i++) {
+		std::copy(factors.data() + i * n + i, factors.data() + (i + 1) * n, R.data() + i * n + i);
+	}
+	return R;
+}
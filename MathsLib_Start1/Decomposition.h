@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "Matrix.h"
+#include "Vector.h"
+
+// Dense factorizations for solving linear systems.
+//
+// Each class factors its matrix once on construction, after which solve, inverse and
+// determinant reuse the factors for any number of right hand sides. The factorizations are
+// blocked: a narrow panel is factored a column at a time and the rest of the matrix is updated
+// with GEMM, so nearly all of the work runs in the cache blocked, threaded kernel. The
+// triangular solves are blocked the same way.
+
+// PA = LU with partial pivoting, for square matrices.
+class LUDecomposition {
+	// L below the diagonal with an implicit unit diagonal, U on and above it.
+	Matrix factors;
+	// Row i of PA is row permutation[i] of A.
+	std::vector<size_t> permutation;
+	int permutation_sign = 1;
+	bool singular = false;
+
+	void factor();
+
+public:
+	explicit LUDecomposition(const Matrix& A);
+	// Factors the matrix in its own storage.
+	explicit LUDecomposition(Matrix&& A);
+
+	// True when a pivot is exactly zero, solve and inverse then throw.
+	bool is_singular() const noexcept;
+
+	// X with A X = B, one column of B per right hand side.
+	Matrix solve(const Matrix& B) const;
+	Vector solve(const Vector& b) const;
+	Matrix inverse() const;
+	double determinant() const noexcept;
+
+	Matrix lower() const;
+	Matrix upper() const;
+	const std::vector<size_t>& get_permutation() const noexcept;
+};
+
+// A = L L^T for symmetric positive definite matrices. Only the lower triangle of A is read.
+class CholeskyDecomposition {
+	// L, with zeros above the diagonal.
+	Matrix factor;
+
+public:
+	explicit CholeskyDecomposition(const Matrix& A);
+	explicit CholeskyDecomposition(Matrix&& A);
+
+	Matrix solve(const Matrix& B) const;
+	Vector solve(const Vector& b) const;
+	Matrix inverse() const;
+	double determinant() const noexcept;
+
+	const Matrix& lower() const noexcept;
+};
+
+// A = QR by Householder reflections, for m x n matrices with m >= n. Q is kept in compact WY
+// form, one block reflector I - V T V^T per panel, and applied to right hand sides with GEMM.
+class QRDecomposition {
+	struct BlockReflector {
+		// First row and column of the panel, and its width.
+		size_t offset;
+		size_t width;
+		// (m - offset) x width unit lower trapezoidal, and width x width upper triangular, row major.
+		std::vector<double> V;
+		std::vector<double> T;
+	};
+
+	// R on and above the diagonal, the reflector vectors below it.
+	Matrix factors;
+	std::vector<BlockReflector> reflectors;
+	size_t reflection_count = 0;
+
+	void factor();
+	// C = Q^T C or C = Q C for a C with m rows.
+	void apply(bool transpose, double* C, size_t cols) const;
+
+public:
+	explicit QRDecomposition(const Matrix& A);
+	explicit QRDecomposition(Matrix&& A);
+
+	// True when no diagonal element of R is exactly zero, solve and inverse throw otherwise.
+	bool is_full_rank() const noexcept;
+
+	// Least squares solution X minimising |A X - B|, the exact solution when A is square.
+	Matrix solve(const Matrix& B) const;
+	Vector solve(const Vector& b) const;
+
+	// Square matrices only.
+	Matrix inverse() const;
+	double determinant() const;
+
+	// Thin factors, Q is m x n with orthonormal columns and R is n x n upper triangular.
+	Matrix Q() const;
+	Matrix R() const;
+};
@@ -0,0 +1,170 @@
+#pragma once
+#include "FixedVector.h"
+#include "Matrix.h"
+#include <cstddef>
+#include <stdexcept>
+
+// Fixed size, stack allocated R x C matrix for 2D/3D/4D maths.
+//
+// Mirrors the Matrix API with the dimensions in the type: multiplying incompatible shapes or
+// taking the trace of a non-square matrix does not compile. Stored as R rows of Vec<C, T>, so
+// M[r][c] indexing matches Matrix.
+
+template <size_t R, size_t C, typename T = double>
+struct Mat {
+	static_assert(R > 0 && C > 0, "Mat must have at least one row and one column.");
+
+	Vec<C, T> rows[R];
+
+	// Copies a runtime sized Matrix, which must be exactly R x C.
+	static Mat from_matrix(const Matrix& M) {
+		if (M.get_row_count() != R || M.get_col_count() != C) {
+			throw std::invalid_argument("Matrix has invalid dimensions for this fixed size matrix.");
+		}
+
+		Mat result{};
+		for (size_t r = 0; r < R; r++) {
+			for (size_t c = 0; c < C; c++) {
+				result.rows[r][c] = static_cast<T>(M[r][c]);
+			}
+		}
+		return result;
+	}
+
+	Matrix to_matrix() const {
+		Matrix result(C, R);
+		for (size_t r = 0; r < R; r++) {
+			for (size_t c = 0; c < C; c++) {
+				result[r][c] = static_cast<double>(rows[r][c]);
+			}
+		}
+		return result;
+	}
+
+	// Converts between float and double variants.
+	template <typename U>
+	constexpr explicit operator Mat<R, C, U>() const noexcept {
+		Mat<R, C, U> result{};
+		for (size_t r = 0; r < R; r++) {
+			result.rows[r] = static_cast<Vec<C, U>>(rows[r]);
+		}
+		return result;
+	}
+
+	static constexpr size_t get_row_count() noexcept {
+		return R;
+	}
+
+	static constexpr size_t get_col_count() noexcept {
+		return C;
+	}
+
+	constexpr Mat<C, R, T> transpose() const noexcept {
+		Mat<C, R, T> result{};
+		for (size_t r = 0; r < R; r++) {
+			for (size_t c = 0; c < C; c++) {
+				result.rows[c][r] = rows[r][c];
+			}
+		}
+		return result;
+	}
+
+	// Only exists for square matrices.
+	constexpr T trace() const noexcept requires (R == C) {
+		T sum = 0;
+		for (size_t i = 0; i < R; i++) {
+			sum += rows[i][i];
+		}
+		return sum;
+	}
+
+	static constexpr Mat identity() noexcept requires (R == C) {
+		Mat result{};
+		for (size_t i = 0; i < R; i++) {
+			result.rows[i][i] = 1;
+		}
+		return result;
+	}
+
+	// Iterators over the rows.
+	constexpr Vec<C, T>* begin() noexcept {
+		return rows;
+	}
+
+	constexpr Vec<C, T>* end() noexcept {
+		return rows + R;
+	}
+
+	constexpr const Vec<C, T>* begin() const noexcept {
+		return rows;
+	}
+
+	constexpr const Vec<C, T>* end() const noexcept {
+		return rows + R;
+	}
+
+	// Operator overloads.
+	constexpr Vec<C, T>& operator[](const size_t& index) noexcept {
+		return rows[index];
+	}
+
+	constexpr const Vec<C, T>& operator[](const size_t& index) const noexcept {
+		return rows[index];
+	}
+
+	constexpr bool operator==(const Mat& M) const noexcept {
+		for (size_t r = 0; r < R; r++) {
+			if (!(rows[r] == M.rows[r])) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	constexpr Mat operator-() const noexcept {
+		return *this * T(-1);
+	}
+
+	constexpr Mat operator*(const T& number) const noexcept {
+		Mat result{};
+		for (size_t r = 0; r < R; r++) {
+			result.rows[r] = rows[r] * number;
+		}
+		return result;
+	}
+
+	constexpr Mat operator/(const T& number) const noexcept {
+		return *this * (T(1) / number);
+	}
+
+	friend constexpr Mat operator*(const T& number, const Mat& M) noexcept {
+		return M * number;
+	}
+
+	constexpr Vec<R, T> operator*(const Vec<C, T>& V) const noexcept {
+		Vec<R, T> result{};
+		for (size_t r = 0; r < R; r++) {
+			result[r] = rows[r].dot_product(V);
+		}
+		return result;
+	}
+
+	// Inner dimensions must agree, (R x C) * (C x K) gives R x K.
+	template <size_t K>
+	constexpr Mat<R, K, T> operator*(const Mat<C, K, T>& M) const noexcept {
+		Mat<R, K, T> result{};
+		for (size_t r = 0; r < R; r++) {
+			for (size_t c = 0; c < C; c++) {
+				result.rows[r] = result.rows[r] + M.rows[c] * rows[r][c];
+			}
+		}
+		return result;
+	}
+};
+
+using Mat2f = Mat<2, 2, float>;
+using Mat3f = Mat<3, 3, float>;
+using Mat4f = Mat<4, 4, float>;
+using Mat2d = Mat<2, 2, double>;
+using Mat3d = Mat<3, 3, double>;
+using Mat4d = Mat<4, 4, double>;
@@ -0,0 +1,175 @@
+#pragma once
+#include "Vector.h"
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+// Fixed size, stack allocated vector for 2D/3D/4D maths.
+//
+// Mirrors the Vector API, but the dimension is part of the type so mixing sizes is a compile
+// time error rather than a std::invalid_argument, and nothing is ever heap allocated. It is an
+// aggregate, so Vec3d{ 1, 2, 3 } works and everything but the square roots is constexpr.
+
+template <size_t N, typename T = double>
+struct Vec {
+	static_assert(N > 0, "Vec must have at least one dimension.");
+	static_assert(std::is_floating_point_v<T>, "Vec elements must be floating point.");
+
+	T elements[N];
+
+	// Copies a runtime sized Vector, which must have exactly N elements.
+	static Vec from_vector(const Vector& vec) {
+		if (vec.size() != N) {
+			throw std::invalid_argument("Vector has invalid dimensions for this fixed size vector.");
+		}
+
+		Vec result{};
+		for (size_t i = 0; i < N; i++) {
+			result.elements[i] = static_cast<T>(vec[i]);
+		}
+		return result;
+	}
+
+	Vector to_vector() const {
+		Vector result(N);
+		for (size_t i = 0; i < N; i++) {
+			result[i] = static_cast<double>(elements[i]);
+		}
+		return result;
+	}
+
+	// Converts between float and double variants.
+	template <typename U>
+	constexpr explicit operator Vec<N, U>() const noexcept {
+		Vec<N, U> result{};
+		for (size_t i = 0; i < N; i++) {
+			result.elements[i] = static_cast<U>(elements[i]);
+		}
+		return result;
+	}
+
+	static constexpr size_t size() noexcept {
+		return N;
+	}
+
+	constexpr T dot_product(const Vec& vec) const noexcept {
+		T sum = 0;
+		for (size_t i = 0; i < N; i++) {
+			sum += elements[i] * vec.elements[i];
+		}
+		return sum;
+	}
+
+	constexpr T squared_length() const noexcept {
+		return dot_product(*this);
+	}
+
+	T euclidean_length() const noexcept {
+		return std::sqrt(squared_length());
+	}
+
+	constexpr bool is_zero(const T& tolerance = 0) const noexcept {
+		for (size_t i = 0; i < N; i++) {
+			if ((elements[i] < 0 ? -elements[i] : elements[i]) > tolerance) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	Vec normalise() const noexcept {
+		return *this / euclidean_length();
+	}
+
+	// Only exists for three dimensional vectors.
+	constexpr Vec cross_product(const Vec& vec) const noexcept requires (N == 3) {
+		return Vec{
+			elements[1] * vec.elements[2] - elements[2] * vec.elements[1],
+			elements[2] * vec.elements[0] - elements[0] * vec.elements[2],
+			elements[0] * vec.elements[1] - elements[1] * vec.elements[0]
+		};
+	}
+
+	T distance(const Vec& vec) const noexcept {
+		return (*this - vec).euclidean_length();
+	}
+
+	// Iterators.
+	constexpr T* begin() noexcept {
+		return elements;
+	}
+
+	constexpr T* end() noexcept {
+		return elements + N;
+	}
+
+	constexpr const T* begin() const noexcept {
+		return elements;
+	}
+
+	constexpr const T* end() const noexcept {
+		return elements + N;
+	}
+
+	// Operator overloads.
+	constexpr T& operator[](const size_t& index) noexcept {
+		return elements[index];
+	}
+
+	constexpr const T& operator[](const size_t& index) const noexcept {
+		return elements[index];
+	}
+
+	constexpr bool operator==(const Vec& vec) const noexcept {
+		for (size_t i = 0; i < N; i++) {
+			if (elements[i] != vec.elements[i]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	constexpr Vec operator+(const Vec& vec) const noexcept {
+		Vec result{};
+		for (size_t i = 0; i < N; i++) {
+			result.elements[i] = elements[i] + vec.elements[i];
+		}
+		return result;
+	}
+
+	constexpr Vec operator-(const Vec& vec) const noexcept {
+		Vec result{};
+		for (size_t i = 0; i < N; i++) {
+			result.elements[i] = elements[i] - vec.elements[i];
+		}
+		return result;
+	}
+
+	constexpr Vec operator*(const T& number) const noexcept {
+		Vec result{};
+		for (size_t i = 0; i < N; i++) {
+			result.elements[i] = elements[i] * number;
+		}
+		return result;
+	}
+
+	constexpr Vec operator/(const T& number) const noexcept {
+		return *this * (T(1) / number);
+	}
+
+	constexpr Vec operator-() const noexcept {
+		return *this * T(-1);
+	}
+
+	friend constexpr Vec operator*(const T& number, const Vec& vec) noexcept {
+		return vec * number;
+	}
+};
+
+using Vec2f = Vec<2, float>;
+using Vec3f = Vec<3, float>;
+using Vec4f = Vec<4, float>;
+using Vec2d = Vec<2, double>;
+using Vec3d = Vec<3, double>;
+using Vec4d = Vec<4, double>;
@@ -0,0 +1,315 @@
+// Cache blocked matrix multiply.
+//
+// Follows the usual Goto/BLIS structure: B is packed into an L3/L2 sized block of NR wide column
+// panels, A is packed into an L2 sized block of MR tall row panels, and a register tiled MR x NR
+// micro-kernel streams through both packed buffers with unit stride.
+
+#include "Gemm.h"
+#include "MemoryResource.h"
+#include "Simd.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <memory_resource>
+#include <algorithm>
+#include <type_traits>
+
+#ifdef MATHSLIB_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+	// Register tile, MR x NR accumulators stay in registers for the whole k loop. A row of the
+	// tile is one 64 byte vector of accumulators, 8 doubles or 16 floats.
+	constexpr size_t MR = 4;
+	template <typename Acc>
+	constexpr size_t NR = 64 / sizeof(Acc);
+
+	// Cache blocks. KC x NR doubles of B fit in L1, MC x KC of A fit in L2, KC x NC of B fit in L3.
+	constexpr size_t KC = 256;
+	constexpr size_t MC = 96;
+	constexpr size_t NC = 2048;
+
+	// Multiply-adds in one pass over k below which the whole pass runs on the calling thread.
+	constexpr size_t parallel_flops = size_t{ 1 } << 20;
+
+	// Elements are widened to the accumulator type as they are packed, so bfloat16 inputs cost
+	// one conversion per packed element rather than one per multiply.
+	template <typename Acc, typename In>
+	Acc widen(In value) noexcept {
+		return static_cast<Acc>(value);
+	}
+
+	// Copies the mc x kc block of A into MR tall panels, each stored column by column, scaled by alpha.
+	// Rows past the edge of the matrix are zero filled so the micro-kernel never needs a remainder path.
+	template <typename In, typename Acc>
+	void pack_a(size_t mc, size_t kc, Acc alpha, const In* A, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a, Acc* packed) {
+		for (size_t i = 0; i < mc; i += MR) {
+			const size_t mr = std::min(MR, mc - i);
+
+			for (size_t p = 0; p < kc; p++) {
+				for (size_t r = 0; r < mr; r++) {
+					packed[r] = alpha * widen<Acc>(A[(i + r) * rs_a + p * cs_a]);
+				}
+				for (size_t r = mr; r < MR; r++) {
+					packed[r] = Acc(0);
+				}
+				packed += MR;
+			}
+		}
+	}
+
+	// Copies the kc x nc block of B into NR wide panels, each stored row by row, zero filling the edge.
+	template <typename In, typename Acc>
+	void pack_b(size_t kc, size_t nc, const In* B, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b, Acc* packed) {
+		for (size_t j = 0; j < nc; j += NR<Acc>) {
+			const size_t nr = std::min(NR<Acc>, nc - j);
+
+			for (size_t p = 0; p < kc; p++) {
+				for (size_t c = 0; c < nr; c++) {
+					packed[c] = widen<Acc>(B[p * rs_b + (j + c) * cs_b]);
+				}
+				for (size_t c = nr; c < NR<Acc>; c++) {
+					packed[c] = Acc(0);
+				}
+				packed += NR<Acc>;
+			}
+		}
+	}
+
+	// Multiplies one packed MR x kc panel of A by one packed kc x NR panel of B and merges the
+	// mr x nr valid corner of the product into C. Inlined into one copy per instruction set below
+	// so the compiler vectorises the accumulator tile for each target.
+	template <typename Acc>
+	MATHSLIB_ALWAYS_INLINE void merge_tile(const Acc (&ab)[MR][NR<Acc>], Acc beta, Acc* C, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c, size_t mr, size_t nr) {
+		for (size_t i = 0; i < mr; i++) {
+			for (size_t j = 0; j < nr; j++) {
+				Acc& c = C[i * rs_c + j * cs_c];
+				c = (beta == Acc(0)) ? ab[i][j] : beta * c + ab[i][j];
+			}
+		}
+	}
+
+	template <typename Acc>
+	MATHSLIB_ALWAYS_INLINE void micro_kernel_body(size_t kc, const Acc* a, const Acc* b, Acc beta, Acc* C, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c, size_t mr, size_t nr) {
+		Acc ab[MR][NR<Acc>] = {};
+
+		for (size_t p = 0; p < kc; p++) {
+			for (size_t i = 0; i < MR; i++) {
+				for (size_t j = 0; j < NR<Acc>; j++) {
+					ab[i][j] += a[i] * b[j];
+				}
+			}
+			a += MR;
+			b += NR<Acc>;
+		}
+
+		merge_tile(ab, beta, C, rs_c, cs_c, mr, nr);
+	}
+
+	template <typename Acc>
+	void micro_kernel_generic(size_t kc, const Acc* a, const Acc* b, Acc beta, Acc* C, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c, size_t mr, size_t nr) {
+		micro_kernel_body(kc, a, b, beta, C, rs_c, cs_c, mr, nr);
+	}
+
+#ifdef MATHSLIB_X86
+	template <typename Acc>
+	MATHSLIB_TARGET_AVX2 void micro_kernel_avx2(size_t kc, const Acc* a, const Acc* b, Acc beta, Acc* C, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c, size_t mr, size_t nr) {
+		micro_kernel_body(kc, a, b, beta, C, rs_c, cs_c, mr, nr);
+	}
+
+	template <typename Acc>
+	MATHSLIB_TARGET_AVX512 void micro_kernel_avx512(size_t kc, const Acc* a, const Acc* b, Acc beta, Acc* C, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c, size_t mr, size_t nr) {
+		micro_kernel_body(kc, a, b, beta, C, rs_c, cs_c, mr, nr);
+	}
+
+	// GCC spreads the 4 x 16 float tile across shuffles instead of keeping one register per row,
+	// so the float kernels are written out with one accumulator per row of 8 or 16 lanes.
+	MATHSLIB_TARGET_AVX2 void micro_kernel_avx2_float(size_t kc, const float* a, const float* b, float beta, float* C, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c, size_t mr, size_t nr) {
+		__m256 acc[MR][2];
+		for (size_t i = 0; i < MR; i++) {
+			acc[i][0] = _mm256_setzero_ps();
+			acc[i][1] = _mm256_setzero_ps();
+		}
+
+		for (size_t p = 0; p < kc; p++) {
+			const __m256 b0 = _mm256_loadu_ps(b);
+			const __m256 b1 = _mm256_loadu_ps(b + 8);
+			for (size_t i = 0; i < MR; i++) {
+				const __m256 ai = _mm256_broadcast_ss(a + i);
+				acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+				acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+			}
+			a += MR;
+			b += NR<float>;
+		}
+
+		alignas(32) float ab[MR][NR<float>];
+		for (size_t i = 0; i < MR; i++) {
+			_mm256_store_ps(ab[i], acc[i][0]);
+			_mm256_store_ps(ab[i] + 8, acc[i][1]);
+		}
+		merge_tile(ab, beta, C, rs_c, cs_c, mr, nr);
+	}
+
+	MATHSLIB_TARGET_AVX512 void micro_kernel_avx512_float(size_t kc, const float* a, const float* b, float beta, float* C, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c, size_t mr, size_t nr) {
+		__m512 acc[MR];
+		for (size_t i = 0; i < MR; i++) {
+			acc[i] = _mm512_setzero_ps();
+		}
+
+		for (size_t p = 0; p < kc; p++) {
+			const __m512 bp = _mm512_loadu_ps(b);
+			for (size_t i = 0; i < MR; i++) {
+				acc[i] = _mm512_fmadd_ps(_mm512_set1_ps(a[i]), bp, acc[i]);
+			}
+			a += MR;
+			b += NR<float>;
+		}
+
+		alignas(64) float ab[MR][NR<float>];
+		for (size_t i = 0; i < MR; i++) {
+			_mm512_store_ps(ab[i], acc[i]);
+		}
+		merge_tile(ab, beta, C, rs_c, cs_c, mr, nr);
+	}
+#endif
+
+	template <typename Acc>
+	using MicroKernel = void (*)(size_t, const Acc*, const Acc*, Acc, Acc*, std::ptrdiff_t, std::ptrdiff_t, size_t, size_t);
+
+	template <typename Acc>
+	MicroKernel<Acc> select_micro_kernel() noexcept {
+		switch (simd_kernels().level) {
+#ifdef MATHSLIB_X86
+		case SimdLevel::AVX512:
+			if constexpr (std::is_same_v<Acc, float>) {
+				return micro_kernel_avx512_float;
+			}
+			return micro_kernel_avx512<Acc>;
+		case SimdLevel::AVX2:
+			if constexpr (std::is_same_v<Acc, float>) {
+				return micro_kernel_avx2_float;
+			}
+			return micro_kernel_avx2<Acc>;
+#endif
+		default:
+			return micro_kernel_generic<Acc>;
+		}
+	}
+
+	// C = beta * C, used when there is nothing to accumulate.
+	template <typename Acc>
+	void scale(size_t m, size_t n, Acc beta, Acc* C, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c) {
+		for (size_t i = 0; i < m; i++) {
+			for (size_t j = 0; j < n; j++) {
+				Acc& c = C[i * rs_c + j * cs_c];
+				c = (beta == Acc(0)) ? Acc(0) : beta * c;
+			}
+		}
+	}
+
+	// The blocked product for inputs of type In accumulated and stored as Acc.
+	template <typename In, typename Acc>
+	void blocked_gemm(size_t m, size_t n, size_t k,
+		Acc alpha, const In* A, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a,
+		const In* B, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b,
+		Acc beta, Acc* C, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c) {
+
+		constexpr size_t nr_max = NR<Acc>;
+
+		if (m == 0 || n == 0) {
+			return;
+		}
+
+		if (k == 0 || alpha == Acc(0)) {
+			scale(m, n, beta, C, rs_c, cs_c);
+			return;
+		}
+
+		static const MicroKernel<Acc> micro_kernel = select_micro_kernel<Acc>();
+		MATHSLIB_COUNT_FLOPS(2 * static_cast<uint64_t>(m) * n * k);
+		MATHSLIB_COUNT_ALLOCATION();
+
+		ThreadPool& pool = default_thread_pool();
+		// Scratch comes from the current resource like the result, so a scoped arena covers both.
+		std::pmr::vector<Acc> packed_b(std::min(KC, k) * ((std::min(NC, n) + nr_max - 1) / nr_max) * nr_max, current_memory_resource());
+
+		for (size_t jc = 0; jc < n; jc += NC) {
+			const size_t nc = std::min(NC, n - jc);
+			const size_t panels = (nc + nr_max - 1) / nr_max;
+
+			// Output tiles are MC rows by a whole number of NR panels. Columns are only split when
+			// there are too few row blocks to keep every thread busy.
+			const size_t row_blocks = (m + MC - 1) / MC;
+			const size_t col_blocks = std::min(panels, std::max<size_t>(1, pool.thread_count() / row_blocks));
+			const size_t tile_panels = (panels + col_blocks - 1) / col_blocks;
+			const size_t tiles = row_blocks * ((panels + tile_panels - 1) / tile_panels);
+
+			for (size_t pc = 0; pc < k; pc += KC) {
+				const size_t kc = std::min(KC, k - pc);
+
+				// Only the first pass over k applies beta, later passes accumulate onto it.
+				const Acc beta_pass = (pc == 0) ? beta : Acc(1);
+
+				pack_b(kc, nc, B + pc * rs_b + jc * cs_b, rs_b, cs_b, packed_b.data());
+
+				// Every element of C gets the same sequence of micro-kernel updates however the tiles
+				// are spread over threads, so the result does not depend on the thread count.
+				auto run_tiles = [&](size_t tile_begin, size_t tile_end) {
+					thread_local std::vector<Acc> packed_a(MC * KC);
+
+					for (size_t tile = tile_begin; tile < tile_end; tile++) {
+						const size_t ic = (tile % row_blocks) * MC;
+						const size_t mc = std::min(MC, m - ic);
+						const size_t jr_begin = (tile / row_blocks) * tile_panels * nr_max;
+						const size_t jr_end = std::min(nc, jr_begin + tile_panels * nr_max);
+
+						pack_a(mc, kc, alpha, A + ic * rs_a + pc * cs_a, rs_a, cs_a, packed_a.data());
+
+						for (size_t jr = jr_begin; jr < jr_end; jr += nr_max) {
+							for (size_t ir = 0; ir < mc; ir += MR) {
+								micro_kernel(kc, packed_a.data() + ir * kc, packed_b.data() + jr * kc, beta_pass,
+									C + (ic + ir) * rs_c + (jc + jr) * cs_c, rs_c, cs_c,
+									std::min(MR, mc - ir), std::min(nr_max, nc - jr));
+							}
+						}
+					}
+				};
+
+				// Small products are not worth waking the pool for.
+				if (m * nc * kc < parallel_flops) {
+					run_tiles(0, tiles);
+				}
+				else {
+					pool.parallel_for(0, tiles, 1, run_tiles);
+				}
+			}
+		}
+	}
+}
+
+void gemm(size_t m, size_t n, size_t k,
+	double alpha, const double* A, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a,
+	const double* B, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b,
+	double beta, double* C, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c) {
+	MATHSLIB_COUNT_OPERATION(Gemm);
+	blocked_gemm(m, n, k, alpha, A, rs_a, cs_a, B, rs_b, cs_b, beta, C, rs_c, cs_c);
+}
+
+void gemm(size_t m, size_t n, size_t k,
+	float alpha, const float* A, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a,
+	const float* B, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b,
+	float beta, float* C, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c) {
+	MATHSLIB_COUNT_OPERATION(Gemm);
+	blocked_gemm(m, n, k, alpha, A, rs_a, cs_a, B, rs_b, cs_b, beta, C, rs_c, cs_c);
+}
+
+void gemm(size_t m, size_t n, size_t k,
+	float alpha, const bfloat16* A, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a,
+	const bfloat16* B, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b,
+	float beta, float* C, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c) {
+	MATHSLIB_COUNT_OPERATION(Gemm);
+	blocked_gemm(m, n, k, alpha, A, rs_a, cs_a, B, rs_b, cs_b, beta, C, rs_c, cs_c);
+}
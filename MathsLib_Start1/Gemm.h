@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include "BFloat16.h"
+
+
+// General matrix multiply, C = alpha * A * B + beta * C.
+//
+// A is m x k, B is k x n and C is m x n. Every operand is addressed through a row stride and a
+// column stride, element (i, j) of A lives at A[i * rs_a + j * cs_a], so transposed operands are
+// passed by swapping the strides rather than copying. When beta is 0 the contents of C are never read.
+void gemm(size_t m, size_t n, size_t k,
+	double alpha, const double* A, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a,
+	const double* B, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b,
+	double beta, double* C, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c);
+
+// Single precision, with the same blocking and twice as many elements per register.
+void gemm(size_t m, size_t n, size_t k,
+	float alpha, const float* A, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a,
+	const float* B, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b,
+	float beta, float* C, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c);
+
+// bfloat16 operands are widened to float as they are packed, the product accumulates in float.
+void gemm(size_t m, size_t n, size_t k,
+	float alpha, const bfloat16* A, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a,
+	const bfloat16* B, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b,
+	float beta, float* C, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c);
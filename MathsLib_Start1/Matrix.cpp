@@ -1,73 +1,216 @@
 #include "Matrix.h"
+#include "Decomposition.h"
+#include "Gemm.h"
+#include "Simd.h"
+#include "Stats.h"
+#include "TextIO.h"
+#include "ThreadPool.h"
+#include "Transpose.h"
+#include <algorithm>
+#include <functional>
 
 
 // Constructors.
 Matrix::Matrix(std::initializer_list<std::initializer_list<double>> matrix) {
+	MATHSLIB_COUNT_OPERATION(MatrixConstruct);
+	row_count = matrix.size();
+	col_count = row_count ? matrix.begin()->size() : 0;
+	internal_storage.reserve(row_count * col_count);
+
 	for (const auto& vector : matrix) {
-		internal_storage.push_back(std::vector<double>(vector));
+		if (vector.size() != col_count) {
+			throw std::invalid_argument("All rows of a matrix must be the same length.");
+		}
+		internal_storage.insert(internal_storage.end(), vector.begin(), vector.end());
 	}
 
 	verify_size();
+	MATHSLIB_COUNT_ALLOCATION();
+	MATHSLIB_COUNT_COPY(internal_storage.size() * sizeof(double));
 }
 
-Matrix::Matrix(std::vector<std::vector<double>> matrix) : internal_storage{ matrix } { verify_size(); }
+Matrix::Matrix(std::vector<std::vector<double>> matrix) {
+	MATHSLIB_COUNT_OPERATION(MatrixConstruct);
+	row_count = matrix.size();
+	col_count = row_count ? matrix[0].size() : 0;
+	internal_storage.reserve(row_count * col_count);
 
-Matrix::Matrix(const Vector& V) {
-	for (const auto& i : V) {
-		internal_storage.emplace_back(1, i);
+	for (const auto& vector : matrix) {
+		if (vector.size() != col_count) {
+			throw std::invalid_argument("All rows of a matrix must be the same length.");
+		}
+		internal_storage.insert(internal_storage.end(), vector.begin(), vector.end());
 	}
+
+	verify_size();
+	MATHSLIB_COUNT_ALLOCATION();
+	MATHSLIB_COUNT_COPY(internal_storage.size() * sizeof(double));
+}
+
+// Delegated to by the constructors below, each with a ConstructionScope.
+Matrix::Matrix(const ConstructionScope&, size_t rows, size_t cols, std::pmr::memory_resource* resource) : row_count{ rows }, col_count{ cols }, internal_storage(rows * cols, 0.0, resource) {
+	MATHSLIB_COUNT_ALLOCATION();
+}
+
+Matrix::Matrix(const ConstructionScope&, size_t rows, size_t cols, const double* first, std::pmr::memory_resource* resource) : row_count{ rows }, col_count{ cols }, internal_storage(first, first + rows * cols, resource) {
+	MATHSLIB_COUNT_ALLOCATION();
+	MATHSLIB_COUNT_COPY(internal_storage.size() * sizeof(double));
+}
+
+// A vector becomes a single column matrix.
+Matrix::Matrix(const Vector& V) : Matrix(ConstructionScope(StatsOperation::MatrixConstruct), V.size(), 1, V.data(), current_memory_resource()) {
+	verify_size();
+}
+
+Matrix::Matrix(const size_t& size) : Matrix(ConstructionScope(StatsOperation::MatrixConstruct), size, size, current_memory_resource()) {
 	verify_size();
 }
 
-Matrix::Matrix(const size_t& size) : internal_storage{
-	std::vector<std::vector<double>>{
-	std::vector(size, std::vector<double>(size, 0.0))
-} } {
+// x is the number of columns and y the number of rows.
+Matrix::Matrix(const size_t& x, const size_t& y) : Matrix(ConstructionScope(StatsOperation::MatrixConstruct), y, x, current_memory_resource()) {
 	verify_size();
 }
 
-Matrix::Matrix(const size_t& x, const size_t& y) : internal_storage{
-	std::vector<std::vector<double>>{
-	std::vector(y, std::vector<double>(x, 0.0))
-} } {
+Matrix::Matrix(const size_t& x, const size_t& y, std::pmr::memory_resource* resource) : Matrix(ConstructionScope(StatsOperation::MatrixConstruct), y, x, resource) {
 	verify_size();
 }
 
+Matrix::Matrix(const Matrix& M) : Matrix(ConstructionScope(StatsOperation::MatrixCopy), M.row_count, M.col_count, M.data(), current_memory_resource()) {}
+
+// Reuses the existing storage when it is large enough.
+Matrix& Matrix::operator=(const Matrix& M) {
+	MATHSLIB_COUNT_OPERATION(MatrixCopy);
+	if (this != &M) {
+		if (M.internal_storage.size() > internal_storage.capacity()) {
+			MATHSLIB_COUNT_ALLOCATION();
+		}
+		MATHSLIB_COUNT_COPY(M.internal_storage.size() * sizeof(double));
+		internal_storage.assign(M.internal_storage.begin(), M.internal_storage.end());
+		row_count = M.row_count;
+		col_count = M.col_count;
+	}
+	return *this;
+}
+
 void Matrix::verify_size() {
-	if (internal_storage.empty()) {
+	if (row_count == 0 || col_count == 0) {
 		throw std::invalid_argument("Cannot construct an empty matrix.");
 	}
+}
 
-	if (internal_storage[0].empty()) {
-		throw std::invalid_argument("Cannot construct an empty matrix.");
+Matrix& Matrix::assign(ConstMatrixView source) {
+	const size_t rows = source.get_row_count();
+	const size_t cols = source.get_col_count();
+	const std::ptrdiff_t rs = source.row_stride();
+	const std::ptrdiff_t cs = source.col_stride();
+
+	// Resizing may move the storage a view of this matrix refers to, so such views are copied out first.
+	if (rows != 0 && cols != 0) {
+		const double* first = source.data();
+		const double* last = first + static_cast<std::ptrdiff_t>(rows - 1) * rs + static_cast<std::ptrdiff_t>(cols - 1) * cs;
+		const double* low = std::min(first, last, std::less<const double*>());
+		const double* high = std::max(first, last, std::less<const double*>());
+		const double* begin = internal_storage.data();
+		const double* end = begin + internal_storage.size();
+		if (std::less<const double*>()(low, end) && !std::less<const double*>()(high, begin)) {
+			Matrix copy(cols, rows, get_memory_resource());
+			copy.assign(source);
+			return *this = std::move(copy);
+		}
+	}
+
+	row_count = rows;
+	col_count = cols;
+	const size_t capacity = internal_storage.capacity();
+	internal_storage.resize(rows * cols);
+	if (internal_storage.capacity() != capacity) {
+		MATHSLIB_COUNT_ALLOCATION();
 	}
+	MATHSLIB_COUNT_COPY(rows * cols * sizeof(double));
+	double* out = internal_storage.data();
+
+	if (cs == 1) {
+		parallel_rows(rows, cols, [=](size_t row_begin, size_t row_end) {
+			for (size_t r = row_begin; r < row_end; r++) {
+				std::copy_n(source.data() + static_cast<std::ptrdiff_t>(r) * rs, cols, out + r * cols);
+			}
+		});
+	}
+	else if (rs == 1) {
+		// Contiguous columns, a transposed view of row-major storage.
+		::transpose(cols, rows, source.data(), cs, out, static_cast<std::ptrdiff_t>(cols));
+	}
+	else {
+		parallel_rows(rows, cols, [=](size_t row_begin, size_t row_end) {
+			for (size_t r = row_begin; r < row_end; r++) {
+				for (size_t c = 0; c < cols; c++) {
+					out[r * cols + c] = source(r, c);
+				}
+			}
+		});
+	}
+
+	return *this;
 }
 
 size_t Matrix::get_col_count() const noexcept {
-	return internal_storage[0].size();
+	return col_count;
 }
 
 size_t Matrix::get_row_count() const noexcept {
-	return internal_storage.size();
+	return row_count;
 }
 
+// Copies the flat storage out into one std::vector per row.
 std::vector<std::vector<double>> Matrix::get_internal_storage() const noexcept {
-	return internal_storage;
+	std::vector<std::vector<double>> rows;
+	rows.reserve(row_count);
+
+	for (const auto& row : *this) {
+		rows.emplace_back(row.begin(), row.end());
+	}
+
+	return rows;
 }
 
-Matrix Matrix::transpose() const {
+double* Matrix::data() noexcept {
+	return internal_storage.data();
+}
 
-	Matrix M(get_row_count(), get_col_count());
+const double* Matrix::data() const noexcept {
+	return internal_storage.data();
+}
 
-	for (int x = 0; x < get_row_count(); x++) {
-		for (int y = 0; y < get_col_count(); y++) {
-			M[y][x] = internal_storage[x][y];
-		}
-	}
+std::pmr::memory_resource* Matrix::get_memory_resource() const noexcept {
+	return internal_storage.get_allocator().resource();
+}
 
+Matrix Matrix::transpose() const & {
+	MATHSLIB_COUNT_OPERATION(MatrixTranspose);
+	MATHSLIB_COUNT_COPY(internal_storage.size() * sizeof(double));
+	Matrix M(row_count, col_count);
+	::transpose(row_count, col_count, internal_storage.data(), col_count, M.internal_storage.data(), row_count);
 	return M;
 }
 
+// A temporary square matrix is transposed in its own storage.
+Matrix Matrix::transpose() && {
+	transpose_in_place();
+	return std::move(*this);
+}
+
+// Square matrices swap across the diagonal without allocating, other shapes need a second buffer.
+Matrix& Matrix::transpose_in_place() {
+	MATHSLIB_COUNT_OPERATION(MatrixTranspose);
+	if (row_count == col_count) {
+		::transpose_in_place(row_count, internal_storage.data(), col_count);
+	}
+	else {
+		*this = std::as_const(*this).transpose();
+	}
+	return *this;
+}
+
 Matrix Matrix::identity(const size_t& num) noexcept {
 	Matrix M(num);
 
@@ -78,14 +221,10 @@ Matrix Matrix::identity(const size_t& num) noexcept {
 	return M;
 }
 
+// Formatted in one go and written without flushing.
 void Matrix::print() const noexcept {
-	for (const auto& vector : internal_storage) {
-		for (const auto& i : vector) {
-			std::cout << i << " ";
-		}
-		std::cout << std::endl;
-	}
-	std::cout << std::endl;
+	const std::string text = format_matrix(view(), ' ') + "\n";
+	std::cout.write(text.data(), static_cast<std::streamsize>(text.size()));
 }
 
 double Matrix::trace() const {
@@ -97,74 +236,124 @@ double Matrix::trace() const {
 	double sum = 0;
 
 	for (int i = 0; i < get_col_count(); i++) {
-		sum += internal_storage[i][i];
+		sum += internal_storage[i * col_count + i];
 	}
 
 	return sum;
 }
 
+double Matrix::determinant() const {
+	MATHSLIB_COUNT_OPERATION(MatrixFactorise);
+	return LUDecomposition(*this).determinant();
+}
+
+Matrix Matrix::inverse() const {
+	MATHSLIB_COUNT_OPERATION(MatrixFactorise);
+	return LUDecomposition(*this).inverse();
+}
+
+Matrix Matrix::solve(const Matrix& B) const {
+	MATHSLIB_COUNT_OPERATION(MatrixFactorise);
+	return LUDecomposition(*this).solve(B);
+}
+
+Vector Matrix::solve(const Vector& b) const {
+	MATHSLIB_COUNT_OPERATION(MatrixFactorise);
+	return LUDecomposition(*this).solve(b);
+}
+
+Matrix Matrix::least_squares(const Matrix& B) const {
+	MATHSLIB_COUNT_OPERATION(MatrixFactorise);
+	return QRDecomposition(*this).solve(B);
+}
+
+Vector Matrix::least_squares(const Vector& b) const {
+	MATHSLIB_COUNT_OPERATION(MatrixFactorise);
+	return QRDecomposition(*this).solve(b);
+}
+
 // Operator overloads.
-std::vector<double>& Matrix::operator[](const size_t& index) {
-	return internal_storage[index];
+Matrix::Row Matrix::operator[](const size_t& index) {
+	return Row(internal_storage.data() + index * col_count, col_count);
+}
+
+Matrix::ConstRow Matrix::operator[](const size_t& index) const {
+	return ConstRow(internal_storage.data() + index * col_count, col_count);
 }
 
 bool Matrix::operator==(const Matrix& M) const noexcept {
-	return internal_storage == get_internal_storage();
+	return row_count == M.row_count && col_count == M.col_count && internal_storage == M.internal_storage;
 }
 
+// Compares the first column of the matrix against the vector.
 bool Matrix::operator==(const Vector& V) const noexcept {
-	return Matrix(internal_storage).transpose().get_internal_storage()[0] == V.get_internal_storage();
+	return row_count == V.size() && vector_expressions_equal(col(0), V.view());
 }
 
+// The vector is read in place as a single column, no intermediate Matrix copy.
 Matrix operator*(const Matrix& M, const Vector& V) {
-	return M * Matrix(V);
-}
-
-Matrix operator*(const Matrix& _M, const double& num) noexcept {
+	MATHSLIB_COUNT_OPERATION(MatrixMultiply);
 
-	Matrix M(_M);
-
-	for (int y = 0; y < M.get_row_count(); y++) {
-		for (int x = 0; x < M.get_col_count(); x++) {
-			M[y][x] *= num;
-		}
+	if (M.get_col_count() != V.size()) {
+		throw std::invalid_argument("Matrix multiplication must have valid dimensions.");
 	}
 
-	return M;
+	Matrix result(1, M.get_row_count());
+	gemm(M.row_count, 1, M.col_count,
+		1.0, M.internal_storage.data(), M.col_count, 1,
+		V.data(), 1, 1,
+		0.0, result.internal_storage.data(), 1, 1);
+
+	return result;
 }
 
-Matrix operator*(const double& num, const Matrix& M) noexcept {
-	return M * num;
+Matrix& Matrix::operator*=(const double& num) noexcept {
+	double* out = internal_storage.data();
+	parallel_elementwise(internal_storage.size(), [out, num](size_t begin, size_t end) {
+		simd_kernels().scale(out + begin, num, out + begin, end - begin);
+	});
+	return *this;
 }
 
-Matrix Matrix::operator-() const noexcept {
-	return Matrix(internal_storage) * -1;
+// Multiplies by the reciprocal, matching operator/.
+Matrix& Matrix::operator/=(const double& num) noexcept {
+	return *this *= (1.0 / num);
 }
 
 // Friend operator overload since Matrix * Matrix is not commutative under multplication.
 Matrix operator*(const Matrix& M0, const Matrix& M1) {
+	MATHSLIB_COUNT_OPERATION(MatrixMultiply);
 
 	if (M0.get_col_count() != M1.get_row_count()) {
 		throw std::invalid_argument("Matrix multiplication must have valid dimensions.");
 	}
 
-	Matrix M(M0.get_row_count(), M1.get_col_count());
+	Matrix M(M1.get_col_count(), M0.get_row_count());
+	gemm(1.0, M0, M1, 0.0, M);
 
-	int x = 0;
-	int y = 0;
-	for (const auto& V1 : M1.transpose()) {
-		for (const auto& V0 : M0) {
-			M[y][x] = Vector(V1).dot_product(V0);
-			x++;
-		}
-		x = 0;
-		y++;
+	return M;
+}
+
+void gemm(const double& alpha, const Matrix& A, const Matrix& B, const double& beta, Matrix& C) {
+
+	if (A.col_count != B.row_count || C.row_count != A.row_count || C.col_count != B.col_count) {
+		throw std::invalid_argument("Matrix multiplication must have valid dimensions.");
 	}
 
-	return M.transpose();
+	gemm(A.row_count, B.col_count, A.col_count,
+		alpha, A.internal_storage.data(), A.col_count, 1,
+		B.internal_storage.data(), B.col_count, 1,
+		beta, C.internal_storage.data(), C.col_count, 1);
 }
 
-Matrix operator/(const Matrix& M, const double& num) noexcept {
-	return M * (1.0 / num);
-}
+void gemm(const double& alpha, ConstMatrixView A, ConstMatrixView B, const double& beta, MatrixView C) {
 
+	if (A.get_col_count() != B.get_row_count() || C.get_row_count() != A.get_row_count() || C.get_col_count() != B.get_col_count()) {
+		throw std::invalid_argument("Matrix multiplication must have valid dimensions.");
+	}
+
+	gemm(A.get_row_count(), B.get_col_count(), A.get_col_count(),
+		alpha, A.data(), A.row_stride(), A.col_stride(),
+		B.data(), B.row_stride(), B.col_stride(),
+		beta, C.data(), C.row_stride(), C.col_stride());
+}
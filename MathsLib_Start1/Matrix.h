@@ -1,51 +1,409 @@
 #pragma once
 #include "Vector.h"
+#include "MatrixExpression.h"
+#include "MatrixView.h"
+#include "Stats.h"
+#include "ThreadPool.h"
 #include <vector>
+#include <memory_resource>
 #include <stdexcept>
 #include <iostream>
+#include <iterator>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
 
 
-class Matrix {
-    std::vector<std::vector<double>> internal_storage;
+class Matrix : public MatrixExpression<Matrix> {
+    // Row-major elements in one contiguous buffer, element (r, c) lives at r * col_count + c.
+    size_t row_count = 0;
+    size_t col_count = 0;
+    std::pmr::vector<double> internal_storage{ current_memory_resource() };
+
+    // Targets of the public constructors, which count the operation from before the storage is made.
+    // The first fills the storage with zeros and the second copies rows * cols elements from first.
+    Matrix(const ConstructionScope&, size_t rows, size_t cols, std::pmr::memory_resource* resource);
+    Matrix(const ConstructionScope&, size_t rows, size_t cols, const double* first, std::pmr::memory_resource* resource);
 
     void verify_size();
+    Matrix& assign(ConstMatrixView source);
+
+    // Writes the elements of an expression into the storage, which already has its shape.
+    template <typename E>
+    void evaluate(const E& source);
 
 public:
 
-    // Public constructors.
+    using Row = VectorView;
+    using ConstRow = ConstVectorView;
+
+    // Public constructors. Storage comes from current_memory_resource() unless a resource is given.
     Matrix(std::initializer_list< std::initializer_list<double>> matrix);
     Matrix(std::vector<std::vector<double>> matrix);
     explicit Matrix(const Vector& V);
     explicit Matrix(const size_t& size);
     explicit Matrix(const size_t& x, const size_t& y);
-    
+    Matrix(const size_t& x, const size_t& y, std::pmr::memory_resource* resource);
+
+    // Copies allocate from the current resource, moves keep the storage and its resource.
+    Matrix(const Matrix& M);
+    Matrix(Matrix&& M) noexcept = default;
+    Matrix& operator=(const Matrix& M);
+    Matrix& operator=(Matrix&& M) = default;
+
+    // Evaluates a lazy expression such as -M * 2 in a single pass.
+    template <typename E>
+    Matrix(const MatrixExpression<E>& expression);
+    template <typename E>
+    Matrix& operator=(const MatrixExpression<E>& expression);
+
     // Methods.
     size_t get_col_count() const noexcept;
     size_t get_row_count() const noexcept;
     std::vector<std::vector<double>> get_internal_storage() const noexcept;
-    Matrix transpose() const;
+    double* data() noexcept;
+    const double* data() const noexcept;
+    std::pmr::memory_resource* get_memory_resource() const noexcept;
+    Matrix transpose() const &;
+    Matrix transpose() &&;
+    Matrix& transpose_in_place();
     void print() const noexcept;
     double trace() const;
     static Matrix identity(const size_t& num) noexcept;
 
+    // Linear systems through the factorizations in Decomposition.h. Use those directly to factor
+    // once and solve for many right hand sides. Least squares needs at least as many rows as columns.
+    double determinant() const;
+    Matrix inverse() const;
+    Matrix solve(const Matrix& B) const;
+    Vector solve(const Vector& b) const;
+    Matrix least_squares(const Matrix& B) const;
+    Vector least_squares(const Vector& b) const;
+
+    // Zero-copy views of the storage, valid until the matrix is resized or destroyed.
+    MatrixView view() noexcept {
+        return MatrixView(internal_storage.data(), row_count, col_count, static_cast<std::ptrdiff_t>(col_count));
+    }
+
+    ConstMatrixView view() const noexcept {
+        return ConstMatrixView(internal_storage.data(), row_count, col_count, static_cast<std::ptrdiff_t>(col_count));
+    }
+
+    // Whether reading this matrix while writing target could read an overwritten element, see MatrixExpression.h.
+    bool aliases(const ConstMatrixView& target) const noexcept {
+        return view().aliases(target);
+    }
+
+    Row row(const size_t& index) noexcept {
+        return view().row(index);
+    }
+
+    ConstRow row(const size_t& index) const noexcept {
+        return view().row(index);
+    }
+
+    VectorView col(const size_t& index) noexcept {
+        return view().col(index);
+    }
+
+    ConstVectorView col(const size_t& index) const noexcept {
+        return view().col(index);
+    }
+
+    // Transposed, block, row range, column range and diagonal views, see MatrixView.h.
+    MatrixView T() noexcept {
+        return view().T();
+    }
+
+    ConstMatrixView T() const noexcept {
+        return view().T();
+    }
+
+    MatrixView block(size_t row, size_t col, size_t rows, size_t cols) {
+        return view().block(row, col, rows, cols);
+    }
+
+    ConstMatrixView block(size_t row, size_t col, size_t rows, size_t cols) const {
+        return view().block(row, col, rows, cols);
+    }
+
+    MatrixView row_range(size_t begin, size_t end) {
+        return view().row_range(begin, end);
+    }
+
+    ConstMatrixView row_range(size_t begin, size_t end) const {
+        return view().row_range(begin, end);
+    }
+
+    MatrixView col_range(size_t begin, size_t end) {
+        return view().col_range(begin, end);
+    }
+
+    ConstMatrixView col_range(size_t begin, size_t end) const {
+        return view().col_range(begin, end);
+    }
+
+    VectorView diagonal() noexcept {
+        return view().diagonal();
+    }
+
+    ConstVectorView diagonal() const noexcept {
+        return view().diagonal();
+    }
+
     // Iterators. Templates (auto) in header only.
+    auto begin() {
+        return view().begin();
+    }
+
+    auto end() {
+        return view().end();
+    }
+
     auto begin() const {
-        return internal_storage.begin();
+        return view().begin();
     }
 
     auto end() const {
-        return internal_storage.end();
+        return view().end();
     }
 
     // Operator overloading.
-    std::vector<double>& operator[](const size_t& index);
+    Row operator[](const size_t& index);
+    ConstRow operator[](const size_t& index) const;
+
+    // Element access is inline so fused expressions can vectorise.
+    double& operator()(const size_t& row, const size_t& col) noexcept {
+        return internal_storage[row * col_count + col];
+    }
+
+    const double& operator()(const size_t& row, const size_t& col) const noexcept {
+        return internal_storage[row * col_count + col];
+    }
+
     bool operator==(const Matrix& M) const noexcept;
     bool operator==(const Vector& V) const noexcept;
-    Matrix operator-() const noexcept;
     friend Matrix operator*(const Matrix& M, const Vector& V);
     friend Matrix operator*(const Matrix& M0, const Matrix& M1);
-    friend Matrix operator*(const Matrix& M, const double& num) noexcept;
-    friend Matrix operator*(const double& num, const Matrix& M) noexcept;
-    friend Matrix operator/(const Matrix& M, const double& num) noexcept;
-    
+
+    // Compound assignment, updates the existing storage in place.
+    template <typename E>
+    Matrix& operator+=(const MatrixExpression<E>& expression);
+    template <typename E>
+    Matrix& operator-=(const MatrixExpression<E>& expression);
+    Matrix& operator*=(const double& num) noexcept;
+    Matrix& operator/=(const double& num) noexcept;
+
+    // C = alpha * A * B + beta * C, accumulating into an existing matrix.
+    friend void gemm(const double& alpha, const Matrix& A, const Matrix& B, const double& beta, Matrix& C);
+
 };
+
+// The same for views, read and written through their strides. C must not overlap A or B.
+void gemm(const double& alpha, ConstMatrixView A, ConstMatrixView B, const double& beta, MatrixView C);
+
+// Operands a product reads in place through their strides.
+template <typename M>
+concept StridedMatrix = std::is_same_v<M, Matrix> || std::is_same_v<M, MatrixView> || std::is_same_v<M, ConstMatrixView>;
+
+inline ConstMatrixView strided_view(const Matrix& M) noexcept {
+    return M.view();
+}
+
+inline ConstMatrixView strided_view(MatrixView M) noexcept {
+    return M;
+}
+
+inline ConstMatrixView strided_view(ConstMatrixView M) noexcept {
+    return M;
+}
+
+// Products involving a view go straight to gemm, where otherwise the view would be converted to a
+// Matrix first. Matrix * Matrix still picks the friend above.
+template <typename L, typename R>
+    requires StridedMatrix<L> && StridedMatrix<R>
+Matrix operator*(const L& lhs, const R& rhs) {
+    MATHSLIB_COUNT_OPERATION(MatrixMultiply);
+    const ConstMatrixView A = strided_view(lhs);
+    const ConstMatrixView B = strided_view(rhs);
+
+    if (A.get_col_count() != B.get_row_count()) {
+        throw std::invalid_argument("Matrix multiplication must have valid dimensions.");
+    }
+
+    Matrix M(B.get_col_count(), A.get_row_count());
+    gemm(1.0, A, B, 0.0, M.view());
+    return M;
+}
+
+template <typename M>
+    requires StridedMatrix<M>
+Matrix operator*(const M& lhs, const Vector& V) {
+    MATHSLIB_COUNT_OPERATION(MatrixMultiply);
+    const ConstMatrixView A = strided_view(lhs);
+
+    if (A.get_col_count() != V.size()) {
+        throw std::invalid_argument("Matrix multiplication must have valid dimensions.");
+    }
+
+    Matrix result(1, A.get_row_count());
+    gemm(1.0, A, ConstMatrixView(V.data(), V.size(), 1, 1), 0.0, result.view());
+    return result;
+}
+
+template <typename E>
+Matrix::Matrix(const MatrixExpression<E>& expression) {
+    *this = expression;
+}
+
+template <typename E>
+void Matrix::evaluate(const E& source) {
+    double* out = internal_storage.data();
+    const size_t cols = col_count;
+    parallel_rows(row_count, cols, [&source, out, cols](size_t row_begin, size_t row_end) {
+        for (size_t r = row_begin; r < row_end; r++) {
+            for (size_t c = 0; c < cols; c++) {
+                out[r * cols + c] = source(r, c);
+            }
+        }
+    });
+}
+
+// Elementwise expressions read (r, c) just before writing (r, c), so an operand laid out like the
+// target, as M is in M = M * 2, is evaluated in place. Operands that overlap the target any other
+// way, such as M.T() or a shifted block of M, are evaluated into new storage. A lone view is copied
+// by rows or by the blocked transpose instead, see assign().
+template <typename E>
+Matrix& Matrix::operator=(const MatrixExpression<E>& expression) {
+    MATHSLIB_COUNT_OPERATION(MatrixExpression);
+    const E& source = expression.self();
+    if constexpr (std::is_same_v<E, MatrixView> || std::is_same_v<E, ConstMatrixView>) {
+        return assign(source);
+    }
+
+    const size_t rows = source.get_row_count();
+    const size_t cols = source.get_col_count();
+    if (source.aliases(ConstMatrixView(internal_storage.data(), rows, cols, static_cast<std::ptrdiff_t>(cols)))) {
+        Matrix result(cols, rows, get_memory_resource());
+        result.evaluate(source);
+        return *this = std::move(result);
+    }
+
+    row_count = rows;
+    col_count = cols;
+    const size_t capacity = internal_storage.capacity();
+    internal_storage.resize(row_count * col_count);
+    if (internal_storage.capacity() != capacity) {
+        MATHSLIB_COUNT_ALLOCATION();
+    }
+
+    evaluate(source);
+    return *this;
+}
+
+template <typename E>
+Matrix& Matrix::operator+=(const MatrixExpression<E>& expression) {
+    const E& source = expression.self();
+    if (source.get_row_count() != row_count || source.get_col_count() != col_count) {
+        throw std::invalid_argument("Matrix addition and subtraction must have valid dimensions.");
+    }
+    if (source.aliases(view())) {
+        return *this += Matrix(source);
+    }
+
+    double* out = internal_storage.data();
+    const size_t cols = col_count;
+    parallel_rows(row_count, cols, [&source, out, cols](size_t row_begin, size_t row_end) {
+        for (size_t r = row_begin; r < row_end; r++) {
+            for (size_t c = 0; c < cols; c++) {
+                out[r * cols + c] += source(r, c);
+            }
+        }
+    });
+
+    return *this;
+}
+
+template <typename E>
+Matrix& Matrix::operator-=(const MatrixExpression<E>& expression) {
+    const E& source = expression.self();
+    if (source.get_row_count() != row_count || source.get_col_count() != col_count) {
+        throw std::invalid_argument("Matrix addition and subtraction must have valid dimensions.");
+    }
+    if (source.aliases(view())) {
+        return *this -= Matrix(source);
+    }
+
+    double* out = internal_storage.data();
+    const size_t cols = col_count;
+    parallel_rows(row_count, cols, [&source, out, cols](size_t row_begin, size_t row_end) {
+        for (size_t r = row_begin; r < row_end; r++) {
+            for (size_t c = 0; c < cols; c++) {
+                out[r * cols + c] -= source(r, c);
+            }
+        }
+    });
+
+    return *this;
+}
+
+// Compares in place, otherwise M == view would also match Matrix == Matrix by converting the view.
+template <typename E>
+bool operator==(const Matrix& M, const MatrixExpression<E>& expression) {
+    return matrix_expressions_equal(M, expression);
+}
+
+// A Matrix that is about to be destroyed donates its storage to the result instead of a new allocation.
+template <typename E>
+Matrix operator+(Matrix&& lhs, const MatrixExpression<E>& rhs) {
+    lhs += rhs.self();
+    return std::move(lhs);
+}
+
+template <typename E>
+Matrix operator+(const MatrixExpression<E>& lhs, Matrix&& rhs) {
+    rhs += lhs.self();
+    return std::move(rhs);
+}
+
+inline Matrix operator+(Matrix&& lhs, Matrix&& rhs) {
+    lhs += rhs;
+    return std::move(lhs);
+}
+
+template <typename E>
+Matrix operator-(Matrix&& lhs, const MatrixExpression<E>& rhs) {
+    lhs -= rhs.self();
+    return std::move(lhs);
+}
+
+template <typename E>
+Matrix operator-(const MatrixExpression<E>& lhs, Matrix&& rhs) {
+    rhs = lhs.self() - rhs;
+    return std::move(rhs);
+}
+
+inline Matrix operator-(Matrix&& lhs, Matrix&& rhs) {
+    lhs -= rhs;
+    return std::move(lhs);
+}
+
+inline Matrix operator*(Matrix&& M, const double& num) noexcept {
+    M *= num;
+    return std::move(M);
+}
+
+inline Matrix operator*(const double& num, Matrix&& M) noexcept {
+    M *= num;
+    return std::move(M);
+}
+
+inline Matrix operator/(Matrix&& M, const double& num) noexcept {
+    M /= num;
+    return std::move(M);
+}
+
+inline Matrix operator-(Matrix&& M) noexcept {
+    M *= -1.0;
+    return std::move(M);
+}
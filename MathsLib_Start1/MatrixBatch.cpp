@@ -0,0 +1,597 @@
+// Batched small matrix operations. Each is written once over blocks of eight matrices in local
+// arrays, where every loop over the lanes of a block becomes SIMD instructions, and compiled once
+// per instruction set.
+
+#include "MatrixBatch.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+	// Matrices per block, one per lane of an AVX-512 register of doubles.
+	constexpr size_t lanes = 8;
+
+	// Element (r, c) of the matrices in a block at m[r][c], one lane per matrix. Blocks are
+	// locals, so the compiler knows they do not alias the batches.
+	template <size_t N>
+	struct MatrixBlock {
+		alignas(64) double m[N][N][lanes];
+	};
+
+	template <size_t N>
+	struct VectorBlock {
+		alignas(64) double v[N][lanes];
+	};
+
+	// Element arrays of a batch, gathered once per operation.
+	template <size_t N>
+	std::array<const double*, N * N> elements_of(const MatrixBatch<N>& A) noexcept {
+		std::array<const double*, N * N> result;
+		for (size_t i = 0; i < N * N; i++) {
+			result[i] = A.element(i / N, i % N);
+		}
+		return result;
+	}
+
+	template <size_t N>
+	std::array<double*, N * N> elements_of(MatrixBatch<N>& A) noexcept {
+		std::array<double*, N * N> result;
+		for (size_t i = 0; i < N * N; i++) {
+			result[i] = A.element(i / N, i % N);
+		}
+		return result;
+	}
+
+	template <size_t N>
+	std::array<const double*, N> components_of(const VectorBatch<N>& v) noexcept {
+		std::array<const double*, N> result;
+		for (size_t i = 0; i < N; i++) {
+			result[i] = v.component(i);
+		}
+		return result;
+	}
+
+	template <size_t N>
+	std::array<double*, N> components_of(VectorBatch<N>& v) noexcept {
+		std::array<double*, N> result;
+		for (size_t i = 0; i < N; i++) {
+			result[i] = v.component(i);
+		}
+		return result;
+	}
+
+	// A partial block at the end of a batch is padded with identity matrices, so no lane divides by zero.
+	template <size_t N>
+	MATHSLIB_ALWAYS_INLINE void load(const std::array<const double*, N * N>& A, size_t first, size_t count, MatrixBlock<N>& block) {
+		for (size_t r = 0; r < N; r++) {
+			for (size_t c = 0; c < N; c++) {
+				const double* in = A[r * N + c] + first;
+				if (count == lanes) {
+					for (size_t l = 0; l < lanes; l++) {
+						block.m[r][c][l] = in[l];
+					}
+				}
+				else {
+					for (size_t l = 0; l < lanes; l++) {
+						block.m[r][c][l] = l < count ? in[l] : (r == c ? 1.0 : 0.0);
+					}
+				}
+			}
+		}
+	}
+
+	template <size_t N>
+	MATHSLIB_ALWAYS_INLINE void load(const std::array<const double*, N>& v, size_t first, size_t count, VectorBlock<N>& block) {
+		for (size_t i = 0; i < N; i++) {
+			const double* in = v[i] + first;
+			for (size_t l = 0; l < lanes; l++) {
+				block.v[i][l] = count == lanes || l < count ? in[l] : 0.0;
+			}
+		}
+	}
+
+	template <size_t N>
+	MATHSLIB_ALWAYS_INLINE void store(const MatrixBlock<N>& block, const std::array<double*, N * N>& out, size_t first, size_t count) {
+		for (size_t r = 0; r < N; r++) {
+			for (size_t c = 0; c < N; c++) {
+				std::copy_n(block.m[r][c], count, out[r * N + c] + first);
+			}
+		}
+	}
+
+	template <size_t N>
+	MATHSLIB_ALWAYS_INLINE void store(const VectorBlock<N>& block, const std::array<double*, N>& out, size_t first, size_t count) {
+		for (size_t i = 0; i < N; i++) {
+			std::copy_n(block.v[i], count, out[i] + first);
+		}
+	}
+
+	// --------- Kernels on one block. ---------
+
+	// Sums run in the same order as Mat, though the AVX2 and AVX-512 builds may fuse multiplies and
+	// adds and so round differently in the last place.
+
+	template <size_t N>
+	MATHSLIB_ALWAYS_INLINE void multiply_block(const MatrixBlock<N>& a, const MatrixBlock<N>& b, MatrixBlock<N>& out) {
+		for (size_t r = 0; r < N; r++) {
+			for (size_t c = 0; c < N; c++) {
+				for (size_t l = 0; l < lanes; l++) {
+					out.m[r][c][l] = a.m[r][0][l] * b.m[0][c][l];
+				}
+				for (size_t k = 1; k < N; k++) {
+					for (size_t l = 0; l < lanes; l++) {
+						out.m[r][c][l] += a.m[r][k][l] * b.m[k][c][l];
+					}
+				}
+			}
+		}
+	}
+
+	template <size_t N>
+	MATHSLIB_ALWAYS_INLINE void transform_block(const MatrixBlock<N>& a, const VectorBlock<N>& v, VectorBlock<N>& out) {
+		for (size_t r = 0; r < N; r++) {
+			for (size_t l = 0; l < lanes; l++) {
+				out.v[r][l] = a.m[r][0][l] * v.v[0][l];
+			}
+			for (size_t k = 1; k < N; k++) {
+				for (size_t l = 0; l < lanes; l++) {
+					out.v[r][l] += a.m[r][k][l] * v.v[k][l];
+				}
+			}
+		}
+	}
+
+	template <size_t N>
+	MATHSLIB_ALWAYS_INLINE void transpose_block(const MatrixBlock<N>& a, MatrixBlock<N>& out) {
+		for (size_t r = 0; r < N; r++) {
+			for (size_t c = 0; c < N; c++) {
+				for (size_t l = 0; l < lanes; l++) {
+					out.m[c][r][l] = a.m[r][c][l];
+				}
+			}
+		}
+	}
+
+	// Cofactor expansion, along the first row for 3 x 3 and through the 2 x 2 minors of the
+	// top and bottom row pairs for 4 x 4.
+	template <size_t N>
+	MATHSLIB_ALWAYS_INLINE void determinant_block(const MatrixBlock<N>& a, double* out) {
+		for (size_t l = 0; l < lanes; l++) {
+			if constexpr (N == 2) {
+				out[l] = a.m[0][0][l] * a.m[1][1][l] - a.m[0][1][l] * a.m[1][0][l];
+			}
+			else if constexpr (N == 3) {
+				out[l] = a.m[0][0][l] * (a.m[1][1][l] * a.m[2][2][l] - a.m[1][2][l] * a.m[2][1][l])
+					- a.m[0][1][l] * (a.m[1][0][l] * a.m[2][2][l] - a.m[1][2][l] * a.m[2][0][l])
+					+ a.m[0][2][l] * (a.m[1][0][l] * a.m[2][1][l] - a.m[1][1][l] * a.m[2][0][l]);
+			}
+			else {
+				const double s0 = a.m[0][0][l] * a.m[1][1][l] - a.m[1][0][l] * a.m[0][1][l];
+				const double s1 = a.m[0][0][l] * a.m[1][2][l] - a.m[1][0][l] * a.m[0][2][l];
+				const double s2 = a.m[0][0][l] * a.m[1][3][l] - a.m[1][0][l] * a.m[0][3][l];
+				const double s3 = a.m[0][1][l] * a.m[1][2][l] - a.m[1][1][l] * a.m[0][2][l];
+				const double s4 = a.m[0][1][l] * a.m[1][3][l] - a.m[1][1][l] * a.m[0][3][l];
+				const double s5 = a.m[0][2][l] * a.m[1][3][l] - a.m[1][2][l] * a.m[0][3][l];
+				const double c5 = a.m[2][2][l] * a.m[3][3][l] - a.m[3][2][l] * a.m[2][3][l];
+				const double c4 = a.m[2][1][l] * a.m[3][3][l] - a.m[3][1][l] * a.m[2][3][l];
+				const double c3 = a.m[2][1][l] * a.m[3][2][l] - a.m[3][1][l] * a.m[2][2][l];
+				const double c2 = a.m[2][0][l] * a.m[3][3][l] - a.m[3][0][l] * a.m[2][3][l];
+				const double c1 = a.m[2][0][l] * a.m[3][2][l] - a.m[3][0][l] * a.m[2][2][l];
+				const double c0 = a.m[2][0][l] * a.m[3][1][l] - a.m[3][0][l] * a.m[2][1][l];
+				out[l] = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+			}
+		}
+	}
+
+	// The adjugate, built from the same minors as the determinant, times the reciprocal determinant.
+	template <size_t N>
+	MATHSLIB_ALWAYS_INLINE void inverse_block(const MatrixBlock<N>& a, MatrixBlock<N>& out) {
+		for (size_t l = 0; l < lanes; l++) {
+			if constexpr (N == 2) {
+				const double a00 = a.m[0][0][l], a01 = a.m[0][1][l];
+				const double a10 = a.m[1][0][l], a11 = a.m[1][1][l];
+				const double inv = 1.0 / (a00 * a11 - a01 * a10);
+				out.m[0][0][l] = a11 * inv;
+				out.m[0][1][l] = -a01 * inv;
+				out.m[1][0][l] = -a10 * inv;
+				out.m[1][1][l] = a00 * inv;
+			}
+			else if constexpr (N == 3) {
+				const double a00 = a.m[0][0][l], a01 = a.m[0][1][l], a02 = a.m[0][2][l];
+				const double a10 = a.m[1][0][l], a11 = a.m[1][1][l], a12 = a.m[1][2][l];
+				const double a20 = a.m[2][0][l], a21 = a.m[2][1][l], a22 = a.m[2][2][l];
+				const double b00 = a11 * a22 - a12 * a21;
+				const double b10 = a12 * a20 - a10 * a22;
+				const double b20 = a10 * a21 - a11 * a20;
+				const double inv = 1.0 / (a00 * b00 + a01 * b10 + a02 * b20);
+				out.m[0][0][l] = b00 * inv;
+				out.m[0][1][l] = (a02 * a21 - a01 * a22) * inv;
+				out.m[0][2][l] = (a01 * a12 - a02 * a11) * inv;
+				out.m[1][0][l] = b10 * inv;
+				out.m[1][1][l] = (a00 * a22 - a02 * a20) * inv;
+				out.m[1][2][l] = (a02 * a10 - a00 * a12) * inv;
+				out.m[2][0][l] = b20 * inv;
+				out.m[2][1][l] = (a01 * a20 - a00 * a21) * inv;
+				out.m[2][2][l] = (a00 * a11 - a01 * a10) * inv;
+			}
+			else {
+				const double a00 = a.m[0][0][l], a01 = a.m[0][1][l], a02 = a.m[0][2][l], a03 = a.m[0][3][l];
+				const double a10 = a.m[1][0][l], a11 = a.m[1][1][l], a12 = a.m[1][2][l], a13 = a.m[1][3][l];
+				const double a20 = a.m[2][0][l], a21 = a.m[2][1][l], a22 = a.m[2][2][l], a23 = a.m[2][3][l];
+				const double a30 = a.m[3][0][l], a31 = a.m[3][1][l], a32 = a.m[3][2][l], a33 = a.m[3][3][l];
+				const double s0 = a00 * a11 - a10 * a01;
+				const double s1 = a00 * a12 - a10 * a02;
+				const double s2 = a00 * a13 - a10 * a03;
+				const double s3 = a01 * a12 - a11 * a02;
+				const double s4 = a01 * a13 - a11 * a03;
+				const double s5 = a02 * a13 - a12 * a03;
+				const double c5 = a22 * a33 - a32 * a23;
+				const double c4 = a21 * a33 - a31 * a23;
+				const double c3 = a21 * a32 - a31 * a22;
+				const double c2 = a20 * a33 - a30 * a23;
+				const double c1 = a20 * a32 - a30 * a22;
+				const double c0 = a20 * a31 - a30 * a21;
+				const double inv = 1.0 / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+				out.m[0][0][l] = (a11 * c5 - a12 * c4 + a13 * c3) * inv;
+				out.m[0][1][l] = (-a01 * c5 + a02 * c4 - a03 * c3) * inv;
+				out.m[0][2][l] = (a31 * s5 - a32 * s4 + a33 * s3) * inv;
+				out.m[0][3][l] = (-a21 * s5 + a22 * s4 - a23 * s3) * inv;
+				out.m[1][0][l] = (-a10 * c5 + a12 * c2 - a13 * c1) * inv;
+				out.m[1][1][l] = (a00 * c5 - a02 * c2 + a03 * c1) * inv;
+				out.m[1][2][l] = (-a30 * s5 + a32 * s2 - a33 * s1) * inv;
+				out.m[1][3][l] = (a20 * s5 - a22 * s2 + a23 * s1) * inv;
+				out.m[2][0][l] = (a10 * c4 - a11 * c2 + a13 * c0) * inv;
+				out.m[2][1][l] = (-a00 * c4 + a01 * c2 - a03 * c0) * inv;
+				out.m[2][2][l] = (a30 * s4 - a31 * s2 + a33 * s0) * inv;
+				out.m[2][3][l] = (-a20 * s4 + a21 * s2 - a23 * s0) * inv;
+				out.m[3][0][l] = (-a10 * c3 + a11 * c1 - a12 * c0) * inv;
+				out.m[3][1][l] = (a00 * c3 - a01 * c1 + a02 * c0) * inv;
+				out.m[3][2][l] = (-a30 * s3 + a31 * s1 - a32 * s0) * inv;
+				out.m[3][3][l] = (a20 * s3 - a21 * s1 + a22 * s0) * inv;
+			}
+		}
+	}
+
+	// --------- Operations on the matrices [first, first + count) of a batch, count at most lanes. ---------
+
+	// Every input of a block is loaded before any output is stored, so outputs may alias inputs.
+	template <size_t N>
+	struct MultiplyOp {
+		std::array<const double*, N * N> A, B;
+		std::array<double*, N * N> out;
+
+		MATHSLIB_ALWAYS_INLINE void operator()(size_t first, size_t count) const {
+			MatrixBlock<N> a, b, c;
+			load(A, first, count, a);
+			load(B, first, count, b);
+			multiply_block(a, b, c);
+			store(c, out, first, count);
+		}
+	};
+
+	template <size_t N>
+	struct TransformOp {
+		std::array<const double*, N * N> A;
+		std::array<const double*, N> v;
+		std::array<double*, N> out;
+
+		MATHSLIB_ALWAYS_INLINE void operator()(size_t first, size_t count) const {
+			MatrixBlock<N> a;
+			VectorBlock<N> x, y;
+			load(A, first, count, a);
+			load(v, first, count, x);
+			transform_block(a, x, y);
+			store(y, out, first, count);
+		}
+	};
+
+	// The single matrix is copied into every lane once, up front.
+	template <size_t N>
+	struct BroadcastTransformOp {
+		MatrixBlock<N> a;
+		std::array<const double*, N> v;
+		std::array<double*, N> out;
+
+		MATHSLIB_ALWAYS_INLINE void operator()(size_t first, size_t count) const {
+			VectorBlock<N> x, y;
+			load(v, first, count, x);
+			transform_block(a, x, y);
+			store(y, out, first, count);
+		}
+	};
+
+	template <size_t N>
+	struct TransposeOp {
+		std::array<const double*, N * N> A;
+		std::array<double*, N * N> out;
+
+		MATHSLIB_ALWAYS_INLINE void operator()(size_t first, size_t count) const {
+			MatrixBlock<N> a, b;
+			load(A, first, count, a);
+			transpose_block(a, b);
+			store(b, out, first, count);
+		}
+	};
+
+	template <size_t N>
+	struct InverseOp {
+		std::array<const double*, N * N> A;
+		std::array<double*, N * N> out;
+
+		MATHSLIB_ALWAYS_INLINE void operator()(size_t first, size_t count) const {
+			MatrixBlock<N> a, b;
+			load(A, first, count, a);
+			inverse_block(a, b);
+			store(b, out, first, count);
+		}
+	};
+
+	template <size_t N>
+	struct DeterminantOp {
+		std::array<const double*, N * N> A;
+		double* out;
+
+		MATHSLIB_ALWAYS_INLINE void operator()(size_t first, size_t count) const {
+			MatrixBlock<N> a;
+			alignas(64) double d[lanes];
+			load(A, first, count, a);
+			determinant_block(a, d);
+			std::copy_n(d, count, out + first);
+		}
+	};
+
+	// --------- One copy of the block loop per instruction set. ---------
+
+	// Full blocks pass a constant count, so their loads and stores compile to whole vector moves.
+	template <typename Op>
+	MATHSLIB_ALWAYS_INLINE void run_blocks(const Op& op, size_t begin, size_t end) {
+		size_t first = begin;
+		for (; first + lanes <= end; first += lanes) {
+			op(first, lanes);
+		}
+		if (first < end) {
+			op(first, end - first);
+		}
+	}
+
+	template <typename Op>
+	void run_generic(const Op& op, size_t begin, size_t end) {
+		run_blocks(op, begin, end);
+	}
+
+#ifdef MATHSLIB_X86
+	template <typename Op>
+	MATHSLIB_TARGET_AVX2 void run_avx2(const Op& op, size_t begin, size_t end) {
+		run_blocks(op, begin, end);
+	}
+
+	template <typename Op>
+	MATHSLIB_TARGET_AVX512 void run_avx512(const Op& op, size_t begin, size_t end) {
+		run_blocks(op, begin, end);
+	}
+#endif
+
+	// Whole blocks are spread over the thread pool, each matrix is answered by exactly one lane.
+	template <size_t N, typename Op>
+	void run(const Op& op, size_t count) {
+		const SimdLevel level = simd_kernels().level;
+		const size_t blocks = (count + lanes - 1) / lanes;
+		parallel_rows(blocks, lanes * N * N, [&op, count, level](size_t block_begin, size_t block_end) {
+			const size_t begin = block_begin * lanes;
+			const size_t end = std::min(block_end * lanes, count);
+			switch (level) {
+#ifdef MATHSLIB_X86
+			case SimdLevel::AVX512:
+				run_avx512(op, begin, end);
+				break;
+			case SimdLevel::AVX2:
+				run_avx2(op, begin, end);
+				break;
+#endif
+			default:
+				run_generic(op, begin, end);
+				break;
+			}
+		});
+	}
+
+	void check_sizes(size_t a, size_t b) {
+		if (a != b) {
+			throw std::invalid_argument("Batches must be the same size.");
+		}
+	}
+}
+
+// --------- VectorBatch. ---------
+
+template <size_t N>
+VectorBatch<N>::VectorBatch(size_t count) {
+	for (BatchArray& component : components) {
+		component.assign(count, 0.0);
+	}
+}
+
+template <size_t N>
+size_t VectorBatch<N>::size() const noexcept {
+	return components[0].size();
+}
+
+template <size_t N>
+void VectorBatch<N>::reserve(size_t count) {
+	for (BatchArray& component : components) {
+		component.reserve(count);
+	}
+}
+
+template <size_t N>
+void VectorBatch<N>::clear() noexcept {
+	for (BatchArray& component : components) {
+		component.clear();
+	}
+}
+
+template <size_t N>
+void VectorBatch<N>::push_back(const Vec<N, double>& vector) {
+	for (size_t i = 0; i < N; i++) {
+		components[i].push_back(vector[i]);
+	}
+}
+
+template <size_t N>
+Vec<N, double> VectorBatch<N>::operator[](const size_t& index) const noexcept {
+	Vec<N, double> result{};
+	for (size_t i = 0; i < N; i++) {
+		result[i] = components[i][index];
+	}
+	return result;
+}
+
+template <size_t N>
+void VectorBatch<N>::set(const size_t& index, const Vec<N, double>& vector) noexcept {
+	for (size_t i = 0; i < N; i++) {
+		components[i][index] = vector[i];
+	}
+}
+
+template <size_t N>
+double* VectorBatch<N>::component(size_t index) noexcept {
+	return components[index].data();
+}
+
+template <size_t N>
+const double* VectorBatch<N>::component(size_t index) const noexcept {
+	return components[index].data();
+}
+
+// --------- MatrixBatch. ---------
+
+template <size_t N>
+MatrixBatch<N>::MatrixBatch(size_t count) {
+	for (BatchArray& element : elements) {
+		element.assign(count, 0.0);
+	}
+}
+
+template <size_t N>
+size_t MatrixBatch<N>::size() const noexcept {
+	return elements[0].size();
+}
+
+template <size_t N>
+void MatrixBatch<N>::reserve(size_t count) {
+	for (BatchArray& element : elements) {
+		element.reserve(count);
+	}
+}
+
+template <size_t N>
+void MatrixBatch<N>::clear() noexcept {
+	for (BatchArray& element : elements) {
+		element.clear();
+	}
+}
+
+template <size_t N>
+void MatrixBatch<N>::push_back(const Mat<N, N, double>& matrix) {
+	for (size_t r = 0; r < N; r++) {
+		for (size_t c = 0; c < N; c++) {
+			elements[r * N + c].push_back(matrix[r][c]);
+		}
+	}
+}
+
+template <size_t N>
+Mat<N, N, double> MatrixBatch<N>::operator[](const size_t& index) const noexcept {
+	Mat<N, N, double> result{};
+	for (size_t r = 0; r < N; r++) {
+		for (size_t c = 0; c < N; c++) {
+			result[r][c] = elements[r * N + c][index];
+		}
+	}
+	return result;
+}
+
+template <size_t N>
+void MatrixBatch<N>::set(const size_t& index, const Mat<N, N, double>& matrix) noexcept {
+	for (size_t r = 0; r < N; r++) {
+		for (size_t c = 0; c < N; c++) {
+			elements[r * N + c][index] = matrix[r][c];
+		}
+	}
+}
+
+template <size_t N>
+double* MatrixBatch<N>::element(size_t row, size_t col) noexcept {
+	return elements[row * N + col].data();
+}
+
+template <size_t N>
+const double* MatrixBatch<N>::element(size_t row, size_t col) const noexcept {
+	return elements[row * N + col].data();
+}
+
+// --------- Operations. ---------
+
+template <size_t N>
+void multiply(const MatrixBatch<N>& A, const MatrixBatch<N>& B, MatrixBatch<N>& out) {
+	check_sizes(A.size(), B.size());
+	check_sizes(A.size(), out.size());
+	run<N>(MultiplyOp<N>{ elements_of(A), elements_of(B), elements_of(out) }, A.size());
+}
+
+template <size_t N>
+void transform(const MatrixBatch<N>& A, const VectorBatch<N>& v, VectorBatch<N>& out) {
+	check_sizes(A.size(), v.size());
+	check_sizes(A.size(), out.size());
+	run<N>(TransformOp<N>{ elements_of(A), components_of(v), components_of(out) }, A.size());
+}
+
+template <size_t N>
+void transform(const Mat<N, N, double>& M, const VectorBatch<N>& v, VectorBatch<N>& out) {
+	check_sizes(v.size(), out.size());
+	BroadcastTransformOp<N> op{ {}, components_of(v), components_of(out) };
+	for (size_t r = 0; r < N; r++) {
+		for (size_t c = 0; c < N; c++) {
+			std::fill_n(op.a.m[r][c], lanes, M[r][c]);
+		}
+	}
+	run<N>(op, v.size());
+}
+
+template <size_t N>
+void transpose(const MatrixBatch<N>& A, MatrixBatch<N>& out) {
+	check_sizes(A.size(), out.size());
+	run<N>(TransposeOp<N>{ elements_of(A), elements_of(out) }, A.size());
+}
+
+template <size_t N>
+void inverse(const MatrixBatch<N>& A, MatrixBatch<N>& out) {
+	check_sizes(A.size(), out.size());
+	run<N>(InverseOp<N>{ elements_of(A), elements_of(out) }, A.size());
+}
+
+template <size_t N>
+void determinant(const MatrixBatch<N>& A, std::span<double> out) {
+	if (out.size() < A.size()) {
+		throw std::invalid_argument("Output buffer is too small for the batch.");
+	}
+	run<N>(DeterminantOp<N>{ elements_of(A), out.data() }, A.size());
+}
+
+// The supported sizes.
+#define MATHSLIB_INSTANTIATE_BATCH(N) \
+	template class VectorBatch<N>; \
+	template class MatrixBatch<N>; \
+	template void multiply(const MatrixBatch<N>&, const MatrixBatch<N>&, MatrixBatch<N>&); \
+	template void transform(const MatrixBatch<N>&, const VectorBatch<N>&, VectorBatch<N>&); \
+	template void transform(const Mat<N, N, double>&, const VectorBatch<N>&, VectorBatch<N>&); \
+	template void transpose(const MatrixBatch<N>&, MatrixBatch<N>&); \
+	template void inverse(const MatrixBatch<N>&, MatrixBatch<N>&); \
+	template void determinant(const MatrixBatch<N>&, std::span<double>);
+
+MATHSLIB_INSTANTIATE_BATCH(2)
+MATHSLIB_INSTANTIATE_BATCH(3)
+MATHSLIB_INSTANTIATE_BATCH(4)
+
+#undef MATHSLIB_INSTANTIATE_BATCH
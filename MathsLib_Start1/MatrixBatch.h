@@ -0,0 +1,126 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <new>
+#include <span>
+#include <vector>
+#include "FixedMatrix.h"
+#include "FixedVector.h"
+
+// Structure of arrays containers and operations for large numbers of small square matrices and
+// vectors, 2 x 2 to 4 x 4.
+//
+// Element (r, c) of every matrix in a batch is stored in its own array, like the coordinates of a
+// PointBatch, so consecutive matrices fill the lanes of a SIMD register and one instruction works
+// on eight of them at once. The operations answer the batch in blocks of eight matrices, with
+// branch free closed forms for determinants and inverses, compiled for each instruction set and
+// chosen at runtime like the kernels in Simd.h. Blocks are spread over the library thread pool.
+//
+// Results go into a batch of the same size supplied by the caller, which may also be one of the
+// inputs, and nothing is allocated. Mismatched sizes throw std::invalid_argument.
+
+// Arrays start on a cache line, so each block of eight elements is one aligned load.
+template <typename T>
+struct CacheLineAllocator {
+	using value_type = T;
+	static constexpr std::align_val_t alignment{ 64 };
+
+	CacheLineAllocator() = default;
+	template <typename U>
+	CacheLineAllocator(const CacheLineAllocator<U>&) noexcept {}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(::operator new(n * sizeof(T), alignment));
+	}
+
+	void deallocate(T* p, size_t) noexcept {
+		::operator delete(p, alignment);
+	}
+
+	template <typename U>
+	bool operator==(const CacheLineAllocator<U>&) const noexcept {
+		return true;
+	}
+};
+
+using BatchArray = std::vector<double, CacheLineAllocator<double>>;
+
+template <size_t N>
+class VectorBatch {
+	static_assert(N >= 2 && N <= 4, "Batched vectors must have 2 to 4 components.");
+
+	std::array<BatchArray, N> components;
+
+public:
+	VectorBatch() = default;
+	explicit VectorBatch(size_t count);
+
+	size_t size() const noexcept;
+	void reserve(size_t count);
+	void clear() noexcept;
+
+	void push_back(const Vec<N, double>& vector);
+
+	Vec<N, double> operator[](const size_t& index) const noexcept;
+	void set(const size_t& index, const Vec<N, double>& vector) noexcept;
+
+	// Component arrays, size() elements each, for filling the batch in place.
+	double* component(size_t index) noexcept;
+	const double* component(size_t index) const noexcept;
+};
+
+template <size_t N>
+class MatrixBatch {
+	static_assert(N >= 2 && N <= 4, "Batched matrices must be 2 x 2 to 4 x 4.");
+
+	// Element (r, c) of every matrix, at elements[r * N + c].
+	std::array<BatchArray, N * N> elements;
+
+public:
+	MatrixBatch() = default;
+	explicit MatrixBatch(size_t count);
+
+	size_t size() const noexcept;
+	void reserve(size_t count);
+	void clear() noexcept;
+
+	void push_back(const Mat<N, N, double>& matrix);
+
+	Mat<N, N, double> operator[](const size_t& index) const noexcept;
+	void set(const size_t& index, const Mat<N, N, double>& matrix) noexcept;
+
+	// Element arrays, size() elements each, for filling the batch in place.
+	double* element(size_t row, size_t col) noexcept;
+	const double* element(size_t row, size_t col) const noexcept;
+};
+
+using Vec2Batch = VectorBatch<2>;
+using Vec3Batch = VectorBatch<3>;
+using Vec4Batch = VectorBatch<4>;
+using Mat2Batch = MatrixBatch<2>;
+using Mat3Batch = MatrixBatch<3>;
+using Mat4Batch = MatrixBatch<4>;
+
+// out[i] = A[i] * B[i].
+template <size_t N>
+void multiply(const MatrixBatch<N>& A, const MatrixBatch<N>& B, MatrixBatch<N>& out);
+
+// out[i] = A[i] * v[i].
+template <size_t N>
+void transform(const MatrixBatch<N>& A, const VectorBatch<N>& v, VectorBatch<N>& out);
+
+// out[i] = M * v[i], one matrix applied to the whole batch.
+template <size_t N>
+void transform(const Mat<N, N, double>& M, const VectorBatch<N>& v, VectorBatch<N>& out);
+
+template <size_t N>
+void transpose(const MatrixBatch<N>& A, MatrixBatch<N>& out);
+
+// The adjugate over the determinant. Singular matrices give infinite or NaN elements rather than
+// throwing, so check their determinants first where that matters.
+template <size_t N>
+void inverse(const MatrixBatch<N>& A, MatrixBatch<N>& out);
+
+// out must hold at least A.size() elements.
+template <size_t N>
+void determinant(const MatrixBatch<N>& A, std::span<double> out);
@@ -0,0 +1,176 @@
+#pragma once
+#include <cstddef>
+#include <stdexcept>
+
+// Expression templates for Matrix elementwise arithmetic.
+//
+// M + N, M - N, M * 2, M / 3 and -M return lazy nodes that are evaluated in one pass when
+// converted or assigned to a Matrix, so chains like -(M * 2) / 3 touch memory once. As with vectors, nodes
+// refer to Matrix operands by reference and must not outlive the statement they appear in.
+//
+// Every node answers aliases(target), whether evaluating it while writing target could read an
+// element already overwritten (see strided_alias in VectorView.h). Assignment evaluates such
+// expressions into new storage first.
+
+class Matrix;
+template <typename Element>
+class BasicMatrixView;
+
+// Base of every matrix expression, E is the concrete node type.
+template <typename E>
+class MatrixExpression {
+public:
+	const E& self() const noexcept {
+		return static_cast<const E&>(*this);
+	}
+
+	// Only reads the diagonal, so (-M).trace() never evaluates the rest of the expression.
+	double trace() const {
+		const E& expression = self();
+
+		if (expression.get_row_count() != expression.get_col_count()) {
+			throw std::invalid_argument("Trace of a matrix can only be obtained if the matrix is square.");
+		}
+
+		double sum = 0;
+		for (size_t i = 0; i < expression.get_row_count(); i++) {
+			sum += expression(i, i);
+		}
+		return sum;
+	}
+};
+
+// How a node holds an operand, containers by reference and other nodes by value.
+template <typename E>
+struct MatrixOperand {
+	using type = const E;
+};
+
+template <>
+struct MatrixOperand<Matrix> {
+	using type = const Matrix&;
+};
+
+struct MatrixAdd {
+	static double apply(const double& a, const double& b) noexcept {
+		return a + b;
+	}
+};
+
+struct MatrixSubtract {
+	static double apply(const double& a, const double& b) noexcept {
+		return a - b;
+	}
+};
+
+// Elementwise lhs Op rhs.
+template <typename L, typename R, typename Op>
+class MatrixBinaryExpression : public MatrixExpression<MatrixBinaryExpression<L, R, Op>> {
+	typename MatrixOperand<L>::type lhs;
+	typename MatrixOperand<R>::type rhs;
+
+public:
+	MatrixBinaryExpression(const L& lhs, const R& rhs) : lhs{ lhs }, rhs{ rhs } {
+		if (lhs.get_row_count() != rhs.get_row_count() || lhs.get_col_count() != rhs.get_col_count()) {
+			throw std::invalid_argument("Matrix addition and subtraction must have valid dimensions.");
+		}
+	}
+
+	size_t get_row_count() const noexcept {
+		return lhs.get_row_count();
+	}
+
+	size_t get_col_count() const noexcept {
+		return lhs.get_col_count();
+	}
+
+	double operator()(const size_t& row, const size_t& col) const {
+		return Op::apply(lhs(row, col), rhs(row, col));
+	}
+
+	bool aliases(const BasicMatrixView<const double>& target) const noexcept {
+		return lhs.aliases(target) || rhs.aliases(target);
+	}
+};
+
+// Every element multiplied by a constant.
+template <typename E>
+class MatrixScaleExpression : public MatrixExpression<MatrixScaleExpression<E>> {
+	typename MatrixOperand<E>::type operand;
+	double number;
+
+public:
+	MatrixScaleExpression(const E& operand, const double& number) noexcept : operand{ operand }, number{ number } { }
+
+	size_t get_row_count() const noexcept {
+		return operand.get_row_count();
+	}
+
+	size_t get_col_count() const noexcept {
+		return operand.get_col_count();
+	}
+
+	double operator()(const size_t& row, const size_t& col) const {
+		return operand(row, col) * number;
+	}
+
+	bool aliases(const BasicMatrixView<const double>& target) const noexcept {
+		return operand.aliases(target);
+	}
+};
+
+// Elementwise comparison of any two matrix expressions without evaluating either into a Matrix.
+template <typename L, typename R>
+bool matrix_expressions_equal(const MatrixExpression<L>& lhs, const MatrixExpression<R>& rhs) {
+	const L& a = lhs.self();
+	const R& b = rhs.self();
+
+	if (a.get_row_count() != b.get_row_count() || a.get_col_count() != b.get_col_count()) {
+		return false;
+	}
+
+	for (size_t r = 0; r < a.get_row_count(); r++) {
+		for (size_t c = 0; c < a.get_col_count(); c++) {
+			if (a(r, c) != b(r, c)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+template <typename L, typename R>
+bool operator==(const MatrixExpression<L>& lhs, const MatrixExpression<R>& rhs) {
+	return matrix_expressions_equal(lhs, rhs);
+}
+
+// Operator overloads, all lazy.
+template <typename L, typename R>
+MatrixBinaryExpression<L, R, MatrixAdd> operator+(const MatrixExpression<L>& lhs, const MatrixExpression<R>& rhs) {
+	return MatrixBinaryExpression<L, R, MatrixAdd>(lhs.self(), rhs.self());
+}
+
+template <typename L, typename R>
+MatrixBinaryExpression<L, R, MatrixSubtract> operator-(const MatrixExpression<L>& lhs, const MatrixExpression<R>& rhs) {
+	return MatrixBinaryExpression<L, R, MatrixSubtract>(lhs.self(), rhs.self());
+}
+
+template <typename E>
+MatrixScaleExpression<E> operator*(const MatrixExpression<E>& M, const double& num) noexcept {
+	return MatrixScaleExpression<E>(M.self(), num);
+}
+
+template <typename E>
+MatrixScaleExpression<E> operator*(const double& num, const MatrixExpression<E>& M) noexcept {
+	return MatrixScaleExpression<E>(M.self(), num);
+}
+
+template <typename E>
+MatrixScaleExpression<E> operator/(const MatrixExpression<E>& M, const double& num) noexcept {
+	return MatrixScaleExpression<E>(M.self(), 1.0 / num);
+}
+
+template <typename E>
+MatrixScaleExpression<E> operator-(const MatrixExpression<E>& M) noexcept {
+	return MatrixScaleExpression<E>(M.self(), -1.0);
+}
@@ -0,0 +1,352 @@
+#include "MatrixStream.h"
+#include "Gemm.h"
+#include "Transpose.h"
+#include <algorithm>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+	// Calls process(b, buffer) for blocks 0 to blocks - 1 in order while another thread runs
+	// load(b + 1, other_buffer), so reading the next block overlaps computing on this one.
+	// Loads run one at a time and in block order.
+	template <typename Load, typename Process>
+	void double_buffered(size_t blocks, size_t buffer_size, Load&& load, Process&& process) {
+		if (blocks == 0) {
+			return;
+		}
+
+		std::unique_ptr<double[]> buffers[2] = {
+			std::make_unique_for_overwrite<double[]>(buffer_size),
+			std::make_unique_for_overwrite<double[]>(blocks > 1 ? buffer_size : 0)
+		};
+
+		load(size_t{ 0 }, buffers[0].get());
+		for (size_t b = 0; b < blocks; b++) {
+			// Joined before the next iteration, and by its destructor if process throws.
+			std::future<void> next;
+			if (b + 1 < blocks) {
+				next = std::async(std::launch::async, [&load, &buffers, b] {
+					load(b + 1, buffers[(b + 1) % 2].get());
+				});
+			}
+
+			process(b, buffers[b % 2].get());
+
+			if (next.valid()) {
+				next.get();
+			}
+		}
+	}
+
+	// Rows per block when each block row costs row_bytes, with at least one row.
+	size_t rows_within(size_t budget, size_t row_bytes) {
+		return std::max<size_t>(1, budget / std::max<size_t>(1, row_bytes));
+	}
+
+	size_t block_count(size_t total, size_t block) {
+		return (total + block - 1) / block;
+	}
+}
+
+MatrixReader::MatrixReader(const std::string& path) : file(path, std::ios::binary | std::ios::ate), path{ path } {
+	if (!file) {
+		throw std::runtime_error("Could not open " + path + " for reading.");
+	}
+
+	const uint64_t file_size = static_cast<uint64_t>(file.tellg());
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(&header), std::min<uint64_t>(sizeof(header), file_size));
+	swapped = validate_header(header, file_size, path);
+
+	if (header.rank != 2) {
+		throw std::invalid_argument(path + " holds a Vector, not a Matrix.");
+	}
+}
+
+size_t MatrixReader::get_row_count() const noexcept {
+	return header.rows;
+}
+
+size_t MatrixReader::get_col_count() const noexcept {
+	return header.cols;
+}
+
+size_t MatrixReader::rows_remaining() const noexcept {
+	return header.rows - next_row;
+}
+
+// Always seeks, so read_block calls in between do not disturb the position.
+size_t MatrixReader::read_rows(double* out, size_t max_rows) {
+	const size_t rows = std::min(max_rows, rows_remaining());
+	if (rows == 0) {
+		return 0;
+	}
+
+	const size_t bytes = rows * header.cols * sizeof(double);
+	file.seekg(static_cast<std::streamoff>(header.data_offset + next_row * header.cols * sizeof(double)));
+	file.read(reinterpret_cast<char*>(out), static_cast<std::streamsize>(bytes));
+	if (!file) {
+		throw std::runtime_error("Could not read " + path + ".");
+	}
+
+	if (sequential) {
+		running.update(out, bytes);
+	}
+	if (swapped) {
+		swap_byte_order(out, rows * header.cols);
+	}
+
+	next_row += rows;
+	if (sequential && next_row == header.rows && running.value() != header.data_checksum) {
+		throw std::runtime_error(path + ": checksum mismatch.");
+	}
+
+	return rows;
+}
+
+Matrix MatrixReader::read_rows(size_t max_rows) {
+	Matrix M(header.cols, std::min(max_rows, rows_remaining()));
+	read_rows(M.data(), max_rows);
+	return M;
+}
+
+void MatrixReader::read_block(size_t row, size_t col, size_t rows, size_t cols, double* out) {
+	if (row > header.rows || rows > header.rows - row || col > header.cols || cols > header.cols - col) {
+		throw std::invalid_argument("Block is out of range.");
+	}
+
+	for (size_t r = 0; r < rows; r++) {
+		file.seekg(static_cast<std::streamoff>(header.data_offset + ((row + r) * header.cols + col) * sizeof(double)));
+		file.read(reinterpret_cast<char*>(out + r * cols), static_cast<std::streamsize>(cols * sizeof(double)));
+	}
+	if (!file) {
+		throw std::runtime_error("Could not read " + path + ".");
+	}
+
+	if (swapped) {
+		swap_byte_order(out, rows * cols);
+	}
+}
+
+void MatrixReader::seek_row(size_t row) {
+	if (row > header.rows) {
+		throw std::invalid_argument("Row is out of range.");
+	}
+	if (row == next_row) {
+		return;
+	}
+
+	next_row = row;
+	sequential = row == 0;
+	running = Checksum();
+}
+
+MatrixWriter::MatrixWriter(const std::string& path, size_t cols) : file(path, std::ios::binary | std::ios::trunc), path{ path } {
+	if (!file) {
+		throw std::runtime_error("Could not open " + path + " for writing.");
+	}
+
+	// Placeholder until finish() knows the row count and checksum.
+	header = make_data_file_header(2, 0, cols, 0);
+	const char padding[DataFileHeader::default_alignment] = {};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(padding, static_cast<std::streamsize>(header.data_offset - sizeof(header)));
+	if (!file) {
+		throw std::runtime_error("Could not write " + path + ".");
+	}
+}
+
+// An unfinished file is removed rather than given a valid header, so an operation that threw
+// partway cannot leave a truncated matrix that loads.
+MatrixWriter::~MatrixWriter() {
+	if (!finished) {
+		file.close();
+		std::error_code ignored;
+		std::filesystem::remove(path, ignored);
+	}
+}
+
+size_t MatrixWriter::get_row_count() const noexcept {
+	return header.rows;
+}
+
+size_t MatrixWriter::get_col_count() const noexcept {
+	return header.cols;
+}
+
+void MatrixWriter::write_rows(const double* data, size_t rows) {
+	if (finished) {
+		throw std::invalid_argument("Cannot write to a finished file.");
+	}
+
+	const size_t bytes = rows * header.cols * sizeof(double);
+	file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+	if (!file) {
+		throw std::runtime_error("Could not write " + path + ".");
+	}
+
+	running.update(data, bytes);
+	header.rows += rows;
+}
+
+// Contiguous rows go straight out, strided ones are packed a row at a time.
+void MatrixWriter::write_rows(ConstMatrixView rows) {
+	if (rows.get_col_count() != header.cols) {
+		throw std::invalid_argument("Matrix dimensions do not match the file.");
+	}
+
+	if (rows.col_stride() == 1 && (rows.row_stride() == static_cast<std::ptrdiff_t>(header.cols) || rows.get_row_count() <= 1)) {
+		write_rows(rows.data(), rows.get_row_count());
+		return;
+	}
+
+	std::vector<double> packed(header.cols);
+	for (size_t r = 0; r < rows.get_row_count(); r++) {
+		for (size_t c = 0; c < header.cols; c++) {
+			packed[c] = rows(r, c);
+		}
+		write_rows(packed.data(), 1);
+	}
+}
+
+void MatrixWriter::finish() {
+	if (finished) {
+		return;
+	}
+	finished = true;
+
+	header.data_size = header.rows * header.cols * sizeof(double);
+	header.data_checksum = running.value();
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.close();
+	if (!file) {
+		throw std::runtime_error("Could not write " + path + ".");
+	}
+}
+
+// The working set is two input bands of rows x band elements and one output band of the same
+// size. Each band is read as a short run from every input row, which is slower to read than
+// whole rows but keeps the output sequential. Those reads cannot check the checksum, so the
+// input is first read through once in order, whole rows at a time, before any output exists.
+void out_of_core_transpose(const std::string& input, const std::string& output, size_t memory_budget) {
+	MatrixReader reader(input);
+	const size_t rows = reader.get_row_count();
+	const size_t cols = reader.get_col_count();
+
+	{
+		const size_t block = std::min(rows, rows_within(memory_budget, cols * sizeof(double)));
+		std::vector<double> buffer(block * cols);
+		while (reader.read_rows(buffer.data(), block) != 0) { }
+	}
+
+	MatrixWriter writer(output, rows);
+
+	const size_t band = std::max<size_t>(1, std::min(cols, rows_within(memory_budget / 3, rows * sizeof(double))));
+	std::vector<double> transposed(band * rows);
+
+	double_buffered(block_count(cols, band), rows * band,
+		[&reader, rows, cols, band](size_t b, double* buffer) {
+			const size_t col = b * band;
+			reader.read_block(0, col, rows, std::min(band, cols - col), buffer);
+		},
+		[&writer, &transposed, rows, cols, band](size_t b, const double* buffer) {
+			const size_t width = std::min(band, cols - b * band);
+			transpose(rows, width, buffer, static_cast<std::ptrdiff_t>(width), transposed.data(), static_cast<std::ptrdiff_t>(rows));
+			writer.write_rows(transposed.data(), width);
+		});
+
+	writer.finish();
+}
+
+Vector out_of_core_multiply(const std::string& A, const Vector& x, size_t memory_budget) {
+	MatrixReader reader(A);
+	const size_t rows = reader.get_row_count();
+	const size_t cols = reader.get_col_count();
+
+	if (cols != x.size()) {
+		throw std::invalid_argument("Matrix multiplication must have valid dimensions.");
+	}
+
+	Vector y(rows);
+	const size_t block = rows_within(memory_budget / 2, cols * sizeof(double));
+
+	double_buffered(block_count(rows, block), block * cols,
+		[&reader, block](size_t, double* buffer) {
+			reader.read_rows(buffer, block);
+		},
+		[&x, &y, rows, cols, block](size_t b, const double* buffer) {
+			const size_t row = b * block;
+			gemm(std::min(block, rows - row), 1, cols,
+				1.0, buffer, static_cast<std::ptrdiff_t>(cols), 1,
+				x.data(), 1, 1,
+				0.0, y.data() + row, 1, 1);
+		});
+
+	return y;
+}
+
+// Half the budget goes to blocks of A and their results, the other half to B. When B fits in
+// that half it is read once and kept, otherwise it is streamed again in panels of rows for
+// every block of A, each panel adding its share of the inner dimension to the result block.
+void out_of_core_multiply(const std::string& A, const std::string& B, const std::string& output, size_t memory_budget) {
+	MatrixReader a_reader(A);
+	MatrixReader b_reader(B);
+	const size_t m = a_reader.get_row_count();
+	const size_t k = a_reader.get_col_count();
+	const size_t n = b_reader.get_col_count();
+
+	if (b_reader.get_row_count() != k) {
+		throw std::invalid_argument("Matrix multiplication must have valid dimensions.");
+	}
+
+	MatrixWriter writer(output, n);
+	const size_t half = memory_budget / 2;
+	const size_t block = rows_within(half, (2 * k + n) * sizeof(double));
+	const bool b_resident = k * n * sizeof(double) <= half;
+	const size_t panel = b_resident ? k : std::min(k, rows_within(half, 2 * n * sizeof(double)));
+
+	std::vector<double> resident_b(b_resident ? k * n : 0);
+	if (b_resident) {
+		b_reader.read_rows(resident_b.data(), k);
+	}
+	std::vector<double> C(block * n);
+
+	double_buffered(block_count(m, block), block * k,
+		[&a_reader, block](size_t, double* buffer) {
+			a_reader.read_rows(buffer, block);
+		},
+		[&](size_t b, const double* a_block) {
+			const size_t rows = std::min(block, m - b * block);
+
+			if (b_resident) {
+				gemm(rows, n, k,
+					1.0, a_block, static_cast<std::ptrdiff_t>(k), 1,
+					resident_b.data(), static_cast<std::ptrdiff_t>(n), 1,
+					0.0, C.data(), static_cast<std::ptrdiff_t>(n), 1);
+			}
+			else {
+				std::fill_n(C.data(), rows * n, 0.0);
+				b_reader.seek_row(0);
+				double_buffered(block_count(k, panel), panel * n,
+					[&b_reader, panel](size_t, double* buffer) {
+						b_reader.read_rows(buffer, panel);
+					},
+					[&, rows](size_t p, const double* b_panel) {
+						const size_t inner = p * panel;
+						gemm(rows, n, std::min(panel, k - inner),
+							1.0, a_block + inner, static_cast<std::ptrdiff_t>(k), 1,
+							b_panel, static_cast<std::ptrdiff_t>(n), 1,
+							1.0, C.data(), static_cast<std::ptrdiff_t>(n), 1);
+					});
+			}
+
+			writer.write_rows(C.data(), rows);
+		});
+
+	writer.finish();
+}
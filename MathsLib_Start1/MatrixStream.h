@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include "DataFile.h"
+#include "Matrix.h"
+#include "MatrixView.h"
+#include "Vector.h"
+
+// Streaming access to matrix data files (see DataFile.h) too large to hold in memory.
+//
+// MatrixReader and MatrixWriter move blocks of rows between a file and caller owned memory,
+// so memory use depends on the block size rather than the matrix. The out of core operations
+// below are built on them. Each one keeps its working set within a memory budget in bytes, and
+// reads the next block on a background thread while the current one is being computed on.
+
+// Working set used by the out of core operations when no budget is given.
+constexpr size_t default_stream_budget = size_t{ 256 } << 20;
+
+// Reads a Matrix data file a block at a time. Reading every row in order with read_rows also
+// verifies the checksum, which throws from the call that reads the last row if it fails.
+class MatrixReader {
+	std::ifstream file;
+	std::string path;
+	DataFileHeader header{};
+	bool swapped = false;
+	size_t next_row = 0;
+	Checksum running;
+	bool sequential = true;
+
+public:
+	explicit MatrixReader(const std::string& path);
+
+	size_t get_row_count() const noexcept;
+	size_t get_col_count() const noexcept;
+	size_t rows_remaining() const noexcept;
+
+	// Reads up to max_rows rows into out, row major with get_col_count() elements per row, and
+	// returns the number read, zero once every row has been read.
+	size_t read_rows(double* out, size_t max_rows);
+	// Throws std::invalid_argument once every row has been read, since a Matrix cannot be empty.
+	Matrix read_rows(size_t max_rows);
+
+	// Reads the rows x cols block at (row, col) into out, row major. Random access that leaves
+	// the read_rows position and checksum alone.
+	void read_block(size_t row, size_t col, size_t rows, size_t cols, double* out);
+
+	// Moves the read_rows position, skipping the checksum unless it moves back to the start.
+	void seek_row(size_t row);
+};
+
+// Writes a Matrix data file a block of rows at a time. The header is written again by finish()
+// with the final row count and checksum, so the total size need not be known up front. Only
+// finish() completes the file.
+class MatrixWriter {
+	std::ofstream file;
+	std::string path;
+	DataFileHeader header{};
+	Checksum running;
+	bool finished = false;
+
+public:
+	MatrixWriter(const std::string& path, size_t cols);
+	// Deletes the file if finish() has not been called.
+	~MatrixWriter();
+
+	MatrixWriter(const MatrixWriter&) = delete;
+	MatrixWriter& operator=(const MatrixWriter&) = delete;
+
+	size_t get_row_count() const noexcept;
+	size_t get_col_count() const noexcept;
+
+	// rows x get_col_count() elements, row major.
+	void write_rows(const double* data, size_t rows);
+	void write_rows(ConstMatrixView rows);
+
+	void finish();
+};
+
+// The output file of each operation must differ from its inputs.
+
+// Writes the transpose of the matrix in input to output. The input is read once in order to
+// verify its checksum, then the output is written in order, a band of its rows at a time, each
+// band gathered from every row of the input.
+void out_of_core_transpose(const std::string& input, const std::string& output, size_t memory_budget = default_stream_budget);
+
+// A x for A in a file, streamed by blocks of rows.
+Vector out_of_core_multiply(const std::string& A, const Vector& x, size_t memory_budget = default_stream_budget);
+
+// Writes A B to output for A and B in files. A is streamed by blocks of rows and, for each of
+// them, B by panels of rows, so B is read once per block of A unless it fits in the budget.
+void out_of_core_multiply(const std::string& A, const std::string& B, const std::string& output, size_t memory_budget = default_stream_budget);
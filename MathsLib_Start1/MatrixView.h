@@ -0,0 +1,299 @@
+#pragma once
+#include "MatrixExpression.h"
+#include "VectorView.h"
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Non-owning, strided views of matrix data.
+//
+// Element (r, c) of a view lives at data[r * row_stride + c * col_stride], with strides in
+// elements rather than bytes. This covers a whole Matrix, and also row major, column major or
+// padded memory owned elsewhere. Views take part in matrix expressions like any Matrix, and
+// assigning to a view writes through to the elements it refers to.
+//
+// Transposes, blocks, row and column ranges and diagonals are views of the same elements with
+// adjusted strides, so taking one never copies. Products of views are passed to gemm with their
+// strides (see Matrix.h), so A.T() * B reads A in place.
+
+// Iterates the rows of a matrix or view, yielding a VectorView per row.
+template <typename T>
+class MatrixRowIterator {
+	T* row_data;
+	size_t length;
+	std::ptrdiff_t row_stride;
+	std::ptrdiff_t col_stride;
+
+public:
+	using iterator_category = std::random_access_iterator_tag;
+	using value_type = BasicVectorView<T>;
+	using difference_type = std::ptrdiff_t;
+	using reference = BasicVectorView<T>;
+	using pointer = void;
+
+	MatrixRowIterator() noexcept : row_data{ nullptr }, length{ 0 }, row_stride{ 0 }, col_stride{ 1 } { }
+	MatrixRowIterator(T* row_data, size_t length, std::ptrdiff_t row_stride, std::ptrdiff_t col_stride = 1) noexcept
+		: row_data{ row_data }, length{ length }, row_stride{ row_stride }, col_stride{ col_stride } { }
+
+	reference operator*() const noexcept {
+		return BasicVectorView<T>(row_data, length, col_stride);
+	}
+
+	reference operator[](difference_type n) const noexcept {
+		return BasicVectorView<T>(row_data + n * row_stride, length, col_stride);
+	}
+
+	MatrixRowIterator& operator++() noexcept {
+		row_data += row_stride;
+		return *this;
+	}
+
+	MatrixRowIterator operator++(int) noexcept {
+		MatrixRowIterator tmp = *this;
+		row_data += row_stride;
+		return tmp;
+	}
+
+	MatrixRowIterator& operator--() noexcept {
+		row_data -= row_stride;
+		return *this;
+	}
+
+	MatrixRowIterator operator--(int) noexcept {
+		MatrixRowIterator tmp = *this;
+		row_data -= row_stride;
+		return tmp;
+	}
+
+	MatrixRowIterator& operator+=(difference_type n) noexcept {
+		row_data += n * row_stride;
+		return *this;
+	}
+
+	MatrixRowIterator& operator-=(difference_type n) noexcept {
+		row_data -= n * row_stride;
+		return *this;
+	}
+
+	friend MatrixRowIterator operator+(MatrixRowIterator it, difference_type n) noexcept {
+		return it += n;
+	}
+
+	friend MatrixRowIterator operator-(MatrixRowIterator it, difference_type n) noexcept {
+		return it -= n;
+	}
+
+	friend difference_type operator-(const MatrixRowIterator& a, const MatrixRowIterator& b) noexcept {
+		return a.row_stride == 0 ? 0 : (a.row_data - b.row_data) / a.row_stride;
+	}
+
+	friend bool operator==(const MatrixRowIterator& a, const MatrixRowIterator& b) noexcept {
+		return a.row_data == b.row_data;
+	}
+
+	friend bool operator<(const MatrixRowIterator& a, const MatrixRowIterator& b) noexcept {
+		return a.row_stride > 0 ? a.row_data < b.row_data : a.row_data > b.row_data;
+	}
+};
+
+// The elements of an expression copied out in row major order, for assigning one that reads
+// elements of its target.
+template <typename E>
+std::vector<double> evaluated_copy(const MatrixExpression<E>& expression) {
+	const E& source = expression.self();
+	const size_t rows = source.get_row_count();
+	const size_t cols = source.get_col_count();
+	std::vector<double> values(rows * cols);
+	for (size_t r = 0; r < rows; r++) {
+		for (size_t c = 0; c < cols; c++) {
+			values[r * cols + c] = source(r, c);
+		}
+	}
+	return values;
+}
+
+// Element is double for a writable view and const double for a read only one.
+template <typename Element>
+class BasicMatrixView : public MatrixExpression<BasicMatrixView<Element>> {
+	Element* view_data;
+	size_t row_count;
+	size_t col_count;
+	std::ptrdiff_t rs;
+	std::ptrdiff_t cs;
+
+public:
+	// Wraps a rows x cols matrix starting at data.
+	BasicMatrixView(Element* data, size_t rows, size_t cols, std::ptrdiff_t row_stride, std::ptrdiff_t col_stride = 1) noexcept
+		: view_data{ data }, row_count{ rows }, col_count{ cols }, rs{ row_stride }, cs{ col_stride } { }
+
+	BasicMatrixView(const BasicMatrixView&) = default;
+
+	// A writable view can be used wherever a read only view is expected.
+	operator BasicMatrixView<const Element>() const noexcept requires (!std::is_const_v<Element>) {
+		return BasicMatrixView<const Element>(view_data, row_count, col_count, rs, cs);
+	}
+
+	size_t get_row_count() const noexcept {
+		return row_count;
+	}
+
+	size_t get_col_count() const noexcept {
+		return col_count;
+	}
+
+	std::ptrdiff_t row_stride() const noexcept {
+		return rs;
+	}
+
+	std::ptrdiff_t col_stride() const noexcept {
+		return cs;
+	}
+
+	Element* data() const noexcept {
+		return view_data;
+	}
+
+	Element& operator()(const size_t& row, const size_t& col) const noexcept {
+		return view_data[static_cast<std::ptrdiff_t>(row) * rs + static_cast<std::ptrdiff_t>(col) * cs];
+	}
+
+	BasicVectorView<Element> row(const size_t& index) const noexcept {
+		return BasicVectorView<Element>(view_data + static_cast<std::ptrdiff_t>(index) * rs, col_count, cs);
+	}
+
+	BasicVectorView<Element> col(const size_t& index) const noexcept {
+		return BasicVectorView<Element>(view_data + static_cast<std::ptrdiff_t>(index) * cs, row_count, rs);
+	}
+
+	// Rows and columns swapped by exchanging the strides.
+	BasicMatrixView T() const noexcept {
+		return BasicMatrixView(view_data, col_count, row_count, cs, rs);
+	}
+
+	// The rows x cols elements starting at (row, col).
+	BasicMatrixView block(size_t row, size_t col, size_t rows, size_t cols) const {
+		if (row > row_count || rows > row_count - row || col > col_count || cols > col_count - col) {
+			throw std::invalid_argument("A block must lie within the matrix.");
+		}
+		return BasicMatrixView(view_data + static_cast<std::ptrdiff_t>(row) * rs + static_cast<std::ptrdiff_t>(col) * cs, rows, cols, rs, cs);
+	}
+
+	// Rows [begin, end) and columns [begin, end).
+	BasicMatrixView row_range(size_t begin, size_t end) const {
+		if (begin > end) {
+			throw std::invalid_argument("A row range must not end before it begins.");
+		}
+		return block(begin, 0, end - begin, col_count);
+	}
+
+	BasicMatrixView col_range(size_t begin, size_t end) const {
+		if (begin > end) {
+			throw std::invalid_argument("A column range must not end before it begins.");
+		}
+		return block(0, begin, row_count, end - begin);
+	}
+
+	// Elements (i, i) for i below the smaller dimension.
+	BasicVectorView<Element> diagonal() const noexcept {
+		return BasicVectorView<Element>(view_data, std::min(row_count, col_count), rs + cs);
+	}
+
+	BasicVectorView<Element> operator[](const size_t& index) const noexcept {
+		return row(index);
+	}
+
+	// Whether reading this view while writing target could read an overwritten element, see MatrixExpression.h.
+	bool aliases(const BasicMatrixView<const double>& target) const noexcept {
+		return strided_alias(view_data, rs, cs, target.data(), target.row_stride(), target.col_stride(), row_count, col_count);
+	}
+
+	MatrixRowIterator<Element> begin() const noexcept {
+		return MatrixRowIterator<Element>(view_data, col_count, rs, cs);
+	}
+
+	MatrixRowIterator<Element> end() const noexcept {
+		return MatrixRowIterator<Element>(view_data + static_cast<std::ptrdiff_t>(row_count) * rs, col_count, rs, cs);
+	}
+
+	// Writes the elements of another view or expression through this view.
+	const BasicMatrixView& operator=(const BasicMatrixView& M) const requires (!std::is_const_v<Element>) {
+		return *this = static_cast<const MatrixExpression<BasicMatrixView>&>(M);
+	}
+
+	template <typename E>
+	const BasicMatrixView& operator=(const MatrixExpression<E>& expression) const requires (!std::is_const_v<Element>) {
+		const E& source = expression.self();
+		if (source.get_row_count() != row_count || source.get_col_count() != col_count) {
+			throw std::invalid_argument("Matrix assignment must have valid dimensions.");
+		}
+		if (source.aliases(*this)) {
+			const std::vector<double> values = evaluated_copy(source);
+			return *this = BasicMatrixView<const double>(values.data(), row_count, col_count, static_cast<std::ptrdiff_t>(col_count));
+		}
+
+		for (size_t r = 0; r < row_count; r++) {
+			for (size_t c = 0; c < col_count; c++) {
+				(*this)(r, c) = source(r, c);
+			}
+		}
+		return *this;
+	}
+
+	// Compound assignment through the view, leaving the elements around it untouched.
+	template <typename E>
+	const BasicMatrixView& operator+=(const MatrixExpression<E>& expression) const requires (!std::is_const_v<Element>) {
+		const E& source = expression.self();
+		if (source.get_row_count() != row_count || source.get_col_count() != col_count) {
+			throw std::invalid_argument("Matrix addition and subtraction must have valid dimensions.");
+		}
+		if (source.aliases(*this)) {
+			const std::vector<double> values = evaluated_copy(source);
+			return *this += BasicMatrixView<const double>(values.data(), row_count, col_count, static_cast<std::ptrdiff_t>(col_count));
+		}
+
+		for (size_t r = 0; r < row_count; r++) {
+			for (size_t c = 0; c < col_count; c++) {
+				(*this)(r, c) += source(r, c);
+			}
+		}
+		return *this;
+	}
+
+	template <typename E>
+	const BasicMatrixView& operator-=(const MatrixExpression<E>& expression) const requires (!std::is_const_v<Element>) {
+		const E& source = expression.self();
+		if (source.get_row_count() != row_count || source.get_col_count() != col_count) {
+			throw std::invalid_argument("Matrix addition and subtraction must have valid dimensions.");
+		}
+		if (source.aliases(*this)) {
+			const std::vector<double> values = evaluated_copy(source);
+			return *this -= BasicMatrixView<const double>(values.data(), row_count, col_count, static_cast<std::ptrdiff_t>(col_count));
+		}
+
+		for (size_t r = 0; r < row_count; r++) {
+			for (size_t c = 0; c < col_count; c++) {
+				(*this)(r, c) -= source(r, c);
+			}
+		}
+		return *this;
+	}
+
+	const BasicMatrixView& operator*=(const double& num) const noexcept requires (!std::is_const_v<Element>) {
+		for (size_t r = 0; r < row_count; r++) {
+			for (size_t c = 0; c < col_count; c++) {
+				(*this)(r, c) *= num;
+			}
+		}
+		return *this;
+	}
+
+	const BasicMatrixView& operator/=(const double& num) const noexcept requires (!std::is_const_v<Element>) {
+		return *this *= (1.0 / num);
+	}
+};
+
+using MatrixView = BasicMatrixView<double>;
+using ConstMatrixView = BasicMatrixView<const double>;
@@ -0,0 +1,176 @@
+#include "MemoryResource.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+namespace {
+
+	thread_local std::pmr::memory_resource* scoped_resource = nullptr;
+
+	std::byte* align_up(std::byte* p, size_t alignment) noexcept {
+		const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(p);
+		return p + ((alignment - address % alignment) % alignment);
+	}
+
+	// Index of the smallest class holding size bytes, class i holds blocks of min_block_size << i.
+	size_t size_class_of(size_t size) noexcept {
+		return std::bit_width(std::max(size, SizeClassPool::min_block_size) - 1) - std::bit_width(SizeClassPool::min_block_size - 1);
+	}
+}
+
+// --------- MemoryArena. ---------
+
+MemoryArena::MemoryArena(size_t initial_size, std::pmr::memory_resource* upstream) :
+	upstream{ upstream }, next_chunk_size{ std::max<size_t>(initial_size, 64) } { }
+
+MemoryArena::~MemoryArena() {
+	release();
+}
+
+void MemoryArena::reset() noexcept {
+	current = 0;
+	cursor = chunks.empty() ? nullptr : chunks[0].data;
+	limit = chunks.empty() ? nullptr : chunks[0].data + chunks[0].size;
+	used = 0;
+}
+
+void MemoryArena::release() noexcept {
+	for (const Chunk& chunk : chunks) {
+		upstream->deallocate(chunk.data, chunk.size, alignof(std::max_align_t));
+	}
+	chunks.clear();
+	reset();
+}
+
+size_t MemoryArena::bytes_used() const noexcept {
+	return used;
+}
+
+size_t MemoryArena::capacity() const noexcept {
+	size_t total = 0;
+	for (const Chunk& chunk : chunks) {
+		total += chunk.size;
+	}
+	return total;
+}
+
+void* MemoryArena::do_allocate(size_t bytes, size_t alignment) {
+	std::byte* p = cursor ? align_up(cursor, alignment) : nullptr;
+
+	// Move on to the next kept chunk, or once they are all used take a new one from upstream,
+	// growing geometrically so the number of chunks stays logarithmic in the peak usage.
+	while (!p || p > limit || bytes > static_cast<size_t>(limit - p)) {
+		const size_t next = cursor ? current + 1 : 0;
+
+		if (next < chunks.size()) {
+			current = next;
+		}
+		else {
+			const size_t size = std::max(next_chunk_size, bytes + alignment);
+			chunks.push_back(Chunk{ static_cast<std::byte*>(upstream->allocate(size, alignof(std::max_align_t))), size });
+			current = chunks.size() - 1;
+			next_chunk_size = size * 2;
+		}
+
+		cursor = chunks[current].data;
+		limit = cursor + chunks[current].size;
+		p = align_up(cursor, alignment);
+	}
+
+	cursor = p + bytes;
+	used += bytes;
+	return p;
+}
+
+// Memory is only reclaimed by reset.
+void MemoryArena::do_deallocate(void*, size_t, size_t) { }
+
+bool MemoryArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+	return this == &other;
+}
+
+// --------- SizeClassPool. ---------
+
+SizeClassPool::SizeClassPool(std::pmr::memory_resource* upstream) : upstream{ upstream } { }
+
+SizeClassPool::~SizeClassPool() {
+	release();
+}
+
+void SizeClassPool::release() noexcept {
+	for (const Chunk& chunk : chunks) {
+		upstream->deallocate(chunk.data, chunk.size, chunk_alignment);
+	}
+	chunks.clear();
+	std::fill(std::begin(free_lists), std::end(free_lists), nullptr);
+}
+
+size_t SizeClassPool::capacity() const noexcept {
+	size_t total = 0;
+	for (const Chunk& chunk : chunks) {
+		total += chunk.size;
+	}
+	return total;
+}
+
+// Carves a new chunk into blocks of one class. Small classes share 64KB chunks, large ones get at least 8 blocks.
+void SizeClassPool::refill(size_t size_class) {
+	const size_t block_size = min_block_size << size_class;
+	const size_t size = std::max<size_t>(64 * 1024, block_size * 8);
+
+	std::byte* data = static_cast<std::byte*>(upstream->allocate(size, chunk_alignment));
+	chunks.push_back(Chunk{ data, size });
+
+	// Threaded back to front so blocks are handed out in address order.
+	for (size_t offset = size; offset >= block_size; offset -= block_size) {
+		FreeBlock* block = reinterpret_cast<FreeBlock*>(data + offset - block_size);
+		block->next = free_lists[size_class];
+		free_lists[size_class] = block;
+	}
+}
+
+void* SizeClassPool::do_allocate(size_t bytes, size_t alignment) {
+	if (bytes > max_block_size || alignment > chunk_alignment) {
+		return upstream->allocate(bytes, alignment);
+	}
+
+	// Power of two blocks carved from aligned chunks are aligned to their own size.
+	const size_t size_class = size_class_of(std::max(bytes, alignment));
+	if (!free_lists[size_class]) {
+		refill(size_class);
+	}
+
+	FreeBlock* block = free_lists[size_class];
+	free_lists[size_class] = block->next;
+	return block;
+}
+
+void SizeClassPool::do_deallocate(void* p, size_t bytes, size_t alignment) {
+	if (bytes > max_block_size || alignment > chunk_alignment) {
+		upstream->deallocate(p, bytes, alignment);
+		return;
+	}
+
+	const size_t size_class = size_class_of(std::max(bytes, alignment));
+	FreeBlock* block = static_cast<FreeBlock*>(p);
+	block->next = free_lists[size_class];
+	free_lists[size_class] = block;
+}
+
+bool SizeClassPool::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+	return this == &other;
+}
+
+// --------- Scoped resources. ---------
+
+std::pmr::memory_resource* current_memory_resource() noexcept {
+	return scoped_resource ? scoped_resource : std::pmr::get_default_resource();
+}
+
+ScopedMemoryResource::ScopedMemoryResource(std::pmr::memory_resource* resource) noexcept : previous{ scoped_resource } {
+	scoped_resource = resource;
+}
+
+ScopedMemoryResource::~ScopedMemoryResource() {
+	scoped_resource = previous;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// Memory resources for Vector and Matrix storage.
+//
+// Vector and Matrix allocate from current_memory_resource(): the resource installed on this
+// thread by the innermost ScopedMemoryResource, or std::pmr::get_default_resource() outside
+// any scope. Storage keeps the resource it was allocated from for its whole life, moves
+// included, so nothing allocated in a scope may outlive its resource or an arena reset().
+// Copies allocate from the resource current where the copy is made.
+
+// Bump pointer arena. Allocation is a pointer increment and deallocation does nothing, reset()
+// frees everything at once in O(1) by rewinding to the first chunk. Chunks come from the
+// upstream resource and are kept for reuse until release() or destruction.
+// Not thread safe, use one arena per thread or per request.
+class MemoryArena : public std::pmr::memory_resource {
+	struct Chunk {
+		std::byte* data;
+		size_t size;
+	};
+
+	std::pmr::memory_resource* upstream;
+	std::vector<Chunk> chunks;
+	size_t next_chunk_size;
+
+	// Chunk being allocated from, and the free space left in it.
+	size_t current = 0;
+	std::byte* cursor = nullptr;
+	std::byte* limit = nullptr;
+	size_t used = 0;
+
+public:
+	explicit MemoryArena(size_t initial_size = 64 * 1024, std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+	~MemoryArena();
+
+	MemoryArena(const MemoryArena&) = delete;
+	MemoryArena& operator=(const MemoryArena&) = delete;
+
+	// Invalidates everything allocated from the arena and keeps the chunks.
+	void reset() noexcept;
+	// As reset, and also returns the chunks to the upstream resource.
+	void release() noexcept;
+
+	// Bytes handed out since the last reset, and bytes held from upstream.
+	size_t bytes_used() const noexcept;
+	size_t capacity() const noexcept;
+
+protected:
+	void* do_allocate(size_t bytes, size_t alignment) override;
+	void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+// Free lists in power of two size classes from 16 bytes, two doubles, up to max_block_size.
+// A freed block is reused by the next allocation in its class, so the many short lived,
+// similar length vectors of a typical workload stop reaching malloc after warming up.
+// Larger requests go straight to the upstream resource.
+// Not thread safe, use one pool per thread.
+class SizeClassPool : public std::pmr::memory_resource {
+public:
+	static constexpr size_t min_block_size = 16;
+	static constexpr size_t max_block_size = 64 * 1024;
+
+private:
+	static constexpr size_t class_count = 13;
+
+	// Blocks are carved from chunks aligned to this, so blocks of at least this size are too.
+	static constexpr size_t chunk_alignment = 64;
+
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+
+	struct Chunk {
+		void* data;
+		size_t size;
+	};
+
+	std::pmr::memory_resource* upstream;
+	std::vector<Chunk> chunks;
+	FreeBlock* free_lists[class_count] = {};
+
+	void refill(size_t size_class);
+
+public:
+	explicit SizeClassPool(std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+	~SizeClassPool();
+
+	SizeClassPool(const SizeClassPool&) = delete;
+	SizeClassPool& operator=(const SizeClassPool&) = delete;
+
+	// Invalidates every pooled block and returns the chunks to the upstream resource.
+	void release() noexcept;
+
+	size_t capacity() const noexcept;
+
+protected:
+	void* do_allocate(size_t bytes, size_t alignment) override;
+	void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+// The resource new Vector and Matrix storage on this thread is allocated from.
+std::pmr::memory_resource* current_memory_resource() noexcept;
+
+// Makes Vector and Matrix on this thread allocate from resource until the end of the scope.
+// Scopes nest, the previous resource is restored on destruction.
+class ScopedMemoryResource {
+	std::pmr::memory_resource* previous;
+
+public:
+	explicit ScopedMemoryResource(std::pmr::memory_resource* resource) noexcept;
+	~ScopedMemoryResource();
+
+	ScopedMemoryResource(const ScopedMemoryResource&) = delete;
+	ScopedMemoryResource& operator=(const ScopedMemoryResource&) = delete;
+};
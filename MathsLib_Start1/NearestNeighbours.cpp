@@ -0,0 +1,429 @@
+#include "NearestNeighbours.h"
+#include "Gemm.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+	// Queries and points per GEMM block. A block of distances, 64 x 1024 doubles, stays in L2.
+	constexpr size_t query_block = 64;
+	constexpr size_t point_block = 1024;
+
+	// Distances are filtered against the heap's threshold this many at a time.
+	constexpr size_t filter_width = 16;
+
+	struct Candidate {
+		double key;
+		size_t index;
+	};
+
+	// The total order of neighbours, ties in distance go to the lower index.
+	bool operator<(const Candidate& a, const Candidate& b) noexcept {
+		return a.key < b.key || (a.key == b.key && a.index < b.index);
+	}
+
+	// Max heap of the best k candidates so far, kept in caller owned storage of k slots.
+	class TopK {
+		Candidate* slots;
+		size_t capacity;
+		size_t count = 0;
+
+	public:
+		TopK(Candidate* slots, size_t capacity) noexcept : slots{ slots }, capacity{ capacity } {}
+
+		// Anything with a larger key can be skipped without comparing indices.
+		double threshold() const noexcept {
+			return count < capacity ? std::numeric_limits<double>::infinity() : slots[0].key;
+		}
+
+		void push(const Candidate& candidate) {
+			if (count < capacity) {
+				slots[count++] = candidate;
+				std::push_heap(slots, slots + count);
+			}
+			else if (candidate < slots[0]) {
+				std::pop_heap(slots, slots + count);
+				slots[count - 1] = candidate;
+				std::push_heap(slots, slots + count);
+			}
+		}
+
+		// Keys of one row of a distance block, for points first_index onward. A vectorisable
+		// pass over each group of keys decides whether any of them can enter the heap.
+		void push_row(const double* keys, size_t n, size_t first_index) {
+			for (size_t j0 = 0; j0 < n; j0 += filter_width) {
+				const size_t end = std::min(n, j0 + filter_width);
+				const double limit = threshold();
+
+				int any = 0;
+				for (size_t j = j0; j < end; j++) {
+					any |= keys[j] <= limit;
+				}
+				if (!any) {
+					continue;
+				}
+
+				for (size_t j = j0; j < end; j++) {
+					if (keys[j] <= threshold()) {
+						push({ keys[j], first_index + j });
+					}
+				}
+			}
+		}
+
+		size_t size() const noexcept {
+			return count;
+		}
+
+		// Sorts the slots nearest first, after which the heap is no longer usable.
+		const Candidate* sorted() noexcept {
+			std::sort_heap(slots, slots + count);
+			return slots;
+		}
+	};
+
+	KnnResult make_result(size_t query_count, size_t k) {
+		KnnResult result;
+		result.query_count = query_count;
+		result.k = k;
+		result.indices.assign(query_count * k, KnnResult::npos);
+		result.distances.assign(query_count * k, std::numeric_limits<double>::infinity());
+		return result;
+	}
+
+	// A single vector as a one row matrix.
+	ConstMatrixView as_row(ConstVectorView query) noexcept {
+		return ConstMatrixView(query.data(), 1, query.size(), 0, query.stride());
+	}
+
+	double squared_norm(ConstVectorView v) noexcept {
+		double sum = 0.0;
+		for (size_t i = 0; i < v.size(); i++) {
+			sum += v[i] * v[i];
+		}
+		return sum;
+	}
+}
+
+BruteForceIndex::BruteForceIndex(ConstMatrixView points, DistanceMetric metric) : points{ points }, metric{ metric },
+	weights(points.get_row_count()), offsets(points.get_row_count()) {
+
+	parallel_rows(points.get_row_count(), points.get_col_count(), [this, &points, metric](size_t begin, size_t end) {
+		for (size_t p = begin; p < end; p++) {
+			const double norm2 = squared_norm(points.row(p));
+			switch (metric) {
+			case DistanceMetric::L2:
+				weights[p] = -2.0;
+				offsets[p] = norm2;
+				break;
+			case DistanceMetric::Cosine:
+				weights[p] = norm2 > 0.0 ? -1.0 / std::sqrt(norm2) : 0.0;
+				offsets[p] = 0.0;
+				break;
+			case DistanceMetric::Dot:
+				weights[p] = -1.0;
+				offsets[p] = 0.0;
+				break;
+			}
+		}
+	});
+}
+
+size_t BruteForceIndex::size() const noexcept {
+	return points.get_row_count();
+}
+
+size_t BruteForceIndex::dimensions() const noexcept {
+	return points.get_col_count();
+}
+
+DistanceMetric BruteForceIndex::get_metric() const noexcept {
+	return metric;
+}
+
+// Tasks are (query block, part of the points) pairs, each keeping its own k best per query. The
+// parts are then merged per query. Since the order of neighbours is total, the merged result is
+// the same however the points were split.
+KnnResult BruteForceIndex::search(ConstMatrixView queries, size_t k) const {
+	MATHSLIB_COUNT_OPERATION(KnnSearch);
+	if (queries.get_col_count() != points.get_col_count()) {
+		throw std::invalid_argument("Queries must have the same dimensions as the points.");
+	}
+
+	const size_t n = points.get_row_count();
+	const size_t q = queries.get_row_count();
+	const size_t dims = points.get_col_count();
+	k = std::min(k, n);
+	KnnResult result = make_result(q, k);
+	if (k == 0 || q == 0) {
+		return result;
+	}
+
+	ThreadPool& pool = default_thread_pool();
+	const size_t query_blocks = (q + query_block - 1) / query_block;
+	const size_t point_blocks = (n + point_block - 1) / point_block;
+	const size_t parts = std::min(point_blocks, std::max<size_t>(1, pool.thread_count() / query_blocks));
+	const size_t blocks_per_part = (point_blocks + parts - 1) / parts;
+
+	std::vector<Candidate> partial(q * parts * k);
+	std::vector<size_t> partial_count(q * parts);
+
+	pool.parallel_for(0, query_blocks * parts, 1, [&](size_t task_begin, size_t task_end) {
+		thread_local std::vector<double> block;
+		block.resize(query_block * point_block);
+
+		for (size_t task = task_begin; task < task_end; task++) {
+			const size_t first_query = (task / parts) * query_block;
+			const size_t rows = std::min(query_block, q - first_query);
+			const size_t part = task % parts;
+
+			std::vector<TopK> heaps;
+			heaps.reserve(rows);
+			for (size_t i = 0; i < rows; i++) {
+				heaps.emplace_back(partial.data() + ((first_query + i) * parts + part) * k, k);
+			}
+
+			const size_t first_block = part * blocks_per_part;
+			const size_t last_block = std::min(point_blocks, first_block + blocks_per_part);
+			for (size_t b = first_block; b < last_block; b++) {
+				const size_t first_point = b * point_block;
+				const size_t cols = std::min(point_block, n - first_point);
+
+				// Inner products of the query rows with the point rows, the points read transposed.
+				gemm(rows, cols, dims,
+					1.0, queries.data() + first_query * queries.row_stride(), queries.row_stride(), queries.col_stride(),
+					points.data() + first_point * points.row_stride(), points.col_stride(), points.row_stride(),
+					0.0, block.data(), static_cast<std::ptrdiff_t>(point_block), 1);
+
+				const double* w = weights.data() + first_point;
+				const double* o = offsets.data() + first_point;
+				for (size_t i = 0; i < rows; i++) {
+					double* keys = block.data() + i * point_block;
+					for (size_t j = 0; j < cols; j++) {
+						keys[j] = w[j] * keys[j] + o[j];
+					}
+					heaps[i].push_row(keys, cols, first_point);
+				}
+			}
+
+			for (size_t i = 0; i < rows; i++) {
+				partial_count[(first_query + i) * parts + part] = heaps[i].size();
+			}
+		}
+	});
+
+	// Merges each query's parts, then turns keys back into distances.
+	parallel_elementwise(q, [&](size_t begin, size_t end) {
+		std::vector<Candidate> merged;
+		for (size_t query = begin; query < end; query++) {
+			merged.clear();
+			for (size_t part = 0; part < parts; part++) {
+				const Candidate* first = partial.data() + (query * parts + part) * k;
+				merged.insert(merged.end(), first, first + partial_count[query * parts + part]);
+			}
+			const size_t found = std::min(k, merged.size());
+			std::partial_sort(merged.begin(), merged.begin() + found, merged.end());
+
+			const double query_norm2 = metric == DistanceMetric::Dot ? 0.0 : squared_norm(queries.row(query));
+			const double query_scale = query_norm2 > 0.0 ? 1.0 / std::sqrt(query_norm2) : 0.0;
+
+			for (size_t rank = 0; rank < found; rank++) {
+				const double key = merged[rank].key;
+				double distance = key;
+				if (metric == DistanceMetric::L2) {
+					distance = std::sqrt(std::max(0.0, key + query_norm2));
+				}
+				else if (metric == DistanceMetric::Cosine) {
+					distance = 1.0 + key * query_scale;
+				}
+				result.indices[query * k + rank] = merged[rank].index;
+				result.distances[query * k + rank] = distance;
+			}
+		}
+	});
+
+	return result;
+}
+
+KnnResult BruteForceIndex::search(ConstVectorView query, size_t k) const {
+	return search(as_row(query), k);
+}
+
+KdTree::KdTree(ConstMatrixView points, size_t leaf_size) : dimension_count{ points.get_col_count() }, leaf_size{ std::max<size_t>(1, leaf_size) } {
+	const size_t n = points.get_row_count();
+	if (n == 0) {
+		return;
+	}
+
+	coordinates.resize(n * dimension_count);
+	original.resize(n);
+	parallel_rows(n, dimension_count, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			for (size_t d = 0; d < dimension_count; d++) {
+				coordinates[i * dimension_count + d] = points(i, d);
+			}
+			original[i] = i;
+		}
+	});
+
+	std::vector<double> scratch(n * dimension_count);
+	std::vector<size_t> scratch_original(n);
+	nodes.reserve(4 * ((n + this->leaf_size - 1) / this->leaf_size));
+	build(0, n, scratch, scratch_original);
+}
+
+// Splits the dimension with the widest spread at the median of an evenly spaced sample. Rows are
+// scattered into their halves through scratch without a branch per row, which mispredicts half
+// the time on a median split, and copied back. Points that are all identical stay in one leaf
+// however many there are.
+size_t KdTree::build(size_t begin, size_t end, std::vector<double>& scratch, std::vector<size_t>& scratch_original) {
+	const size_t index = nodes.size();
+	nodes.push_back({ begin, end, 0, 0.0, 0, 0 });
+	if (end - begin <= leaf_size) {
+		return index;
+	}
+
+	const size_t dims = dimension_count;
+	size_t dim = 0;
+	double widest = 0.0;
+	for (size_t d = 0; d < dims; d++) {
+		double low = coordinates[begin * dims + d];
+		double high = low;
+		for (size_t i = begin + 1; i < end; i++) {
+			const double x = coordinates[i * dims + d];
+			low = std::min(low, x);
+			high = std::max(high, x);
+		}
+		if (high - low > widest) {
+			widest = high - low;
+			dim = d;
+		}
+	}
+	if (widest == 0.0) {
+		return index;
+	}
+
+	constexpr size_t max_samples = 255;
+	const size_t count = end - begin;
+	const size_t samples = std::min(count, max_samples);
+	double sample[max_samples];
+	for (size_t s = 0; s < samples; s++) {
+		sample[s] = coordinates[(begin + s * count / samples) * dims + dim];
+	}
+	std::nth_element(sample, sample + samples / 2, sample + samples);
+	const double split = sample[samples / 2];
+
+	// Rows below the split go left. If the split is the smallest value, rows equal to it go
+	// left instead, and since the spread is not zero the right side still gets the largest.
+	size_t below = 0;
+	for (size_t i = begin; i < end; i++) {
+		below += coordinates[i * dims + dim] < split;
+	}
+	const bool inclusive = below == 0;
+
+	size_t left_end = begin;
+	size_t right_begin = end;
+	for (size_t i = begin; i < end; i++) {
+		const double x = coordinates[i * dims + dim];
+		const bool left = inclusive ? x <= split : x < split;
+		const size_t to = left ? left_end : right_begin - 1;
+		left_end += left;
+		right_begin -= !left;
+
+		for (size_t d = 0; d < dims; d++) {
+			scratch[to * dims + d] = coordinates[i * dims + d];
+		}
+		scratch_original[to] = original[i];
+	}
+	std::copy(scratch.data() + begin * dims, scratch.data() + end * dims, coordinates.data() + begin * dims);
+	std::copy(scratch_original.data() + begin, scratch_original.data() + end, original.data() + begin);
+
+	const size_t left = build(begin, left_end, scratch, scratch_original);
+	const size_t right = build(left_end, end, scratch, scratch_original);
+	nodes[index].dim = dim;
+	nodes[index].split = split;
+	nodes[index].left = left;
+	nodes[index].right = right;
+	return index;
+}
+
+// Keys are squared distances. The far side of a split is only visited when the plane is no
+// further than the current k-th best, equal counting so ties still go to the lower index.
+template <typename Heap>
+void KdTree::search_node(size_t node, const double* query, Heap& heap) const {
+	const Node& current = nodes[node];
+
+	if (current.left == 0) {
+		for (size_t i = current.begin; i < current.end; i++) {
+			const double* point = coordinates.data() + i * dimension_count;
+			double sum = 0.0;
+			for (size_t d = 0; d < dimension_count; d++) {
+				const double diff = query[d] - point[d];
+				sum += diff * diff;
+			}
+			if (sum <= heap.threshold()) {
+				heap.push({ sum, original[i] });
+			}
+		}
+		return;
+	}
+
+	const double diff = query[current.dim] - current.split;
+	search_node(diff < 0.0 ? current.left : current.right, query, heap);
+	if (diff * diff <= heap.threshold()) {
+		search_node(diff < 0.0 ? current.right : current.left, query, heap);
+	}
+}
+
+size_t KdTree::size() const noexcept {
+	return original.size();
+}
+
+size_t KdTree::dimensions() const noexcept {
+	return dimension_count;
+}
+
+KnnResult KdTree::search(ConstMatrixView queries, size_t k) const {
+	MATHSLIB_COUNT_OPERATION(KnnSearch);
+	if (queries.get_col_count() != dimension_count) {
+		throw std::invalid_argument("Queries must have the same dimensions as the points.");
+	}
+
+	const size_t q = queries.get_row_count();
+	k = std::min(k, size());
+	KnnResult result = make_result(q, k);
+	if (k == 0 || q == 0) {
+		return result;
+	}
+
+	// A query costs a few leaves of work, so chunks of queries are fine grained enough.
+	default_thread_pool().parallel_for(0, q, 64, [&](size_t begin, size_t end) {
+		std::vector<Candidate> slots(k);
+		std::vector<double> query(dimension_count);
+
+		for (size_t i = begin; i < end; i++) {
+			for (size_t d = 0; d < dimension_count; d++) {
+				query[d] = queries(i, d);
+			}
+
+			TopK heap(slots.data(), k);
+			search_node(0, query.data(), heap);
+
+			const size_t found = heap.size();
+			const Candidate* sorted = heap.sorted();
+			for (size_t rank = 0; rank < found; rank++) {
+				result.indices[i * k + rank] = sorted[rank].index;
+				result.distances[i * k + rank] = std::sqrt(sorted[rank].key);
+			}
+		}
+	});
+
+	return result;
+}
+
+KnnResult KdTree::search(ConstVectorView query, size_t k) const {
+	return search(as_row(query), k);
+}
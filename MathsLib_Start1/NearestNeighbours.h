@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <limits>
+#include <vector>
+#include "MatrixView.h"
+#include "VectorView.h"
+
+// k nearest neighbour search over points stored as the rows of a matrix.
+//
+// BruteForceIndex compares every query with every point. Distances for a block of queries and
+// a block of points come out of one GEMM, using |q - p|^2 = |q|^2 + |p|^2 - 2 q.p for L2, and
+// each row of the block is filtered against the current k-th best before anything is inserted
+// into that query's heap. Blocks are spread over the library thread pool, by queries and, when
+// there are few queries, by points.
+//
+// KdTree partitions low dimensional points (up to about 10 dimensions) for L2 queries that
+// visit only a few leaves, instead of every point.
+//
+// Neighbours are ordered by distance, then by point index, so results do not depend on the
+// thread count or the blocking. Points whose distance is NaN are never returned.
+
+enum class DistanceMetric {
+	// Euclidean distance.
+	L2,
+	// 1 - cos(angle), in [0, 2]. A zero vector is at distance 1 from everything.
+	Cosine,
+	// The negated inner product, so the nearest point has the largest dot product.
+	Dot
+};
+
+// Neighbours of each query, nearest first.
+struct KnnResult {
+	// Marks the unused slots of a query with fewer than k valid neighbours.
+	static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+	size_t query_count = 0;
+	size_t k = 0;
+	// Row major, query_count x k.
+	std::vector<size_t> indices;
+	std::vector<double> distances;
+
+	size_t index(size_t query, size_t rank) const noexcept {
+		return indices[query * k + rank];
+	}
+
+	double distance(size_t query, size_t rank) const noexcept {
+		return distances[query * k + rank];
+	}
+};
+
+// Exact search for any metric. The index keeps a view of the points, which must outlive it, and
+// the per point norms the metric needs. k is clamped to the number of points.
+class BruteForceIndex {
+	ConstMatrixView points;
+	DistanceMetric metric;
+	// Per point terms of the distance, key = weights[p] * (q.p) + offsets[p].
+	std::vector<double> weights;
+	std::vector<double> offsets;
+
+public:
+	explicit BruteForceIndex(ConstMatrixView points, DistanceMetric metric = DistanceMetric::L2);
+
+	size_t size() const noexcept;
+	size_t dimensions() const noexcept;
+	DistanceMetric get_metric() const noexcept;
+
+	// One row of the result per row of queries.
+	KnnResult search(ConstMatrixView queries, size_t k) const;
+	KnnResult search(ConstVectorView query, size_t k) const;
+};
+
+// Exact L2 search that prunes subtrees by their splitting plane. The points are copied into
+// leaf order, so the tree does not refer to the original storage.
+class KdTree {
+	struct Node {
+		// Points [begin, end) in leaf order. Leaves have no children.
+		size_t begin;
+		size_t end;
+		size_t dim;
+		double split;
+		size_t left;
+		size_t right;
+	};
+
+	size_t dimension_count = 0;
+	size_t leaf_size;
+	std::vector<Node> nodes;
+	// Points in leaf order, row major, and the original index of each.
+	std::vector<double> coordinates;
+	std::vector<size_t> original;
+
+	size_t build(size_t begin, size_t end, std::vector<double>& scratch, std::vector<size_t>& scratch_original);
+
+	template <typename Heap>
+	void search_node(size_t node, const double* query, Heap& heap) const;
+
+public:
+	explicit KdTree(ConstMatrixView points, size_t leaf_size = 16);
+
+	size_t size() const noexcept;
+	size_t dimensions() const noexcept;
+
+	KnnResult search(ConstMatrixView queries, size_t k) const;
+	KnnResult search(ConstVectorView query, size_t k) const;
+};
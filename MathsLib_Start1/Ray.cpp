@@ -1,58 +1,96 @@
 #include <cmath>
 #include <vector>
 #include <stdexcept>
+#include <utility>
 #include "Ray.h"
+#include "Stats.h"
 #include "Vector.h"
 
 // Constructor for the Ray class.
-Ray::Ray(Vector position, Vector direction) : position{ position }, direction{ direction } {
-    if ((position.size() != 3) && (direction.size() != 3)) {
+Ray::Ray(Vector position, Vector direction) : position{ std::move(position) }, direction{ std::move(direction) } {
+    if ((this->position.size() != 3) || (this->direction.size() != 3)) {
         throw std::invalid_argument("Position and direction vectors are not three dimensional.");
     }
 }
 
 // Operator overloading.
-Ray Ray::operator-() {
+Ray Ray::operator-() const & {
     return Ray(-position, -direction);
 }
 
-Ray Ray::operator-(Ray ray) {
+Ray Ray::operator-() && {
+    *this *= -1;
+    return std::move(*this);
+}
+
+Ray Ray::operator-(const Ray& ray) const & {
     return Ray(position - ray.position, direction - ray.direction);
 }
 
-Ray Ray::operator+(Ray ray) {
+Ray Ray::operator-(const Ray& ray) && {
+    *this -= ray;
+    return std::move(*this);
+}
+
+Ray Ray::operator+(const Ray& ray) const & {
     return Ray(position + ray.position, direction + ray.direction);
 }
 
-Ray Ray::operator*(double number) {
+Ray Ray::operator+(const Ray& ray) && {
+    *this += ray;
+    return std::move(*this);
+}
+
+Ray Ray::operator*(double number) const & {
     return Ray(position * number, direction * number);
 }
 
-// Methods on ray.
-double Ray::point_distance(Vector M0) {
-    Vector tmp_1 = (M0 - position);
-    Vector tmp_2 = tmp_1.cross_product(direction);
+Ray Ray::operator*(double number) && {
+    *this *= number;
+    return std::move(*this);
+}
 
-    return tmp_2.euclidean_length() / direction.euclidean_length();
+Ray& Ray::operator+=(const Ray& ray) {
+    position += ray.position;
+    direction += ray.direction;
+    return *this;
 }
 
-double Ray::line_distance(Ray ray) {
+Ray& Ray::operator-=(const Ray& ray) {
+    position -= ray.position;
+    direction -= ray.direction;
+    return *this;
+}
 
-    Vector n = (direction).cross_product(ray.direction);
+Ray& Ray::operator*=(double number) {
+    position *= number;
+    direction *= number;
+    return *this;
+}
 
-    if (n.is_zero(10e-6)) {
-        double d = ((direction).cross_product(ray.position - position)).euclidean_length() / (direction).euclidean_length();
-        return abs(d);
-    }
+Ray& Ray::operator/=(double number) {
+    position /= number;
+    direction /= number;
+    return *this;
+}
+
+// Stack copy of the ray for the queries below, so they make no heap allocations.
+Ray3d Ray::as_fixed() const {
+    return Ray3d{ Vec3d::from_vector(position), Vec3d::from_vector(direction) };
+}
 
-    double d = n.dot_product(ray.position - position) / n.euclidean_length();
-    return abs(d);
+// Methods on ray.
+double Ray::point_distance(const Vector& M0) const {
+    MATHSLIB_COUNT_OPERATION(RayQuery);
+    return as_fixed().point_distance(Vec3d::from_vector(M0));
+}
 
+double Ray::line_distance(const Ray& ray) const {
+    MATHSLIB_COUNT_OPERATION(RayQuery);
+    return as_fixed().line_distance(ray.as_fixed());
 }
 
-bool Ray::intersect(Ray ray) {
-    if ((((direction).cross_product(ray.direction)).dot_product(ray.position - position)) == 0) {
-        return true;
-    }
-    return false;
+bool Ray::intersect(const Ray& ray) const {
+    MATHSLIB_COUNT_OPERATION(RayQuery);
+    return as_fixed().intersect(ray.as_fixed());
 }
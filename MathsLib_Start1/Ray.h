@@ -1,20 +1,79 @@
 #pragma once
 #include <stdexcept>
 #include "Vector.h"
+#include "FixedVector.h"
+
+
+// Allocation free 3D ray on fixed size vectors, Ray forwards its queries here.
+template <typename T = double>
+struct FixedRay {
+    Vec<3, T> position, direction;
+
+    constexpr FixedRay operator-() const noexcept {
+        return FixedRay{ -position, -direction };
+    }
+
+    constexpr FixedRay operator-(const FixedRay& ray) const noexcept {
+        return FixedRay{ position - ray.position, direction - ray.direction };
+    }
+
+    constexpr FixedRay operator+(const FixedRay& ray) const noexcept {
+        return FixedRay{ position + ray.position, direction + ray.direction };
+    }
+
+    constexpr FixedRay operator*(const T& number) const noexcept {
+        return FixedRay{ position * number, direction * number };
+    }
+
+    T point_distance(const Vec<3, T>& M0) const noexcept {
+        return (M0 - position).cross_product(direction).euclidean_length() / direction.euclidean_length();
+    }
+
+    T line_distance(const FixedRay& ray) const noexcept {
+        const Vec<3, T> n = direction.cross_product(ray.direction);
+
+        // Parallel lines, fall back to the distance from a point on one to the other.
+        if (n.is_zero(T(10e-6))) {
+            return std::abs(direction.cross_product(ray.position - position).euclidean_length() / direction.euclidean_length());
+        }
+
+        return std::abs(n.dot_product(ray.position - position) / n.euclidean_length());
+    }
+
+    constexpr bool intersect(const FixedRay& ray) const noexcept {
+        return direction.cross_product(ray.direction).dot_product(ray.position - position) == 0;
+    }
+};
+
+using Ray3f = FixedRay<float>;
+using Ray3d = FixedRay<double>;
 
 
 class Ray
 {
+    Ray3d as_fixed() const;
 
 public:
     Vector position, direction;
     Ray(Vector position, Vector direction);
-    Ray operator-();
-    Ray operator-(Ray ray);
-    Ray operator+(Ray ray);
-    Ray operator*(double number);
-
-    double point_distance(Vector M0);
-    double line_distance(Ray ray);
-    bool intersect(Ray ray);
-};
\ No newline at end of file
+
+    // Operators on a temporary Ray reuse its vectors for the result.
+    Ray operator-() const &;
+    Ray operator-() &&;
+    Ray operator-(const Ray& ray) const &;
+    Ray operator-(const Ray& ray) &&;
+    Ray operator+(const Ray& ray) const &;
+    Ray operator+(const Ray& ray) &&;
+    Ray operator*(double number) const &;
+    Ray operator*(double number) &&;
+
+    // Compound assignment, updates both vectors in place.
+    Ray& operator+=(const Ray& ray);
+    Ray& operator-=(const Ray& ray);
+    Ray& operator*=(double number);
+    Ray& operator/=(double number);
+
+    double point_distance(const Vector& M0) const;
+    double line_distance(const Ray& ray) const;
+    bool intersect(const Ray& ray) const;
+};
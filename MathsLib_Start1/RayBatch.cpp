@@ -0,0 +1,396 @@
+// Structure of arrays ray queries, vectorised across points or rays with one copy per instruction set.
+
+#include "RayBatch.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <cmath>
+#include <stdexcept>
+
+#ifdef MATHSLIB_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+	// --------- Scalar, the Ray3d queries one pair at a time. Also finishes the tails below. ---------
+
+	void point_distance_generic(const Ray3d& ray, const PointBatch& points, size_t j, double* out) {
+		for (; j < points.size(); j++) {
+			out[j] = ray.point_distance(points[j]);
+		}
+	}
+
+	void line_distance_generic(const Ray3d& ray, const RayBatch& others, size_t j, double* out) {
+		for (; j < others.size(); j++) {
+			out[j] = ray.line_distance(others[j]);
+		}
+	}
+
+	void intersect_generic(const Ray3d& ray, const RayBatch& others, size_t j, bool* out) {
+		for (; j < others.size(); j++) {
+			out[j] = ray.intersect(others[j]);
+		}
+	}
+
+	// Each vector path follows the arithmetic of the matching Ray3d query, one pair per lane.
+#ifdef MATHSLIB_X86
+
+	// --------- AVX2, four pairs per register. ---------
+
+	struct Avx2Vec3 {
+		__m256d x, y, z;
+	};
+
+	MATHSLIB_TARGET_AVX2 MATHSLIB_ALWAYS_INLINE Avx2Vec3 load_avx2(const PointBatch& points, size_t j) {
+		return { _mm256_loadu_pd(points.x() + j), _mm256_loadu_pd(points.y() + j), _mm256_loadu_pd(points.z() + j) };
+	}
+
+	MATHSLIB_TARGET_AVX2 MATHSLIB_ALWAYS_INLINE Avx2Vec3 broadcast_avx2(const Vec3d& v) {
+		return { _mm256_set1_pd(v[0]), _mm256_set1_pd(v[1]), _mm256_set1_pd(v[2]) };
+	}
+
+	MATHSLIB_TARGET_AVX2 MATHSLIB_ALWAYS_INLINE Avx2Vec3 subtract_avx2(const Avx2Vec3& a, const Avx2Vec3& b) {
+		return { _mm256_sub_pd(a.x, b.x), _mm256_sub_pd(a.y, b.y), _mm256_sub_pd(a.z, b.z) };
+	}
+
+	MATHSLIB_TARGET_AVX2 MATHSLIB_ALWAYS_INLINE Avx2Vec3 cross_product_avx2(const Avx2Vec3& a, const Avx2Vec3& b) {
+		return {
+			_mm256_sub_pd(_mm256_mul_pd(a.y, b.z), _mm256_mul_pd(a.z, b.y)),
+			_mm256_sub_pd(_mm256_mul_pd(a.z, b.x), _mm256_mul_pd(a.x, b.z)),
+			_mm256_sub_pd(_mm256_mul_pd(a.x, b.y), _mm256_mul_pd(a.y, b.x))
+		};
+	}
+
+	MATHSLIB_TARGET_AVX2 MATHSLIB_ALWAYS_INLINE __m256d dot_product_avx2(const Avx2Vec3& a, const Avx2Vec3& b) {
+		return _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(a.x, b.x), _mm256_mul_pd(a.y, b.y)), _mm256_mul_pd(a.z, b.z));
+	}
+
+	MATHSLIB_TARGET_AVX2 MATHSLIB_ALWAYS_INLINE __m256d length_avx2(const Avx2Vec3& a) {
+		return _mm256_sqrt_pd(dot_product_avx2(a, a));
+	}
+
+	MATHSLIB_TARGET_AVX2 MATHSLIB_ALWAYS_INLINE __m256d abs_avx2(__m256d a) {
+		return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a);
+	}
+
+	MATHSLIB_TARGET_AVX2 void point_distance_avx2(const Ray3d& ray, const PointBatch& points, size_t j, double* out) {
+		const Avx2Vec3 position = broadcast_avx2(ray.position);
+		const Avx2Vec3 direction = broadcast_avx2(ray.direction);
+		const __m256d direction_length = _mm256_set1_pd(ray.direction.euclidean_length());
+
+		for (; j + 4 <= points.size(); j += 4) {
+			const Avx2Vec3 offset = subtract_avx2(load_avx2(points, j), position);
+			_mm256_storeu_pd(out + j, _mm256_div_pd(length_avx2(cross_product_avx2(offset, direction)), direction_length));
+		}
+		point_distance_generic(ray, points, j, out);
+	}
+
+	MATHSLIB_TARGET_AVX2 void line_distance_avx2(const Ray3d& ray, const RayBatch& others, size_t j, double* out) {
+		const Avx2Vec3 position = broadcast_avx2(ray.position);
+		const Avx2Vec3 direction = broadcast_avx2(ray.direction);
+		const __m256d direction_length = _mm256_set1_pd(ray.direction.euclidean_length());
+		const __m256d tolerance = _mm256_set1_pd(10e-6);
+
+		for (; j + 4 <= others.size(); j += 4) {
+			const Avx2Vec3 offset = subtract_avx2(load_avx2(others.position(), j), position);
+			const Avx2Vec3 n = cross_product_avx2(direction, load_avx2(others.direction(), j));
+
+			// Parallel lines fall back to the distance from a point on one to the other.
+			const __m256d skew = _mm256_or_pd(_mm256_or_pd(
+				_mm256_cmp_pd(abs_avx2(n.x), tolerance, _CMP_GT_OQ),
+				_mm256_cmp_pd(abs_avx2(n.y), tolerance, _CMP_GT_OQ)),
+				_mm256_cmp_pd(abs_avx2(n.z), tolerance, _CMP_GT_OQ));
+			const __m256d skew_distance = abs_avx2(_mm256_div_pd(dot_product_avx2(n, offset), length_avx2(n)));
+			const __m256d parallel_distance = abs_avx2(_mm256_div_pd(length_avx2(cross_product_avx2(direction, offset)), direction_length));
+
+			_mm256_storeu_pd(out + j, _mm256_blendv_pd(parallel_distance, skew_distance, skew));
+		}
+		line_distance_generic(ray, others, j, out);
+	}
+
+	MATHSLIB_TARGET_AVX2 void intersect_avx2(const Ray3d& ray, const RayBatch& others, size_t j, bool* out) {
+		const Avx2Vec3 position = broadcast_avx2(ray.position);
+		const Avx2Vec3 direction = broadcast_avx2(ray.direction);
+
+		for (; j + 4 <= others.size(); j += 4) {
+			const Avx2Vec3 offset = subtract_avx2(load_avx2(others.position(), j), position);
+			const Avx2Vec3 n = cross_product_avx2(direction, load_avx2(others.direction(), j));
+			const int hits = _mm256_movemask_pd(_mm256_cmp_pd(dot_product_avx2(n, offset), _mm256_setzero_pd(), _CMP_EQ_OQ));
+
+			for (size_t lane = 0; lane < 4; lane++) {
+				out[j + lane] = (hits >> lane) & 1;
+			}
+		}
+		intersect_generic(ray, others, j, out);
+	}
+
+	// --------- AVX-512, eight pairs per register. ---------
+
+	struct Avx512Vec3 {
+		__m512d x, y, z;
+	};
+
+	MATHSLIB_TARGET_AVX512 MATHSLIB_ALWAYS_INLINE Avx512Vec3 load_avx512(const PointBatch& points, size_t j) {
+		return { _mm512_loadu_pd(points.x() + j), _mm512_loadu_pd(points.y() + j), _mm512_loadu_pd(points.z() + j) };
+	}
+
+	MATHSLIB_TARGET_AVX512 MATHSLIB_ALWAYS_INLINE Avx512Vec3 broadcast_avx512(const Vec3d& v) {
+		return { _mm512_set1_pd(v[0]), _mm512_set1_pd(v[1]), _mm512_set1_pd(v[2]) };
+	}
+
+	MATHSLIB_TARGET_AVX512 MATHSLIB_ALWAYS_INLINE Avx512Vec3 subtract_avx512(const Avx512Vec3& a, const Avx512Vec3& b) {
+		return { _mm512_sub_pd(a.x, b.x), _mm512_sub_pd(a.y, b.y), _mm512_sub_pd(a.z, b.z) };
+	}
+
+	MATHSLIB_TARGET_AVX512 MATHSLIB_ALWAYS_INLINE Avx512Vec3 cross_product_avx512(const Avx512Vec3& a, const Avx512Vec3& b) {
+		return {
+			_mm512_sub_pd(_mm512_mul_pd(a.y, b.z), _mm512_mul_pd(a.z, b.y)),
+			_mm512_sub_pd(_mm512_mul_pd(a.z, b.x), _mm512_mul_pd(a.x, b.z)),
+			_mm512_sub_pd(_mm512_mul_pd(a.x, b.y), _mm512_mul_pd(a.y, b.x))
+		};
+	}
+
+	MATHSLIB_TARGET_AVX512 MATHSLIB_ALWAYS_INLINE __m512d dot_product_avx512(const Avx512Vec3& a, const Avx512Vec3& b) {
+		return _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(a.x, b.x), _mm512_mul_pd(a.y, b.y)), _mm512_mul_pd(a.z, b.z));
+	}
+
+	MATHSLIB_TARGET_AVX512 MATHSLIB_ALWAYS_INLINE __m512d length_avx512(const Avx512Vec3& a) {
+		// The masked form with every lane set avoids GCC warning about the undefined pass through in _mm512_sqrt_pd.
+		const __m512d squared = dot_product_avx512(a, a);
+		return _mm512_mask_sqrt_pd(squared, 0xFF, squared);
+	}
+
+	MATHSLIB_TARGET_AVX512 void point_distance_avx512(const Ray3d& ray, const PointBatch& points, size_t j, double* out) {
+		const Avx512Vec3 position = broadcast_avx512(ray.position);
+		const Avx512Vec3 direction = broadcast_avx512(ray.direction);
+		const __m512d direction_length = _mm512_set1_pd(ray.direction.euclidean_length());
+
+		for (; j + 8 <= points.size(); j += 8) {
+			const Avx512Vec3 offset = subtract_avx512(load_avx512(points, j), position);
+			_mm512_storeu_pd(out + j, _mm512_div_pd(length_avx512(cross_product_avx512(offset, direction)), direction_length));
+		}
+		point_distance_generic(ray, points, j, out);
+	}
+
+	MATHSLIB_TARGET_AVX512 void line_distance_avx512(const Ray3d& ray, const RayBatch& others, size_t j, double* out) {
+		const Avx512Vec3 position = broadcast_avx512(ray.position);
+		const Avx512Vec3 direction = broadcast_avx512(ray.direction);
+		const __m512d direction_length = _mm512_set1_pd(ray.direction.euclidean_length());
+		const __m512d tolerance = _mm512_set1_pd(10e-6);
+
+		for (; j + 8 <= others.size(); j += 8) {
+			const Avx512Vec3 offset = subtract_avx512(load_avx512(others.position(), j), position);
+			const Avx512Vec3 n = cross_product_avx512(direction, load_avx512(others.direction(), j));
+
+			// Parallel lines fall back to the distance from a point on one to the other.
+			const __mmask8 skew = _mm512_cmp_pd_mask(_mm512_abs_pd(n.x), tolerance, _CMP_GT_OQ)
+				| _mm512_cmp_pd_mask(_mm512_abs_pd(n.y), tolerance, _CMP_GT_OQ)
+				| _mm512_cmp_pd_mask(_mm512_abs_pd(n.z), tolerance, _CMP_GT_OQ);
+			const __m512d skew_distance = _mm512_abs_pd(_mm512_div_pd(dot_product_avx512(n, offset), length_avx512(n)));
+			const __m512d parallel_distance = _mm512_abs_pd(_mm512_div_pd(length_avx512(cross_product_avx512(direction, offset)), direction_length));
+
+			_mm512_storeu_pd(out + j, _mm512_mask_blend_pd(skew, parallel_distance, skew_distance));
+		}
+		line_distance_generic(ray, others, j, out);
+	}
+
+	MATHSLIB_TARGET_AVX512 void intersect_avx512(const Ray3d& ray, const RayBatch& others, size_t j, bool* out) {
+		const Avx512Vec3 position = broadcast_avx512(ray.position);
+		const Avx512Vec3 direction = broadcast_avx512(ray.direction);
+
+		for (; j + 8 <= others.size(); j += 8) {
+			const Avx512Vec3 offset = subtract_avx512(load_avx512(others.position(), j), position);
+			const Avx512Vec3 n = cross_product_avx512(direction, load_avx512(others.direction(), j));
+			const __mmask8 hits = _mm512_cmp_pd_mask(dot_product_avx512(n, offset), _mm512_setzero_pd(), _CMP_EQ_OQ);
+
+			for (size_t lane = 0; lane < 8; lane++) {
+				out[j + lane] = (hits >> lane) & 1;
+			}
+		}
+		intersect_generic(ray, others, j, out);
+	}
+#endif
+
+	struct RayQueries {
+		// Each answers one ray against points or rays [j, size()), writing out[j] onwards.
+		void (*point_distance)(const Ray3d& ray, const PointBatch& points, size_t j, double* out);
+		void (*line_distance)(const Ray3d& ray, const RayBatch& others, size_t j, double* out);
+		void (*intersect)(const Ray3d& ray, const RayBatch& others, size_t j, bool* out);
+	};
+
+	const RayQueries& select_ray_queries() noexcept {
+		static const RayQueries generic = { point_distance_generic, line_distance_generic, intersect_generic };
+#ifdef MATHSLIB_X86
+		static const RayQueries avx2 = { point_distance_avx2, line_distance_avx2, intersect_avx2 };
+		static const RayQueries avx512 = { point_distance_avx512, line_distance_avx512, intersect_avx512 };
+#endif
+
+		switch (simd_kernels().level) {
+#ifdef MATHSLIB_X86
+		case SimdLevel::AVX512:
+			return avx512;
+		case SimdLevel::AVX2:
+			return avx2;
+#endif
+		default:
+			return generic;
+		}
+	}
+
+	// Rows of the output, one per ray, are spread over the thread pool.
+	template <typename Out, typename Query>
+	void for_each_ray(const RayBatch& rays, size_t count, std::span<Out> out, Query query) {
+		if (out.size() < rays.size() * count) {
+			throw std::invalid_argument("Output buffer is too small for the batch.");
+		}
+
+		Out* results = out.data();
+		parallel_rows(rays.size(), count, [&rays, &query, results, count](size_t row_begin, size_t row_end) {
+			for (size_t i = row_begin; i < row_end; i++) {
+				query(rays[i], results + i * count);
+			}
+		});
+	}
+}
+
+// --------- PointBatch. ---------
+
+PointBatch::PointBatch(size_t count) : xs(count, 0.0), ys(count, 0.0), zs(count, 0.0) { }
+
+size_t PointBatch::size() const noexcept {
+	return xs.size();
+}
+
+void PointBatch::reserve(size_t count) {
+	xs.reserve(count);
+	ys.reserve(count);
+	zs.reserve(count);
+}
+
+void PointBatch::clear() noexcept {
+	xs.clear();
+	ys.clear();
+	zs.clear();
+}
+
+void PointBatch::push_back(const Vec3d& point) {
+	xs.push_back(point[0]);
+	ys.push_back(point[1]);
+	zs.push_back(point[2]);
+}
+
+void PointBatch::push_back(const Vector& point) {
+	if (point.size() != 3) {
+		throw std::invalid_argument("Points in a batch must be three dimensional.");
+	}
+	push_back(Vec3d::from_vector(point));
+}
+
+Vec3d PointBatch::operator[](const size_t& index) const noexcept {
+	return Vec3d{ xs[index], ys[index], zs[index] };
+}
+
+void PointBatch::set(const size_t& index, const Vec3d& point) noexcept {
+	xs[index] = point[0];
+	ys[index] = point[1];
+	zs[index] = point[2];
+}
+
+double* PointBatch::x() noexcept {
+	return xs.data();
+}
+
+double* PointBatch::y() noexcept {
+	return ys.data();
+}
+
+double* PointBatch::z() noexcept {
+	return zs.data();
+}
+
+const double* PointBatch::x() const noexcept {
+	return xs.data();
+}
+
+const double* PointBatch::y() const noexcept {
+	return ys.data();
+}
+
+const double* PointBatch::z() const noexcept {
+	return zs.data();
+}
+
+// --------- RayBatch. ---------
+
+RayBatch::RayBatch(size_t count) : positions(count), directions(count) { }
+
+size_t RayBatch::size() const noexcept {
+	return positions.size();
+}
+
+void RayBatch::reserve(size_t count) {
+	positions.reserve(count);
+	directions.reserve(count);
+}
+
+void RayBatch::clear() noexcept {
+	positions.clear();
+	directions.clear();
+}
+
+void RayBatch::push_back(const Ray3d& ray) {
+	positions.push_back(ray.position);
+	directions.push_back(ray.direction);
+}
+
+void RayBatch::push_back(const Ray& ray) {
+	push_back(Ray3d{ Vec3d::from_vector(ray.position), Vec3d::from_vector(ray.direction) });
+}
+
+Ray3d RayBatch::operator[](const size_t& index) const noexcept {
+	return Ray3d{ positions[index], directions[index] };
+}
+
+void RayBatch::set(const size_t& index, const Ray3d& ray) noexcept {
+	positions.set(index, ray.position);
+	directions.set(index, ray.direction);
+}
+
+PointBatch& RayBatch::position() noexcept {
+	return positions;
+}
+
+PointBatch& RayBatch::direction() noexcept {
+	return directions;
+}
+
+const PointBatch& RayBatch::position() const noexcept {
+	return positions;
+}
+
+const PointBatch& RayBatch::direction() const noexcept {
+	return directions;
+}
+
+// --------- Queries. ---------
+
+void point_distance(const RayBatch& rays, const PointBatch& points, std::span<double> out) {
+	static const RayQueries& queries = select_ray_queries();
+	for_each_ray(rays, points.size(), out, [&points](const Ray3d& ray, double* row) {
+		queries.point_distance(ray, points, 0, row);
+	});
+}
+
+void line_distance(const RayBatch& rays, const RayBatch& others, std::span<double> out) {
+	static const RayQueries& queries = select_ray_queries();
+	for_each_ray(rays, others.size(), out, [&others](const Ray3d& ray, double* row) {
+		queries.line_distance(ray, others, 0, row);
+	});
+}
+
+void intersect(const RayBatch& rays, const RayBatch& others, std::span<bool> out) {
+	static const RayQueries& queries = select_ray_queries();
+	for_each_ray(rays, others.size(), out, [&others](const Ray3d& ray, bool* row) {
+		queries.intersect(ray, others, 0, row);
+	});
+}
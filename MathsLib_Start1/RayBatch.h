@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <span>
+#include <vector>
+#include "Ray.h"
+
+// Structure of arrays containers and all-pairs queries for large numbers of rays and points.
+//
+// Each coordinate is stored in its own array, so a query against many points or rays loads
+// several consecutive ones into one SIMD register and answers them together. The queries
+// compute exactly what Ray and Ray3d compute for one pair. Results go into a buffer supplied
+// by the caller and no memory is allocated.
+
+// 3D points, coordinate by coordinate.
+class PointBatch {
+	std::vector<double> xs, ys, zs;
+
+public:
+	PointBatch() = default;
+	explicit PointBatch(size_t count);
+
+	size_t size() const noexcept;
+	void reserve(size_t count);
+	void clear() noexcept;
+
+	void push_back(const Vec3d& point);
+	void push_back(const Vector& point);
+
+	Vec3d operator[](const size_t& index) const noexcept;
+	void set(const size_t& index, const Vec3d& point) noexcept;
+
+	// Coordinate arrays, size() elements each, for filling the batch in place.
+	double* x() noexcept;
+	double* y() noexcept;
+	double* z() noexcept;
+	const double* x() const noexcept;
+	const double* y() const noexcept;
+	const double* z() const noexcept;
+};
+
+// Rays, position and direction coordinate by coordinate.
+class RayBatch {
+	PointBatch positions, directions;
+
+public:
+	RayBatch() = default;
+	explicit RayBatch(size_t count);
+
+	size_t size() const noexcept;
+	void reserve(size_t count);
+	void clear() noexcept;
+
+	void push_back(const Ray3d& ray);
+	void push_back(const Ray& ray);
+
+	Ray3d operator[](const size_t& index) const noexcept;
+	void set(const size_t& index, const Ray3d& ray) noexcept;
+
+	PointBatch& position() noexcept;
+	PointBatch& direction() noexcept;
+	const PointBatch& position() const noexcept;
+	const PointBatch& direction() const noexcept;
+};
+
+// All-pairs queries. The result for rays[i] against points[j] or others[j] is written to
+// out[i * points.size() + j], so out must hold at least rays.size() * points.size() elements.
+// Work is split over the rays on the library thread pool.
+void point_distance(const RayBatch& rays, const PointBatch& points, std::span<double> out);
+void line_distance(const RayBatch& rays, const RayBatch& others, std::span<double> out);
+void intersect(const RayBatch& rays, const RayBatch& others, std::span<bool> out);
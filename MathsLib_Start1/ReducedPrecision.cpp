@@ -0,0 +1,39 @@
+#include "ReducedPrecision.h"
+#include "ThreadPool.h"
+
+namespace {
+
+	// Applies the element conversion to every element, in parallel chunks for long arrays.
+	template <typename In, typename Out, typename Convert>
+	void convert_elements(const In* in, Out* out, size_t n, Convert&& convert_one) {
+		parallel_elementwise(n, [=](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				out[i] = convert_one(in[i]);
+			}
+		});
+	}
+}
+
+void convert(const double* in, float* out, size_t n) {
+	convert_elements(in, out, n, [](double x) { return static_cast<float>(x); });
+}
+
+void convert(const double* in, bfloat16* out, size_t n) {
+	convert_elements(in, out, n, [](double x) { return bfloat16(x); });
+}
+
+void convert(const float* in, double* out, size_t n) {
+	convert_elements(in, out, n, [](float x) { return static_cast<double>(x); });
+}
+
+void convert(const float* in, bfloat16* out, size_t n) {
+	convert_elements(in, out, n, [](float x) { return bfloat16(x); });
+}
+
+void convert(const bfloat16* in, double* out, size_t n) {
+	convert_elements(in, out, n, [](bfloat16 x) { return static_cast<double>(x); });
+}
+
+void convert(const bfloat16* in, float* out, size_t n) {
+	convert_elements(in, out, n, [](bfloat16 x) { return static_cast<float>(x); });
+}
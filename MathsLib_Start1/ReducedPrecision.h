@@ -0,0 +1,239 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <initializer_list>
+#include <memory_resource>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "BFloat16.h"
+#include "Gemm.h"
+#include "Matrix.h"
+#include "MemoryResource.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include "Vector.h"
+
+// Float and bfloat16 counterparts of Vector and Matrix for bandwidth bound workloads such as
+// similarity search, where float storage halves the bytes moved per element and bfloat16
+// quarters them.
+//
+// Elements are stored in the reduced type, but every product and distance accumulates in float
+// using the dispatched SIMD kernels (see Simd.h) or the blocked gemm (see Gemm.h). Results are
+// float or VectorF / MatrixF.
+//
+// Conversions between precisions are explicit. Widening is exact, narrowing rounds each element
+// to nearest with ties to even and overflows to infinity, and double to bfloat16 rounds once
+// rather than through float.
+
+// Element conversions between arrays of n values, split over the thread pool for large arrays.
+void convert(const double* in, float* out, size_t n);
+void convert(const double* in, bfloat16* out, size_t n);
+void convert(const float* in, double* out, size_t n);
+void convert(const float* in, bfloat16* out, size_t n);
+void convert(const bfloat16* in, double* out, size_t n);
+void convert(const bfloat16* in, float* out, size_t n);
+
+template <typename T>
+class ReducedVector {
+	static_assert(std::is_same_v<T, float> || std::is_same_v<T, bfloat16>, "ReducedVector elements must be float or bfloat16.");
+
+	std::pmr::vector<T> elements;
+
+public:
+	// Storage comes from current_memory_resource(), like Vector.
+	explicit ReducedVector(size_t n) : elements(n, T(), current_memory_resource()) {}
+
+	ReducedVector(std::initializer_list<float> values) : elements(current_memory_resource()) {
+		elements.reserve(values.size());
+		for (const float value : values) {
+			elements.push_back(T(value));
+		}
+	}
+
+	explicit ReducedVector(const Vector& vec) : ReducedVector(vec.size()) {
+		convert(vec.data(), elements.data(), vec.size());
+	}
+
+	// Between float and bfloat16.
+	template <typename U>
+	explicit ReducedVector(const ReducedVector<U>& vec) : ReducedVector(vec.size()) {
+		convert(vec.data(), elements.data(), vec.size());
+	}
+
+	ReducedVector(const ReducedVector& vec) : elements(vec.elements, current_memory_resource()) {}
+	ReducedVector(ReducedVector&& vec) noexcept = default;
+	ReducedVector& operator=(const ReducedVector& vec) = default;
+	ReducedVector& operator=(ReducedVector&& vec) = default;
+
+	Vector to_vector() const {
+		Vector result(elements.size());
+		convert(elements.data(), result.data(), elements.size());
+		return result;
+	}
+
+	size_t size() const noexcept {
+		return elements.size();
+	}
+
+	T* data() noexcept {
+		return elements.data();
+	}
+
+	const T* data() const noexcept {
+		return elements.data();
+	}
+
+	T& operator[](size_t index) {
+		return elements[index];
+	}
+
+	const T& operator[](size_t index) const {
+		return elements[index];
+	}
+
+	float dot_product(const ReducedVector& vec) const {
+		if (vec.size() != size()) {
+			throw std::invalid_argument("Vectors used for dot product are not the same size.");
+		}
+		if constexpr (std::is_same_v<T, float>) {
+			return simd_kernels().dot_float(data(), vec.data(), size());
+		}
+		else {
+			return simd_kernels().dot_bf16(data(), vec.data(), size());
+		}
+	}
+
+	float squared_distance(const ReducedVector& vec) const {
+		if (vec.size() != size()) {
+			throw std::invalid_argument("Vectors have invalid dimensions.");
+		}
+		if constexpr (std::is_same_v<T, float>) {
+			return simd_kernels().squared_distance_float(data(), vec.data(), size());
+		}
+		else {
+			return simd_kernels().squared_distance_bf16(data(), vec.data(), size());
+		}
+	}
+
+	float distance(const ReducedVector& vec) const {
+		return std::sqrt(squared_distance(vec));
+	}
+
+	float euclidean_length() const {
+		return std::sqrt(dot_product(*this));
+	}
+
+	friend bool operator==(const ReducedVector& a, const ReducedVector& b) {
+		return a.elements == b.elements;
+	}
+};
+
+// Row major, and sized like Matrix from the number of columns then rows.
+template <typename T>
+class ReducedMatrix {
+	static_assert(std::is_same_v<T, float> || std::is_same_v<T, bfloat16>, "ReducedMatrix elements must be float or bfloat16.");
+
+	size_t row_count;
+	size_t col_count;
+	std::pmr::vector<T> elements;
+
+public:
+	// x is the number of columns and y the number of rows, as for Matrix.
+	ReducedMatrix(size_t x, size_t y) : row_count{ y }, col_count{ x }, elements(x * y, T(), current_memory_resource()) {
+		if (x == 0 || y == 0) {
+			throw std::invalid_argument("Cannot construct an empty matrix.");
+		}
+	}
+
+	explicit ReducedMatrix(const Matrix& M) : ReducedMatrix(M.get_col_count(), M.get_row_count()) {
+		convert(M.data(), elements.data(), elements.size());
+	}
+
+	template <typename U>
+	explicit ReducedMatrix(const ReducedMatrix<U>& M) : ReducedMatrix(M.get_col_count(), M.get_row_count()) {
+		convert(M.data(), elements.data(), elements.size());
+	}
+
+	ReducedMatrix(const ReducedMatrix& M) : row_count{ M.row_count }, col_count{ M.col_count }, elements(M.elements, current_memory_resource()) {}
+	ReducedMatrix(ReducedMatrix&& M) noexcept = default;
+	ReducedMatrix& operator=(const ReducedMatrix& M) = default;
+	ReducedMatrix& operator=(ReducedMatrix&& M) = default;
+
+	Matrix to_matrix() const {
+		Matrix result(col_count, row_count);
+		convert(elements.data(), result.data(), elements.size());
+		return result;
+	}
+
+	size_t get_row_count() const noexcept {
+		return row_count;
+	}
+
+	size_t get_col_count() const noexcept {
+		return col_count;
+	}
+
+	T* data() noexcept {
+		return elements.data();
+	}
+
+	const T* data() const noexcept {
+		return elements.data();
+	}
+
+	T& operator()(size_t row, size_t col) {
+		return elements[row * col_count + col];
+	}
+
+	const T& operator()(size_t row, size_t col) const {
+		return elements[row * col_count + col];
+	}
+
+	friend bool operator==(const ReducedMatrix& A, const ReducedMatrix& B) {
+		return A.row_count == B.row_count && A.col_count == B.col_count && A.elements == B.elements;
+	}
+
+	// A B accumulated in float.
+	friend ReducedMatrix<float> operator*(const ReducedMatrix& A, const ReducedMatrix& B) {
+		if (A.col_count != B.row_count) {
+			throw std::invalid_argument("Matrix multiplication must have valid dimensions.");
+		}
+
+		ReducedMatrix<float> C(B.col_count, A.row_count);
+		gemm(A.row_count, B.col_count, A.col_count,
+			1.0f, A.data(), static_cast<std::ptrdiff_t>(A.col_count), 1,
+			B.data(), static_cast<std::ptrdiff_t>(B.col_count), 1,
+			0.0f, C.data(), static_cast<std::ptrdiff_t>(B.col_count), 1);
+		return C;
+	}
+
+	// A x, one dot product per row of A streamed straight from the reduced storage.
+	friend ReducedVector<float> operator*(const ReducedMatrix& A, const ReducedVector<T>& x) {
+		if (A.col_count != x.size()) {
+			throw std::invalid_argument("Matrix multiplication must have valid dimensions.");
+		}
+
+		ReducedVector<float> y(A.row_count);
+		float* out = y.data();
+		const T* in = A.data();
+		const T* v = x.data();
+		const size_t cols = A.col_count;
+		parallel_rows(A.row_count, cols, [=](size_t begin, size_t end) {
+			for (size_t r = begin; r < end; r++) {
+				if constexpr (std::is_same_v<T, float>) {
+					out[r] = simd_kernels().dot_float(in + r * cols, v, cols);
+				}
+				else {
+					out[r] = simd_kernels().dot_bf16(in + r * cols, v, cols);
+				}
+			}
+		});
+		return y;
+	}
+};
+
+using VectorF = ReducedVector<float>;
+using VectorBF16 = ReducedVector<bfloat16>;
+using MatrixF = ReducedMatrix<float>;
+using MatrixBF16 = ReducedMatrix<bfloat16>;
@@ -0,0 +1,790 @@
+// Vectorised kernels for the Vector arithmetic and the reduced precision types, one set per
+// instruction set.
+
+#include "Simd.h"
+#include <cmath>
+#include <algorithm>
+
+#ifdef MATHSLIB_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+
+	// --------- Scalar reference kernels. ---------
+
+	void add_scalar(const double* a, const double* b, double* out, size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			out[i] = a[i] + b[i];
+		}
+	}
+
+	void subtract_scalar(const double* a, const double* b, double* out, size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			out[i] = a[i] - b[i];
+		}
+	}
+
+	void scale_scalar(const double* a, double number, double* out, size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			out[i] = number * a[i];
+		}
+	}
+
+	double dot_scalar(const double* a, const double* b, size_t n) {
+		double sum = 0.0;
+		for (size_t i = 0; i < n; i++) {
+			sum += a[i] * b[i];
+		}
+		return sum;
+	}
+
+	double squared_distance_scalar(const double* a, const double* b, size_t n) {
+		double sum = 0.0;
+		for (size_t i = 0; i < n; i++) {
+			const double d = a[i] - b[i];
+			sum += d * d;
+		}
+		return sum;
+	}
+
+	bool any_abs_greater_scalar(const double* a, double tolerance, size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			if (std::abs(a[i]) > tolerance) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	float dot_float_scalar(const float* a, const float* b, size_t n) {
+		float sum = 0.0f;
+		for (size_t i = 0; i < n; i++) {
+			sum += a[i] * b[i];
+		}
+		return sum;
+	}
+
+	float squared_distance_float_scalar(const float* a, const float* b, size_t n) {
+		float sum = 0.0f;
+		for (size_t i = 0; i < n; i++) {
+			const float d = a[i] - b[i];
+			sum += d * d;
+		}
+		return sum;
+	}
+
+	float dot_bf16_scalar(const bfloat16* a, const bfloat16* b, size_t n) {
+		float sum = 0.0f;
+		for (size_t i = 0; i < n; i++) {
+			sum += static_cast<float>(a[i]) * static_cast<float>(b[i]);
+		}
+		return sum;
+	}
+
+	float squared_distance_bf16_scalar(const bfloat16* a, const bfloat16* b, size_t n) {
+		float sum = 0.0f;
+		for (size_t i = 0; i < n; i++) {
+			const float d = static_cast<float>(a[i]) - static_cast<float>(b[i]);
+			sum += d * d;
+		}
+		return sum;
+	}
+
+#ifdef MATHSLIB_X86
+
+	// --------- SSE2, two doubles per register. ---------
+
+	MATHSLIB_TARGET_SSE2 void add_sse2(const double* a, const double* b, double* out, size_t n) {
+		size_t i = 0;
+		for (; i + 2 <= n; i += 2) {
+			_mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+		}
+		for (; i < n; i++) {
+			out[i] = a[i] + b[i];
+		}
+	}
+
+	MATHSLIB_TARGET_SSE2 void subtract_sse2(const double* a, const double* b, double* out, size_t n) {
+		size_t i = 0;
+		for (; i + 2 <= n; i += 2) {
+			_mm_storeu_pd(out + i, _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+		}
+		for (; i < n; i++) {
+			out[i] = a[i] - b[i];
+		}
+	}
+
+	MATHSLIB_TARGET_SSE2 void scale_sse2(const double* a, double number, double* out, size_t n) {
+		const __m128d s = _mm_set1_pd(number);
+		size_t i = 0;
+		for (; i + 2 <= n; i += 2) {
+			_mm_storeu_pd(out + i, _mm_mul_pd(s, _mm_loadu_pd(a + i)));
+		}
+		for (; i < n; i++) {
+			out[i] = number * a[i];
+		}
+	}
+
+	MATHSLIB_TARGET_SSE2 double dot_sse2(const double* a, const double* b, size_t n) {
+		__m128d acc0 = _mm_setzero_pd();
+		__m128d acc1 = _mm_setzero_pd();
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+			acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+		}
+		acc0 = _mm_add_pd(acc0, acc1);
+
+		double lanes[2];
+		_mm_storeu_pd(lanes, acc0);
+		double sum = lanes[0] + lanes[1];
+
+		for (; i < n; i++) {
+			sum += a[i] * b[i];
+		}
+		return sum;
+	}
+
+	MATHSLIB_TARGET_SSE2 double squared_distance_sse2(const double* a, const double* b, size_t n) {
+		__m128d acc0 = _mm_setzero_pd();
+		__m128d acc1 = _mm_setzero_pd();
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			const __m128d d0 = _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+			const __m128d d1 = _mm_sub_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2));
+			acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+			acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+		}
+		acc0 = _mm_add_pd(acc0, acc1);
+
+		double lanes[2];
+		_mm_storeu_pd(lanes, acc0);
+		double sum = lanes[0] + lanes[1];
+
+		for (; i < n; i++) {
+			const double d = a[i] - b[i];
+			sum += d * d;
+		}
+		return sum;
+	}
+
+	MATHSLIB_TARGET_SSE2 bool any_abs_greater_sse2(const double* a, double tolerance, size_t n) {
+		const __m128d sign = _mm_set1_pd(-0.0);
+		const __m128d t = _mm_set1_pd(tolerance);
+		size_t i = 0;
+		for (; i + 2 <= n; i += 2) {
+			const __m128d x = _mm_andnot_pd(sign, _mm_loadu_pd(a + i));
+			if (_mm_movemask_pd(_mm_cmpgt_pd(x, t))) {
+				return true;
+			}
+		}
+		for (; i < n; i++) {
+			if (std::abs(a[i]) > tolerance) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	MATHSLIB_TARGET_SSE2 inline float horizontal_sum_sse2(__m128 v) {
+		v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+		v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+		return _mm_cvtss_f32(v);
+	}
+
+	MATHSLIB_TARGET_SSE2 float dot_float_sse2(const float* a, const float* b, size_t n) {
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+		}
+		float sum = horizontal_sum_sse2(_mm_add_ps(acc0, acc1));
+
+		for (; i < n; i++) {
+			sum += a[i] * b[i];
+		}
+		return sum;
+	}
+
+	MATHSLIB_TARGET_SSE2 float squared_distance_float_sse2(const float* a, const float* b, size_t n) {
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+			const __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+		}
+		float sum = horizontal_sum_sse2(_mm_add_ps(acc0, acc1));
+
+		for (; i < n; i++) {
+			const float d = a[i] - b[i];
+			sum += d * d;
+		}
+		return sum;
+	}
+
+	// bfloat16 is the top half of a float, so interleaving zeros below each value widens it exactly.
+	MATHSLIB_TARGET_SSE2 inline __m128 widen_low_sse2(__m128i x) {
+		return _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), x));
+	}
+
+	MATHSLIB_TARGET_SSE2 inline __m128 widen_high_sse2(__m128i x) {
+		return _mm_castsi128_ps(_mm_unpackhi_epi16(_mm_setzero_si128(), x));
+	}
+
+	MATHSLIB_TARGET_SSE2 float dot_bf16_sse2(const bfloat16* a, const bfloat16* b, size_t n) {
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+			const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(widen_low_sse2(x), widen_low_sse2(y)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(widen_high_sse2(x), widen_high_sse2(y)));
+		}
+		float sum = horizontal_sum_sse2(_mm_add_ps(acc0, acc1));
+
+		for (; i < n; i++) {
+			sum += static_cast<float>(a[i]) * static_cast<float>(b[i]);
+		}
+		return sum;
+	}
+
+	MATHSLIB_TARGET_SSE2 float squared_distance_bf16_sse2(const bfloat16* a, const bfloat16* b, size_t n) {
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+			const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+			const __m128 d0 = _mm_sub_ps(widen_low_sse2(x), widen_low_sse2(y));
+			const __m128 d1 = _mm_sub_ps(widen_high_sse2(x), widen_high_sse2(y));
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+		}
+		float sum = horizontal_sum_sse2(_mm_add_ps(acc0, acc1));
+
+		for (; i < n; i++) {
+			const float d = static_cast<float>(a[i]) - static_cast<float>(b[i]);
+			sum += d * d;
+		}
+		return sum;
+	}
+
+	// --------- AVX2 with FMA, four doubles per register. ---------
+
+	MATHSLIB_TARGET_AVX2 void add_avx2(const double* a, const double* b, double* out, size_t n) {
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			_mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+		}
+		for (; i < n; i++) {
+			out[i] = a[i] + b[i];
+		}
+	}
+
+	MATHSLIB_TARGET_AVX2 void subtract_avx2(const double* a, const double* b, double* out, size_t n) {
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			_mm256_storeu_pd(out + i, _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+		}
+		for (; i < n; i++) {
+			out[i] = a[i] - b[i];
+		}
+	}
+
+	MATHSLIB_TARGET_AVX2 void scale_avx2(const double* a, double number, double* out, size_t n) {
+		const __m256d s = _mm256_set1_pd(number);
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			_mm256_storeu_pd(out + i, _mm256_mul_pd(s, _mm256_loadu_pd(a + i)));
+		}
+		for (; i < n; i++) {
+			out[i] = number * a[i];
+		}
+	}
+
+	// Four independent accumulators hide the FMA latency.
+	MATHSLIB_TARGET_AVX2 double dot_avx2(const double* a, const double* b, size_t n) {
+		__m256d acc0 = _mm256_setzero_pd();
+		__m256d acc1 = _mm256_setzero_pd();
+		__m256d acc2 = _mm256_setzero_pd();
+		__m256d acc3 = _mm256_setzero_pd();
+		size_t i = 0;
+		for (; i + 16 <= n; i += 16) {
+			acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), acc0);
+			acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4), acc1);
+			acc2 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 8), _mm256_loadu_pd(b + i + 8), acc2);
+			acc3 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 12), _mm256_loadu_pd(b + i + 12), acc3);
+		}
+		for (; i + 4 <= n; i += 4) {
+			acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), acc0);
+		}
+		acc0 = _mm256_add_pd(_mm256_add_pd(acc0, acc1), _mm256_add_pd(acc2, acc3));
+
+		const __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc0), _mm256_extractf128_pd(acc0, 1));
+		double sum = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+
+		for (; i < n; i++) {
+			sum += a[i] * b[i];
+		}
+		return sum;
+	}
+
+	MATHSLIB_TARGET_AVX2 double squared_distance_avx2(const double* a, const double* b, size_t n) {
+		__m256d acc0 = _mm256_setzero_pd();
+		__m256d acc1 = _mm256_setzero_pd();
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+			const __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4));
+			acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+			acc1 = _mm256_fmadd_pd(d1, d1, acc1);
+		}
+		for (; i + 4 <= n; i += 4) {
+			const __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+			acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+		}
+		acc0 = _mm256_add_pd(acc0, acc1);
+
+		const __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc0), _mm256_extractf128_pd(acc0, 1));
+		double sum = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+
+		for (; i < n; i++) {
+			const double d = a[i] - b[i];
+			sum += d * d;
+		}
+		return sum;
+	}
+
+	MATHSLIB_TARGET_AVX2 bool any_abs_greater_avx2(const double* a, double tolerance, size_t n) {
+		const __m256d sign = _mm256_set1_pd(-0.0);
+		const __m256d t = _mm256_set1_pd(tolerance);
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			const __m256d x = _mm256_andnot_pd(sign, _mm256_loadu_pd(a + i));
+			if (_mm256_movemask_pd(_mm256_cmp_pd(x, t, _CMP_GT_OQ))) {
+				return true;
+			}
+		}
+		for (; i < n; i++) {
+			if (std::abs(a[i]) > tolerance) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	MATHSLIB_TARGET_AVX2 inline float horizontal_sum_avx2(__m256 v) {
+		__m128 half = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+		return _mm_cvtss_f32(_mm_add_ss(half, _mm_shuffle_ps(half, half, 1)));
+	}
+
+	MATHSLIB_TARGET_AVX2 float dot_float_avx2(const float* a, const float* b, size_t n) {
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		__m256 acc2 = _mm256_setzero_ps();
+		__m256 acc3 = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 32 <= n; i += 32) {
+			acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+			acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+			acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), acc2);
+			acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), acc3);
+		}
+		for (; i + 8 <= n; i += 8) {
+			acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+		}
+		float sum = horizontal_sum_avx2(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+
+		for (; i < n; i++) {
+			sum += a[i] * b[i];
+		}
+		return sum;
+	}
+
+	MATHSLIB_TARGET_AVX2 float squared_distance_float_avx2(const float* a, const float* b, size_t n) {
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 16 <= n; i += 16) {
+			const __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+			const __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+			acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+			acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+		}
+		for (; i + 8 <= n; i += 8) {
+			const __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+			acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+		}
+		float sum = horizontal_sum_avx2(_mm256_add_ps(acc0, acc1));
+
+		for (; i < n; i++) {
+			const float d = a[i] - b[i];
+			sum += d * d;
+		}
+		return sum;
+	}
+
+	// Eight bfloat16 zero extended to 32 bits and shifted into the top half of each float.
+	MATHSLIB_TARGET_AVX2 inline __m256 load_bf16_avx2(const bfloat16* p) {
+		const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(x), 16));
+	}
+
+	MATHSLIB_TARGET_AVX2 float dot_bf16_avx2(const bfloat16* a, const bfloat16* b, size_t n) {
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		__m256 acc2 = _mm256_setzero_ps();
+		__m256 acc3 = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 32 <= n; i += 32) {
+			acc0 = _mm256_fmadd_ps(load_bf16_avx2(a + i), load_bf16_avx2(b + i), acc0);
+			acc1 = _mm256_fmadd_ps(load_bf16_avx2(a + i + 8), load_bf16_avx2(b + i + 8), acc1);
+			acc2 = _mm256_fmadd_ps(load_bf16_avx2(a + i + 16), load_bf16_avx2(b + i + 16), acc2);
+			acc3 = _mm256_fmadd_ps(load_bf16_avx2(a + i + 24), load_bf16_avx2(b + i + 24), acc3);
+		}
+		for (; i + 8 <= n; i += 8) {
+			acc0 = _mm256_fmadd_ps(load_bf16_avx2(a + i), load_bf16_avx2(b + i), acc0);
+		}
+		float sum = horizontal_sum_avx2(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+
+		for (; i < n; i++) {
+			sum += static_cast<float>(a[i]) * static_cast<float>(b[i]);
+		}
+		return sum;
+	}
+
+	MATHSLIB_TARGET_AVX2 float squared_distance_bf16_avx2(const bfloat16* a, const bfloat16* b, size_t n) {
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 16 <= n; i += 16) {
+			const __m256 d0 = _mm256_sub_ps(load_bf16_avx2(a + i), load_bf16_avx2(b + i));
+			const __m256 d1 = _mm256_sub_ps(load_bf16_avx2(a + i + 8), load_bf16_avx2(b + i + 8));
+			acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+			acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+		}
+		for (; i + 8 <= n; i += 8) {
+			const __m256 d0 = _mm256_sub_ps(load_bf16_avx2(a + i), load_bf16_avx2(b + i));
+			acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+		}
+		float sum = horizontal_sum_avx2(_mm256_add_ps(acc0, acc1));
+
+		for (; i < n; i++) {
+			const float d = static_cast<float>(a[i]) - static_cast<float>(b[i]);
+			sum += d * d;
+		}
+		return sum;
+	}
+
+	// --------- AVX-512, eight doubles per register with masked tails. ---------
+
+	MATHSLIB_TARGET_AVX512 inline __mmask8 tail_mask(size_t remaining) {
+		return static_cast<__mmask8>((1u << remaining) - 1u);
+	}
+
+	MATHSLIB_TARGET_AVX512 void add_avx512(const double* a, const double* b, double* out, size_t n) {
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			_mm512_storeu_pd(out + i, _mm512_add_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+		}
+		if (i < n) {
+			const __mmask8 m = tail_mask(n - i);
+			_mm512_mask_storeu_pd(out + i, m, _mm512_add_pd(_mm512_maskz_loadu_pd(m, a + i), _mm512_maskz_loadu_pd(m, b + i)));
+		}
+	}
+
+	MATHSLIB_TARGET_AVX512 void subtract_avx512(const double* a, const double* b, double* out, size_t n) {
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			_mm512_storeu_pd(out + i, _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+		}
+		if (i < n) {
+			const __mmask8 m = tail_mask(n - i);
+			_mm512_mask_storeu_pd(out + i, m, _mm512_sub_pd(_mm512_maskz_loadu_pd(m, a + i), _mm512_maskz_loadu_pd(m, b + i)));
+		}
+	}
+
+	MATHSLIB_TARGET_AVX512 void scale_avx512(const double* a, double number, double* out, size_t n) {
+		const __m512d s = _mm512_set1_pd(number);
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			_mm512_storeu_pd(out + i, _mm512_mul_pd(s, _mm512_loadu_pd(a + i)));
+		}
+		if (i < n) {
+			const __mmask8 m = tail_mask(n - i);
+			_mm512_mask_storeu_pd(out + i, m, _mm512_mul_pd(s, _mm512_maskz_loadu_pd(m, a + i)));
+		}
+	}
+
+	MATHSLIB_TARGET_AVX512 double dot_avx512(const double* a, const double* b, size_t n) {
+		__m512d acc0 = _mm512_setzero_pd();
+		__m512d acc1 = _mm512_setzero_pd();
+		__m512d acc2 = _mm512_setzero_pd();
+		__m512d acc3 = _mm512_setzero_pd();
+		size_t i = 0;
+		for (; i + 32 <= n; i += 32) {
+			acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), acc0);
+			acc1 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 8), _mm512_loadu_pd(b + i + 8), acc1);
+			acc2 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 16), _mm512_loadu_pd(b + i + 16), acc2);
+			acc3 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 24), _mm512_loadu_pd(b + i + 24), acc3);
+		}
+		for (; i + 8 <= n; i += 8) {
+			acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), acc0);
+		}
+		if (i < n) {
+			const __mmask8 m = tail_mask(n - i);
+			acc1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(m, a + i), _mm512_maskz_loadu_pd(m, b + i), acc1);
+		}
+		acc0 = _mm512_add_pd(_mm512_add_pd(acc0, acc1), _mm512_add_pd(acc2, acc3));
+
+		alignas(64) double lanes[8];
+		_mm512_store_pd(lanes, acc0);
+		return ((lanes[0] + lanes[4]) + (lanes[1] + lanes[5])) + ((lanes[2] + lanes[6]) + (lanes[3] + lanes[7]));
+	}
+
+	MATHSLIB_TARGET_AVX512 double squared_distance_avx512(const double* a, const double* b, size_t n) {
+		__m512d acc0 = _mm512_setzero_pd();
+		__m512d acc1 = _mm512_setzero_pd();
+		size_t i = 0;
+		for (; i + 16 <= n; i += 16) {
+			const __m512d d0 = _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i));
+			const __m512d d1 = _mm512_sub_pd(_mm512_loadu_pd(a + i + 8), _mm512_loadu_pd(b + i + 8));
+			acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+			acc1 = _mm512_fmadd_pd(d1, d1, acc1);
+		}
+		for (; i + 8 <= n; i += 8) {
+			const __m512d d0 = _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i));
+			acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+		}
+		if (i < n) {
+			const __mmask8 m = tail_mask(n - i);
+			const __m512d d0 = _mm512_sub_pd(_mm512_maskz_loadu_pd(m, a + i), _mm512_maskz_loadu_pd(m, b + i));
+			acc1 = _mm512_fmadd_pd(d0, d0, acc1);
+		}
+		acc0 = _mm512_add_pd(acc0, acc1);
+
+		alignas(64) double lanes[8];
+		_mm512_store_pd(lanes, acc0);
+		return ((lanes[0] + lanes[4]) + (lanes[1] + lanes[5])) + ((lanes[2] + lanes[6]) + (lanes[3] + lanes[7]));
+	}
+
+	MATHSLIB_TARGET_AVX512 bool any_abs_greater_avx512(const double* a, double tolerance, size_t n) {
+		const __m512d t = _mm512_set1_pd(tolerance);
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			if (_mm512_cmp_pd_mask(_mm512_abs_pd(_mm512_loadu_pd(a + i)), t, _CMP_GT_OQ)) {
+				return true;
+			}
+		}
+		if (i < n) {
+			const __mmask8 m = tail_mask(n - i);
+			return _mm512_mask_cmp_pd_mask(m, _mm512_abs_pd(_mm512_maskz_loadu_pd(m, a + i)), t, _CMP_GT_OQ) != 0;
+		}
+		return false;
+	}
+
+	MATHSLIB_TARGET_AVX512 inline __mmask16 tail_mask16(size_t remaining) {
+		return static_cast<__mmask16>((1u << remaining) - 1u);
+	}
+
+	MATHSLIB_TARGET_AVX512 float dot_float_avx512(const float* a, const float* b, size_t n) {
+		__m512 acc0 = _mm512_setzero_ps();
+		__m512 acc1 = _mm512_setzero_ps();
+		__m512 acc2 = _mm512_setzero_ps();
+		__m512 acc3 = _mm512_setzero_ps();
+		size_t i = 0;
+		for (; i + 64 <= n; i += 64) {
+			acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+			acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+			acc2 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32), acc2);
+			acc3 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48), acc3);
+		}
+		for (; i + 16 <= n; i += 16) {
+			acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+		}
+		if (i < n) {
+			const __mmask16 m = tail_mask16(n - i);
+			acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i), acc1);
+		}
+		return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+	}
+
+	MATHSLIB_TARGET_AVX512 float squared_distance_float_avx512(const float* a, const float* b, size_t n) {
+		__m512 acc0 = _mm512_setzero_ps();
+		__m512 acc1 = _mm512_setzero_ps();
+		size_t i = 0;
+		for (; i + 32 <= n; i += 32) {
+			const __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+			const __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+			acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+			acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+		}
+		for (; i + 16 <= n; i += 16) {
+			const __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+			acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+		}
+		if (i < n) {
+			const __mmask16 m = tail_mask16(n - i);
+			const __m512 d0 = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i));
+			acc1 = _mm512_fmadd_ps(d0, d0, acc1);
+		}
+		return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+	}
+
+	// Sixteen bfloat16 widened to floats. Masked 16 bit loads need AVX-512BW, so the tails below
+	// are finished by the scalar loop instead.
+	MATHSLIB_TARGET_AVX512 inline __m512 load_bf16_avx512(const bfloat16* p) {
+		const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+		return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(x), 16));
+	}
+
+	MATHSLIB_TARGET_AVX512 float dot_bf16_avx512(const bfloat16* a, const bfloat16* b, size_t n) {
+		__m512 acc0 = _mm512_setzero_ps();
+		__m512 acc1 = _mm512_setzero_ps();
+		__m512 acc2 = _mm512_setzero_ps();
+		__m512 acc3 = _mm512_setzero_ps();
+		size_t i = 0;
+		for (; i + 64 <= n; i += 64) {
+			acc0 = _mm512_fmadd_ps(load_bf16_avx512(a + i), load_bf16_avx512(b + i), acc0);
+			acc1 = _mm512_fmadd_ps(load_bf16_avx512(a + i + 16), load_bf16_avx512(b + i + 16), acc1);
+			acc2 = _mm512_fmadd_ps(load_bf16_avx512(a + i + 32), load_bf16_avx512(b + i + 32), acc2);
+			acc3 = _mm512_fmadd_ps(load_bf16_avx512(a + i + 48), load_bf16_avx512(b + i + 48), acc3);
+		}
+		for (; i + 16 <= n; i += 16) {
+			acc0 = _mm512_fmadd_ps(load_bf16_avx512(a + i), load_bf16_avx512(b + i), acc0);
+		}
+		float sum = _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+
+		for (; i < n; i++) {
+			sum += static_cast<float>(a[i]) * static_cast<float>(b[i]);
+		}
+		return sum;
+	}
+
+	MATHSLIB_TARGET_AVX512 float squared_distance_bf16_avx512(const bfloat16* a, const bfloat16* b, size_t n) {
+		__m512 acc0 = _mm512_setzero_ps();
+		__m512 acc1 = _mm512_setzero_ps();
+		size_t i = 0;
+		for (; i + 32 <= n; i += 32) {
+			const __m512 d0 = _mm512_sub_ps(load_bf16_avx512(a + i), load_bf16_avx512(b + i));
+			const __m512 d1 = _mm512_sub_ps(load_bf16_avx512(a + i + 16), load_bf16_avx512(b + i + 16));
+			acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+			acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+		}
+		for (; i + 16 <= n; i += 16) {
+			const __m512 d0 = _mm512_sub_ps(load_bf16_avx512(a + i), load_bf16_avx512(b + i));
+			acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+		}
+		float sum = _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+
+		for (; i < n; i++) {
+			const float d = static_cast<float>(a[i]) - static_cast<float>(b[i]);
+			sum += d * d;
+		}
+		return sum;
+	}
+
+#endif
+
+	const SimdKernels scalar_kernels = { SimdLevel::Scalar, "scalar", add_scalar, subtract_scalar, scale_scalar, dot_scalar, squared_distance_scalar, any_abs_greater_scalar,
+		dot_float_scalar, squared_distance_float_scalar, dot_bf16_scalar, squared_distance_bf16_scalar };
+
+#ifdef MATHSLIB_X86
+	const SimdKernels sse2_kernels = { SimdLevel::SSE2, "sse2", add_sse2, subtract_sse2, scale_sse2, dot_sse2, squared_distance_sse2, any_abs_greater_sse2,
+		dot_float_sse2, squared_distance_float_sse2, dot_bf16_sse2, squared_distance_bf16_sse2 };
+	const SimdKernels avx2_kernels = { SimdLevel::AVX2, "avx2", add_avx2, subtract_avx2, scale_avx2, dot_avx2, squared_distance_avx2, any_abs_greater_avx2,
+		dot_float_avx2, squared_distance_float_avx2, dot_bf16_avx2, squared_distance_bf16_avx2 };
+	const SimdKernels avx512_kernels = { SimdLevel::AVX512, "avx512", add_avx512, subtract_avx512, scale_avx512, dot_avx512, squared_distance_avx512, any_abs_greater_avx512,
+		dot_float_avx512, squared_distance_float_avx512, dot_bf16_avx512, squared_distance_bf16_avx512 };
+#endif
+
+#if defined(MATHSLIB_X86) && defined(_MSC_VER)
+	// CPUID alone is not enough, the OS must also save the wider registers on a context switch.
+	SimdLevel detect_msvc() noexcept {
+		int info[4];
+		__cpuid(info, 0);
+		const int max_leaf = info[0];
+
+		__cpuid(info, 1);
+		const bool sse2 = (info[3] & (1 << 26)) != 0;
+		const bool fma = (info[2] & (1 << 12)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+
+		if (!sse2) {
+			return SimdLevel::Scalar;
+		}
+		if (!osxsave || !avx || max_leaf < 7) {
+			return SimdLevel::SSE2;
+		}
+
+		const unsigned long long xcr0 = _xgetbv(0);
+		__cpuidex(info, 7, 0);
+		const bool avx2 = (info[1] & (1 << 5)) != 0;
+		const bool avx512f = (info[1] & (1 << 16)) != 0;
+
+		if (avx512f && fma && (xcr0 & 0xE6) == 0xE6) {
+			return SimdLevel::AVX512;
+		}
+		if (avx2 && fma && (xcr0 & 0x6) == 0x6) {
+			return SimdLevel::AVX2;
+		}
+		return SimdLevel::SSE2;
+	}
+#endif
+}
+
+SimdLevel detect_simd_level() noexcept {
+#if defined(MATHSLIB_X86) && defined(_MSC_VER)
+	return detect_msvc();
+#elif defined(MATHSLIB_X86) && (defined(__GNUC__) || defined(__clang__))
+	// The builtins also check that the OS has enabled the extended register state.
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma")) {
+		return SimdLevel::AVX512;
+	}
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return SimdLevel::AVX2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return SimdLevel::SSE2;
+	}
+	return SimdLevel::Scalar;
+#else
+	return SimdLevel::Scalar;
+#endif
+}
+
+const SimdKernels& simd_kernels() noexcept {
+	static const SimdKernels& selected = simd_kernels(detect_simd_level());
+	return selected;
+}
+
+const SimdKernels& simd_kernels(SimdLevel level) noexcept {
+	static const SimdLevel supported = detect_simd_level();
+	level = std::min(level, supported);
+
+	switch (level) {
+#ifdef MATHSLIB_X86
+	case SimdLevel::AVX512:
+		return avx512_kernels;
+	case SimdLevel::AVX2:
+		return avx2_kernels;
+	case SimdLevel::SSE2:
+		return sse2_kernels;
+#endif
+	default:
+		return scalar_kernels;
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include "BFloat16.h"
+
+// Instruction set selection for the vectorised kernels.
+//
+// Every kernel is compiled for each instruction set in the same binary, the best one the host
+// supports is picked once at runtime from CPUID. The scalar kernels are the reference implementation.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MATHSLIB_X86 1
+#endif
+
+// Per function code generation targets. MSVC allows intrinsics anywhere so needs no attribute.
+#if defined(__GNUC__) || defined(__clang__)
+#define MATHSLIB_TARGET_SSE2 __attribute__((target("sse2")))
+#define MATHSLIB_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define MATHSLIB_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#define MATHSLIB_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define MATHSLIB_TARGET_SSE2
+#define MATHSLIB_TARGET_AVX2
+#define MATHSLIB_TARGET_AVX512
+#define MATHSLIB_ALWAYS_INLINE __forceinline
+#endif
+
+
+// Ordered from least to most capable.
+enum class SimdLevel {
+	Scalar,
+	SSE2,
+	AVX2,
+	AVX512
+};
+
+// Kernels over contiguous arrays of n doubles. out may alias either input.
+struct SimdKernels {
+	SimdLevel level;
+	const char* name;
+
+	void (*add)(const double* a, const double* b, double* out, size_t n);
+	void (*subtract)(const double* a, const double* b, double* out, size_t n);
+	void (*scale)(const double* a, double number, double* out, size_t n);
+	double (*dot)(const double* a, const double* b, size_t n);
+
+	// Sum of (a[i] - b[i])^2, the squared Euclidean distance without a temporary difference vector.
+	double (*squared_distance)(const double* a, const double* b, size_t n);
+
+	// True if any |a[i]| > tolerance. NaN never compares greater, matching the scalar loop.
+	bool (*any_abs_greater)(const double* a, double tolerance, size_t n);
+
+	// Reduced precision storage. bfloat16 is widened to float on load, and both accumulate in
+	// float lanes, so the sum order and rounding differ slightly between instruction sets.
+	float (*dot_float)(const float* a, const float* b, size_t n);
+	float (*squared_distance_float)(const float* a, const float* b, size_t n);
+	float (*dot_bf16)(const bfloat16* a, const bfloat16* b, size_t n);
+	float (*squared_distance_bf16)(const bfloat16* a, const bfloat16* b, size_t n);
+};
+
+// Most capable instruction set supported by both this CPU and the operating system.
+SimdLevel detect_simd_level() noexcept;
+
+// Kernels for the detected instruction set, selected on first use.
+const SimdKernels& simd_kernels() noexcept;
+
+// Kernels for a specific instruction set, clamped to what the host supports.
+const SimdKernels& simd_kernels(SimdLevel level) noexcept;
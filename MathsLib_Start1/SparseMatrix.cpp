@@ -0,0 +1,637 @@
+#include "SparseMatrix.h"
+#include "MemoryResource.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <memory_resource>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+	void verify_dimensions(size_t rows, size_t cols) {
+		if (rows == 0 || cols == 0) {
+			throw std::invalid_argument("Cannot construct an empty matrix.");
+		}
+	}
+
+	// Calls body(major_begin, major_end) over consecutive runs of rows (or columns) holding a
+	// similar share of the work, counting each stored element and each row as one unit of
+	// work_per_unit operations. The boundaries only depend on the offsets, so every row is
+	// always summed by one chunk in the same order whatever the thread count.
+	template <typename F>
+	void parallel_nonzeros(const std::vector<size_t>& offsets, size_t work_per_unit, F&& body) {
+		const size_t majors = offsets.size() - 1;
+		const size_t units = offsets.back() + majors;
+
+		if (units * work_per_unit < parallel_threshold) {
+			body(size_t{ 0 }, majors);
+			return;
+		}
+
+		const size_t chunks = std::min(majors, (units * work_per_unit + parallel_grain - 1) / parallel_grain);
+
+		// offsets[r] + r counts the units before row r and strictly increases with r.
+		std::vector<size_t> bounds(chunks + 1, majors);
+		bounds[0] = 0;
+		for (size_t c = 1; c < chunks; c++) {
+			const size_t target = units / chunks * c + units % chunks * c / chunks;
+			size_t low = bounds[c - 1];
+			size_t high = majors;
+			while (low < high) {
+				const size_t mid = low + (high - low) / 2;
+				if (offsets[mid] + mid < target) {
+					low = mid + 1;
+				}
+				else {
+					high = mid;
+				}
+			}
+			bounds[c] = low;
+		}
+
+		default_thread_pool().parallel_for(0, chunks, 1, [&bounds, &body](size_t chunk_begin, size_t chunk_end) {
+			for (size_t c = chunk_begin; c < chunk_end; c++) {
+				if (bounds[c] < bounds[c + 1]) {
+					body(bounds[c], bounds[c + 1]);
+				}
+			}
+		});
+	}
+
+	// A + sign B for matrices in the same layout, merging each row of the two.
+	SparseMatrix combine(const SparseMatrix& A, const SparseMatrix& B, double sign) {
+		const size_t majors = A.get_offsets().size() - 1;
+		const std::vector<size_t>& a_offsets = A.get_offsets();
+		const std::vector<size_t>& a_indices = A.get_indices();
+		const std::vector<double>& a_values = A.get_values();
+		const std::vector<size_t>& b_offsets = B.get_offsets();
+		const std::vector<size_t>& b_indices = B.get_indices();
+		const std::vector<double>& b_values = B.get_values();
+
+		std::vector<size_t> offsets(majors + 1, 0);
+		std::vector<size_t> indices;
+		std::vector<double> values;
+		indices.reserve(A.non_zero_count() + B.non_zero_count());
+		values.reserve(A.non_zero_count() + B.non_zero_count());
+
+		auto push = [&indices, &values](size_t index, double value) {
+			if (value != 0.0) {
+				indices.push_back(index);
+				values.push_back(value);
+			}
+		};
+
+		for (size_t r = 0; r < majors; r++) {
+			size_t p = a_offsets[r];
+			size_t q = b_offsets[r];
+			while (p < a_offsets[r + 1] || q < b_offsets[r + 1]) {
+				if (q == b_offsets[r + 1] || (p < a_offsets[r + 1] && a_indices[p] < b_indices[q])) {
+					push(a_indices[p], a_values[p]);
+					p++;
+				}
+				else if (p == a_offsets[r + 1] || b_indices[q] < a_indices[p]) {
+					push(b_indices[q], sign * b_values[q]);
+					q++;
+				}
+				else {
+					push(a_indices[p], a_values[p] + sign * b_values[q]);
+					p++;
+					q++;
+				}
+			}
+			offsets[r + 1] = indices.size();
+		}
+
+		return SparseMatrix(A.get_row_count(), A.get_col_count(), A.get_layout(), std::move(offsets), std::move(indices), std::move(values));
+	}
+
+	// Adds sign A to M in place.
+	void add_to_dense(Matrix& M, const SparseMatrix& A, double sign) {
+		if (M.get_row_count() != A.get_row_count() || M.get_col_count() != A.get_col_count()) {
+			throw std::invalid_argument("Matrix addition and subtraction must have valid dimensions.");
+		}
+
+		const bool csr = A.get_layout() == SparseLayout::CSR;
+		const std::vector<size_t>& offsets = A.get_offsets();
+		const std::vector<size_t>& indices = A.get_indices();
+		const std::vector<double>& values = A.get_values();
+
+		for (size_t r = 0; r + 1 < offsets.size(); r++) {
+			for (size_t p = offsets[r]; p < offsets[r + 1]; p++) {
+				double& element = csr ? M(r, indices[p]) : M(indices[p], r);
+				element += sign * values[p];
+			}
+		}
+	}
+}
+
+SparseMatrix::SparseMatrix(size_t rows, size_t cols, SparseLayout layout) : row_count{ rows }, col_count{ cols }, layout{ layout } {
+	verify_dimensions(rows, cols);
+	offsets.assign(major_count() + 1, 0);
+}
+
+// Built as CSR with a counting pass and a filling pass, then converted if CSC was asked for.
+SparseMatrix::SparseMatrix(const Matrix& M, SparseLayout layout, double tolerance) : row_count{ M.get_row_count() }, col_count{ M.get_col_count() } {
+	offsets.assign(row_count + 1, 0);
+	for (size_t r = 0; r < row_count; r++) {
+		size_t count = 0;
+		for (size_t c = 0; c < col_count; c++) {
+			count += std::abs(M(r, c)) > tolerance;
+		}
+		offsets[r + 1] = offsets[r] + count;
+	}
+
+	indices.resize(offsets.back());
+	values.resize(offsets.back());
+	for (size_t r = 0; r < row_count; r++) {
+		size_t p = offsets[r];
+		for (size_t c = 0; c < col_count; c++) {
+			if (std::abs(M(r, c)) > tolerance) {
+				indices[p] = c;
+				values[p] = M(r, c);
+				p++;
+			}
+		}
+	}
+
+	if (layout != SparseLayout::CSR) {
+		*this = to_layout(layout);
+	}
+}
+
+SparseMatrix::SparseMatrix(size_t rows, size_t cols, SparseLayout layout, std::vector<size_t> offsets, std::vector<size_t> indices, std::vector<double> values)
+	: row_count{ rows }, col_count{ cols }, layout{ layout }, offsets{ std::move(offsets) }, indices{ std::move(indices) }, values{ std::move(values) } {
+	verify_dimensions(rows, cols);
+
+	const size_t majors = major_count();
+	const size_t minors = layout == SparseLayout::CSR ? col_count : row_count;
+	bool valid = this->offsets.size() == majors + 1 && this->offsets[0] == 0 && this->offsets.back() == this->indices.size() && this->indices.size() == this->values.size();
+
+	for (size_t r = 0; valid && r < majors; r++) {
+		valid = this->offsets[r] <= this->offsets[r + 1] && this->offsets[r + 1] <= this->indices.size();
+		for (size_t p = this->offsets[r]; valid && p < this->offsets[r + 1]; p++) {
+			valid = this->indices[p] < minors && (p == this->offsets[r] || this->indices[p - 1] < this->indices[p]);
+		}
+	}
+
+	if (!valid) {
+		throw std::invalid_argument("Compressed arrays do not describe a valid sparse matrix.");
+	}
+}
+
+size_t SparseMatrix::major_count() const noexcept {
+	return layout == SparseLayout::CSR ? row_count : col_count;
+}
+
+size_t SparseMatrix::get_row_count() const noexcept {
+	return row_count;
+}
+
+size_t SparseMatrix::get_col_count() const noexcept {
+	return col_count;
+}
+
+size_t SparseMatrix::non_zero_count() const noexcept {
+	return values.size();
+}
+
+SparseLayout SparseMatrix::get_layout() const noexcept {
+	return layout;
+}
+
+const std::vector<size_t>& SparseMatrix::get_offsets() const noexcept {
+	return offsets;
+}
+
+const std::vector<size_t>& SparseMatrix::get_indices() const noexcept {
+	return indices;
+}
+
+const std::vector<double>& SparseMatrix::get_values() const noexcept {
+	return values;
+}
+
+// Walking the rows in order places each column's elements in increasing row order, so the
+// result is sorted without comparisons.
+SparseMatrix SparseMatrix::to_layout(SparseLayout target) const {
+	if (target == layout) {
+		return *this;
+	}
+
+	const size_t majors = major_count();
+	const size_t minors = layout == SparseLayout::CSR ? col_count : row_count;
+
+	std::vector<size_t> new_offsets(minors + 1, 0);
+	for (const size_t index : indices) {
+		new_offsets[index + 1]++;
+	}
+	for (size_t c = 0; c < minors; c++) {
+		new_offsets[c + 1] += new_offsets[c];
+	}
+
+	std::vector<size_t> new_indices(indices.size());
+	std::vector<double> new_values(values.size());
+	std::vector<size_t> next(new_offsets.begin(), new_offsets.end() - 1);
+	for (size_t r = 0; r < majors; r++) {
+		for (size_t p = offsets[r]; p < offsets[r + 1]; p++) {
+			const size_t q = next[indices[p]]++;
+			new_indices[q] = r;
+			new_values[q] = values[p];
+		}
+	}
+
+	SparseMatrix result(row_count, col_count, target);
+	result.offsets = std::move(new_offsets);
+	result.indices = std::move(new_indices);
+	result.values = std::move(new_values);
+	return result;
+}
+
+SparseMatrix SparseMatrix::transpose() const {
+	SparseMatrix result(col_count, row_count, layout == SparseLayout::CSR ? SparseLayout::CSC : SparseLayout::CSR);
+	result.offsets = offsets;
+	result.indices = indices;
+	result.values = values;
+	return result;
+}
+
+Matrix SparseMatrix::to_dense() const {
+	Matrix M(col_count, row_count);
+	add_to_dense(M, *this, 1.0);
+	return M;
+}
+
+double SparseMatrix::operator()(const size_t& row, const size_t& col) const {
+	if (row >= row_count || col >= col_count) {
+		throw std::invalid_argument("Index is out of range.");
+	}
+
+	const size_t major = layout == SparseLayout::CSR ? row : col;
+	const size_t minor = layout == SparseLayout::CSR ? col : row;
+	const auto first = indices.begin() + offsets[major];
+	const auto last = indices.begin() + offsets[major + 1];
+	const auto found = std::lower_bound(first, last, minor);
+
+	return found != last && *found == minor ? values[found - indices.begin()] : 0.0;
+}
+
+SparseMatrix& SparseMatrix::operator*=(const double& number) noexcept {
+	for (double& value : values) {
+		value *= number;
+	}
+	return *this;
+}
+
+// Multiplies by the reciprocal, matching Matrix.
+SparseMatrix& SparseMatrix::operator/=(const double& number) noexcept {
+	return *this *= (1.0 / number);
+}
+
+// Elements that are not stored compare as zero, so scaling by zero does not break equality.
+bool operator==(const SparseMatrix& A, const SparseMatrix& B) {
+	if (A.row_count != B.row_count || A.col_count != B.col_count) {
+		return false;
+	}
+
+	if (A.layout != B.layout) {
+		return A == B.to_layout(A.layout);
+	}
+
+	for (size_t r = 0; r < A.major_count(); r++) {
+		size_t p = A.offsets[r];
+		size_t q = B.offsets[r];
+		while (p < A.offsets[r + 1] || q < B.offsets[r + 1]) {
+			if (q == B.offsets[r + 1] || (p < A.offsets[r + 1] && A.indices[p] < B.indices[q])) {
+				if (A.values[p++] != 0.0) {
+					return false;
+				}
+			}
+			else if (p == A.offsets[r + 1] || B.indices[q] < A.indices[p]) {
+				if (B.values[q++] != 0.0) {
+					return false;
+				}
+			}
+			else if (A.values[p++] != B.values[q++]) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool operator==(const SparseMatrix& A, const Matrix& M) {
+	if (A.row_count != M.get_row_count() || A.col_count != M.get_col_count()) {
+		return false;
+	}
+
+	const bool csr = A.layout == SparseLayout::CSR;
+	const size_t minors = csr ? A.col_count : A.row_count;
+
+	for (size_t r = 0; r < A.major_count(); r++) {
+		size_t p = A.offsets[r];
+		for (size_t c = 0; c < minors; c++) {
+			const double expected = p < A.offsets[r + 1] && A.indices[p] == c ? A.values[p++] : 0.0;
+			if ((csr ? M(r, c) : M(c, r)) != expected) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+SparseMatrix operator+(const SparseMatrix& A, const SparseMatrix& B) {
+	if (A.row_count != B.row_count || A.col_count != B.col_count) {
+		throw std::invalid_argument("Matrix addition and subtraction must have valid dimensions.");
+	}
+
+	return A.layout == B.layout ? combine(A, B, 1.0) : combine(A, B.to_layout(A.layout), 1.0);
+}
+
+SparseMatrix operator-(const SparseMatrix& A, const SparseMatrix& B) {
+	if (A.row_count != B.row_count || A.col_count != B.col_count) {
+		throw std::invalid_argument("Matrix addition and subtraction must have valid dimensions.");
+	}
+
+	return A.layout == B.layout ? combine(A, B, -1.0) : combine(A, B.to_layout(A.layout), -1.0);
+}
+
+// CSR is a gather per row. CSC scatters each column into y, so large products give each
+// chunk of columns its own partial y and add them up in chunk order afterwards. The chunk
+// count is capped so the partial results never outgrow the matrix itself.
+Vector operator*(const SparseMatrix& A, const Vector& x) {
+	if (A.col_count != x.size()) {
+		throw std::invalid_argument("Matrix multiplication must have valid dimensions.");
+	}
+
+	Vector y(A.row_count);
+	const size_t* offsets = A.offsets.data();
+	const size_t* indices = A.indices.data();
+	const double* values = A.values.data();
+	const double* in = x.data();
+	double* out = y.data();
+
+	if (A.layout == SparseLayout::CSR) {
+		parallel_nonzeros(A.offsets, 1, [=](size_t row_begin, size_t row_end) {
+			for (size_t r = row_begin; r < row_end; r++) {
+				double sum = 0.0;
+				for (size_t p = offsets[r]; p < offsets[r + 1]; p++) {
+					sum += values[p] * in[indices[p]];
+				}
+				out[r] = sum;
+			}
+		});
+		return y;
+	}
+
+	const size_t rows = A.row_count;
+	const size_t cols = A.col_count;
+	const size_t units = A.non_zero_count() + cols;
+	size_t chunks = 1;
+	if (units >= parallel_threshold) {
+		chunks = std::clamp<size_t>(std::min(units / parallel_grain, units / rows), 1, cols);
+	}
+
+	auto scatter = [=](double* partial, size_t col_begin, size_t col_end) {
+		for (size_t c = col_begin; c < col_end; c++) {
+			const double xc = in[c];
+			for (size_t p = offsets[c]; p < offsets[c + 1]; p++) {
+				partial[indices[p]] += values[p] * xc;
+			}
+		}
+	};
+
+	if (chunks == 1) {
+		scatter(out, 0, cols);
+		return y;
+	}
+
+	std::pmr::vector<double> partials(chunks * rows, 0.0, current_memory_resource());
+	double* partial = partials.data();
+	default_thread_pool().parallel_for(0, chunks, 1, [=](size_t chunk_begin, size_t chunk_end) {
+		for (size_t c = chunk_begin; c < chunk_end; c++) {
+			scatter(partial + c * rows, cols * c / chunks, cols * (c + 1) / chunks);
+		}
+	});
+
+	parallel_elementwise(rows, [=](size_t begin, size_t end) {
+		for (size_t c = 0; c < chunks; c++) {
+			const double* source = partial + c * rows;
+			for (size_t r = begin; r < end; r++) {
+				out[r] += source[r];
+			}
+		}
+	});
+
+	return y;
+}
+
+// Each stored A(r, k) adds a multiple of row k of B to row r of the result, contiguous row
+// operations over B's columns. CSC is converted first, which costs one pass over the
+// non-zeros against the B column count passes of the product.
+Matrix operator*(const SparseMatrix& A, const Matrix& B) {
+	if (A.col_count != B.get_row_count()) {
+		throw std::invalid_argument("Matrix multiplication must have valid dimensions.");
+	}
+
+	if (A.layout != SparseLayout::CSR) {
+		return A.to_layout(SparseLayout::CSR) * B;
+	}
+
+	const size_t n = B.get_col_count();
+	Matrix C(n, A.row_count);
+	const size_t* offsets = A.offsets.data();
+	const size_t* indices = A.indices.data();
+	const double* values = A.values.data();
+	const double* b = B.data();
+	double* c = C.data();
+
+	parallel_nonzeros(A.offsets, n, [=](size_t row_begin, size_t row_end) {
+		for (size_t r = row_begin; r < row_end; r++) {
+			double* out = c + r * n;
+			for (size_t p = offsets[r]; p < offsets[r + 1]; p++) {
+				const double a = values[p];
+				const double* source = b + indices[p] * n;
+				for (size_t j = 0; j < n; j++) {
+					out[j] += a * source[j];
+				}
+			}
+		}
+	});
+
+	return C;
+}
+
+// Rows of the result are independent, each combines the sparse rows (CSR) or gathers along
+// the sparse columns (CSC) using one row of A.
+Matrix operator*(const Matrix& A, const SparseMatrix& B) {
+	if (A.get_col_count() != B.row_count) {
+		throw std::invalid_argument("Matrix multiplication must have valid dimensions.");
+	}
+
+	const size_t k = B.row_count;
+	const size_t n = B.col_count;
+	const bool csr = B.layout == SparseLayout::CSR;
+	Matrix C(n, A.get_row_count());
+	const size_t* offsets = B.offsets.data();
+	const size_t* indices = B.indices.data();
+	const double* values = B.values.data();
+	const double* a = A.data();
+	double* c = C.data();
+
+	parallel_rows(A.get_row_count(), B.non_zero_count() + k, [=](size_t row_begin, size_t row_end) {
+		for (size_t i = row_begin; i < row_end; i++) {
+			const double* in = a + i * k;
+			double* out = c + i * n;
+
+			if (csr) {
+				for (size_t r = 0; r < k; r++) {
+					const double scale = in[r];
+					if (scale == 0.0) {
+						continue;
+					}
+					for (size_t p = offsets[r]; p < offsets[r + 1]; p++) {
+						out[indices[p]] += scale * values[p];
+					}
+				}
+			}
+			else {
+				for (size_t j = 0; j < n; j++) {
+					double sum = 0.0;
+					for (size_t p = offsets[j]; p < offsets[j + 1]; p++) {
+						sum += in[indices[p]] * values[p];
+					}
+					out[j] = sum;
+				}
+			}
+		}
+	});
+
+	return C;
+}
+
+SparseMatrix operator*(SparseMatrix A, const double& number) noexcept {
+	A *= number;
+	return A;
+}
+
+SparseMatrix operator*(const double& number, SparseMatrix A) noexcept {
+	A *= number;
+	return A;
+}
+
+SparseMatrix operator/(SparseMatrix A, const double& number) noexcept {
+	A /= number;
+	return A;
+}
+
+SparseMatrix operator-(SparseMatrix A) noexcept {
+	A *= -1.0;
+	return A;
+}
+
+Matrix operator+(const Matrix& M, const SparseMatrix& A) {
+	Matrix result = M;
+	add_to_dense(result, A, 1.0);
+	return result;
+}
+
+Matrix operator+(const SparseMatrix& A, const Matrix& M) {
+	return M + A;
+}
+
+Matrix operator-(const Matrix& M, const SparseMatrix& A) {
+	Matrix result = M;
+	add_to_dense(result, A, -1.0);
+	return result;
+}
+
+Matrix operator-(const SparseMatrix& A, const Matrix& M) {
+	Matrix result = M;
+	result *= -1.0;
+	add_to_dense(result, A, 1.0);
+	return result;
+}
+
+SparseBuilder::SparseBuilder(size_t rows, size_t cols) : row_count{ rows }, col_count{ cols } {
+	verify_dimensions(rows, cols);
+}
+
+void SparseBuilder::reserve(size_t count) {
+	rows.reserve(count);
+	cols.reserve(count);
+	values.reserve(count);
+}
+
+void SparseBuilder::add(size_t row, size_t col, double value) {
+	if (row >= row_count || col >= col_count) {
+		throw std::invalid_argument("Index is out of range.");
+	}
+
+	rows.push_back(row);
+	cols.push_back(col);
+	values.push_back(value);
+}
+
+size_t SparseBuilder::size() const noexcept {
+	return values.size();
+}
+
+// A counting sort buckets the triplets by row (or column), then each bucket is sorted by the
+// other index and its duplicates are summed in the order they were added.
+SparseMatrix SparseBuilder::build(SparseLayout layout) const {
+	const bool csr = layout == SparseLayout::CSR;
+	const std::vector<size_t>& majors = csr ? rows : cols;
+	const std::vector<size_t>& minors = csr ? cols : rows;
+	const size_t major_count = csr ? row_count : col_count;
+
+	std::vector<size_t> offsets(major_count + 1, 0);
+	for (const size_t major : majors) {
+		offsets[major + 1]++;
+	}
+	for (size_t r = 0; r < major_count; r++) {
+		offsets[r + 1] += offsets[r];
+	}
+
+	std::vector<std::pair<size_t, double>> entries(values.size());
+	std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < values.size(); i++) {
+		entries[next[majors[i]]++] = { minors[i], values[i] };
+	}
+
+	std::vector<size_t> indices;
+	std::vector<double> compressed;
+	indices.reserve(entries.size());
+	compressed.reserve(entries.size());
+
+	auto by_index = [](const std::pair<size_t, double>& a, const std::pair<size_t, double>& b) {
+		return a.first < b.first;
+	};
+
+	// Buckets are compacted as they are read, so each end offset is rewritten once its bucket is done.
+	size_t bucket_begin = 0;
+	for (size_t r = 0; r < major_count; r++) {
+		const size_t bucket_end = offsets[r + 1];
+		const auto first = entries.begin() + bucket_begin;
+		const auto last = entries.begin() + bucket_end;
+		std::stable_sort(first, last, by_index);
+
+		for (auto it = first; it != last;) {
+			const size_t index = it->first;
+			double sum = 0.0;
+			for (; it != last && it->first == index; ++it) {
+				sum += it->second;
+			}
+			if (sum != 0.0) {
+				indices.push_back(index);
+				compressed.push_back(sum);
+			}
+		}
+		offsets[r + 1] = indices.size();
+		bucket_begin = bucket_end;
+	}
+
+	return SparseMatrix(row_count, col_count, layout, std::move(offsets), std::move(indices), std::move(compressed));
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "Matrix.h"
+#include "Vector.h"
+
+// Compressed sparse matrices.
+//
+// Only non-zero elements are stored, grouped by row (CSR) or by column (CSC). For CSR, the
+// elements of row r are values[offsets[r]] to values[offsets[r + 1] - 1], and their columns
+// are in indices at the same positions, in increasing order. CSC is the same with rows and
+// columns swapped, so the CSR arrays of a matrix are the CSC arrays of its transpose.
+
+enum class SparseLayout { CSR, CSC };
+
+class SparseMatrix {
+	size_t row_count = 0;
+	size_t col_count = 0;
+	SparseLayout layout = SparseLayout::CSR;
+	std::vector<size_t> offsets;
+	std::vector<size_t> indices;
+	std::vector<double> values;
+
+	// Rows for CSR, columns for CSC.
+	size_t major_count() const noexcept;
+
+public:
+	// An all zero matrix.
+	SparseMatrix(size_t rows, size_t cols, SparseLayout layout = SparseLayout::CSR);
+	// Keeps the elements of M with an absolute value above tolerance.
+	explicit SparseMatrix(const Matrix& M, SparseLayout layout = SparseLayout::CSR, double tolerance = 0.0);
+	// Takes compressed arrays as described above, checking their sizes and index ranges.
+	SparseMatrix(size_t rows, size_t cols, SparseLayout layout, std::vector<size_t> offsets, std::vector<size_t> indices, std::vector<double> values);
+
+	size_t get_row_count() const noexcept;
+	size_t get_col_count() const noexcept;
+	size_t non_zero_count() const noexcept;
+	SparseLayout get_layout() const noexcept;
+
+	const std::vector<size_t>& get_offsets() const noexcept;
+	const std::vector<size_t>& get_indices() const noexcept;
+	const std::vector<double>& get_values() const noexcept;
+
+	// Same matrix in the other layout, a counting sort over the non-zeros.
+	SparseMatrix to_layout(SparseLayout target) const;
+	// Reinterprets the arrays in the other layout, no sorting needed.
+	SparseMatrix transpose() const;
+	Matrix to_dense() const;
+
+	// Binary search within the row or column, zero when the element is not stored.
+	double operator()(const size_t& row, const size_t& col) const;
+
+	SparseMatrix& operator*=(const double& number) noexcept;
+	SparseMatrix& operator/=(const double& number) noexcept;
+
+	friend bool operator==(const SparseMatrix& A, const SparseMatrix& B);
+	friend bool operator==(const SparseMatrix& A, const Matrix& M);
+
+	// Sparse results drop elements that cancel to zero.
+	friend SparseMatrix operator+(const SparseMatrix& A, const SparseMatrix& B);
+	friend SparseMatrix operator-(const SparseMatrix& A, const SparseMatrix& B);
+
+	// Multiplications run on the library thread pool, split so each thread gets a similar
+	// number of non-zeros. Results do not depend on the thread count.
+	friend Vector operator*(const SparseMatrix& A, const Vector& x);
+	friend Matrix operator*(const SparseMatrix& A, const Matrix& B);
+	friend Matrix operator*(const Matrix& A, const SparseMatrix& B);
+};
+
+SparseMatrix operator*(SparseMatrix A, const double& number) noexcept;
+SparseMatrix operator*(const double& number, SparseMatrix A) noexcept;
+SparseMatrix operator/(SparseMatrix A, const double& number) noexcept;
+SparseMatrix operator-(SparseMatrix A) noexcept;
+
+// Dense results, the sparse elements are added to a copy of M.
+Matrix operator+(const Matrix& M, const SparseMatrix& A);
+Matrix operator+(const SparseMatrix& A, const Matrix& M);
+Matrix operator-(const Matrix& M, const SparseMatrix& A);
+Matrix operator-(const SparseMatrix& A, const Matrix& M);
+
+// Collects (row, column, value) triplets in any order and compresses them. Duplicates are
+// summed and elements that end up exactly zero are dropped.
+class SparseBuilder {
+	size_t row_count;
+	size_t col_count;
+	std::vector<size_t> rows;
+	std::vector<size_t> cols;
+	std::vector<double> values;
+
+public:
+	SparseBuilder(size_t rows, size_t cols);
+
+	void reserve(size_t count);
+	void add(size_t row, size_t col, double value);
+	size_t size() const noexcept;
+
+	SparseMatrix build(SparseLayout layout = SparseLayout::CSR) const;
+};
@@ -0,0 +1,273 @@
+#include "Stats.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <mutex>
+#include <vector>
+
+namespace {
+	// Written only by the owning thread with relaxed loads and stores, which compile to plain
+	// moves, and read by snapshots from any thread.
+	struct Counter {
+		std::atomic<uint64_t> value{ 0 };
+
+		void add(uint64_t n) noexcept {
+			value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}
+
+		uint64_t get() const noexcept {
+			return value.load(std::memory_order_relaxed);
+		}
+
+		void reset() noexcept {
+			value.store(0, std::memory_order_relaxed);
+		}
+	};
+
+	struct OperationCounters {
+		Counter calls;
+		Counter allocations;
+		Counter bytes_copied;
+		Counter flops;
+		Counter nanoseconds;
+	};
+
+	void add_to(OperationStats& stats, const OperationCounters& counters) noexcept {
+		stats.calls += counters.calls.get();
+		stats.allocations += counters.allocations.get();
+		stats.bytes_copied += counters.bytes_copied.get();
+		stats.flops += counters.flops.get();
+		stats.nanoseconds += counters.nanoseconds.get();
+	}
+
+	void reset(OperationCounters& counters) noexcept {
+		counters.calls.reset();
+		counters.allocations.reset();
+		counters.bytes_copied.reset();
+		counters.flops.reset();
+		counters.nanoseconds.reset();
+	}
+
+	struct ThreadStats;
+
+	// Live threads, and the counts of threads that have exited.
+	struct Registry {
+		std::mutex mutex;
+		std::vector<ThreadStats*> threads;
+		StatsSnapshot retired;
+	};
+
+	// Never destroyed, so threads that exit during static destruction, such as the workers of the
+	// library thread pool, can still retire their counts.
+	Registry& registry() {
+		static Registry* const instance = new Registry;
+		return *instance;
+	}
+
+	struct ThreadStats {
+		std::array<OperationCounters, stats_operation_count> operations;
+		// Running totals that never reset, an OperationScope takes the difference across its life.
+		uint64_t allocations = 0;
+		uint64_t bytes_copied = 0;
+		uint64_t flops = 0;
+
+		ThreadStats() {
+			Registry& r = registry();
+			std::lock_guard lock(r.mutex);
+			r.threads.push_back(this);
+		}
+
+		~ThreadStats() {
+			Registry& r = registry();
+			std::lock_guard lock(r.mutex);
+			for (size_t i = 0; i < stats_operation_count; i++) {
+				add_to(r.retired.operations[i], operations[i]);
+			}
+			r.threads.erase(std::find(r.threads.begin(), r.threads.end(), this));
+		}
+
+		StatsSnapshot snapshot() const noexcept {
+			StatsSnapshot result;
+			for (size_t i = 0; i < stats_operation_count; i++) {
+				add_to(result.operations[i], operations[i]);
+			}
+			return result;
+		}
+
+		void reset() noexcept {
+			for (OperationCounters& counters : operations) {
+				::reset(counters);
+			}
+		}
+	};
+
+	ThreadStats& thread_stats() noexcept {
+		thread_local ThreadStats stats;
+		return stats;
+	}
+
+	constexpr const char* operation_names[stats_operation_count] = {
+		"vector_construct",
+		"vector_copy",
+		"vector_expression",
+		"vector_dot",
+		"vector_distance",
+		"matrix_construct",
+		"matrix_copy",
+		"matrix_expression",
+		"matrix_transpose",
+		"matrix_multiply",
+		"matrix_factorise",
+		"gemm",
+		"ray_query",
+		"bvh_build",
+		"bvh_query",
+		"knn_search"
+	};
+
+	void append_number(std::string& out, uint64_t value) {
+		char buffer[24];
+		const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+		out.append(buffer, result.ptr);
+	}
+
+	// Shortest form that reads back exactly.
+	void append_seconds(std::string& out, uint64_t nanoseconds) {
+		char buffer[32];
+		const auto result = std::to_chars(buffer, buffer + sizeof(buffer), static_cast<double>(nanoseconds) * 1e-9);
+		out.append(buffer, result.ptr);
+	}
+
+	struct Family {
+		const char* name;
+		const char* help;
+		uint64_t OperationStats::* field;
+	};
+
+	constexpr Family families[] = {
+		{ "mathslib_calls_total", "Calls of each operation.", &OperationStats::calls },
+		{ "mathslib_allocations_total", "Heap allocations made by each operation, inclusive.", &OperationStats::allocations },
+		{ "mathslib_bytes_copied_total", "Bytes copied by each operation, inclusive.", &OperationStats::bytes_copied },
+		{ "mathslib_flops_total", "Floating point operations of each operation, inclusive.", &OperationStats::flops },
+		{ "mathslib_seconds_total", "Wall time spent in each operation, inclusive.", &OperationStats::nanoseconds }
+	};
+}
+
+const char* stats_operation_name(StatsOperation operation) noexcept {
+	const size_t index = static_cast<size_t>(operation);
+	return index < stats_operation_count ? operation_names[index] : "unknown";
+}
+
+std::string StatsSnapshot::to_prometheus() const {
+	std::string out;
+	for (const Family& family : families) {
+		out += "# HELP ";
+		out += family.name;
+		out += ' ';
+		out += family.help;
+		out += "\n# TYPE ";
+		out += family.name;
+		out += " counter\n";
+
+		for (size_t i = 0; i < stats_operation_count; i++) {
+			out += family.name;
+			out += "{operation=\"";
+			out += operation_names[i];
+			out += "\"} ";
+			if (family.field == &OperationStats::nanoseconds) {
+				append_seconds(out, operations[i].nanoseconds);
+			}
+			else {
+				append_number(out, operations[i].*family.field);
+			}
+			out += '\n';
+		}
+	}
+	return out;
+}
+
+std::string StatsSnapshot::to_json() const {
+	std::string out = stats_enabled ? "{\"enabled\":true,\"operations\":{" : "{\"enabled\":false,\"operations\":{";
+	for (size_t i = 0; i < stats_operation_count; i++) {
+		const OperationStats& stats = operations[i];
+		if (i != 0) {
+			out += ',';
+		}
+		out += '"';
+		out += operation_names[i];
+		out += "\":{\"calls\":";
+		append_number(out, stats.calls);
+		out += ",\"allocations\":";
+		append_number(out, stats.allocations);
+		out += ",\"bytes_copied\":";
+		append_number(out, stats.bytes_copied);
+		out += ",\"flops\":";
+		append_number(out, stats.flops);
+		out += ",\"nanoseconds\":";
+		append_number(out, stats.nanoseconds);
+		out += '}';
+	}
+	out += "}}";
+	return out;
+}
+
+StatsSnapshot stats_snapshot(StatsScope scope) {
+	if (scope == StatsScope::Thread) {
+		return thread_stats().snapshot();
+	}
+
+	Registry& r = registry();
+	std::lock_guard lock(r.mutex);
+	StatsSnapshot result = r.retired;
+	for (const ThreadStats* thread : r.threads) {
+		for (size_t i = 0; i < stats_operation_count; i++) {
+			add_to(result.operations[i], thread->operations[i]);
+		}
+	}
+	return result;
+}
+
+void reset_stats(StatsScope scope) {
+	if (scope == StatsScope::Thread) {
+		thread_stats().reset();
+		return;
+	}
+
+	Registry& r = registry();
+	std::lock_guard lock(r.mutex);
+	r.retired = StatsSnapshot();
+	for (ThreadStats* thread : r.threads) {
+		thread->reset();
+	}
+}
+
+void count_allocation() noexcept {
+	thread_stats().allocations++;
+}
+
+void count_copy(size_t bytes) noexcept {
+	thread_stats().bytes_copied += bytes;
+}
+
+void count_flops(uint64_t flops) noexcept {
+	thread_stats().flops += flops;
+}
+
+OperationScope::OperationScope(StatsOperation operation) noexcept : operation{ operation } {
+	const ThreadStats& stats = thread_stats();
+	allocations = stats.allocations;
+	bytes_copied = stats.bytes_copied;
+	flops = stats.flops;
+	start = std::chrono::steady_clock::now();
+}
+
+OperationScope::~OperationScope() {
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	ThreadStats& stats = thread_stats();
+	OperationCounters& counters = stats.operations[static_cast<size_t>(operation)];
+	counters.calls.add(1);
+	counters.allocations.add(stats.allocations - allocations);
+	counters.bytes_copied.add(stats.bytes_copied - bytes_copied);
+	counters.flops.add(stats.flops - flops);
+	counters.nanoseconds.add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Opt in counters for finding where Vector, Matrix and Ray work allocates, copies and spends time.
+//
+// With MATHSLIB_STATS defined to 1 (the CMake option of the same name) every instrumented operation
+// counts its calls, heap allocations, bytes copied, floating point operations and wall time. Counters
+// belong to the calling thread and are only ever written by it, so counting is a few plain adds and
+// two clock reads, with no locks or read-modify-write atomics.
+//
+// Counts are inclusive: a Matrix product also counts the allocation of its result and the flops of
+// the gemm it calls, which are counted again under matrix_construct and gemm. Work done outside any
+// instrumented operation is not recorded.
+//
+// By default MATHSLIB_STATS is 0, the counting macros expand to nothing and snapshots are all zero.
+// The functions below are always available, so code that reads the stats builds either way.
+// Like MATHSLIB_VECTOR_INLINE_SIZE it must be the same for the library and everything using it.
+#ifndef MATHSLIB_STATS
+#define MATHSLIB_STATS 0
+#endif
+
+inline constexpr bool stats_enabled = MATHSLIB_STATS != 0;
+
+enum class StatsOperation : uint8_t {
+	VectorConstruct,
+	VectorCopy,
+	VectorExpression,
+	VectorDot,
+	VectorDistance,
+	MatrixConstruct,
+	MatrixCopy,
+	MatrixExpression,
+	MatrixTranspose,
+	MatrixMultiply,
+	MatrixFactorise,
+	Gemm,
+	RayQuery,
+	BvhBuild,
+	BvhQuery,
+	KnnSearch,
+	Count
+};
+
+inline constexpr size_t stats_operation_count = static_cast<size_t>(StatsOperation::Count);
+
+// Snake case name used in the dumps, such as "matrix_multiply".
+const char* stats_operation_name(StatsOperation operation) noexcept;
+
+struct OperationStats {
+	uint64_t calls = 0;
+	uint64_t allocations = 0;
+	uint64_t bytes_copied = 0;
+	uint64_t flops = 0;
+	uint64_t nanoseconds = 0;
+};
+
+struct StatsSnapshot {
+	std::array<OperationStats, stats_operation_count> operations{};
+
+	const OperationStats& operator[](StatsOperation operation) const noexcept {
+		return operations[static_cast<size_t>(operation)];
+	}
+
+	// Prometheus text exposition format, one counter family per field labelled by operation, with
+	// wall time in seconds.
+	std::string to_prometheus() const;
+
+	// {"enabled":true,"operations":{"vector_construct":{"calls":1,...},...}}
+	std::string to_json() const;
+};
+
+enum class StatsScope {
+	// Counters of the calling thread.
+	Thread,
+	// Every thread, including threads that have exited. Counts made by other threads while
+	// resetting may survive the reset.
+	Process
+};
+
+StatsSnapshot stats_snapshot(StatsScope scope = StatsScope::Thread);
+void reset_stats(StatsScope scope = StatsScope::Thread);
+
+// Called by the macros below.
+void count_allocation() noexcept;
+void count_copy(size_t bytes) noexcept;
+void count_flops(uint64_t flops) noexcept;
+
+// Counts one call of an operation, with everything counted on this thread until it is destroyed.
+class OperationScope {
+	StatsOperation operation;
+	uint64_t allocations;
+	uint64_t bytes_copied;
+	uint64_t flops;
+	std::chrono::steady_clock::time_point start;
+
+public:
+	explicit OperationScope(StatsOperation operation) noexcept;
+	~OperationScope();
+
+	OperationScope(const OperationScope&) = delete;
+	OperationScope& operator=(const OperationScope&) = delete;
+};
+
+// Counts a constructor from before its member initialisers run, passed as a temporary to the
+// constructor it delegates to, which it outlives:
+//     Matrix(size_t n) : Matrix(ConstructionScope(StatsOperation::MatrixConstruct), n, n) {}
+#if MATHSLIB_STATS
+using ConstructionScope = OperationScope;
+#else
+struct ConstructionScope {
+	explicit constexpr ConstructionScope(StatsOperation) noexcept {}
+};
+#endif
+
+#if MATHSLIB_STATS
+#define MATHSLIB_COUNT_OPERATION(operation) const OperationScope mathslib_operation_scope(StatsOperation::operation)
+#define MATHSLIB_COUNT_ALLOCATION() count_allocation()
+#define MATHSLIB_COUNT_COPY(bytes) count_copy(bytes)
+#define MATHSLIB_COUNT_FLOPS(flops) count_flops(flops)
+#else
+#define MATHSLIB_COUNT_OPERATION(operation) ((void)0)
+#define MATHSLIB_COUNT_ALLOCATION() ((void)0)
+#define MATHSLIB_COUNT_COPY(bytes) ((void)0)
+#define MATHSLIB_COUNT_FLOPS(flops) ((void)0)
+#endif
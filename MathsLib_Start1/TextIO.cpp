@@ -0,0 +1,353 @@
+#include "TextIO.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+	// Texts are split into chunks of about this many bytes, each parsed as one task.
+	constexpr size_t text_grain = size_t{ 1 } << 20;
+
+	// Longest shortest round trip form of a double, "-2.2250738585072014e-308", and its delimiter.
+	constexpr size_t max_formatted_length = 25;
+
+	[[noreturn]] void fail(size_t line, const std::string& reason) {
+		throw std::invalid_argument("Line " + std::to_string(line) + ": " + reason);
+	}
+
+	// Spaces and tabs around values are skipped unless the delimiter is one of them.
+	bool is_blank(char c, char delimiter) noexcept {
+		return (c == ' ' || c == '\t') && (delimiter == ' ' || c != delimiter);
+	}
+
+	// Drops trailing blank lines so a final newline does not add an empty row.
+	std::string_view trim_end(std::string_view text) noexcept {
+		while (!text.empty() && (text.back() == '\n' || text.back() == '\r' || text.back() == ' ' || text.back() == '\t')) {
+			text.remove_suffix(1);
+		}
+		return text;
+	}
+
+	// Removes the first lines of the text, returning how many it could.
+	size_t drop_lines(std::string_view& text, size_t lines) noexcept {
+		for (size_t i = 0; i < lines; i++) {
+			const size_t newline = text.find('\n');
+			if (newline == std::string_view::npos) {
+				text = {};
+				return i + 1;
+			}
+			text.remove_prefix(newline + 1);
+		}
+		return lines;
+	}
+
+	// Calls store(value) for each value of the line [p, end), which holds no newline. Whitespace
+	// delimited lines need at least one blank between values, others exactly one delimiter.
+	template <typename Store>
+	void parse_line(const char* p, const char* end, char delimiter, size_t line, Store&& store) {
+		while (p < end && is_blank(*p, delimiter)) {
+			p++;
+		}
+
+		while (p < end) {
+			// from_chars takes no leading plus.
+			if (*p == '+') {
+				p++;
+			}
+
+			double value;
+			const auto [next, error] = std::from_chars(p, end, value);
+			if (error != std::errc()) {
+				fail(line, "could not parse \"" + std::string(p, std::min<size_t>(end - p, 32)) + "\" as a number.");
+			}
+			store(value);
+
+			p = next;
+			while (p < end && is_blank(*p, delimiter)) {
+				p++;
+			}
+			if (p == end) {
+				return;
+			}
+
+			if (delimiter == ' ') {
+				if (p == next) {
+					fail(line, "expected whitespace between values.");
+				}
+			}
+			else {
+				if (*p != delimiter) {
+					fail(line, std::string("expected '") + delimiter + "' between values.");
+				}
+				p++;
+				while (p < end && is_blank(*p, delimiter)) {
+					p++;
+				}
+				if (p == end) {
+					fail(line, "missing value after the last delimiter.");
+				}
+			}
+		}
+	}
+
+	// Chunks of whole lines, the first index of each chunk followed by the end of the text, and
+	// the line number within the text of each chunk's first line.
+	struct LineChunks {
+		std::vector<size_t> begins;
+		std::vector<size_t> first_lines;
+		size_t line_count = 0;
+	};
+
+	// Chunk boundaries are the first line starts after multiples of text_grain, so they depend
+	// only on the text. Lines are counted per chunk in parallel.
+	LineChunks split_lines(std::string_view text) {
+		LineChunks chunks;
+		chunks.begins.push_back(0);
+		for (size_t next = text_grain; next < text.size(); next = chunks.begins.back() + text_grain) {
+			const size_t newline = text.find('\n', next);
+			if (newline == std::string_view::npos || newline + 1 == text.size()) {
+				break;
+			}
+			chunks.begins.push_back(newline + 1);
+		}
+		chunks.begins.push_back(text.size());
+
+		const size_t count = chunks.begins.size() - 1;
+		std::vector<size_t> newlines(count);
+		default_thread_pool().parallel_for(0, count, 1, [&](size_t chunk_begin, size_t chunk_end) {
+			for (size_t c = chunk_begin; c < chunk_end; c++) {
+				newlines[c] = static_cast<size_t>(std::count(text.begin() + chunks.begins[c], text.begin() + chunks.begins[c + 1], '\n'));
+			}
+		});
+
+		chunks.first_lines.resize(count);
+		for (size_t c = 0; c < count; c++) {
+			chunks.first_lines[c] = chunks.line_count;
+			chunks.line_count += newlines[c];
+		}
+		// The trimmed text does not end in a newline, so its last line is not counted above.
+		if (!text.empty()) {
+			chunks.line_count++;
+		}
+
+		return chunks;
+	}
+
+	// Calls body(chunk, line, p, end) for every line of every chunk, chunks in parallel and lines
+	// in order within a chunk, with any "\r" before the newline removed.
+	template <typename F>
+	void for_each_line(std::string_view text, const LineChunks& chunks, F&& body) {
+		const size_t count = chunks.begins.size() - 1;
+		default_thread_pool().parallel_for(0, count, 1, [&](size_t chunk_begin, size_t chunk_end) {
+			for (size_t c = chunk_begin; c < chunk_end; c++) {
+				size_t position = chunks.begins[c];
+				size_t line = chunks.first_lines[c];
+				const size_t chunk_end_position = chunks.begins[c + 1];
+
+				while (position < chunk_end_position) {
+					const char* p = text.data() + position;
+					const void* newline = std::memchr(p, '\n', chunk_end_position - position);
+					const char* line_end = newline != nullptr ? static_cast<const char*>(newline) : text.data() + chunk_end_position;
+					const char* content_end = line_end > p && line_end[-1] == '\r' ? line_end - 1 : line_end;
+
+					body(c, line, p, content_end);
+
+					position = static_cast<size_t>(line_end - text.data()) + 1;
+					line++;
+				}
+			}
+		});
+	}
+
+	// Appends rows of M from first_row to last_row to out.
+	void format_rows(std::string& out, ConstMatrixView M, size_t first_row, size_t last_row, char delimiter) {
+		const size_t cols = M.get_col_count();
+		out.reserve(out.size() + (last_row - first_row) * (cols * max_formatted_length + 1));
+
+		char buffer[max_formatted_length];
+		for (size_t r = first_row; r < last_row; r++) {
+			for (size_t c = 0; c < cols; c++) {
+				char* p = buffer;
+				if (c > 0) {
+					*p++ = delimiter;
+				}
+				p = std::to_chars(p, buffer + max_formatted_length, M(r, c)).ptr;
+				out.append(buffer, p);
+			}
+			out.push_back('\n');
+		}
+	}
+
+	// Rows per formatting task, roughly parallel_grain elements.
+	size_t format_block(size_t cols) noexcept {
+		return std::max<size_t>(1, parallel_grain / std::max<size_t>(1, cols));
+	}
+
+	// Formats rows [first_block * block, ...) into one string per block of rows, in parallel.
+	std::vector<std::string> format_blocks(ConstMatrixView M, size_t first_block, size_t blocks, char delimiter) {
+		const size_t rows = M.get_row_count();
+		const size_t block = format_block(M.get_col_count());
+		std::vector<std::string> texts(blocks);
+
+		default_thread_pool().parallel_for(0, blocks, 1, [&](size_t chunk_begin, size_t chunk_end) {
+			for (size_t b = chunk_begin; b < chunk_end; b++) {
+				const size_t first_row = (first_block + b) * block;
+				format_rows(texts[b], M, first_row, std::min(rows, first_row + block), delimiter);
+			}
+		});
+
+		return texts;
+	}
+}
+
+Matrix parse_matrix(std::string_view text, char delimiter, size_t skip_lines) {
+	text = trim_end(text);
+	const size_t line_offset = drop_lines(text, skip_lines);
+
+	// The first row sets the column count.
+	const size_t first_newline = std::min(text.find('\n'), text.size());
+	const char* first_end = text.data() + first_newline;
+	if (first_end > text.data() && first_end[-1] == '\r') {
+		first_end--;
+	}
+	size_t cols = 0;
+	parse_line(text.data(), first_end, delimiter, line_offset + 1, [&cols](double) {
+		cols++;
+	});
+
+	const LineChunks chunks = split_lines(text);
+	Matrix M(cols, chunks.line_count);
+	const size_t row_length = cols;
+	double* const out = M.data();
+
+	for_each_line(text, chunks, [=](size_t, size_t row, const char* p, const char* end) {
+		double* row_out = out + row * row_length;
+		size_t count = 0;
+		parse_line(p, end, delimiter, line_offset + row + 1, [&](double value) {
+			if (count == row_length) {
+				fail(line_offset + row + 1, "more than the " + std::to_string(row_length) + " values of the first row.");
+			}
+			row_out[count++] = value;
+		});
+		if (count != row_length) {
+			fail(line_offset + row + 1, std::to_string(count) + " values where the first row has " + std::to_string(row_length) + ".");
+		}
+	});
+
+	return M;
+}
+
+void parse_matrix(std::string_view text, MatrixView out, char delimiter, size_t skip_lines) {
+	text = trim_end(text);
+	const size_t line_offset = drop_lines(text, skip_lines);
+	const LineChunks chunks = split_lines(text);
+
+	const size_t cols = out.get_col_count();
+	if (chunks.line_count != out.get_row_count()) {
+		throw std::invalid_argument("Text has " + std::to_string(chunks.line_count) + " rows where the destination has " + std::to_string(out.get_row_count()) + ".");
+	}
+
+	for_each_line(text, chunks, [=](size_t, size_t row, const char* p, const char* end) {
+		size_t count = 0;
+		parse_line(p, end, delimiter, line_offset + row + 1, [&](double value) {
+			if (count == cols) {
+				fail(line_offset + row + 1, "more than the " + std::to_string(cols) + " values of the destination.");
+			}
+			out(row, count++) = value;
+		});
+		if (count != cols) {
+			fail(line_offset + row + 1, std::to_string(count) + " values where the destination has " + std::to_string(cols) + ".");
+		}
+	});
+}
+
+// Each chunk parses into its own buffer, since a chunk's first index is only known once the
+// chunks before it are counted, then the buffers are copied out in order.
+Vector parse_vector(std::string_view text, char delimiter) {
+	text = trim_end(text);
+	const LineChunks chunks = split_lines(text);
+	const size_t count = chunks.begins.size() - 1;
+	std::vector<std::vector<double>> parts(count);
+
+	for_each_line(text, chunks, [&parts, delimiter](size_t chunk, size_t line, const char* p, const char* end) {
+		parse_line(p, end, delimiter, line + 1, [&parts, chunk](double value) {
+			parts[chunk].push_back(value);
+		});
+	});
+
+	size_t total = 0;
+	for (const auto& part : parts) {
+		total += part.size();
+	}
+
+	Vector V(total);
+	double* out = V.data();
+	for (const auto& part : parts) {
+		out = std::copy(part.begin(), part.end(), out);
+	}
+	return V;
+}
+
+std::string format_matrix(ConstMatrixView M, char delimiter) {
+	const size_t block = format_block(M.get_col_count());
+	const std::vector<std::string> texts = format_blocks(M, 0, (M.get_row_count() + block - 1) / block, delimiter);
+
+	size_t total = 0;
+	for (const auto& text : texts) {
+		total += text.size();
+	}
+
+	std::string result;
+	result.reserve(total);
+	for (const auto& text : texts) {
+		result += text;
+	}
+	return result;
+}
+
+std::string format_vector(ConstVectorView V, char delimiter) {
+	return format_matrix(ConstMatrixView(V.data(), 1, V.size(), 0, V.stride()), delimiter);
+}
+
+Matrix read_csv(const std::string& path, char delimiter, size_t skip_lines) {
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file) {
+		throw std::runtime_error("Could not open " + path + " for reading.");
+	}
+
+	std::string text(static_cast<size_t>(file.tellg()), '\0');
+	file.seekg(0);
+	file.read(text.data(), static_cast<std::streamsize>(text.size()));
+	if (!file) {
+		throw std::runtime_error("Could not read " + path + ".");
+	}
+
+	return parse_matrix(text, delimiter, skip_lines);
+}
+
+// Formatted a group of blocks at a time so the text in memory stays bounded for large matrices.
+void write_csv(const std::string& path, ConstMatrixView M, char delimiter) {
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		throw std::runtime_error("Could not open " + path + " for writing.");
+	}
+
+	constexpr size_t group = 64;
+	const size_t block = format_block(M.get_col_count());
+	const size_t blocks = (M.get_row_count() + block - 1) / block;
+
+	for (size_t first = 0; first < blocks; first += group) {
+		for (const auto& text : format_blocks(M, first, std::min(group, blocks - first), delimiter)) {
+			file.write(text.data(), static_cast<std::streamsize>(text.size()));
+		}
+	}
+
+	if (!file.flush()) {
+		throw std::runtime_error("Could not write " + path + ".");
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include "Matrix.h"
+#include "MatrixView.h"
+#include "Vector.h"
+#include "VectorView.h"
+
+// Delimited text (CSV and the like) for Vector and Matrix.
+//
+// Numbers are parsed with std::from_chars and formatted with std::to_chars in their shortest
+// form that reads back to the same double, so text written here round trips exactly.
+// A Matrix is one line per row. Lines end in "\n" or "\r\n", and trailing blank lines are
+// ignored. The delimiter separates values within a row and may have spaces around it, while a
+// delimiter of ' ' accepts any run of spaces and tabs between values.
+//
+// Large texts are split into chunks of lines that are parsed or formatted on the library thread
+// pool, writing straight into the destination storage.
+//
+// Malformed numbers and rows with the wrong number of values throw std::invalid_argument,
+// naming the line.
+
+// Reads the rows and columns of the text into a Matrix, after skipping skip_lines lines such as
+// a header of column names.
+Matrix parse_matrix(std::string_view text, char delimiter = ',', size_t skip_lines = 0);
+// Parses into existing storage, which must have the dimensions of the text.
+void parse_matrix(std::string_view text, MatrixView out, char delimiter = ',', size_t skip_lines = 0);
+
+// Every value in the text in order, whatever its line structure.
+Vector parse_vector(std::string_view text, char delimiter = ',');
+
+// One line per row with a "\n" after each.
+std::string format_matrix(ConstMatrixView M, char delimiter = ',');
+// A single line with a trailing "\n".
+std::string format_vector(ConstVectorView V, char delimiter = ',');
+
+// File versions, the whole file is read into memory before parsing.
+Matrix read_csv(const std::string& path, char delimiter = ',', size_t skip_lines = 0);
+void write_csv(const std::string& path, ConstMatrixView M, char delimiter = ',');
@@ -0,0 +1,161 @@
+#include "ThreadPool.h"
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+	// The pool and worker index of the current thread, so nested work lands on the worker's own deque.
+	thread_local ThreadPool* current_pool = nullptr;
+	thread_local size_t current_index = 0;
+
+	std::mutex default_pool_mutex;
+	std::unique_ptr<ThreadPool> default_pool;
+
+	size_t initial_thread_count() {
+		if (const char* requested = std::getenv("MATHSLIB_THREADS")) {
+			try {
+				const unsigned long count = std::stoul(requested);
+				if (count > 0) {
+					return count;
+				}
+			}
+			catch (const std::exception&) {
+				// Fall back to the hardware thread count.
+			}
+		}
+
+		const unsigned int hardware = std::thread::hardware_concurrency();
+		return hardware > 0 ? hardware : 1;
+	}
+}
+
+ThreadPool::ThreadPool(size_t thread_count) {
+	const size_t worker_count = thread_count > 1 ? thread_count - 1 : 0;
+
+	queues.reserve(worker_count);
+	for (size_t i = 0; i < worker_count; i++) {
+		queues.push_back(std::make_unique<WorkQueue>());
+	}
+
+	workers.reserve(worker_count);
+	for (size_t i = 0; i < worker_count; i++) {
+		workers.emplace_back(&ThreadPool::worker_loop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+size_t ThreadPool::thread_count() const noexcept {
+	return workers.size() + 1;
+}
+
+void ThreadPool::submit(Task task) {
+	if (workers.empty()) {
+		task();
+		return;
+	}
+
+	// Workers keep their own tasks, other threads spread theirs round robin.
+	const size_t index = (current_pool == this) ? current_index : next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+
+	// Counted before it is queued so a thief can never take pending below zero.
+	pending.fetch_add(1, std::memory_order_release);
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->tasks.push_back(std::move(task));
+	}
+
+	{
+		// Taking the lock orders this against a worker checking pending before it sleeps.
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+	}
+	wake.notify_one();
+}
+
+// Own deque from the back, newest first, then steal from the front of the others, oldest first.
+bool ThreadPool::pop_task(size_t index, Task& task) {
+	{
+		WorkQueue& own = *queues[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < queues.size(); i++) {
+		WorkQueue& victim = *queues[(index + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool ThreadPool::try_run_one() {
+	if (queues.empty()) {
+		return false;
+	}
+
+	// Threads outside the pool have no deque of their own and start stealing at queue 0.
+	const size_t index = (current_pool == this) ? current_index : 0;
+
+	Task task;
+	if (!pop_task(index, task)) {
+		return false;
+	}
+
+	pending.fetch_sub(1, std::memory_order_relaxed);
+	task();
+	return true;
+}
+
+void ThreadPool::worker_loop(size_t index) {
+	current_pool = this;
+	current_index = index;
+
+	while (true) {
+		if (try_run_one()) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		wake.wait(lock, [this] { return stopping || pending.load(std::memory_order_acquire) > 0; });
+		if (stopping && pending.load(std::memory_order_acquire) == 0) {
+			return;
+		}
+	}
+}
+
+ThreadPool& default_thread_pool() {
+	std::lock_guard<std::mutex> lock(default_pool_mutex);
+	if (!default_pool) {
+		default_pool = std::make_unique<ThreadPool>(initial_thread_count());
+	}
+	return *default_pool;
+}
+
+void set_thread_count(size_t thread_count) {
+	std::lock_guard<std::mutex> lock(default_pool_mutex);
+	default_pool.reset();
+	default_pool = std::make_unique<ThreadPool>(thread_count);
+}
+
+size_t get_thread_count() {
+	return default_thread_pool().thread_count();
+}
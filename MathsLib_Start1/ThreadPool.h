@@ -0,0 +1,163 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Work stealing thread pool used to spread large operations across cores.
+//
+// Every worker owns a deque of tasks. A worker pushes and pops its own tasks at the back and,
+// when it runs dry, steals from the front of the other workers' deques. A thread waiting in
+// parallel_for runs queued tasks instead of blocking, so parallel_for may be nested.
+//
+// Library operations split their work into chunks whose boundaries depend only on the problem
+// size, never on the thread count, and each output element is written by exactly one chunk. The
+// same inputs therefore give bit identical results on any number of threads.
+
+class ThreadPool {
+public:
+	using Task = std::function<void()>;
+
+	// thread_count includes the calling thread, so 1 runs everything inline with no workers.
+	explicit ThreadPool(size_t thread_count);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t thread_count() const noexcept;
+
+	// Queues a task. Called from a worker it goes onto that worker's own deque.
+	void submit(Task task);
+
+	// Calls body(chunk_begin, chunk_end) for consecutive chunks of grain indices covering
+	// [begin, end) and returns once all of them have finished. The first exception thrown by
+	// a chunk is rethrown here after the remaining chunks complete.
+	template <typename F>
+	void parallel_for(size_t begin, size_t end, size_t grain, F&& body);
+
+private:
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::vector<std::thread> workers;
+
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	std::atomic<size_t> pending{ 0 };
+	std::atomic<size_t> next_queue{ 0 };
+	bool stopping = false;
+
+	void worker_loop(size_t index);
+
+	// Runs one queued task if there is one, preferring the caller's own deque.
+	bool try_run_one();
+	bool pop_task(size_t index, Task& task);
+};
+
+// The pool used by the library. Created on first use with MATHSLIB_THREADS threads if that
+// environment variable is set, otherwise one per hardware thread.
+ThreadPool& default_thread_pool();
+
+// Replaces the library pool. Must not be called while library operations are running.
+void set_thread_count(size_t thread_count);
+size_t get_thread_count();
+
+// Elementwise loops over fewer elements than this stay on the calling thread, and longer
+// loops are split into chunks of parallel_grain elements.
+constexpr size_t parallel_threshold = size_t{ 1 } << 16;
+constexpr size_t parallel_grain = size_t{ 1 } << 14;
+
+// Runs body(chunk_begin, chunk_end) over [0, n) on the library pool when n is large enough.
+template <typename F>
+void parallel_elementwise(size_t n, F&& body) {
+	if (n < parallel_threshold) {
+		body(size_t{ 0 }, n);
+		return;
+	}
+	default_thread_pool().parallel_for(0, n, parallel_grain, body);
+}
+
+// Matrix variant, chunks are whole rows holding roughly parallel_grain elements between them.
+template <typename F>
+void parallel_rows(size_t rows, size_t cols, F&& body) {
+	if (rows * cols < parallel_threshold) {
+		body(size_t{ 0 }, rows);
+		return;
+	}
+	default_thread_pool().parallel_for(0, rows, std::max<size_t>(1, parallel_grain / cols), body);
+}
+
+template <typename F>
+void ThreadPool::parallel_for(size_t begin, size_t end, size_t grain, F&& body) {
+	if (end <= begin) {
+		return;
+	}
+
+	if (grain == 0) {
+		grain = 1;
+	}
+
+	const size_t chunks = (end - begin + grain - 1) / grain;
+
+	// Chunks are still handed to body one at a time so the split matches the threaded path.
+	if (chunks == 1 || workers.empty()) {
+		for (size_t c = 0; c < chunks; c++) {
+			const size_t chunk_begin = begin + c * grain;
+			body(chunk_begin, chunk_begin + std::min(grain, end - chunk_begin));
+		}
+		return;
+	}
+
+	struct State {
+		std::remove_reference_t<F>* body;
+		size_t begin;
+		size_t end;
+		size_t grain;
+		std::atomic<size_t> remaining;
+		std::mutex error_mutex;
+		std::exception_ptr error;
+
+		void run(size_t c) noexcept {
+			const size_t chunk_begin = begin + c * grain;
+			try {
+				(*body)(chunk_begin, chunk_begin + std::min(grain, end - chunk_begin));
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+			remaining.fetch_sub(1, std::memory_order_acq_rel);
+		}
+	};
+
+	State state{ &body, begin, end, grain, chunks, {}, {} };
+
+	for (size_t c = 1; c < chunks; c++) {
+		submit([&state, c] { state.run(c); });
+	}
+	state.run(0);
+
+	while (state.remaining.load(std::memory_order_acquire) != 0) {
+		if (!try_run_one()) {
+			std::this_thread::yield();
+		}
+	}
+
+	if (state.error) {
+		std::rethrow_exception(state.error);
+	}
+}
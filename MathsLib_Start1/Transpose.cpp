@@ -0,0 +1,63 @@
+#include "Transpose.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+	// Tile edges in elements, measured rather than derived. The tiles stay small because every row
+	// of a power of two sized matrix maps to the same few cache sets, so a tall tile evicts itself.
+	// Swapping touches two tiles of the same matrix at once and prefers an even smaller one.
+	constexpr size_t TILE = 16;
+	constexpr size_t SWAP_TILE = 8;
+
+	// Copies the transpose of rows [r0, r1) and columns [c0, c1) of in.
+	void transpose_tile(size_t r0, size_t r1, size_t c0, size_t c1, const double* in, std::ptrdiff_t ld_in, double* out, std::ptrdiff_t ld_out) {
+		for (size_t c = c0; c < c1; c++) {
+			for (size_t r = r0; r < r1; r++) {
+				out[c * ld_out + r] = in[r * ld_in + c];
+			}
+		}
+	}
+
+	// Exchanges tile (r0, c0) with its mirror tile (c0, r0), transposing both. A diagonal tile swaps with itself.
+	void swap_tiles(size_t r0, size_t r1, size_t c0, size_t c1, double* data, std::ptrdiff_t ld) {
+		for (size_t r = r0; r < r1; r++) {
+			for (size_t c = (r0 == c0) ? r + 1 : c0; c < c1; c++) {
+				std::swap(data[r * ld + c], data[c * ld + r]);
+			}
+		}
+	}
+}
+
+void transpose(size_t rows, size_t cols, const double* in, std::ptrdiff_t ld_in, double* out, std::ptrdiff_t ld_out) {
+	// Each task owns a band of TILE rows of the output, the columns of in with the same indices.
+	const size_t bands = (cols + TILE - 1) / TILE;
+
+	parallel_rows(bands, rows * TILE, [=](size_t band_begin, size_t band_end) {
+		for (size_t band = band_begin; band < band_end; band++) {
+			const size_t c0 = band * TILE;
+			const size_t c1 = std::min(cols, c0 + TILE);
+
+			for (size_t r0 = 0; r0 < rows; r0 += TILE) {
+				transpose_tile(r0, std::min(rows, r0 + TILE), c0, c1, in, ld_in, out, ld_out);
+			}
+		}
+	});
+}
+
+void transpose_in_place(size_t n, double* data, std::ptrdiff_t ld) {
+	// Band b swaps its tiles on and right of the diagonal with their mirrors, so bands never touch the same elements.
+	const size_t bands = (n + SWAP_TILE - 1) / SWAP_TILE;
+
+	parallel_rows(bands, n * SWAP_TILE / 2, [=](size_t band_begin, size_t band_end) {
+		for (size_t band = band_begin; band < band_end; band++) {
+			const size_t r0 = band * SWAP_TILE;
+			const size_t r1 = std::min(n, r0 + SWAP_TILE);
+
+			for (size_t c0 = r0; c0 < n; c0 += SWAP_TILE) {
+				swap_tiles(r0, r1, c0, std::min(n, c0 + SWAP_TILE), data, ld);
+			}
+		}
+	});
+}
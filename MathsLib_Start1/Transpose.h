@@ -0,0 +1,15 @@
+#pragma once
+#include <cstddef>
+
+
+// Cache blocked transposes on raw row-major storage.
+//
+// Both walk the matrix in square tiles small enough that a tile of the source and a tile of the
+// destination sit in L1 together, so every cache line fetched is used in full before it is evicted.
+// ld_in and ld_out are the distances in elements between consecutive rows.
+
+// out (cols x rows) = transpose of in (rows x cols). in and out must not overlap.
+void transpose(size_t rows, size_t cols, const double* in, std::ptrdiff_t ld_in, double* out, std::ptrdiff_t ld_out);
+
+// Transposes the n x n matrix at data in place.
+void transpose_in_place(size_t n, double* data, std::ptrdiff_t ld);
@@ -1,16 +1,44 @@
-#pragma once
-
 // Definition of our vector class:
 
 // This is essentially a wrapper around std::vector that allows us to perform additional 
 // calculations as if it was a mathematical vector. Similar to valarray.
 
 #include "Vector.h"
+#include "Simd.h"
+#include "TextIO.h"
+#include "ThreadPool.h"
+
+// Constructors for the Vector class. Each delegates with a ConstructionScope, so making and
+// filling the storage is counted as part of the operation.
+Vector::Vector(const ConstructionScope&, const double* first, size_t n, std::pmr::memory_resource* resource) : internal_vector(first, n, resource) {
+	if (!internal_vector.is_inline()) {
+		MATHSLIB_COUNT_ALLOCATION();
+	}
+	MATHSLIB_COUNT_COPY(n * sizeof(double));
+}
+
+Vector::Vector(const ConstructionScope&, size_t n, std::pmr::memory_resource* resource) : internal_vector(n, 0.0, resource) {
+	if (!internal_vector.is_inline()) {
+		MATHSLIB_COUNT_ALLOCATION();
+	}
+}
+
+Vector::Vector(std::vector<double> input_vector) : Vector(ConstructionScope(StatsOperation::VectorConstruct), input_vector.data(), input_vector.size(), current_memory_resource()) {}
+
+Vector::Vector(std::initializer_list<double> input_vector) : Vector(ConstructionScope(StatsOperation::VectorConstruct), input_vector.begin(), input_vector.size(), current_memory_resource()) {}
 
-// Constructors for the Vector class.
-Vector::Vector(std::vector<double> input_vector) : internal_vector{ input_vector } { };
-Vector::Vector(std::initializer_list<double> input_vector) : internal_vector{ input_vector } { }
-Vector::Vector(size_t n) : internal_vector(std::vector<double>(n, 0.0)) { }
+Vector::Vector(size_t n) : Vector(ConstructionScope(StatsOperation::VectorConstruct), n, current_memory_resource()) {}
+
+Vector::Vector(size_t n, std::pmr::memory_resource* resource) : Vector(ConstructionScope(StatsOperation::VectorConstruct), n, resource) {}
+
+Vector::Vector(const Vector& vec) : Vector(ConstructionScope(StatsOperation::VectorCopy), vec.data(), vec.size(), current_memory_resource()) {}
+
+// The storage counts its own allocation and copy.
+Vector& Vector::operator=(const Vector& vec) {
+	MATHSLIB_COUNT_OPERATION(VectorCopy);
+	internal_vector = vec.internal_vector;
+	return *this;
+}
 
 // Calculates the Euclidean distance of the vector from the origin.
 double Vector::euclidean_length() const {
@@ -20,18 +48,19 @@ double Vector::euclidean_length() const {
 // Checks if the vector is approximately equal to the zero vector, useful helper function. Returns either true or false.
 // Default value of 0 for tolerance if no value is provided.
 bool Vector::is_zero(const double& tolerance) const noexcept {
-	for (const auto& i : internal_vector) {
-		// If any value but 0 is found then it returns false.
-		if (abs(i) > tolerance) {
-			return false;
-		};
-	}
-	return true;
+	// If any value but 0 is found then it returns false.
+	return !simd_kernels().any_abs_greater(internal_vector.data(), tolerance, internal_vector.size());
 }
 
 // Return normalised Vector object that has length of 1.
-Vector Vector::normalise() {
-	return Vector(internal_vector) / this->euclidean_length();
+Vector Vector::normalise() const & {
+	return *this / this->euclidean_length();
+}
+
+// A temporary is normalised in place.
+Vector Vector::normalise() && {
+	*this /= this->euclidean_length();
+	return std::move(*this);
 }
 
 // Calculate dot product between two vectors.
@@ -42,12 +71,9 @@ double Vector::dot_product(const Vector& vec) const
 		throw std::invalid_argument("Vectors used for dot product are not the same size.");
 	}
 
-	return std::inner_product(vec.internal_vector.begin(), vec.internal_vector.end(), internal_vector.begin(), 0.0);
-}
-
-// Returns the dimensionality of the vector.
-size_t Vector::size() const {
-	return internal_vector.size();
+	MATHSLIB_COUNT_OPERATION(VectorDot);
+	MATHSLIB_COUNT_FLOPS(2 * internal_vector.size());
+	return simd_kernels().dot(vec.internal_vector.data(), internal_vector.data(), internal_vector.size());
 }
 
 // Calculate a cross product, only works with 3D vectors.
@@ -57,13 +83,13 @@ Vector Vector::cross_product(const Vector& vec) const {
 		throw std::invalid_argument("Vectors have invalid dimensions. Only three dimensional vectors can utilise the cross product operator.");
 	}
 
-	std::vector<double> tmp_array;
+	Vector result(3);
 
-	tmp_array.push_back((internal_vector[1] * vec[2] - internal_vector[2] * vec[1]));
-	tmp_array.push_back((internal_vector[2] * vec[0] - internal_vector[0] * vec[2]));
-	tmp_array.push_back((internal_vector[0] * vec[1] - internal_vector[1] * vec[0]));
+	result[0] = internal_vector[1] * vec[2] - internal_vector[2] * vec[1];
+	result[1] = internal_vector[2] * vec[0] - internal_vector[0] * vec[2];
+	result[2] = internal_vector[0] * vec[1] - internal_vector[1] * vec[0];
 
-	return Vector(tmp_array);
+	return result;
 }
 
 double Vector::distance(const Vector& vec) const {
@@ -71,42 +97,32 @@ double Vector::distance(const Vector& vec) const {
 		throw std::invalid_argument("Vectors have invalid dimensions.");
 	}
 
-	const Vector tmp_vec = Vector(internal_vector) - vec;
-
-	return tmp_vec.euclidean_length();
+	MATHSLIB_COUNT_OPERATION(VectorDistance);
+	MATHSLIB_COUNT_FLOPS(3 * internal_vector.size());
+	return sqrt(simd_kernels().squared_distance(internal_vector.data(), vec.internal_vector.data(), internal_vector.size()));
 }
 
+// Formatted in one go and written without flushing.
 void Vector::print() const noexcept {
-
-	for (const auto& i : internal_vector) {
-		std::cout << i << " ";
-	}
-	std::cout << std::endl << std::endl;
+	const std::string text = format_vector(view(), ' ') + "\n";
+	std::cout.write(text.data(), static_cast<std::streamsize>(text.size()));
 }
 
 
 std::vector<double> Vector::get_internal_storage() const noexcept {
-	return internal_vector;
+	return std::vector<double>(internal_vector.begin(), internal_vector.end());
 }
 
-double& Vector::operator[](const size_t& index) {
-	return internal_vector[index];
+double* Vector::data() noexcept {
+	return internal_vector.data();
 }
 
-const double& Vector::operator[](const size_t& index) const {
-	return internal_vector[index];
+const double* Vector::data() const noexcept {
+	return internal_vector.data();
 }
 
-Vector Vector::operator+(const Vector& vec) const {
-	if (vec.size() != this->size()) {
-		throw std::invalid_argument("Vectors have invalid dimensions.");
-	}
-
-	// Add the two vectors together and instantiate a new Vector object to return.
-	std::vector<double> result = internal_vector;
-	std::transform(result.begin(), result.end(), vec.internal_vector.begin(), result.begin(), std::plus<>());
-
-	return Vector(result);
+std::pmr::memory_resource* Vector::get_memory_resource() const noexcept {
+	return internal_vector.get_resource();
 }
 
 bool Vector::operator==(const Vector& vec) const {
@@ -117,35 +133,66 @@ bool Vector::operator==(const Vector& vec) const {
 	return internal_vector == vec.internal_vector;
 }
 
-Vector Vector::operator-(const Vector& vec) const {
+Vector& Vector::operator+=(const Vector& vec) {
 	if (vec.size() != this->size()) {
 		throw std::invalid_argument("Vectors have invalid dimensions.");
 	}
 
-	// Subtract the two vectors together and instantiate a new Vector object to return.
-	std::vector<double> result = internal_vector;
-	std::transform(result.begin(), result.end(), vec.internal_vector.begin(), result.begin(), std::minus<>());
-
-	return Vector(result);
+	double* out = internal_vector.data();
+	const double* in = vec.internal_vector.data();
+	parallel_elementwise(size(), [out, in](size_t begin, size_t end) {
+		simd_kernels().add(out + begin, in + begin, out + begin, end - begin);
+	});
+	return *this;
 }
 
-Vector Vector::operator*(const double& number) const noexcept {
+Vector& Vector::operator-=(const Vector& vec) {
+	if (vec.size() != this->size()) {
+		throw std::invalid_argument("Vectors have invalid dimensions.");
+	}
+
+	double* out = internal_vector.data();
+	const double* in = vec.internal_vector.data();
+	parallel_elementwise(size(), [out, in](size_t begin, size_t end) {
+		simd_kernels().subtract(out + begin, in + begin, out + begin, end - begin);
+	});
+	return *this;
+}
 
-	std::vector<double> result = internal_vector;
-	std::transform(result.begin(), result.end(), result.begin(), [number](const auto& i) { return number * i;  });
+Vector& Vector::operator*=(const double& number) noexcept {
+	double* out = internal_vector.data();
+	parallel_elementwise(size(), [out, number](size_t begin, size_t end) {
+		simd_kernels().scale(out + begin, number, out + begin, end - begin);
+	});
+	return *this;
+}
 
-	return Vector(result);
+// Multiplies by the reciprocal, matching operator/.
+Vector& Vector::operator/=(const double& number) noexcept {
+	return *this *= (1.0 / number);
 }
 
-Vector Vector::operator/(const double& number) const noexcept {
-	return Vector(internal_vector) * (1.0 / number);
+// Expression fast paths, each maps directly onto one SIMD kernel.
+void evaluate_expression(const VectorBinaryExpression<Vector, Vector, ExpressionAdd>& expression, double* out) {
+	const double* a = expression.left().data();
+	const double* b = expression.right().data();
+	parallel_elementwise(expression.size(), [a, b, out](size_t begin, size_t end) {
+		simd_kernels().add(a + begin, b + begin, out + begin, end - begin);
+	});
 }
 
-Vector Vector::operator-() const noexcept {
-	return Vector(internal_vector) * -1;
+void evaluate_expression(const VectorBinaryExpression<Vector, Vector, ExpressionSubtract>& expression, double* out) {
+	const double* a = expression.left().data();
+	const double* b = expression.right().data();
+	parallel_elementwise(expression.size(), [a, b, out](size_t begin, size_t end) {
+		simd_kernels().subtract(a + begin, b + begin, out + begin, end - begin);
+	});
 }
 
-// Friend method for operator overloading.
-Vector operator*(const double& number, Vector vec) noexcept {
-	return vec * number;
+void evaluate_expression(const VectorScaleExpression<Vector>& expression, double* out) {
+	const double* a = expression.inner().data();
+	const double number = expression.scale();
+	parallel_elementwise(expression.size(), [a, number, out](size_t begin, size_t end) {
+		simd_kernels().scale(a + begin, number, out + begin, end - begin);
+	});
 }
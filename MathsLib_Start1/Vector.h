@@ -1,31 +1,80 @@
 #pragma once
 #include <vector>
+#include <memory_resource>
 #include <cmath>
 #include <stdexcept>
 #include <numeric>
 #include <algorithm>
 #include <iostream>
+#include <utility>
+#include "VectorExpression.h"
+#include "VectorView.h"
+#include "MemoryResource.h"
+#include "Stats.h"
+#include "VectorStorage.h"
 
 
-class Vector {
-	std::vector<double> internal_vector;
+class Vector : public VectorExpression<Vector> {
+	VectorStorage internal_vector;
+
+	// Targets of the public constructors, which count the operation from before the storage is made.
+	Vector(const ConstructionScope&, const double* first, size_t n, std::pmr::memory_resource* resource);
+	Vector(const ConstructionScope&, size_t n, std::pmr::memory_resource* resource);
 public:
 
-	// Constructors.
+	// Constructors. Up to VectorStorage::inline_capacity elements are stored inline, longer
+	// vectors allocate from current_memory_resource() unless a resource is given.
 	Vector(std::vector<double> input_vector);
 	Vector(std::initializer_list<double> input_vector);
 	explicit Vector(size_t n);
+	Vector(size_t n, std::pmr::memory_resource* resource);
+
+	// Copies allocate from the current resource, moves keep the storage and its resource.
+	Vector(const Vector& vec);
+	Vector(Vector&& vec) noexcept = default;
+	Vector& operator=(const Vector& vec);
+	Vector& operator=(Vector&& vec) = default;
+
+	// Evaluates a lazy expression such as a + b * 2.0 in a single pass.
+	template <typename E>
+	Vector(const VectorExpression<E>& expression);
+	template <typename E>
+	Vector& operator=(const VectorExpression<E>& expression);
 
 	double euclidean_length() const;
 	bool is_zero(const double& tolerance = 0) const noexcept;
-	Vector normalise();
+	Vector normalise() const &;
+	Vector normalise() &&;
 	double dot_product(const Vector& vec) const;
-	size_t size() const;
+	template <typename T>
+	double dot_product(const BasicVectorView<T>& vec) const {
+		return view().dot_product(vec);
+	}
+	size_t size() const {
+		return internal_vector.size();
+	}
 	Vector cross_product(const Vector& vec) const;
 	double distance(const Vector& vec) const;
 	void print() const noexcept;
 
 	std::vector<double> get_internal_storage() const noexcept;
+	double* data() noexcept;
+	const double* data() const noexcept;
+	std::pmr::memory_resource* get_memory_resource() const noexcept;
+
+	// Zero-copy views of the storage, valid until the vector is resized or destroyed.
+	VectorView view() noexcept {
+		return VectorView(internal_vector.data(), internal_vector.size());
+	}
+
+	ConstVectorView view() const noexcept {
+		return ConstVectorView(internal_vector.data(), internal_vector.size());
+	}
+
+	// Whether reading this vector while writing target could read an overwritten element, see VectorExpression.h.
+	bool aliases(const ConstVectorView& target) const noexcept {
+		return view().aliases(target);
+	}
 
 	// Iterators. Templates (auto) in header only.
 	auto begin() const {
@@ -36,16 +85,153 @@ public:
 		return internal_vector.end();
 	}
 
-	// Operator overloads.
-	double& operator[](const size_t& index);
-	const double& operator[](const size_t& index) const;
+	// Operator overloads. Element access is inline so fused expressions can vectorise.
+	double& operator[](const size_t& index) {
+		return internal_vector[index];
+	}
+
+	const double& operator[](const size_t& index) const {
+		return internal_vector[index];
+	}
+
 	bool operator==(const Vector& _vec) const;
-	Vector operator+(const Vector& _vec) const;
-	Vector operator-(const Vector& _vec) const;
-	Vector operator*(const double& number) const noexcept;
-	Vector operator/(const double& number) const noexcept;
-	Vector operator-() const noexcept;
 
-	friend Vector operator*(const double& number, Vector _vec) noexcept;
+	// Compound assignment, updates the existing storage in place.
+	Vector& operator+=(const Vector& vec);
+	Vector& operator-=(const Vector& vec);
+	template <typename E>
+	Vector& operator+=(const VectorExpression<E>& expression);
+	template <typename E>
+	Vector& operator-=(const VectorExpression<E>& expression);
+	Vector& operator*=(const double& number) noexcept;
+	Vector& operator/=(const double& number) noexcept;
 };
 
+// Single SIMD kernel fast paths for the simplest expressions, see VectorExpression.h.
+void evaluate_expression(const VectorBinaryExpression<Vector, Vector, ExpressionAdd>& expression, double* out);
+void evaluate_expression(const VectorBinaryExpression<Vector, Vector, ExpressionSubtract>& expression, double* out);
+void evaluate_expression(const VectorScaleExpression<Vector>& expression, double* out);
+
+template <typename E>
+Vector::Vector(const VectorExpression<E>& expression) : internal_vector(current_memory_resource()) {
+	*this = expression;
+}
+
+// Elementwise expressions read index i just before writing index i, so an operand laid out like the
+// target, as v is in v = v * 2.0, is evaluated in place. Operands that overlap the target any other
+// way, such as a reversed or shifted view of it, are evaluated into new storage, which also keeps
+// them valid when the size changes.
+template <typename E>
+Vector& Vector::operator=(const VectorExpression<E>& expression) {
+	MATHSLIB_COUNT_OPERATION(VectorExpression);
+	const E& source = expression.self();
+	if (source.aliases(ConstVectorView(internal_vector.data(), source.size()))) {
+		Vector result(source.size(), get_memory_resource());
+		evaluate_expression(source, result.data());
+		return *this = std::move(result);
+	}
+
+	internal_vector.resize(source.size());
+	evaluate_expression(source, internal_vector.data());
+	return *this;
+}
+
+
+template <typename E>
+Vector& Vector::operator+=(const VectorExpression<E>& expression) {
+	const E& source = expression.self();
+	if (source.size() != size()) {
+		throw std::invalid_argument("Vectors have invalid dimensions.");
+	}
+	if (source.aliases(view())) {
+		return *this += Vector(source);
+	}
+
+	double* out = internal_vector.data();
+	parallel_elementwise(size(), [&source, out](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			out[i] += source[i];
+		}
+	});
+	return *this;
+}
+
+template <typename E>
+Vector& Vector::operator-=(const VectorExpression<E>& expression) {
+	const E& source = expression.self();
+	if (source.size() != size()) {
+		throw std::invalid_argument("Vectors have invalid dimensions.");
+	}
+	if (source.aliases(view())) {
+		return *this -= Vector(source);
+	}
+
+	double* out = internal_vector.data();
+	parallel_elementwise(size(), [&source, out](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			out[i] -= source[i];
+		}
+	});
+	return *this;
+}
+
+// Compares in place, otherwise vec == view would also match Vector == Vector by converting the view.
+template <typename E>
+bool operator==(const Vector& vec, const VectorExpression<E>& expression) {
+	return vector_expressions_equal(vec, expression);
+}
+
+// A Vector that is about to be destroyed donates its storage to the result instead of a new allocation.
+template <typename E>
+Vector operator+(Vector&& lhs, const VectorExpression<E>& rhs) {
+	lhs += rhs.self();
+	return std::move(lhs);
+}
+
+template <typename E>
+Vector operator+(const VectorExpression<E>& lhs, Vector&& rhs) {
+	rhs += lhs.self();
+	return std::move(rhs);
+}
+
+inline Vector operator+(Vector&& lhs, Vector&& rhs) {
+	lhs += rhs;
+	return std::move(lhs);
+}
+
+template <typename E>
+Vector operator-(Vector&& lhs, const VectorExpression<E>& rhs) {
+	lhs -= rhs.self();
+	return std::move(lhs);
+}
+
+template <typename E>
+Vector operator-(const VectorExpression<E>& lhs, Vector&& rhs) {
+	rhs = lhs.self() - rhs;
+	return std::move(rhs);
+}
+
+inline Vector operator-(Vector&& lhs, Vector&& rhs) {
+	lhs -= rhs;
+	return std::move(lhs);
+}
+
+inline Vector operator*(Vector&& vec, const double& number) noexcept {
+	vec *= number;
+	return std::move(vec);
+}
+
+inline Vector operator*(const double& number, Vector&& vec) noexcept {
+	vec *= number;
+	return std::move(vec);
+}
+
+inline Vector operator/(Vector&& vec, const double& number) noexcept {
+	vec /= number;
+	return std::move(vec);
+}
+
+inline Vector operator-(Vector&& vec) noexcept {
+	vec *= -1.0;
+	return std::move(vec);
+}
@@ -0,0 +1,181 @@
+#pragma once
+#include <cstddef>
+#include <stdexcept>
+#include "ThreadPool.h"
+
+// Expression templates for Vector arithmetic.
+//
+// a + b * 2.0 - c does not compute anything on its own, each operator returns a small node that
+// records its operands. The whole tree is evaluated element by element in a single pass when it
+// is converted or assigned to a Vector, so no intermediate Vector is ever created. Nodes refer to
+// Vector operands by reference: keep expressions as temporaries and do not store them with auto.
+//
+// Every node answers aliases(target), whether evaluating it while writing target could read an
+// element already overwritten (see strided_alias in VectorView.h). Assignment evaluates such
+// expressions into new storage first.
+
+class Vector;
+template <typename T>
+class BasicVectorView;
+
+// Base of every vector expression, E is the concrete node type.
+template <typename E>
+class VectorExpression {
+public:
+	const E& self() const noexcept {
+		return static_cast<const E&>(*this);
+	}
+};
+
+// How a node holds an operand, containers by reference and other nodes by value.
+template <typename E>
+struct VectorOperand {
+	using type = const E;
+};
+
+template <>
+struct VectorOperand<Vector> {
+	using type = const Vector&;
+};
+
+struct ExpressionAdd {
+	static double apply(const double& a, const double& b) noexcept {
+		return a + b;
+	}
+};
+
+struct ExpressionSubtract {
+	static double apply(const double& a, const double& b) noexcept {
+		return a - b;
+	}
+};
+
+// Elementwise lhs Op rhs.
+template <typename L, typename R, typename Op>
+class VectorBinaryExpression : public VectorExpression<VectorBinaryExpression<L, R, Op>> {
+	typename VectorOperand<L>::type lhs;
+	typename VectorOperand<R>::type rhs;
+
+public:
+	VectorBinaryExpression(const L& lhs, const R& rhs) : lhs{ lhs }, rhs{ rhs } {
+		if (lhs.size() != rhs.size()) {
+			throw std::invalid_argument("Vectors have invalid dimensions.");
+		}
+	}
+
+	size_t size() const noexcept {
+		return lhs.size();
+	}
+
+	double operator[](const size_t& index) const {
+		return Op::apply(lhs[index], rhs[index]);
+	}
+
+	bool aliases(const BasicVectorView<const double>& target) const noexcept {
+		return lhs.aliases(target) || rhs.aliases(target);
+	}
+
+	const L& left() const noexcept {
+		return lhs;
+	}
+
+	const R& right() const noexcept {
+		return rhs;
+	}
+};
+
+// Every element multiplied by a constant.
+template <typename E>
+class VectorScaleExpression : public VectorExpression<VectorScaleExpression<E>> {
+	typename VectorOperand<E>::type operand;
+	double number;
+
+public:
+	VectorScaleExpression(const E& operand, const double& number) noexcept : operand{ operand }, number{ number } { }
+
+	size_t size() const noexcept {
+		return operand.size();
+	}
+
+	double operator[](const size_t& index) const {
+		return operand[index] * number;
+	}
+
+	bool aliases(const BasicVectorView<const double>& target) const noexcept {
+		return operand.aliases(target);
+	}
+
+	const E& inner() const noexcept {
+		return operand;
+	}
+
+	double scale() const noexcept {
+		return number;
+	}
+};
+
+// Fallback evaluation, one fused loop over the whole expression, split across threads for long
+// vectors. Simple shapes that map onto a single SIMD kernel have non-template overloads in Vector.h.
+template <typename E>
+void evaluate_expression(const E& expression, double* out) {
+	parallel_elementwise(expression.size(), [&expression, out](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			out[i] = expression[i];
+		}
+	});
+}
+
+// Elementwise comparison of any two vector expressions. Like Vector == Vector, comparing
+// different sizes throws.
+template <typename L, typename R>
+bool vector_expressions_equal(const VectorExpression<L>& lhs, const VectorExpression<R>& rhs) {
+	const L& a = lhs.self();
+	const R& b = rhs.self();
+
+	if (a.size() != b.size()) {
+		throw std::invalid_argument("Vectors have invalid dimensions.");
+	}
+
+	for (size_t i = 0; i < a.size(); i++) {
+		if (a[i] != b[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template <typename L, typename R>
+bool operator==(const VectorExpression<L>& lhs, const VectorExpression<R>& rhs) {
+	return vector_expressions_equal(lhs, rhs);
+}
+
+// Operator overloads, all lazy.
+template <typename L, typename R>
+VectorBinaryExpression<L, R, ExpressionAdd> operator+(const VectorExpression<L>& lhs, const VectorExpression<R>& rhs) {
+	return VectorBinaryExpression<L, R, ExpressionAdd>(lhs.self(), rhs.self());
+}
+
+template <typename L, typename R>
+VectorBinaryExpression<L, R, ExpressionSubtract> operator-(const VectorExpression<L>& lhs, const VectorExpression<R>& rhs) {
+	return VectorBinaryExpression<L, R, ExpressionSubtract>(lhs.self(), rhs.self());
+}
+
+template <typename E>
+VectorScaleExpression<E> operator*(const VectorExpression<E>& vec, const double& number) noexcept {
+	return VectorScaleExpression<E>(vec.self(), number);
+}
+
+template <typename E>
+VectorScaleExpression<E> operator*(const double& number, const VectorExpression<E>& vec) noexcept {
+	return VectorScaleExpression<E>(vec.self(), number);
+}
+
+template <typename E>
+VectorScaleExpression<E> operator/(const VectorExpression<E>& vec, const double& number) noexcept {
+	return VectorScaleExpression<E>(vec.self(), 1.0 / number);
+}
+
+template <typename E>
+VectorScaleExpression<E> operator-(const VectorExpression<E>& vec) noexcept {
+	return VectorScaleExpression<E>(vec.self(), -1.0);
+}
@@ -0,0 +1,108 @@
+#include "VectorStorage.h"
+#include <algorithm>
+#include <utility>
+
+VectorStorage::VectorStorage(std::pmr::memory_resource* resource) noexcept : elements{ inline_buffer }, resource{ resource } { }
+
+VectorStorage::VectorStorage(size_t n, double value, std::pmr::memory_resource* resource) : VectorStorage(resource) {
+	reserve_discard(n);
+	std::fill_n(elements, n, value);
+	count = n;
+}
+
+VectorStorage::VectorStorage(const double* first, size_t n, std::pmr::memory_resource* resource) : VectorStorage(resource) {
+	reserve_discard(n);
+	std::copy_n(first, n, elements);
+	count = n;
+}
+
+VectorStorage::VectorStorage(const VectorStorage& other, std::pmr::memory_resource* resource) : VectorStorage(other.elements, other.count, resource) { }
+
+// Takes over a heap buffer, inline elements are copied across.
+VectorStorage::VectorStorage(VectorStorage&& other) noexcept : elements{ inline_buffer }, count{ other.count }, resource{ other.resource } {
+	if (other.on_heap()) {
+		elements = std::exchange(other.elements, other.inline_buffer);
+		capacity = std::exchange(other.capacity, inline_capacity);
+	}
+	else {
+		std::copy_n(other.elements, other.count, elements);
+	}
+	other.count = 0;
+}
+
+VectorStorage& VectorStorage::operator=(const VectorStorage& other) {
+	if (this != &other) {
+		if (other.count > capacity) {
+			MATHSLIB_COUNT_ALLOCATION();
+		}
+		MATHSLIB_COUNT_COPY(other.count * sizeof(double));
+		reserve_discard(other.count);
+		std::copy_n(other.elements, other.count, elements);
+		count = other.count;
+	}
+	return *this;
+}
+
+VectorStorage& VectorStorage::operator=(VectorStorage&& other) {
+	if (this == &other) {
+		return *this;
+	}
+
+	// A heap buffer can only change hands between storages sharing a resource.
+	if (other.on_heap() && *resource == *other.resource) {
+		deallocate();
+		elements = std::exchange(other.elements, other.inline_buffer);
+		capacity = std::exchange(other.capacity, inline_capacity);
+		count = std::exchange(other.count, 0);
+		return *this;
+	}
+
+	*this = std::as_const(other);
+	return *this;
+}
+
+VectorStorage::~VectorStorage() {
+	deallocate();
+}
+
+void VectorStorage::deallocate() noexcept {
+	if (on_heap()) {
+		resource->deallocate(elements, capacity * sizeof(double), alignof(double));
+		elements = inline_buffer;
+		capacity = inline_capacity;
+	}
+}
+
+void VectorStorage::reserve_discard(size_t n) {
+	if (n <= capacity) {
+		return;
+	}
+
+	// Allocated before the old buffer is released so a failure leaves the storage unchanged.
+	double* buffer = static_cast<double*>(resource->allocate(n * sizeof(double), alignof(double)));
+	deallocate();
+	elements = buffer;
+	capacity = n;
+	count = 0;
+}
+
+void VectorStorage::resize(size_t n) {
+	if (n > capacity) {
+		MATHSLIB_COUNT_ALLOCATION();
+		MATHSLIB_COUNT_COPY(count * sizeof(double));
+		double* buffer = static_cast<double*>(resource->allocate(n * sizeof(double), alignof(double)));
+		std::copy_n(elements, count, buffer);
+		deallocate();
+		elements = buffer;
+		capacity = n;
+	}
+
+	if (n > count) {
+		std::fill(elements + count, elements + n, 0.0);
+	}
+	count = n;
+}
+
+bool VectorStorage::operator==(const VectorStorage& other) const noexcept {
+	return std::equal(begin(), end(), other.begin(), other.end());
+}
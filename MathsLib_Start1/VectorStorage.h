@@ -0,0 +1,99 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+#include "Stats.h"
+
+// Vectors up to this many elements keep them inline, larger ones spill to the memory resource.
+// Changes the layout of Vector, so it must be the same for the library and everything using it.
+#ifndef MATHSLIB_VECTOR_INLINE_SIZE
+#define MATHSLIB_VECTOR_INLINE_SIZE 8
+#endif
+
+// Contiguous doubles with small buffer optimisation, the storage behind Vector.
+//
+// Up to inline_capacity elements live inside the object and never allocate. Beyond that they
+// are allocated from the memory resource given on construction, which the storage keeps for
+// its whole life like a std::pmr::vector: copy and move assignment reuse it, and moving from
+// storage with another resource copies the elements instead of taking the buffer.
+class VectorStorage {
+public:
+	static constexpr size_t inline_capacity = MATHSLIB_VECTOR_INLINE_SIZE;
+
+private:
+	// Declared first so it exists before elements points into it. Never empty, so elements is never null.
+	double inline_buffer[inline_capacity > 0 ? inline_capacity : 1];
+	double* elements;
+	size_t count = 0;
+	size_t capacity = inline_capacity;
+	std::pmr::memory_resource* resource;
+
+	bool on_heap() const noexcept {
+		return capacity > inline_capacity;
+	}
+
+	// Makes room for n elements, discarding the current ones.
+	void reserve_discard(size_t n);
+	void deallocate() noexcept;
+
+public:
+	explicit VectorStorage(std::pmr::memory_resource* resource) noexcept;
+	VectorStorage(size_t n, double value, std::pmr::memory_resource* resource);
+	VectorStorage(const double* first, size_t n, std::pmr::memory_resource* resource);
+	VectorStorage(const VectorStorage& other, std::pmr::memory_resource* resource);
+
+	// Copies choose their resource explicitly, see the constructor above.
+	VectorStorage(const VectorStorage& other) = delete;
+	VectorStorage(VectorStorage&& other) noexcept;
+	VectorStorage& operator=(const VectorStorage& other);
+	VectorStorage& operator=(VectorStorage&& other);
+	~VectorStorage();
+
+	// New elements are zero, existing ones up to the new size are kept.
+	void resize(size_t n);
+
+	std::pmr::memory_resource* get_resource() const noexcept {
+		return resource;
+	}
+
+	bool is_inline() const noexcept {
+		return !on_heap();
+	}
+
+	size_t size() const noexcept {
+		return count;
+	}
+
+	double* data() noexcept {
+		return elements;
+	}
+
+	const double* data() const noexcept {
+		return elements;
+	}
+
+	double* begin() noexcept {
+		return elements;
+	}
+
+	double* end() noexcept {
+		return elements + count;
+	}
+
+	const double* begin() const noexcept {
+		return elements;
+	}
+
+	const double* end() const noexcept {
+		return elements + count;
+	}
+
+	double& operator[](const size_t& index) noexcept {
+		return elements[index];
+	}
+
+	const double& operator[](const size_t& index) const noexcept {
+		return elements[index];
+	}
+
+	bool operator==(const VectorStorage& other) const noexcept;
+};
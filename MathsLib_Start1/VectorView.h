@@ -0,0 +1,270 @@
+#pragma once
+#include "VectorExpression.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Non-owning, strided views of vector data.
+//
+// A view is a pointer, a length and a stride in elements, so it can look at a Vector, a row or
+// column of a Matrix, or memory owned by someone else such as a numpy buffer or a mapped file,
+// without copying. Views take part in vector expressions like any Vector. Assigning to a view
+// writes through to the elements it refers to, it never rebinds the view.
+
+// Random access iterator stepping a fixed number of elements at a time.
+template <typename T>
+class StridedIterator {
+	T* element;
+	std::ptrdiff_t stride;
+
+public:
+	using iterator_category = std::random_access_iterator_tag;
+	using value_type = std::remove_const_t<T>;
+	using difference_type = std::ptrdiff_t;
+	using reference = T&;
+	using pointer = T*;
+
+	StridedIterator() noexcept : element{ nullptr }, stride{ 1 } { }
+	StridedIterator(T* element, std::ptrdiff_t stride) noexcept : element{ element }, stride{ stride } { }
+
+	reference operator*() const noexcept {
+		return *element;
+	}
+
+	reference operator[](difference_type n) const noexcept {
+		return element[n * stride];
+	}
+
+	StridedIterator& operator++() noexcept {
+		element += stride;
+		return *this;
+	}
+
+	StridedIterator operator++(int) noexcept {
+		StridedIterator tmp = *this;
+		element += stride;
+		return tmp;
+	}
+
+	StridedIterator& operator--() noexcept {
+		element -= stride;
+		return *this;
+	}
+
+	StridedIterator operator--(int) noexcept {
+		StridedIterator tmp = *this;
+		element -= stride;
+		return tmp;
+	}
+
+	StridedIterator& operator+=(difference_type n) noexcept {
+		element += n * stride;
+		return *this;
+	}
+
+	StridedIterator& operator-=(difference_type n) noexcept {
+		element -= n * stride;
+		return *this;
+	}
+
+	friend StridedIterator operator+(StridedIterator it, difference_type n) noexcept {
+		return it += n;
+	}
+
+	friend StridedIterator operator-(StridedIterator it, difference_type n) noexcept {
+		return it -= n;
+	}
+
+	friend difference_type operator-(const StridedIterator& a, const StridedIterator& b) noexcept {
+		return (a.element - b.element) / a.stride;
+	}
+
+	friend bool operator==(const StridedIterator& a, const StridedIterator& b) noexcept {
+		return a.element == b.element;
+	}
+
+	friend bool operator<(const StridedIterator& a, const StridedIterator& b) noexcept {
+		return a.stride > 0 ? a.element < b.element : a.element > b.element;
+	}
+};
+
+// Whether reading the rows x cols elements at source while writing the same shape at target, in
+// any order, could read an element after it has been overwritten. The same layout reads each
+// element just before writing it, any other overlap of the two address ranges counts. Vectors
+// pass one column.
+inline bool strided_alias(const double* source, std::ptrdiff_t source_rs, std::ptrdiff_t source_cs,
+	const double* target, std::ptrdiff_t target_rs, std::ptrdiff_t target_cs, size_t rows, size_t cols) noexcept {
+	if (rows == 0 || cols == 0 || (source == target && source_rs == target_rs && source_cs == target_cs)) {
+		return false;
+	}
+
+	const std::ptrdiff_t last_row = static_cast<std::ptrdiff_t>(rows - 1);
+	const std::ptrdiff_t last_col = static_cast<std::ptrdiff_t>(cols - 1);
+	const auto low = [=](const double* data, std::ptrdiff_t rs, std::ptrdiff_t cs) {
+		return data + std::min<std::ptrdiff_t>(last_row * rs, 0) + std::min<std::ptrdiff_t>(last_col * cs, 0);
+	};
+	const auto high = [=](const double* data, std::ptrdiff_t rs, std::ptrdiff_t cs) {
+		return data + std::max<std::ptrdiff_t>(last_row * rs, 0) + std::max<std::ptrdiff_t>(last_col * cs, 0);
+	};
+
+	const std::less<const double*> less;
+	return !less(high(source, source_rs, source_cs), low(target, target_rs, target_cs))
+		&& !less(high(target, target_rs, target_cs), low(source, source_rs, source_cs));
+}
+
+// The elements of an expression copied out, for assigning one that reads elements of its target.
+template <typename E>
+std::vector<double> evaluated_copy(const VectorExpression<E>& expression) {
+	std::vector<double> values(expression.self().size());
+	evaluate_expression(expression.self(), values.data());
+	return values;
+}
+
+// T is double for a writable view and const double for a read only one.
+template <typename T>
+class BasicVectorView : public VectorExpression<BasicVectorView<T>> {
+	T* view_data;
+	size_t length;
+	std::ptrdiff_t view_stride;
+
+public:
+	// Wraps length elements starting at data, stride elements apart.
+	BasicVectorView(T* data, size_t length, std::ptrdiff_t stride = 1) noexcept : view_data{ data }, length{ length }, view_stride{ stride } { }
+
+	BasicVectorView(const BasicVectorView&) = default;
+
+	// A writable view can be used wherever a read only view is expected.
+	operator BasicVectorView<const T>() const noexcept requires (!std::is_const_v<T>) {
+		return BasicVectorView<const T>(view_data, length, view_stride);
+	}
+
+	size_t size() const noexcept {
+		return length;
+	}
+
+	std::ptrdiff_t stride() const noexcept {
+		return view_stride;
+	}
+
+	T* data() const noexcept {
+		return view_data;
+	}
+
+	bool is_contiguous() const noexcept {
+		return view_stride == 1 || length <= 1;
+	}
+
+	StridedIterator<T> begin() const noexcept {
+		return StridedIterator<T>(view_data, view_stride);
+	}
+
+	StridedIterator<T> end() const noexcept {
+		return StridedIterator<T>(view_data + static_cast<std::ptrdiff_t>(length) * view_stride, view_stride);
+	}
+
+	T& operator[](const size_t& index) const noexcept {
+		return view_data[static_cast<std::ptrdiff_t>(index) * view_stride];
+	}
+
+	template <typename U>
+	double dot_product(const BasicVectorView<U>& vec) const {
+		if (vec.size() != length) {
+			throw std::invalid_argument("Vectors used for dot product are not the same size.");
+		}
+
+		if (is_contiguous() && vec.is_contiguous()) {
+			return simd_kernels().dot(vec.data(), view_data, length);
+		}
+
+		double sum = 0.0;
+		for (size_t i = 0; i < length; i++) {
+			sum += vec[i] * (*this)[i];
+		}
+		return sum;
+	}
+
+	double euclidean_length() const {
+		return std::sqrt(dot_product(*this));
+	}
+
+	// Whether reading this view while writing target could read an overwritten element, see VectorExpression.h.
+	bool aliases(const BasicVectorView<const double>& target) const noexcept {
+		return strided_alias(view_data, view_stride, 0, target.data(), target.stride(), 0, length, 1);
+	}
+
+	// Writes the elements of another view or expression through this view.
+	const BasicVectorView& operator=(const BasicVectorView& vec) const requires (!std::is_const_v<T>) {
+		return *this = static_cast<const VectorExpression<BasicVectorView>&>(vec);
+	}
+
+	template <typename E>
+	const BasicVectorView& operator=(const VectorExpression<E>& expression) const requires (!std::is_const_v<T>) {
+		const E& source = expression.self();
+		if (source.size() != length) {
+			throw std::invalid_argument("Vectors have invalid dimensions.");
+		}
+		if (source.aliases(*this)) {
+			const std::vector<double> values = evaluated_copy(source);
+			return *this = BasicVectorView<const double>(values.data(), length);
+		}
+
+		for (size_t i = 0; i < length; i++) {
+			(*this)[i] = source[i];
+		}
+		return *this;
+	}
+
+	template <typename E>
+	const BasicVectorView& operator+=(const VectorExpression<E>& expression) const requires (!std::is_const_v<T>) {
+		const E& source = expression.self();
+		if (source.size() != length) {
+			throw std::invalid_argument("Vectors have invalid dimensions.");
+		}
+		if (source.aliases(*this)) {
+			const std::vector<double> values = evaluated_copy(source);
+			return *this += BasicVectorView<const double>(values.data(), length);
+		}
+
+		for (size_t i = 0; i < length; i++) {
+			(*this)[i] += source[i];
+		}
+		return *this;
+	}
+
+	template <typename E>
+	const BasicVectorView& operator-=(const VectorExpression<E>& expression) const requires (!std::is_const_v<T>) {
+		const E& source = expression.self();
+		if (source.size() != length) {
+			throw std::invalid_argument("Vectors have invalid dimensions.");
+		}
+		if (source.aliases(*this)) {
+			const std::vector<double> values = evaluated_copy(source);
+			return *this -= BasicVectorView<const double>(values.data(), length);
+		}
+
+		for (size_t i = 0; i < length; i++) {
+			(*this)[i] -= source[i];
+		}
+		return *this;
+	}
+
+	const BasicVectorView& operator*=(const double& number) const noexcept requires (!std::is_const_v<T>) {
+		for (size_t i = 0; i < length; i++) {
+			(*this)[i] *= number;
+		}
+		return *this;
+	}
+
+	const BasicVectorView& operator/=(const double& number) const noexcept requires (!std::is_const_v<T>) {
+		return *this *= (1.0 / number);
+	}
+};
+
+using VectorView = BasicVectorView<double>;
+using ConstVectorView = BasicVectorView<const double>;